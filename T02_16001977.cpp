@@ -1,20 +1,56 @@
 #define GL_SILENCE_DEPRECATION
 #include <GLUT/glut.h>
+#ifdef __APPLE__
+#include <OpenGL/OpenGL.h>
+#elif defined(__linux__)
+#include <GL/glx.h>
+#endif
 #include <cmath>
 #include <cstdlib>
 #include <ctime>
 #include <vector>
 #include <string>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <cstdarg>
+#include <cassert>
+#include <new>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SW_SSE2
+#endif
 
 const int WINDOW_WIDTH = 1200;
 const int WINDOW_HEIGHT = 800;
-const float GRAVITY = -0.0008f;
-const float JUMP_VELOCITY = 0.7f;
-const float MOVE_SPEED = 0.15f;
+constexpr float GRAVITY = -0.0008f;
+constexpr float JUMP_VELOCITY = 0.7f;
+constexpr float MOVE_SPEED = 0.15f;
 const int INITIAL_LIVES = 3;
 const int COLLECTABLES_COUNT = 7;
-const float LAVA_INITIAL_SPEED = 0.02f;
-const float LAVA_SPEED_INCREMENT = 0.0004f;
+constexpr float LAVA_INITIAL_SPEED = 0.02f;
+constexpr float LAVA_SPEED_INCREMENT = 0.0004f;
+const int ROCK_WAVE_TICKS = 240;       // how long a wave keeps emitting
+const float ROCK_WAVE_LANE = 160;      // width of the gap a rain wave leaves
+const int POWERUP_PICKUP_TICKS = 300;  // how long one waits to be picked up
+const int LETS_GO_TICKS = 120;         // the start banner
 
 // Button positions
 const float startButtonX = WINDOW_WIDTH / 2 - 75;
@@ -33,7 +69,8 @@ float pauseButtonWidth = 100;
 float pauseButtonHeight = 35;
 
 enum GameState { MENU, PLAYING, WIN, LOSE };
-GameState gameState = MENU;
+
+typedef int32_t fixed;   // Q16.16, see "Fixed point"
 
 struct Player {
     float x, y;
@@ -43,14 +80,21 @@ struct Player {
     int lives;
     int score;
     bool hasKey;
-    int activePowerUp;
-    float powerUpTimer;
-} player;
+    int activePowerUp;   // index into POWERUP_EFFECTS, 0 for none
+    int powerUpEnds;     // gameTime it runs out
+    int standingOn;      // platform landed on this tick, or -1
+};
+
+enum PlatformKind { PLATFORM_STATIC, PLATFORM_SLIDING, PLATFORM_SWINGING, PLATFORM_CRUMBLING,
+                    PLATFORM_CONVEYOR, PLATFORM_KINDS };
 
 struct Platform {
     float x, y;
     float width, height;
     bool destroyed;
+    uint8_t kind;      // PlatformKind
+    bool crumbling;    // cracking up under the player; falls when its timer says so
+    float carry;       // px a player standing here moves this tick
 };
 
 struct Collectable {
@@ -63,8 +107,24 @@ struct Collectable {
 struct Rock {
     float x, y;
     float size;
-    float speed;
+    float speed;      // falling, pixels per tick
+    float drift;      // sideways, pixels per tick
     bool active;
+    uint8_t contact;  // ROCK_HIT_* bits found by the broadphase this tick
+};
+
+enum RockWavePattern { WAVE_RAIN, WAVE_FAN, WAVE_SWEEP, WAVE_PATTERNS };
+
+// A scripted burst of rocks; see startRockWave().
+struct RockWave {
+    int number;       // waves so far this level
+    int pattern;
+    int left;         // rocks still to emit
+    int ticksLeft;
+    int count;
+    float laneX;      // rain: centre of the gap; fan: origin; sweep: entry side
+    float laneDrift;
+    fixed fixedLaneX, fixedLaneDrift;   // fixed-point mode
 };
 
 struct PowerUp {
@@ -72,10 +132,25 @@ struct PowerUp {
     float size;
     int type;
     bool collected;
-    float timer;
     float rotation;
 };
 
+// What a power-up does while it lasts, by type; 0 is none.
+struct PowerUpEffect {
+    const char* name;
+    int ticks;         // how long it lasts
+    float reach;       // added to the player's radius against rocks
+    bool shield;       // rock hits cost no life
+    float lavaScale;   // on the lava's rise
+};
+
+const PowerUpEffect POWERUP_EFFECTS[] = {
+    {"none", 0, 0, false, 1.0f},
+    {"shield", 180, 10, true, 1.0f},
+    {"slow lava", 180, 0, false, 0.3f},
+};
+const int POWERUP_KINDS = 3;
+
 struct Key {
     float x, y;
     float size;
@@ -91,1129 +166,8153 @@ struct Door {
     float openAnimation;
 };
 
-std::vector<Platform> platforms;
-std::vector<Collectable> collectables;
-std::vector<Rock> rocks;
-std::vector<PowerUp> powerUps;
-Key key;
-Door door;
+struct TickInput {
+    bool left, right, jump;
+};
 
-float lavaHeight = 0.0f;
-float lavaSpeed = LAVA_INITIAL_SPEED;
+enum GameEventType {
+    EV_COIN_COLLECTED,
+    EV_ROCK_HIT,          // value: 1 if the shield took it
+    EV_KEY_COLLECTED,
+    EV_POWERUP_COLLECTED, // value: power-up type
+    EV_POWERUP_EXPIRED,
+    EV_LAVA_TOUCHED,
+    EV_DOOR_REACHED
+};
 
-int lastRockSpawn = 0;
-int gameTime = 0;
-int powerUpSpawnTime = 0;
-int letsGoTimer = 0;
+// Something the tick noticed, for the gameplay rules to act on.
+struct GameEvent {
+    GameEventType type;
+    float x, y;
+    int value;
+};
 
-bool keys[256];
+// Timed gameplay, fired by the timer wheel; see "Timer wheel".
+enum TimerKind {
+    TIMER_BANNER_END,     // the LET'S GO banner comes down
+    TIMER_SCRIPT,         // arg: hazard script thread to resume
+    TIMER_PICKUP_EXPIRE,  // arg: index into powerUps, gone if not picked up
+    TIMER_POWERUP_EXPIRE, // the player's power-up may have run out
+    TIMER_DOOR_SWING,     // one step of the door opening
+    TIMER_KINDS
+};
 
-void init() {
-   // glClearColor(0.53f, 0.81f, 0.92f, 1.0f);
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    gluOrtho2D(0, WINDOW_WIDTH, 0, WINDOW_HEIGHT);
-    
-    srand(time(0));
-    
-   player.x = WINDOW_WIDTH / 2;
-    // create starting platform and place the player on top of it
-    Platform startP;
-    startP.width = 200;
-   startP.height = 20;
-    startP.x = WINDOW_WIDTH / 2 - startP.width / 2;
-    startP.y = 50;                 // visual Y for the starter platform
-    startP.destroyed = false;
-    platforms.push_back(startP);   // make it a real platform for collisions/rendering
-    player.width = 30;
-    player.height = 40;
-    player.y = startP.y + startP.height;
-    player.height = 40;
-    player.velocityY = 0;
-    player.isJumping = false;
-    player.lives = INITIAL_LIVES;
-    player.score = 0;
-    player.hasKey = false;
-    player.activePowerUp = 0;
-    player.powerUpTimer = 0;
-    
-    float platformY = 100;
-    float platformWidths[] = {80, 120, 100, 90, 110, 85, 95, 105, 80, 90};
-    
-    for (int i = 0; i < 10; i++) {
-        Platform p;
-        p.width = platformWidths[i];
-        p.height = 20;
-        p.y = platformY;
-        p.x = rand() % (WINDOW_WIDTH - (int)p.width);
-        p.destroyed = false;
-        platforms.push_back(p);
-        platformY += 55;
-    }
-    
-    for (int i = 0; i < COLLECTABLES_COUNT; i++) {
-        Collectable c;
-        c.x = rand() % (WINDOW_WIDTH - 40) + 20;
-        c.y = 150 + i * 70;
-        c.size = 15;
-        c.collected = false;
-        c.rotation = 0;
-        collectables.push_back(c);
-    }
-    
-    key.spawned = false;
-    key.collected = false;
-    key.size = 20;
-    key.rotation = 0;
-    
-    door.x = WINDOW_WIDTH / 2 - 40;
-    door.y = platformY - 100;
-    door.width = 80;
-    door.height = 60;
-    door.unlocked = false;
-    door.openAnimation = 0;
-    
-    for (int i = 0; i < 256; i++) keys[i] = false;
-    letsGoTimer = 120;
+struct Timer {
+    int due;         // gameTime it fires
+    int arg;
+    uint16_t next;   // in its slot's list, or the free list
+    uint8_t kind;
+};
 
-}
+const int TIMER_WHEEL_BITS = 6;
+const int TIMER_WHEEL_SLOTS = 1 << TIMER_WHEEL_BITS;
+const int TIMER_WHEEL_LEVELS = 3;   // 2^18 ticks, over an hour
+const uint16_t TIMER_NONE = 0xffff;
 
-void drawText(float x, float y, const char* text) {
-    glRasterPos2f(x, y);
-    while (*text) {
-        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, *text);
-        text++;
-    }
-}
+struct TimerWheel {
+    int now;   // the last tick run
+    int pending;
+    uint16_t free;
+    uint16_t slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];   // list heads
+    std::vector<Timer> pool;   // reserved for MAX_TIMERS
+};
 
-void drawLargeText(float x, float y, const char* text) {
-    glRasterPos2f(x, y);
-    while (*text) {
-        glutBitmapCharacter(GLUT_BITMAP_TIMES_ROMAN_24, *text);
-        text++;
-    }
+const int SCRIPT_MAX_THREADS = 8;
+const int SCRIPT_MAX_VARS = 32;
+
+struct HazardScript;
+
+// A level's hazard script as it runs; see "Hazard scripts".
+struct ScriptState {
+    const HazardScript* program;
+    uint16_t pc[SCRIPT_MAX_THREADS];   // where each thread resumes
+    int32_t vars[SCRIPT_MAX_VARS];     // shared by the threads
+    int budget;     // ops left this tick
+    int ops;        // run this tick
+    int overruns;   // times a thread was put off to the next tick by the budget
+};
+
+struct World;
+
+// ---------------- Difficulty ----------------
+// Presets are types whose tuning values are constant expressions. The tick
+// (stepWorldT) is instantiated per preset, so each mode gets its own fully
+// constant-folded step; the instantiation is picked once when a level is
+// built. NormalPreset is the original tuning.
+
+struct EasyPreset {
+    static constexpr float gravity() { return -0.0007f; }
+    static constexpr float jumpVelocity() { return 0.7f; }
+    static constexpr float moveSpeed() { return 0.16f; }
+    static constexpr float lavaInitialSpeed() { return 0.015f; }
+    static constexpr float lavaSpeedIncrement() { return 0.00025f; }
+    static constexpr int waveRocks() { return 30; }   // first wave; each later one adds as many
+    static constexpr bool fixedPoint() { return false; }
+};
+
+struct NormalPreset {
+    static constexpr float gravity() { return GRAVITY; }
+    static constexpr float jumpVelocity() { return JUMP_VELOCITY; }
+    static constexpr float moveSpeed() { return MOVE_SPEED; }
+    static constexpr float lavaInitialSpeed() { return LAVA_INITIAL_SPEED; }
+    static constexpr float lavaSpeedIncrement() { return LAVA_SPEED_INCREMENT; }
+    static constexpr int waveRocks() { return 60; }   // first wave; each later one adds as many
+    static constexpr bool fixedPoint() { return false; }
+};
+
+struct HardPreset {
+    static constexpr float gravity() { return -0.0009f; }
+    static constexpr float jumpVelocity() { return 0.72f; }
+    static constexpr float moveSpeed() { return 0.15f; }
+    static constexpr float lavaInitialSpeed() { return 0.025f; }
+    static constexpr float lavaSpeedIncrement() { return 0.0006f; }
+    static constexpr int waveRocks() { return 120; }   // first wave; each later one adds as many
+    static constexpr bool fixedPoint() { return false; }
+};
+
+// A preset's tuning with the tick on fixed-point numbers (see "Fixed point").
+template <class P>
+struct FixedPointPreset : P {
+    static constexpr bool fixedPoint() { return true; }
+};
+
+template <class P> void stepWorldT(World& w, const TickInput& in);
+
+// Run-time view of a preset for code off the hot path (level generation,
+// menus, the planner).
+struct Difficulty {
+    const char* name;
+    void (*step)(World&, const TickInput&);
+    void (*fixedStep)(World&, const TickInput&);
+    float gravity;
+    float jumpVelocity;
+    float moveSpeed;
+    float lavaInitialSpeed;
+    float lavaSpeedIncrement;   // until the hazard script says otherwise
+    int waveRocks;
+};
+
+template <class P>
+Difficulty describePreset(const char* name) {
+    Difficulty d = {name, stepWorldT<P>, stepWorldT<FixedPointPreset<P> >, P::gravity(),
+                    P::jumpVelocity(), P::moveSpeed(), P::lavaInitialSpeed(),
+                    P::lavaSpeedIncrement(), P::waveRocks()};
+    return d;
 }
 
-void drawPlayer() {
-    float x = player.x;
-    float y = player.y;
-    float w = player.width;
-    float h = player.height;
+const Difficulty DIFFICULTIES[] = {
+    describePreset<EasyPreset>("EASY"),
+    describePreset<NormalPreset>("NORMAL"),
+    describePreset<HardPreset>("HARD")
+};
+const int DIFFICULTY_COUNT = 3;
+int selectedDifficulty = 1;
+int levelScreens = 1;   // --tall N builds levels N screens high
+bool fixedPointPhysics = false;   // --fixed: new levels use the fixed-point tick
 
-    // Power-up aura (glow)
-    if (player.activePowerUp == 1) {
-        glColor4f(0.2f, 0.6f, 1.0f, 0.4f); // soft blue aura with transparency
-        glBegin(GL_TRIANGLE_FAN);
-        glVertex2f(x, y + h / 2);
-        for (int i = 0; i <= 40; i++) {
-            float angle = i * 2.0f * 3.14159f / 40;
-            glVertex2f(x + cos(angle) * (w / 2 + 10), y + h / 2 + sin(angle) * (h / 2 + 10));
-        }
-        glEnd();
-    }
+// The fixed-point tick's copy of what moves; see "Fixed point".
+struct FixedBody {
+    fixed playerX, playerY, velocityY;
+    fixed lavaHeight, lavaSpeed, lavaIncrement;
+    fixed cameraY;
+};
 
-    // === BODY (Shirt) ===
-    glColor3f(0.2f, 0.4f, 0.9f); // bright blue shirt
-    glBegin(GL_QUADS);
-    glVertex2f(x - w / 2, y + h * 0.25f);
-    glVertex2f(x + w / 2, y + h * 0.25f);
-    glVertex2f(x + w / 2, y + h * 0.7f);
-    glVertex2f(x - w / 2, y + h * 0.7f);
-    glEnd();
+// The rocks' real state in fixed-point mode, index for index with
+// World::rocks and one array per field, like PlatformPaths. Empty in float mode.
+struct FixedRocks {
+    std::vector<fixed> x, y;
+    std::vector<fixed> speed, drift;
+};
 
-    // === LEGS ===
-    glColor3f(0.1f, 0.1f, 0.2f); // dark navy pants
-    float legWidth = w / 3.5f;
-    float legHeight = h * 0.25f;
+// Platforms that move along a path, one array per field so the per-tick pass
+// runs straight down them; see "Dynamic platforms".
+struct PlatformPaths {
+    std::vector<int> platform;      // index into World::platforms
+    std::vector<float> originX;     // middle of the path
+    std::vector<float> range;       // px either side of it
+    std::vector<int> period;        // ticks per round trip
+    std::vector<int> offset;        // ticks into the trip at gameTime 0
+    std::vector<float> invPeriod;
+    std::vector<uint32_t> phaseStep;    // fixed tick: share of a trip per tick, in 2^-32
+    std::vector<uint32_t> phaseStart;   // and at gameTime 0
+    std::vector<float> x;           // this tick's positions, before they are scattered
+};
 
-    // Left leg
-    glBegin(GL_QUADS);
-    glVertex2f(x - legWidth - 2, y);
-    glVertex2f(x - 2, y);
-    glVertex2f(x - 2, y + legHeight);
-    glVertex2f(x - legWidth - 2, y + legHeight);
-    glEnd();
+struct CrumblingPlatforms {
+    std::vector<int> platform;
+    std::vector<int> timer;         // 0 while whole
+};
 
-    // Right leg
-    glBegin(GL_QUADS);
-    glVertex2f(x + 2, y);
-    glVertex2f(x + legWidth + 2, y);
-    glVertex2f(x + legWidth + 2, y + legHeight);
-    glVertex2f(x + 2, y + legHeight);
-    glEnd();
+// Everything the simulation reads or writes lives in one World so it can be
+// copied: the autopilot plans on clones of the live world.
+struct World {
+    GameState state;
+    Player player;
+    std::vector<Platform> platforms;
+    std::vector<unsigned short> platformLinks;   // bit k: platforms[i - 1 - k] can jump here
+    PlatformPaths sliding;     // back and forth at a steady speed
+    PlatformPaths swinging;    // easing in and out at the ends
+    CrumblingPlatforms crumbling;
+    std::vector<Collectable> collectables;
+    std::vector<Rock> rocks;
+    std::vector<PowerUp> powerUps;
+    Key key;
+    Door door;
+    std::vector<GameEvent> events;   // this tick's, emptied by runGameRules()
+    int coinsCollected;
 
-    // === SHOES ===
-    glColor3f(0.2f, 0.05f, 0.05f); // brown shoes
-    float shoeHeight = 4.0f;
-    glBegin(GL_QUADS);
-    // left shoe
-    glVertex2f(x - legWidth - 2, y);
-    glVertex2f(x - 2, y);
-    glVertex2f(x - 2, y - shoeHeight);
-    glVertex2f(x - legWidth - 2, y - shoeHeight);
-    // right shoe
-    glVertex2f(x + 2, y);
-    glVertex2f(x + legWidth + 2, y);
-    glVertex2f(x + legWidth + 2, y - shoeHeight);
-    glVertex2f(x + 2, y - shoeHeight);
-    glEnd();
+    float lavaHeight;
+    float lavaSpeed;
+    float lavaIncrement;   // added to lavaSpeed each tick
+    int levelScreens;     // as asked for in resetWorld()
+    int levelPlatforms;   // platforms generated above the starting one
+    float levelHeight;    // top of the level; one screen unless built taller
+    float cameraY;        // world Y at the bottom of the screen, follows the player
 
-    // === HEAD ===
-    glColor3f(0.95f, 0.78f, 0.55f); // lighter, warmer skin tone
-    glBegin(GL_TRIANGLE_FAN);
-    glVertex2f(x, y + h * 0.88f);
-    for (int i = 0; i <= 20; i++) {
-        float angle = i * 2.0f * 3.14159f / 20;
-        glVertex2f(x + cos(angle) * w / 3, y + h * 0.88f + sin(angle) * w / 3);
-    }
-    glEnd();
+    RockWave wave;
+    int gameTime;
+    bool letsGo;   // the start banner is up
+    TimerWheel timers;
+    ScriptState script;
 
-    // === CAP ===
-    glColor3f(0.8f, 0.1f, 0.1f); // deep red
-    glBegin(GL_POLYGON);
-    glVertex2f(x - w / 2.5f, y + h * 0.97f);
-    glVertex2f(x + w / 2.5f, y + h * 0.97f);
-    glVertex2f(x + w / 2.2f, y + h * 1.05f);
-    glVertex2f(x - w / 2.2f, y + h * 1.05f);
-    glEnd();
+    int difficulty;  // index into DIFFICULTIES
+    void (*step)(World&, const TickInput&);   // the preset's instantiation of stepWorldT
+    bool fixedPoint;   // step is the fixed-point one; body holds the real positions
+    FixedBody body;
+    FixedRocks fixedRocks;
 
-    // Cap brim
-    glColor3f(0.6f, 0.05f, 0.05f);
-    glBegin(GL_QUADS);
-    glVertex2f(x - w / 2, y + h * 0.95f);
-    glVertex2f(x + w / 2, y + h * 0.95f);
-    glVertex2f(x + w / 2, y + h * 0.97f);
-    glVertex2f(x - w / 2, y + h * 0.97f);
-    glEnd();
+    unsigned seed;   // the level was built from this
+    unsigned rng;    // per-world random state, so clones replay the same spawns
+    int levelRepairs;   // placements the generator had to move to keep them reachable
+    int levelUnreachable;   // placements no repair could make reachable; 0 unless out of attempts
+    int levelAttempts;      // layouts built for this level, see buildLayout()
+    bool live;       // only the on-screen world reports telemetry
+};
 
-    // Cap button
-    glColor3f(0.95f, 0.95f, 0.95f);
-    glBegin(GL_TRIANGLE_FAN);
-    glVertex2f(x, y + h * 1.05f);
-    for (int i = 0; i <= 12; i++) {
-        float angle = i * 2.0f * 3.14159f / 12;
-        glVertex2f(x + cos(angle) * 3, y + h * 1.05f + sin(angle) * 3);
-    }
-    glEnd();
+World world;
 
-    // === EYES ===
-    glColor3f(0.1f, 0.1f, 0.1f);
-    glPointSize(4);
-    glBegin(GL_POINTS);
-    glVertex2f(x - w / 6, y + h * 0.88f);
-    glVertex2f(x + w / 6, y + h * 0.88f);
-    glEnd();
+// The rest of the game still talks to the live world through these names.
+GameState& gameState = world.state;
+Player& player = world.player;
+std::vector<Platform>& platforms = world.platforms;
+std::vector<Collectable>& collectables = world.collectables;
+std::vector<Rock>& rocks = world.rocks;
+std::vector<PowerUp>& powerUps = world.powerUps;
+Key& key = world.key;
+Door& door = world.door;
 
-    // === ARMS ===
-    glLineWidth(3);
-    glColor3f(0.95f, 0.78f, 0.55f);
-    glBegin(GL_LINES);
-    glVertex2f(x - w / 2, y + h * 0.55f);
-    glVertex2f(x - w / 2 - 8, y + h * 0.35f);
-    glVertex2f(x + w / 2, y + h * 0.55f);
-    glVertex2f(x + w / 2 + 8, y + h * 0.35f);
-    glEnd();
+float& lavaHeight = world.lavaHeight;
+float& lavaSpeed = world.lavaSpeed;
+
+int& gameTime = world.gameTime;
+bool& letsGo = world.letsGo;
+
+// xorshift32, returns a non-negative int like rand()
+int worldRand(World& w) {
+    unsigned x = w.rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    w.rng = x;
+    return (int)(x & 0x7fffffff);
 }
 
-void drawPlatforms() {
-    for (auto& p : platforms) {
-        if (p.destroyed) continue;
+bool keys[256];
 
-        float x = p.x;
-        float y = p.y;
-        float w = p.width;
-        float h = p.height;
+// ---------------- Memory ----------------
+// Steady-state ticks and frames must not touch the heap: entity storage is
+// reserved when a level is built and dead rocks are dropped in place, and anything a
+// frame needs only until it is on screen comes from frameArena, which is
+// rewound at the start of every display(). Debug builds count the game
+// thread's operator new calls so this can be checked (see --alloccheck).
 
-        // Rock base color (gray)
-        glColor3f(0.4f, 0.4f, 0.42f);
-        
-        // Main rock body (irregular polygon to look like a rock)
-        glBegin(GL_POLYGON);
-        glVertex2f(x + w * 0.1f, y);
-        glVertex2f(x + w * 0.9f, y);
-        glVertex2f(x + w, y + h * 0.3f);
-        glVertex2f(x + w * 0.95f, y + h * 0.7f);
-        glVertex2f(x + w * 0.7f, y + h);
-        glVertex2f(x + w * 0.3f, y + h);
-        glVertex2f(x + w * 0.05f, y + h * 0.7f);
-        glVertex2f(x, y + h * 0.3f);
-        glEnd();
-        
-        // Rock highlights (lighter gray triangles for texture)
-        glColor3f(0.55f, 0.55f, 0.58f);
-        glBegin(GL_TRIANGLES);
-        // Top left highlight
-        glVertex2f(x + w * 0.2f, y + h * 0.6f);
-        glVertex2f(x + w * 0.35f, y + h * 0.8f);
-        glVertex2f(x + w * 0.15f, y + h * 0.9f);
-        
-        // Top right highlight
-        glVertex2f(x + w * 0.7f, y + h * 0.7f);
-        glVertex2f(x + w * 0.85f, y + h * 0.6f);
-        glVertex2f(x + w * 0.8f, y + h * 0.9f);
-        glEnd();
-        
-        // Rock cracks/lines (dark lines for detail)
-        glColor3f(0.25f, 0.25f, 0.27f);
-        glLineWidth(2);
-        glBegin(GL_LINES);
-        // Crack 1
-        glVertex2f(x + w * 0.3f, y + h * 0.2f);
-        glVertex2f(x + w * 0.4f, y + h * 0.8f);
-        // Crack 2
-        glVertex2f(x + w * 0.6f, y + h * 0.1f);
-        glVertex2f(x + w * 0.7f, y + h * 0.7f);
-        glEnd();
-        
-        // Rock outline for definition
-        glColor3f(0.2f, 0.2f, 0.22f);
-        glLineWidth(2);
-        glBegin(GL_LINE_LOOP);
-        glVertex2f(x + w * 0.1f, y);
-        glVertex2f(x + w * 0.9f, y);
-        glVertex2f(x + w, y + h * 0.3f);
-        glVertex2f(x + w * 0.95f, y + h * 0.7f);
-        glVertex2f(x + w * 0.7f, y + h);
-        glVertex2f(x + w * 0.3f, y + h);
-        glVertex2f(x + w * 0.05f, y + h * 0.7f);
-        glVertex2f(x, y + h * 0.3f);
-        glEnd();
-    }
+#ifndef NDEBUG
+thread_local long allocationCount = 0;
+
+void* operator new(size_t size) {
+    allocationCount++;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
 }
 
-void drawCollectables() {
-    for (auto& c : collectables) {
-        if (c.collected) continue;
-        
-        glPushMatrix();
-        glTranslatef(c.x, c.y, 0);
-        glRotatef(c.rotation, 0, 0, 1);
-        
-        glColor3f(1.0f, 0.85f, 0.2f);
-        glBegin(GL_TRIANGLE_FAN);
-        glVertex2f(0, 0);
-        for (int i = 0; i <= 20; i++) {
-            float angle = i * 2.0f * 3.14159f / 20;
-            glVertex2f(cos(angle) * c.size, sin(angle) * c.size);
-        }
-        glEnd();
-        
-        glColor3f(0.9f, 0.7f, 0.1f);
-        glBegin(GL_TRIANGLE_FAN);
-        glVertex2f(0, 0);
-        for (int i = 0; i <= 20; i++) {
-            float angle = i * 2.0f * 3.14159f / 20;
-            glVertex2f(cos(angle) * c.size * 0.6f, sin(angle) * c.size * 0.6f);
-        }
-        glEnd();
-        
-        glColor3f(1.0f, 0.95f, 0.5f);
-        glBegin(GL_TRIANGLES);
-        for (int i = 0; i < 4; i++) {
-            float angle = i * 3.14159f / 2;
-            glVertex2f(0, 0);
-            glVertex2f(cos(angle) * c.size * 0.4f, sin(angle) * c.size * 0.4f);
-            glVertex2f(cos(angle + 3.14159f/2) * c.size * 0.4f, sin(angle + 3.14159f/2) * c.size * 0.4f);
-        }
-        glEnd();
-        
-        glPopMatrix();
-    }
+void operator delete(void* p) noexcept {
+    free(p);
 }
 
-void drawRocks() {
-    for (auto& r : rocks) {
-        if (!r.active) continue;
+long drawnFrames = 0;
+long allocatingFrames = 0;   // frames whose ticks or drawing called operator new
 
-        int layers = 6; // number of gradient layers
-        float maxSize = r.size;
+void printAllocationStats() {
+    if (drawnFrames == 0) return;
+    fprintf(stderr, "allocations: %ld of %ld frames allocated\n", allocatingFrames, drawnFrames);
+}
+#endif
 
-        // Draw layered glow (outer dark -> inner bright)
-        for (int l = 0; l < layers; l++) {
-            float t = (float)l / (layers - 1);
-            float radius = maxSize * (1.0f - 0.12f * l);
+const int MAX_ROCKS = 2048;         // reserved; no more spawn past this many
+const int MAX_POWERUPS = 2;
+const int MAX_TIMERS = 4096;        // pending at once
+const int MAX_TICK_EVENTS = 64;     // besides one per rock
+const size_t FRAME_ARENA_SIZE = 16 * 1024;
 
-            // Color gradient: from dark gray to fiery orange
-            float rColor = 0.2f + 0.8f * (1 - t);
-            float gColor = 0.1f + 0.4f * (1 - t);
-            float bColor = 0.05f + 0.1f * (1 - t);
+alignas(16) char frameArena[FRAME_ARENA_SIZE];
+size_t frameArenaUsed = 0;
 
-            glColor3f(rColor, gColor, bColor);
+void frameArenaReset() {
+    frameArenaUsed = 0;
+}
 
-            glBegin(GL_POLYGON);
-            for (int i = 0; i < 12; i++) {
-                float angle = i * 2.0f * 3.14159f / 12.0f;
-                float randOffset = (rand() % 10 - 5) * 0.01f * radius; // jagged edges
-                float x = r.x + cos(angle) * (radius + randOffset);
-                float y = r.y + sin(angle) * (radius + randOffset);
-                glVertex2f(x, y);
-            }
-            glEnd();
-        }
+// Returns NULL when the frame has used up the arena.
+void* frameAlloc(size_t size) {
+    size = (size + 15) & ~(size_t)15;
+    if (frameArenaUsed + size > FRAME_ARENA_SIZE) return NULL;
+    void* p = frameArena + frameArenaUsed;
+    frameArenaUsed += size;
+    return p;
+}
 
-        // Add fiery cracks (random thin triangles)
-        glColor3f(1.0f, 0.6f, 0.0f); // bright orange
-        for (int i = 0; i < 3; i++) {
-            float angle = (rand() % 360) * 3.14159f / 180.0f;
-            float innerR = r.size * 0.2f;
-            float outerR = r.size * (0.5f + (rand() % 50) / 100.0f);
+// printf into the frame arena; the text is valid until the next frame.
+const char* frameFormat(const char* format, ...) {
+    char* out = frameArena + frameArenaUsed;
+    size_t room = FRAME_ARENA_SIZE - frameArenaUsed;
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(out, room, format, args);
+    va_end(args);
+    if (len < 0 || (size_t)len >= room) return "";
+    frameAlloc(len + 1);
+    return out;
+}
 
-            glBegin(GL_TRIANGLES);
-                glVertex2f(r.x, r.y);
-                glVertex2f(r.x + cos(angle) * innerR, r.y + sin(angle) * innerR);
-                glVertex2f(r.x + cos(angle) * outerR, r.y + sin(angle) * outerR);
-            glEnd();
-        }
+// ---------------- Telemetry ----------------
+// Gameplay events are pushed from update() into a single-producer /
+// single-consumer ring and written out as JSON lines by a background thread,
+// so the game loop never touches the file system.
 
-        // Subtle glowing halo (transparency)
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-        glColor4f(1.0f, 0.4f, 0.1f, 0.15f); // soft orange glow
-        glBegin(GL_POLYGON);
-        for (int i = 0; i < 20; i++) {
-            float angle = i * 2.0f * 3.14159f / 20.0f;
-            glVertex2f(r.x + cos(angle) * (r.size * 1.3f),
-                       r.y + sin(angle) * (r.size * 1.3f));
+enum TelemetryType {
+    TEL_SESSION_START,
+    TEL_LIFE_LOST,
+    TEL_DEATH_ROCK,
+    TEL_DEATH_LAVA,
+    TEL_FIVE_COINS,
+    TEL_KEY_SPAWN,
+    TEL_POWERUP_PICKUP,
+    TEL_WIN
+};
+
+struct TelemetryEvent {
+    uint8_t type;
+    int session;
+    int tick;
+    float x, y;
+    int value;
+};
+
+const uint32_t TELEMETRY_CAPACITY = 4096;   // must be a power of two
+const int TELEMETRY_FLUSH_MS = 250;
+
+TelemetryEvent telemetrySlots[TELEMETRY_CAPACITY];
+alignas(64) std::atomic<uint32_t> telemetryHead(0);   // written by the game thread only
+alignas(64) std::atomic<uint32_t> telemetryTail(0);   // written by the writer thread only
+alignas(64) uint32_t telemetryTailCache = 0;           // game thread's last view of the tail
+uint32_t telemetryDropped = 0;
+int telemetrySession = 0;
+
+std::thread telemetryThread;
+std::mutex telemetryMutex;
+std::condition_variable telemetryWake;
+bool telemetryStopping = false;
+FILE* telemetryFile = NULL;
+
+// Game thread: a couple of plain stores and one release store. When the ring
+// is full the event is dropped and counted rather than blocking the frame.
+inline void telemetryPush(TelemetryType type, float x = 0, float y = 0, int value = 0) {
+    uint32_t head = telemetryHead.load(std::memory_order_relaxed);
+    if (head - telemetryTailCache >= TELEMETRY_CAPACITY) {
+        telemetryTailCache = telemetryTail.load(std::memory_order_acquire);
+        if (head - telemetryTailCache >= TELEMETRY_CAPACITY) {
+            telemetryDropped++;
+            return;
         }
-        glEnd();
-        glDisable(GL_BLEND);
     }
+    TelemetryEvent& e = telemetrySlots[head & (TELEMETRY_CAPACITY - 1)];
+    e.type = (uint8_t)type;
+    e.session = telemetrySession;
+    e.tick = gameTime;
+    e.x = x;
+    e.y = y;
+    e.value = value;
+    telemetryHead.store(head + 1, std::memory_order_release);
 }
 
+const char* telemetryName(uint8_t type) {
+    switch (type) {
+        case TEL_SESSION_START:  return "session_start";
+        case TEL_LIFE_LOST:      return "life_lost";
+        case TEL_DEATH_ROCK:     return "death_rock";
+        case TEL_DEATH_LAVA:     return "death_lava";
+        case TEL_FIVE_COINS:     return "five_coins";
+        case TEL_KEY_SPAWN:      return "key_spawn";
+        case TEL_POWERUP_PICKUP: return "powerup_pickup";
+        case TEL_WIN:            return "win";
+    }
+    return "unknown";
+}
 
-void drawLava() {
-    glColor3f(1.0f, 0.4f, 0.0f); 
-    glBegin(GL_QUADS);
-    glVertex2f(0, 0);
-    glVertex2f(WINDOW_WIDTH, 0);
-    glVertex2f(WINDOW_WIDTH, lavaHeight);
-    glVertex2f(0, lavaHeight);
-    glEnd();
-    
-    glColor3f(1.0f, 0.4f, 0.0f); 
-    glBegin(GL_TRIANGLES);
-    for (int i = 0; i < WINDOW_WIDTH; i += 40) {
-        float wave = sin((i + gameTime * 0.1f) * 0.1f) * 10;
-        glVertex2f(i, lavaHeight);
-        glVertex2f(i + 20, lavaHeight + 15 + wave);
-        glVertex2f(i + 40, lavaHeight);
+// Writer thread: drains everything available, formats it into one buffer and
+// hands it to the file in a single fwrite per batch.
+void telemetryDrain() {
+    static char batch[TELEMETRY_CAPACITY * 192];
+    uint32_t tail = telemetryTail.load(std::memory_order_relaxed);
+    uint32_t head = telemetryHead.load(std::memory_order_acquire);
+    size_t len = 0;
+    while (tail != head) {
+        const TelemetryEvent& e = telemetrySlots[tail & (TELEMETRY_CAPACITY - 1)];
+        len += snprintf(batch + len, sizeof(batch) - len,
+                        "{\"session\":%d,\"event\":\"%s\",\"tick\":%d,\"ms\":%d,"
+                        "\"x\":%.1f,\"y\":%.1f,\"value\":%d}\n",
+                        e.session, telemetryName(e.type), e.tick, e.tick * 16,
+                        e.x, e.y, e.value);
+        tail++;
+    }
+    telemetryTail.store(tail, std::memory_order_release);
+    if (len > 0 && telemetryFile) {
+        fwrite(batch, 1, len, telemetryFile);
+        fflush(telemetryFile);
     }
-    glEnd();
 }
 
-void drawKey() {
-    if (!key.spawned || key.collected) return;
-    
-    glPushMatrix();
-    glTranslatef(key.x, key.y, 0);
-    glRotatef(key.rotation, 0, 0, 1);
-    
-    glColor3f(1.0f, 0.85f, 0.2f);
-    glBegin(GL_TRIANGLE_FAN);
-    glVertex2f(0, 0);
-    for (int i = 0; i <= 20; i++) {
-        float angle = i * 2.0f * 3.14159f / 20;
-        glVertex2f(cos(angle) * key.size * 0.6f, sin(angle) * key.size * 0.6f);
+void telemetryWriter() {
+    std::unique_lock<std::mutex> lock(telemetryMutex);
+    while (!telemetryStopping) {
+        telemetryWake.wait_for(lock, std::chrono::milliseconds(TELEMETRY_FLUSH_MS));
+        telemetryDrain();
     }
-    glEnd();
-    
-    glColor3f(0.4f, 0.25f, 0.05f);
-    glBegin(GL_TRIANGLE_FAN);
-    glVertex2f(0, 0);
-    for (int i = 0; i <= 20; i++) {
-        float angle = i * 2.0f * 3.14159f / 20;
-        glVertex2f(cos(angle) * key.size * 0.2f, sin(angle) * key.size * 0.2f);
+    telemetryDrain();
+}
+
+void telemetryStop() {
+    {
+        std::lock_guard<std::mutex> lock(telemetryMutex);
+        telemetryStopping = true;
+    }
+    telemetryWake.notify_one();
+    if (telemetryThread.joinable()) telemetryThread.join();
+    if (telemetryFile) {
+        if (telemetryDropped > 0)
+            fprintf(telemetryFile, "{\"event\":\"dropped\",\"value\":%u}\n", telemetryDropped);
+        fclose(telemetryFile);
+        telemetryFile = NULL;
     }
-    glEnd();
-    
-    glColor3f(1.0f, 0.85f, 0.2f);
-    glBegin(GL_QUADS);
-    glVertex2f(key.size * 0.3f, -key.size * 0.2f);
-    glVertex2f(key.size * 1.5f, -key.size * 0.2f);
-    glVertex2f(key.size * 1.5f, key.size * 0.2f);
-    glVertex2f(key.size * 0.3f, key.size * 0.2f);
-    glEnd();
-    
-    glBegin(GL_TRIANGLES);
-    glVertex2f(key.size * 1.2f, -key.size * 0.2f);
-    glVertex2f(key.size * 1.3f, -key.size * 0.2f);
-    glVertex2f(key.size * 1.25f, -key.size * 0.5f);
-    
-    glVertex2f(key.size * 1.4f, -key.size * 0.2f);
-    glVertex2f(key.size * 1.5f, -key.size * 0.2f);
-    glVertex2f(key.size * 1.45f, -key.size * 0.4f);
-    glEnd();
-    
-    glPopMatrix();
 }
 
-void drawPowerUps() {
-    for (auto& pu : powerUps) {
-        if (pu.collected) continue;
-        
-        glPushMatrix();
-        glTranslatef(pu.x, pu.y, 0);
-        
-        if (pu.type == 1) {
-            glRotatef(pu.rotation, 0, 0, 1);
-            glColor3f(0.2f, 0.55f, 0.95f);
-            
-            glBegin(GL_TRIANGLE_FAN);
-            glVertex2f(0, 0);
-            for (int i = 0; i <= 20; i++) {
-                float angle = i * 2.0f * 3.14159f / 20;
-                glVertex2f(cos(angle) * pu.size, sin(angle) * pu.size);
-            }
-            glEnd();
-            
-            glColor3f(0.4f, 0.7f, 1.0f);
-            glBegin(GL_POLYGON);
-            glVertex2f(0, pu.size * 0.7f);
-            glVertex2f(-pu.size * 0.5f, pu.size * 0.3f);
-            glVertex2f(-pu.size * 0.5f, -pu.size * 0.5f);
-            glVertex2f(0, -pu.size * 0.7f);
-            glVertex2f(pu.size * 0.5f, -pu.size * 0.5f);
-            glVertex2f(pu.size * 0.5f, pu.size * 0.3f);
-            glEnd();
-            
-            glColor3f(1.0f, 1.0f, 1.0f);
-            glBegin(GL_QUADS);
-            glVertex2f(-pu.size * 0.1f, -pu.size * 0.4f);
-            glVertex2f(pu.size * 0.1f, -pu.size * 0.4f);
-            glVertex2f(pu.size * 0.1f, pu.size * 0.4f);
-            glVertex2f(-pu.size * 0.1f, pu.size * 0.4f);
-            
-            glVertex2f(-pu.size * 0.4f, -pu.size * 0.1f);
-            glVertex2f(pu.size * 0.4f, -pu.size * 0.1f);
-            glVertex2f(pu.size * 0.4f, pu.size * 0.1f);
-            glVertex2f(-pu.size * 0.4f, pu.size * 0.1f);
-            glEnd();
-            
-        } else {
-            float scale = 1.0f + sin(pu.rotation * 0.05f) * 0.2f;
-            glScalef(scale, scale, 1.0f);
-            
-            glColor3f(0.1f, 0.75f, 0.95f);
-            
-            glBegin(GL_TRIANGLE_FAN);
-            glVertex2f(0, 0);
-            for (int i = 0; i <= 20; i++) {
-                float angle = i * 2.0f * 3.14159f / 20;
-                glVertex2f(cos(angle) * pu.size * 0.3f, sin(angle) * pu.size * 0.3f);
+void telemetryStart() {
+    char name[64];
+    snprintf(name, sizeof(name), "telemetry-%ld.jsonl", (long)time(0));
+    telemetryFile = fopen(name, "w");
+    if (!telemetryFile) return;
+    telemetryThread = std::thread(telemetryWriter);
+    atexit(telemetryStop);
+}
+
+// ---------------- Leaderboard ----------------
+// Finished games are appended to leaderboard.log, a memory-mapped array of
+// fixed-size records that is never rewritten. Rank and top-N queries use
+// leaderboard.idx, which is memory-mapped too. It holds a Fenwick tree of
+// entry counts per score, ordered best first, and for each score a chain of
+// record numbers, newest first. Both queries cost O(log scores) steps plus
+// the entries returned. The index stores how many log records it covers,
+// so opening replays only records appended since, e.g. after a crash
+// between the two writes. A crash during an index update forces a rebuild.
+
+const uint32_t LEADERBOARD_MAGIC = 0x3142444c;   // "LDB1"
+const int LEADERBOARD_SCORES = 1 << 16;          // scores are clamped into [0, 65535] for ranking
+const uint64_t LEADERBOARD_MIN_CAPACITY = 1024;
+
+const int32_t RESULT_WON = 1;
+const int32_t RESULT_AUTOPILOT = 2;
+
+struct LeaderboardRecord {
+    int32_t score;
+    int32_t ticks;      // game time at the end
+    uint32_t seed;      // level seed, so the run can be regenerated
+    int32_t coins;
+    int32_t flags;      // RESULT_*
+    int32_t reserved;
+    int64_t time;       // wall clock at the end, seconds
+};
+
+struct LeaderboardLogHeader {
+    uint32_t magic;
+    uint32_t recordSize;
+    uint64_t count;     // records appended so far
+};
+
+// Followed by uint32 tree[SCORES + 1], head[SCORES] and next[capacity].
+// head and next hold record number + 1, 0 ending a chain.
+struct LeaderboardIndexHeader {
+    uint32_t magic;
+    uint32_t scores;
+    uint64_t covered;   // log records reflected in the index
+    uint64_t capacity;  // length of next[]
+    uint32_t updating;  // set while a record is being indexed
+    uint32_t reserved;
+};
+
+struct MappedFile {
+    int fd;
+    uint8_t* data;
+    size_t size;
+};
+
+bool mapFile(MappedFile& m, const char* path) {
+    m.fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (m.fd < 0) return false;
+    struct stat st;
+    if (fstat(m.fd, &st) != 0) return false;
+    m.size = st.st_size;
+    m.data = NULL;
+    if (m.size == 0) return true;
+    void* p = mmap(NULL, m.size, PROT_READ | PROT_WRITE, MAP_SHARED, m.fd, 0);
+    if (p == MAP_FAILED) return false;
+    m.data = (uint8_t*)p;
+    return true;
+}
+
+// Grows the file (new bytes read as zero) and remaps it.
+bool growMapping(MappedFile& m, size_t size) {
+    if (size <= m.size) return true;
+    if (ftruncate(m.fd, size) != 0) return false;
+    if (m.data) munmap(m.data, m.size);
+    void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, m.fd, 0);
+    if (p == MAP_FAILED) {
+        m.data = NULL;
+        m.size = 0;
+        return false;
+    }
+    m.data = (uint8_t*)p;
+    m.size = size;
+    return true;
+}
+
+void unmapFile(MappedFile& m) {
+    if (m.data) munmap(m.data, m.size);
+    if (m.fd >= 0) close(m.fd);
+    m.data = NULL;
+    m.fd = -1;
+}
+
+struct Leaderboard {
+    MappedFile log;
+    MappedFile index;
+    bool open;
+};
+
+Leaderboard leaderboard;
+uint64_t lastResultRank = 0;   // rank of the game just finished, 0 if not recorded
+
+LeaderboardLogHeader& logHeader(const Leaderboard& lb) {
+    return *(LeaderboardLogHeader*)lb.log.data;
+}
+
+LeaderboardRecord* logRecords(const Leaderboard& lb) {
+    return (LeaderboardRecord*)(lb.log.data + sizeof(LeaderboardLogHeader));
+}
+
+LeaderboardIndexHeader& indexHeader(const Leaderboard& lb) {
+    return *(LeaderboardIndexHeader*)lb.index.data;
+}
+
+uint32_t* indexTree(const Leaderboard& lb) {
+    return (uint32_t*)(lb.index.data + sizeof(LeaderboardIndexHeader));
+}
+
+uint32_t* indexHeads(const Leaderboard& lb) {
+    return indexTree(lb) + LEADERBOARD_SCORES + 1;
+}
+
+uint32_t* indexNext(const Leaderboard& lb) {
+    return indexHeads(lb) + LEADERBOARD_SCORES;
+}
+
+size_t indexBytes(uint64_t capacity) {
+    return sizeof(LeaderboardIndexHeader) + (2 * LEADERBOARD_SCORES + 1 + capacity) * sizeof(uint32_t);
+}
+
+int clampScore(int score) {
+    return score < 0 ? 0 : score >= LEADERBOARD_SCORES ? LEADERBOARD_SCORES - 1 : score;
+}
+
+// Fenwick position of a score: 1 is the best possible score.
+int scorePosition(int score) {
+    return LEADERBOARD_SCORES - clampScore(score);
+}
+
+// Entries in positions 1..pos, i.e. scoring at least LEADERBOARD_SCORES - pos.
+uint64_t fenwickPrefix(const uint32_t* tree, int pos) {
+    uint64_t sum = 0;
+    for (; pos > 0; pos -= pos & -pos) sum += tree[pos];
+    return sum;
+}
+
+// Smallest position whose prefix reaches k (k >= 1 and at most the total).
+int fenwickFind(const uint32_t* tree, uint64_t k) {
+    int pos = 0;
+    for (int step = LEADERBOARD_SCORES; step > 0; step >>= 1) {
+        if (pos + step <= LEADERBOARD_SCORES && tree[pos + step] < k) {
+            pos += step;
+            k -= tree[pos];
+        }
+    }
+    return pos + 1;
+}
+
+// Adds log record i to the index.
+bool indexRecord(Leaderboard& lb, uint64_t i) {
+    if (i >= indexHeader(lb).capacity) {
+        uint64_t capacity = std::max(indexHeader(lb).capacity * 2, LEADERBOARD_MIN_CAPACITY);
+        if (!growMapping(lb.index, indexBytes(capacity))) return false;
+        indexHeader(lb).capacity = capacity;
+    }
+    int score = clampScore(logRecords(lb)[i].score);
+    indexHeader(lb).updating = 1;
+    uint32_t* tree = indexTree(lb);
+    for (int pos = scorePosition(score); pos <= LEADERBOARD_SCORES; pos += pos & -pos) tree[pos]++;
+    indexNext(lb)[i] = indexHeads(lb)[score];
+    indexHeads(lb)[score] = (uint32_t)(i + 1);
+    indexHeader(lb).covered = i + 1;
+    indexHeader(lb).updating = 0;
+    return true;
+}
+
+// Opens or creates base.log and base.idx.
+bool leaderboardOpen(Leaderboard& lb, const char* base) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s.log", base);
+    if (!mapFile(lb.log, path)) return false;
+    snprintf(path, sizeof(path), "%s.idx", base);
+    if (!mapFile(lb.index, path)) return false;
+
+    if (lb.log.size < sizeof(LeaderboardLogHeader) || logHeader(lb).magic != LEADERBOARD_MAGIC) {
+        if (!growMapping(lb.log, sizeof(LeaderboardLogHeader) +
+                         LEADERBOARD_MIN_CAPACITY * sizeof(LeaderboardRecord))) return false;
+        logHeader(lb).magic = LEADERBOARD_MAGIC;
+        logHeader(lb).recordSize = sizeof(LeaderboardRecord);
+        logHeader(lb).count = 0;
+    }
+    if (logHeader(lb).recordSize != sizeof(LeaderboardRecord)) return false;
+    size_t stored = (lb.log.size - sizeof(LeaderboardLogHeader)) / sizeof(LeaderboardRecord);
+    if (logHeader(lb).count > stored) logHeader(lb).count = stored;
+
+    // A missing, foreign or half-updated index is rebuilt from the whole
+    // log; a valid one only needs the records it has not seen yet.
+    if (lb.index.size < indexBytes(0) || indexHeader(lb).magic != LEADERBOARD_MAGIC ||
+        indexHeader(lb).updating ||
+        indexHeader(lb).scores != (uint32_t)LEADERBOARD_SCORES ||
+        lb.index.size < indexBytes(indexHeader(lb).capacity) ||
+        indexHeader(lb).covered > logHeader(lb).count) {
+        if (lb.index.data) memset(lb.index.data, 0, lb.index.size);
+        if (!growMapping(lb.index, indexBytes(LEADERBOARD_MIN_CAPACITY))) return false;
+        indexHeader(lb).magic = LEADERBOARD_MAGIC;
+        indexHeader(lb).scores = LEADERBOARD_SCORES;
+        indexHeader(lb).covered = 0;
+        indexHeader(lb).capacity = (lb.index.size - indexBytes(0)) / sizeof(uint32_t);
+    }
+    for (uint64_t i = indexHeader(lb).covered; i < logHeader(lb).count; i++) {
+        if (!indexRecord(lb, i)) return false;
+    }
+    lb.open = true;
+    return true;
+}
+
+void leaderboardClose(Leaderboard& lb) {
+    unmapFile(lb.log);
+    unmapFile(lb.index);
+    lb.open = false;
+}
+
+uint64_t leaderboardSize(const Leaderboard& lb) {
+    return lb.open ? logHeader(lb).count : 0;
+}
+
+// The record is written before the count that publishes it, and the index
+// after both, so a crash at any point leaves files that open cleanly.
+bool leaderboardAdd(Leaderboard& lb, const LeaderboardRecord& r) {
+    if (!lb.open) return false;
+    uint64_t i = logHeader(lb).count;
+    size_t need = sizeof(LeaderboardLogHeader) + (i + 1) * sizeof(LeaderboardRecord);
+    if (need > lb.log.size && !growMapping(lb.log, 2 * lb.log.size)) return false;
+    logRecords(lb)[i] = r;
+    logHeader(lb).count = i + 1;
+    return indexRecord(lb, i);
+}
+
+// 1 + the number of entries with a strictly higher score.
+uint64_t leaderboardRank(const Leaderboard& lb, int score) {
+    if (!lb.open) return 0;
+    return 1 + fenwickPrefix(indexTree(lb), scorePosition(score) - 1);
+}
+
+// Best n entries, highest score first and newest first among equal scores.
+int leaderboardTop(const Leaderboard& lb, int n, LeaderboardRecord* out) {
+    if (!lb.open) return 0;
+    const uint32_t* tree = indexTree(lb);
+    uint64_t total = fenwickPrefix(tree, LEADERBOARD_SCORES);
+    int found = 0;
+    uint64_t k = 1;
+    while (found < n && k <= total) {
+        int pos = fenwickFind(tree, k);
+        for (uint32_t r = indexHeads(lb)[LEADERBOARD_SCORES - pos]; r && found < n; r = indexNext(lb)[r - 1]) {
+            out[found++] = logRecords(lb)[r - 1];
+        }
+        k = fenwickPrefix(tree, pos) + 1;
+    }
+    return found;
+}
+
+LeaderboardRecord resultOf(const World& w, int32_t flags) {
+    LeaderboardRecord r;
+    memset(&r, 0, sizeof(r));
+    r.score = w.player.score;
+    r.ticks = w.gameTime;
+    r.seed = w.seed;
+    for (const Collectable& c : w.collectables) r.coins += c.collected;
+    r.flags = flags | (w.state == WIN ? RESULT_WON : 0);
+    r.time = (int64_t)time(0);
+    return r;
+}
+
+// ---------------- Fixed point ----------------
+// With --fixed, new levels run a tick that keeps everything that moves (the
+// player, lava, camera, rocks and the wave lane) as Q16.16 integers, in
+// World::body and the fixed* fields of Rock and RockWave. Their motion and every
+// collision test is integer maths, with sine and cosine as short Taylor
+// series. A run therefore plays out bit for bit the same whatever the
+// compiler, flags, FMA contraction or libm. After each step the floats are
+// rewritten from the integers for drawing and the rest of the game. Things
+// that stand still keep float positions, which the fixed tick reads back by
+// an exact scaling. For that, the level builder works in whole pixels in
+// this mode, against the fixed-point jump arc (see "Level generation"), so
+// the level is bit for bit the same too. Q16.16 spans +-32767 px, so
+// fixed-point levels are at most FIXED_MAX_SCREENS high.
+// The fixed tick buys determinism, not speed: a whole tick measures about a
+// fifth slower than float. The rocks' integers sit in parallel arrays so
+// their move is a plain vector loop; --fixedbench times it on its own.
+
+const int FIXED_SHIFT = 16;
+const fixed FIXED_ONE = 1 << FIXED_SHIFT;
+const int FIXED_MAX_SCREENS = 40;
+
+// Nearest 1/65536. The scaling is by a power of two, so the result depends
+// only on v, never on how the compiler arranged the maths.
+constexpr fixed toFixed(double v) {
+    return (fixed)(v * FIXED_ONE + (v < 0 ? -0.5 : 0.5));
+}
+
+// For values known to be whole pixels, like platform edges: one conversion
+// and a multiply rather than toFixed()'s rounding.
+inline fixed pixelsToFixed(float v) {
+    return (fixed)v * FIXED_ONE;
+}
+
+inline float fromFixed(fixed v) {
+    return v * (1.0f / FIXED_ONE);
+}
+
+inline fixed fixedMul(fixed a, fixed b) {
+    return (fixed)(((int64_t)a * b) >> FIXED_SHIFT);
+}
+
+inline float snapToPixel(float v) {
+    return floorf(v + 0.5f);
+}
+
+// Taylor series, to the last bit for |x| up to about 1.3 (a fan's spread).
+fixed fixedSin(fixed x) {
+    fixed x2 = fixedMul(x, x);
+    fixed term = x, sum = x;
+    for (int n = 2; n <= 8; n += 2) {
+        term = -fixedMul(term, x2) / (n * (n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+fixed fixedCos(fixed x) {
+    fixed x2 = fixedMul(x, x);
+    fixed term = FIXED_ONE, sum = FIXED_ONE;
+    for (int n = 1; n <= 9; n += 2) {
+        term = -fixedMul(term, x2) / (n * (n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+bool fixedBoxes(fixed x1, fixed y1, fixed w1, fixed h1, fixed x2, fixed y2, fixed w2, fixed h2) {
+    return x1 < x2 + w2 && x1 + w1 > x2 && y1 < y2 + h2 && y1 + h1 > y2;
+}
+
+// The squares are only taken once both offsets are known to be small.
+bool fixedCircles(fixed x1, fixed y1, fixed r1, fixed x2, fixed y2, fixed r2) {
+    int64_t dx = (int64_t)x2 - x1, dy = (int64_t)y2 - y1, reach = (int64_t)r1 + r2;
+    if (dx >= reach || -dx >= reach || dy >= reach || -dy >= reach) return false;
+    return dx * dx + dy * dy < reach * reach;
+}
+
+bool fixedCircleHitsRect(fixed cx, fixed cy, fixed radius, fixed x, fixed y, fixed w, fixed h) {
+    int64_t dx = (int64_t)cx - std::max(x, std::min(cx, x + w));
+    int64_t dy = (int64_t)cy - std::max(y, std::min(cy, y + h));
+    if (dx >= radius || -dx >= radius || dy >= radius || -dy >= radius) return false;
+    return dx * dx + dy * dy < (int64_t)radius * radius;
+}
+
+// Appends a new rock's fixed-point state and sets the floats drawn from it.
+// The caller pushes r itself straight after.
+void pushFixedRock(World& w, Rock& r, fixed x, fixed y, fixed speed, fixed drift) {
+    FixedRocks& f = w.fixedRocks;
+    f.x.push_back(x);
+    f.y.push_back(y);
+    f.speed.push_back(speed);
+    f.drift.push_back(drift);
+    r.x = fromFixed(x);
+    r.y = fromFixed(y);
+    r.speed = fromFixed(speed);
+    r.drift = fromFixed(drift);
+}
+
+// The player's part of the fixed-point tick: input, gravity, landing and
+// the camera, as in the float path of stepWorldT.
+template <class P>
+void fixedMovePlayer(World& w, const TickInput& in) {
+    Player& player = w.player;
+    FixedBody& b = w.body;
+    const fixed step = toFixed(P::moveSpeed() * 16);
+    const fixed width = toFixed(player.width);
+    const fixed halfWidth = width / 2;
+    if (in.left) {
+        b.playerX -= step;
+        if (b.playerX < halfWidth) b.playerX = halfWidth;
+    }
+    if (in.right) {
+        b.playerX += step;
+        if (b.playerX > toFixed(WINDOW_WIDTH) - halfWidth) b.playerX = toFixed(WINDOW_WIDTH) - halfWidth;
+    }
+    if (in.jump && !player.isJumping) {
+        b.velocityY = toFixed(P::jumpVelocity());
+        player.isJumping = true;
+    }
+    b.velocityY += toFixed(P::gravity() * 16);
+    b.playerY += b.velocityY * 16;
+
+    player.standingOn = -1;
+    for (size_t i = 0; i < w.platforms.size(); i++) {
+        const Platform& p = w.platforms[i];
+        if (p.destroyed) continue;
+        if (b.velocityY <= 0 &&
+            fixedBoxes(b.playerX - halfWidth, b.playerY, width, toFixed(5), pixelsToFixed(p.x),
+                       pixelsToFixed(p.y + p.height - 5), pixelsToFixed(p.width), toFixed(10))) {
+            b.playerY = pixelsToFixed(p.y + p.height);
+            b.velocityY = 0;
+            player.isJumping = false;
+            player.standingOn = (int)i;
+        }
+    }
+    if (player.standingOn >= 0) {
+        b.playerX += pixelsToFixed(w.platforms[player.standingOn].carry);
+        b.playerX = std::min(std::max(b.playerX, halfWidth), toFixed(WINDOW_WIDTH) - halfWidth);
+    }
+    if (b.playerY <= toFixed(30)) {
+        b.playerY = toFixed(30);
+        b.velocityY = 0;
+        player.isJumping = false;
+    }
+    if (b.playerY > toFixed(w.levelHeight)) b.playerY = toFixed(w.levelHeight);
+
+    fixed target = b.playerY - toFixed(WINDOW_HEIGHT * 0.4);
+    target = std::min(std::max(target, 0), toFixed(w.levelHeight - WINDOW_HEIGHT));
+    b.cameraY += (target - b.cameraY) / 10;
+
+    player.x = fromFixed(b.playerX);
+    player.y = fromFixed(b.playerY);
+    player.velocityY = fromFixed(b.velocityY);
+    w.cameraY = fromFixed(b.cameraY);
+}
+
+template <class P>
+void fixedMoveLava(World& w) {
+    FixedBody& b = w.body;
+    fixed speed = b.lavaSpeed;
+    speed = fixedMul(speed, toFixed(POWERUP_EFFECTS[w.player.activePowerUp].lavaScale));
+    b.lavaHeight += speed;
+    b.lavaSpeed += b.lavaIncrement;
+    w.lavaHeight = fromFixed(b.lavaHeight);
+    w.lavaSpeed = fromFixed(b.lavaSpeed);
+}
+
+// ---------------- Timer wheel ----------------
+// Everything in the game that happens after a delay (spawns, expiries, the
+// banner, the door's swing) is a Timer in the world's wheel rather than a
+// counter polled every tick. The wheel is hierarchical: level 0 has a slot
+// per tick for the next 64, level 1 a slot per 64 ticks and level 2 per
+// 4096. A tick looks at one level-0 slot, and on every 64th tick moves the
+// next level-1 slot's timers down (likewise level 2 every 4096th), so its
+// cost follows the timers that are due, not how many are waiting. Slots are
+// index lists into a pool reserved with the world, so worlds stay plain
+// copyable values and scheduling never allocates.
+
+void fireTimer(World& w, const Timer& t);   // see "Gameplay rules"
+
+void resetTimers(TimerWheel& wheel) {
+    wheel.now = 0;
+    wheel.pending = 0;
+    wheel.free = TIMER_NONE;
+    memset(wheel.slots, 0xff, sizeof(wheel.slots));
+    wheel.pool.clear();
+}
+
+void wheelInsert(TimerWheel& wheel, uint16_t id) {
+    Timer& t = wheel.pool[id];
+    int delta = t.due - wheel.now;
+    int level = 0;
+    int due = t.due;
+    if (delta >= 1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) {
+        // Past the top level: parked in its last slot and filed again then
+        level = TIMER_WHEEL_LEVELS - 1;
+        due = wheel.now + (1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+    } else {
+        while (level < TIMER_WHEEL_LEVELS - 1 && delta >= 1 << (TIMER_WHEEL_BITS * (level + 1))) level++;
+    }
+    uint16_t& head = wheel.slots[level][(due >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)];
+    t.next = head;
+    head = id;
+}
+
+// Runs kind with arg delay ticks from now (at least one). Returns false if
+// MAX_TIMERS are already pending.
+bool scheduleTimer(World& w, int delay, TimerKind kind, int arg = 0) {
+    TimerWheel& wheel = w.timers;
+    assert(delay >= 1);
+    uint16_t id = wheel.free;
+    if (id != TIMER_NONE) {
+        wheel.free = wheel.pool[id].next;
+    } else {
+        if (wheel.pool.size() >= (size_t)MAX_TIMERS) return false;
+        id = (uint16_t)wheel.pool.size();
+        wheel.pool.push_back(Timer());
+    }
+    Timer& t = wheel.pool[id];
+    t.due = wheel.now + std::max(delay, 1);
+    t.arg = arg;
+    t.kind = (uint8_t)kind;
+    wheel.pending++;
+    wheelInsert(wheel, id);
+    return true;
+}
+
+// Files a higher level's slot down into the levels below.
+void wheelCascade(TimerWheel& wheel, int level) {
+    uint16_t& head = wheel.slots[level][(wheel.now >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)];
+    uint16_t id = head;
+    head = TIMER_NONE;
+    while (id != TIMER_NONE) {
+        uint16_t next = wheel.pool[id].next;
+        wheelInsert(wheel, id);
+        id = next;
+    }
+}
+
+// Brings the wheel up to w.gameTime, firing what falls due on the way.
+// Timers fired may schedule others, even for the next tick.
+void runTimers(World& w) {
+    TimerWheel& wheel = w.timers;
+    while (wheel.now < w.gameTime) {
+        wheel.now++;
+        for (int level = TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+            if ((wheel.now & ((1 << (TIMER_WHEEL_BITS * level)) - 1)) == 0) wheelCascade(wheel, level);
+        }
+        uint16_t& head = wheel.slots[0][wheel.now & (TIMER_WHEEL_SLOTS - 1)];
+        uint16_t id = head;
+        head = TIMER_NONE;
+        while (id != TIMER_NONE) {
+            Timer t = wheel.pool[id];   // a copy: the entry is freed before it fires
+            assert(t.due == wheel.now);
+            wheel.pool[id].next = wheel.free;
+            wheel.free = id;
+            wheel.pending--;
+            fireTimer(w, t);
+            id = t.next;
+        }
+    }
+}
+
+// ---------------- Dynamic platforms ----------------
+// Some platforms slide back and forth, swing (easing at the ends), crumble
+// when stood on or carry the player along like a conveyor. Their state is
+// kept by behaviour in World::sliding, swinging and crumbling, an array per
+// field, and each tick runs one pass per behaviour straight down those
+// arrays. A path's position is a function of gameTime alone, so the arrays
+// only change when a level is built. The float passes run four paths at a
+// time with SSE2, so they are vectorized whatever the optimization level; the
+// fixed passes are branch-free but scalar, as SSE2 has no lane multiply for
+// their 64-bit products. Results are then scattered into the platforms.
+// Moves are sideways only, so platforms stay ordered by height for the
+// broadphase and the view. Conveyors need no pass: their carry is constant.
+// On the fixed-point tick positions are whole pixels, as elsewhere for
+// things the fixed tick reads from floats, and a trip's phase is a 32-bit
+// fraction advanced by a precomputed step, so it wraps without a modulo.
+
+const int DYNAMIC_PLATFORM_SHARE = 4;   // 1 in this many generated platforms is not static
+const int CRUMBLE_TICKS = 45;           // cracking under the player
+const int REGROW_TICKS = 180;           // gone, then back unless the lava has it
+const float CONVEYOR_CARRY = 1;         // px per tick; whole, for the fixed tick
+// sin(pi/2 t) on [-1, 1], odd powers of t from the first
+const float SWING_POLY[] = {1.5707963f, 0.6459641f, 0.0796926f, 0.0046818f, 0.0001604f};
+const fixed FIXED_SWING_POLY[] = {toFixed(SWING_POLY[0]), toFixed(SWING_POLY[1]), toFixed(SWING_POLY[2]),
+                                  toFixed(SWING_POLY[3]), toFixed(SWING_POLY[4])};
+
+void addPlatformPath(PlatformPaths& paths, int platform, float originX, float range, int period,
+                     int offset) {
+    paths.platform.push_back(platform);
+    paths.originX.push_back(originX);
+    paths.range.push_back(range);
+    paths.period.push_back(period);
+    paths.offset.push_back(offset);
+    paths.invPeriod.push_back(1.0f / period);
+    uint32_t step = (uint32_t)((((uint64_t)1 << 32) + period / 2) / period);
+    paths.phaseStep.push_back(step);
+    paths.phaseStart.push_back(step * (uint32_t)offset);
+    paths.x.push_back(originX);
+}
+
+void clearPlatformPaths(PlatformPaths& paths) {
+    paths.platform.clear();
+    paths.originX.clear();
+    paths.range.clear();
+    paths.period.clear();
+    paths.offset.clear();
+    paths.invPeriod.clear();
+    paths.phaseStep.clear();
+    paths.phaseStart.clear();
+    paths.x.clear();
+}
+
+void clearDynamicPlatforms(World& w) {
+    clearPlatformPaths(w.sliding);
+    clearPlatformPaths(w.swinging);
+    w.crumbling.platform.clear();
+    w.crumbling.timer.clear();
+}
+
+// A round trip is a triangle wave, -1 to 1 and back. Swinging platforms
+// bend it with sin(pi/2 t), which makes the trip cos(2 pi phase); the
+// polynomial is good to 4e-6 on [-1, 1] and needs no range reduction.
+inline float swingCurve(float t) {
+    float t2 = t * t;
+    return t * (SWING_POLY[0] - t2 * (SWING_POLY[1] - t2 * (SWING_POLY[2] - t2 * (SWING_POLY[3] - t2 * SWING_POLY[4]))));
+}
+
+template <bool Swing>
+void pathPositions(PlatformPaths& paths, int tick) {
+    size_t n = paths.platform.size();
+    const float* originX = paths.originX.data();
+    const float* range = paths.range.data();
+    const int* offset = paths.offset.data();
+    const float* invPeriod = paths.invPeriod.data();
+    float* x = paths.x.data();
+    size_t i = 0;
+#ifdef SW_SSE2
+    // The loop below four paths at a time, in the same order of operations.
+    __m128 magnitude = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 one = _mm_set1_ps(1), two = _mm_set1_ps(2), four = _mm_set1_ps(4);
+    for (; i + 4 <= n; i += 4) {
+        __m128i ticks = _mm_add_epi32(_mm_set1_epi32(tick), _mm_loadu_si128((const __m128i*)(offset + i)));
+        __m128 cycles = _mm_mul_ps(_mm_cvtepi32_ps(ticks), _mm_loadu_ps(invPeriod + i));
+        __m128 phase = _mm_sub_ps(cycles, _mm_cvtepi32_ps(_mm_cvttps_epi32(cycles)));
+        __m128 t = _mm_sub_ps(_mm_and_ps(_mm_sub_ps(_mm_mul_ps(four, phase), two), magnitude), one);
+        if (Swing) {
+            __m128 t2 = _mm_mul_ps(t, t);
+            __m128 p = _mm_mul_ps(t2, _mm_set1_ps(SWING_POLY[4]));
+            for (int k = 3; k >= 1; k--) p = _mm_mul_ps(t2, _mm_sub_ps(_mm_set1_ps(SWING_POLY[k]), p));
+            t = _mm_mul_ps(t, _mm_sub_ps(_mm_set1_ps(SWING_POLY[0]), p));
+        }
+        _mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(originX + i), _mm_mul_ps(_mm_loadu_ps(range + i), t)));
+    }
+#endif
+    for (; i < n; i++) {
+        float cycles = (float)(tick + offset[i]) * invPeriod[i];
+        float phase = cycles - (float)(int)cycles;
+        float t = fabsf(4 * phase - 2) - 1;
+        if (Swing) t = swingCurve(t);
+        x[i] = originX[i] + range[i] * t;
+    }
+}
+
+// The same curve in Q16.16, clamped as the last bits can overshoot.
+inline fixed fixedSwingCurve(fixed t) {
+    fixed t2 = fixedMul(t, t);
+    fixed p = fixedMul(t2, FIXED_SWING_POLY[4]);
+    for (int k = 3; k >= 1; k--) p = fixedMul(t2, FIXED_SWING_POLY[k] - p);
+    return std::min(std::max(fixedMul(t, FIXED_SWING_POLY[0] - p), -FIXED_ONE), FIXED_ONE);
+}
+
+// The same trips in integers, rounded to whole pixels. The top 16 bits of
+// the phase are its Q16.16 fraction of a trip.
+template <bool Swing>
+void fixedPathPositions(PlatformPaths& paths, int tick) {
+    size_t n = paths.platform.size();
+    const float* originX = paths.originX.data();
+    const float* range = paths.range.data();
+    const uint32_t* phaseStep = paths.phaseStep.data();
+    const uint32_t* phaseStart = paths.phaseStart.data();
+    float* x = paths.x.data();
+    for (size_t i = 0; i < n; i++) {
+        fixed phase = (fixed)((phaseStart[i] + phaseStep[i] * (uint32_t)tick) >> 16);
+        fixed u = 4 * phase - 2 * FIXED_ONE;
+        fixed t = (u ^ (u >> 31)) - (u >> 31) - FIXED_ONE;   // |u| - 1
+        if (Swing) t = fixedSwingCurve(t);
+        fixed offsetX = (fixed)range[i] * t;
+        x[i] = originX[i] + (float)((offsetX + FIXED_ONE / 2) >> FIXED_SHIFT);
+    }
+}
+
+void scatterPaths(World& w, const PlatformPaths& paths) {
+    for (size_t i = 0; i < paths.platform.size(); i++) {
+        Platform& p = w.platforms[paths.platform[i]];
+        p.carry = paths.x[i] - p.x;
+        p.x = paths.x[i];
+    }
+}
+
+// Stepping on a whole crumbling platform starts its timer. It cracks for
+// CRUMBLE_TICKS, falls, and comes back REGROW_TICKS later; the lava tick
+// destroys it again straight away if it came back under the lava.
+void crumblePlatforms(World& w) {
+    CrumblingPlatforms& c = w.crumbling;
+    int standing = w.player.standingOn;
+    for (size_t i = 0; i < c.platform.size(); i++) {
+        Platform& p = w.platforms[c.platform[i]];
+        int t = c.timer[i];
+        if (t == 0 && c.platform[i] == standing) {
+            t = CRUMBLE_TICKS + REGROW_TICKS;
+        } else if (t > 0) {
+            t--;
+            if (t == REGROW_TICKS) p.destroyed = true;
+            else if (t == 0) p.destroyed = false;
+        }
+        c.timer[i] = t;
+        p.crumbling = t > REGROW_TICKS;
+    }
+}
+
+// The platforms' part of a tick, before the player moves.
+template <class P>
+void movePlatforms(World& w) {
+    if (P::fixedPoint()) {
+        fixedPathPositions<false>(w.sliding, w.gameTime);
+        fixedPathPositions<true>(w.swinging, w.gameTime);
+    } else {
+        pathPositions<false>(w.sliding, w.gameTime);
+        pathPositions<true>(w.swinging, w.gameTime);
+    }
+    scatterPaths(w, w.sliding);
+    scatterPaths(w, w.swinging);
+    crumblePlatforms(w);
+}
+
+// Makes about one generated platform in DYNAMIC_PLATFORM_SHARE dynamic,
+// never the starting platform or the first one above it. A path is centred
+// on where the generator put the platform, so the jumps it was linked by
+// still land at some point of every trip; too little room for a path leaves
+// the platform static. Positions are then set for gameTime 0.
+void assignPlatformKinds(World& w) {
+    const int dynamicKinds = PLATFORM_KINDS - 1;
+    for (size_t i = 2; i < w.platforms.size(); i++) {
+        Platform& p = w.platforms[i];
+        int roll = worldRand(w) % (DYNAMIC_PLATFORM_SHARE * dynamicKinds);
+        if (roll >= dynamicKinds) continue;
+        int kind = PLATFORM_SLIDING + roll;
+        if (kind == PLATFORM_SLIDING || kind == PLATFORM_SWINGING) {
+            float room = fmin(p.x, WINDOW_WIDTH - p.width - p.x);
+            float range = fmin((float)(60 + worldRand(w) % 120), room);
+            int period = 120 + worldRand(w) % 240;
+            int offset = worldRand(w) % period;
+            if (w.fixedPoint) range = floorf(range);
+            if (range < 20) continue;
+            addPlatformPath(kind == PLATFORM_SLIDING ? w.sliding : w.swinging, (int)i, p.x, range,
+                            period, offset);
+        } else if (kind == PLATFORM_CRUMBLING) {
+            w.crumbling.platform.push_back((int)i);
+            w.crumbling.timer.push_back(0);
+        } else {
+            p.carry = worldRand(w) % 2 ? CONVEYOR_CARRY : -CONVEYOR_CARRY;
+        }
+        p.kind = (uint8_t)kind;
+    }
+    if (w.fixedPoint) {
+        fixedPathPositions<false>(w.sliding, 0);
+        fixedPathPositions<true>(w.swinging, 0);
+    } else {
+        pathPositions<false>(w.sliding, 0);
+        pathPositions<true>(w.swinging, 0);
+    }
+    scatterPaths(w, w.sliding);
+    scatterPaths(w, w.swinging);
+    for (Platform& p : w.platforms) {
+        if (p.kind != PLATFORM_CONVEYOR) p.carry = 0;
+    }
+}
+
+// ---------------- Level generation ----------------
+// Platforms are placed bottom-up and each one has to be reachable by a jump
+// from a platform already placed. The test uses the exact arc stepWorldT
+// integrates for the level's preset: t ticks after take-off the player has
+// risen
+//     y(t) = 16 (v0 t - g t (t + 1) / 2),  v0 = jumpVelocity, g = -16 gravity
+// while moving moveSpeed * 16 px sideways per tick. Only platforms within one
+// apex below the new one can reach it, so each placement checks a bounded
+// window and the whole level is linear in its height.
+// A --fixed level has to come out the same from any build, like its ticks.
+// Its arc is the one the fixed-point tick integrates, tabulated per preset
+// in Q16.16, and its apex and reaches are rounded down to whole pixels in
+// integers. Every coordinate the layout then computes is a whole number of
+// pixels, so the float sums and comparisons below are exact and cannot
+// depend on the compiler, FMA contraction or libm.
+
+const int LEVEL_PLATFORMS = 10;
+const float PLATFORM_SPACING = 55;
+const float REACH_SAFETY = 0.8f;    // share of the ideal sideways reach we rely on
+const float REACH_HEADROOM = 20;    // px kept below the apex
+const int REACH_WINDOW = 16;        // bits in a platform's link mask
+const int LEVEL_ATTEMPTS = 8;       // layouts tried before one with a gap is kept
+const float REPAIR_MARGIN = 1;      // px a repair stays inside the reach
+const int ARC_TICKS = 512;          // a fixed-point jump tabulated this far
+
+struct FixedArc {
+    fixed rise[ARC_TICKS];   // height above take-off, t ticks after it
+    int apexTick;
+    int ticks;               // entries filled; the last is well below take-off
+    fixed step;              // sideways per tick
+};
+
+// Integrates a jump exactly as fixedMovePlayer() does.
+FixedArc makeFixedArc(const Difficulty& d) {
+    FixedArc arc;
+    fixed velocity = toFixed(d.jumpVelocity), gravity = toFixed(d.gravity * 16);
+    arc.step = toFixed(d.moveSpeed * 16);
+    arc.rise[0] = 0;
+    arc.apexTick = 0;
+    arc.ticks = 1;
+    while (arc.ticks < ARC_TICKS && arc.rise[arc.ticks - 1] > -toFixed(WINDOW_HEIGHT)) {
+        velocity += gravity;
+        arc.rise[arc.ticks] = arc.rise[arc.ticks - 1] + velocity * 16;
+        if (arc.rise[arc.ticks] > arc.rise[arc.apexTick]) arc.apexTick = arc.ticks;
+        arc.ticks++;
+    }
+    return arc;
+}
+
+const FixedArc& fixedArc(int difficulty) {
+    static const FixedArc arcs[DIFFICULTY_COUNT] = {
+        makeFixedArc(DIFFICULTIES[0]), makeFixedArc(DIFFICULTIES[1]), makeFixedArc(DIFFICULTIES[2])
+    };
+    return arcs[difficulty];
+}
+
+// Ticks until a jump comes back down through dy px above take-off, or -1 if
+// dy is above the apex.
+float jumpDescentTicks(const Difficulty& d, float dy) {
+    float a = 8 * (-d.gravity * 16);
+    float b = 16 * d.jumpVelocity - a;
+    float disc = b * b - 4 * a * dy;
+    if (disc < 0) return -1;
+    return floor((b + sqrt(disc)) / (2 * a));
+}
+
+float jumpApex(const World& w) {
+    if (w.fixedPoint) {
+        const FixedArc& arc = fixedArc(w.difficulty);
+        return (float)(arc.rise[arc.apexTick] >> FIXED_SHIFT);
+    }
+    const Difficulty& d = DIFFICULTIES[w.difficulty];
+    float a = 8 * (-d.gravity * 16);
+    float b = 16 * d.jumpVelocity - a;
+    return b * b / (4 * a);
+}
+
+// Widest sideways gap that can be crossed while arriving dy px above take-off.
+float jumpReach(const World& w, float dy) {
+    if (dy > jumpApex(w) - REACH_HEADROOM) return -1;
+    if (w.fixedPoint) {
+        const FixedArc& arc = fixedArc(w.difficulty);
+        fixed rise = toFixed(dy);
+        int t = arc.apexTick;
+        while (t + 1 < arc.ticks && arc.rise[t + 1] >= rise) t++;
+        return (float)(fixedMul(toFixed(REACH_SAFETY), arc.step * t) >> FIXED_SHIFT);
+    }
+    const Difficulty& d = DIFFICULTIES[w.difficulty];
+    return REACH_SAFETY * d.moveSpeed * 16 * jumpDescentTicks(d, dy);
+}
+
+float spanGap(float a0, float a1, float b0, float b1) {
+    return fmax(0.0f, fmax(b0 - a1, a0 - b1));
+}
+
+bool platformReaches(const World& w, const Platform& from, const Platform& to) {
+    float reach = jumpReach(w, (to.y + to.height) - (from.y + from.height));
+    return reach >= 0 && spanGap(from.x, from.x + from.width, to.x, to.x + to.width) <= reach;
+}
+
+// Player centre has to come within 25 px of the coin; from below the coin,
+// or standing level with it.
+bool coinReachableFrom(const World& w, const Platform& p, const Collectable& c,
+                       float playerHeight) {
+    float dy = c.y - 25 - playerHeight / 2 - (p.y + p.height);
+    if (dy < -50) return false;
+    float reach = jumpReach(w, fmax(dy, 0.0f));
+    return reach >= 0 && spanGap(p.x, p.x + p.width, c.x - 25, c.x + 25) <= reach;
+}
+
+// The player's box has to overlap the door, so the feet must rise past
+// door.y - height.
+bool doorReachableFrom(const World& w, const Platform& p, const Door& door,
+                       float playerHeight) {
+    float top = p.y + p.height;
+    if (top >= door.y + door.height) return false;
+    float reach = jumpReach(w, door.y - playerHeight + 1 - top);
+    return reach >= 0 &&
+           spanGap(p.x, p.x + p.width, door.x - 15, door.x + door.width + 15) <= reach;
+}
+
+// Pulls the span [x, x + width] sideways until it is within reach of p, by
+// REPAIR_MARGIN more so that rounding or the pixel snap cannot undo it.
+float clampIntoReach(float x, float width, const Platform& p, float reach) {
+    reach = fmax(reach - REPAIR_MARGIN, 0.0f);
+    float lo = p.x - reach - width;
+    float hi = p.x + p.width + reach;
+    return fmin(fmax(x, lo), hi);
+}
+
+// Bit k - 1 is set when the k-th platform below the top can jump to p.
+unsigned platformLinksTo(const World& w, const Platform& p) {
+    int n = (int)w.platforms.size();
+    unsigned links = 0;
+    for (int k = 1; k <= REACH_WINDOW && k <= n; k++) {
+        const Platform& below = w.platforms[n - k];
+        if (p.y - below.y > jumpApex(w)) break;
+        if (platformReaches(w, below, p)) links |= 1u << (k - 1);
+    }
+    return links;
+}
+
+// Adds p on top of the level and links it to every placed platform in the
+// window below that can reach it. A platform nothing can reach is moved
+// sideways towards the one placed before it, then tested again: the walls
+// or the pixel snap can undo a repair, and then it counts as unreachable.
+void addPlatform(World& w, Platform p) {
+    std::vector<Platform>& platforms = w.platforms;
+    int n = (int)platforms.size();
+    unsigned links = platformLinksTo(w, p);
+    if (n > 0 && links == 0) {
+        const Platform& prev = platforms[n - 1];
+        float reach = jumpReach(w, (p.y + p.height) - (prev.y + prev.height));
+        if (reach >= 0) p.x = clampIntoReach(p.x, p.width, prev, reach);
+        p.x = fmin(fmax(p.x, 0.0f), (float)WINDOW_WIDTH - p.width);
+        if (w.fixedPoint) p.x = snapToPixel(p.x);
+        links = platformLinksTo(w, p);
+        w.levelRepairs++;
+        if (links == 0) w.levelUnreachable++;
+    }
+    platforms.push_back(p);
+    w.platformLinks.push_back((unsigned short)links);
+}
+
+// Highest platform whose top is at or below height y.
+int platformBelow(const World& w, float y) {
+    for (int i = (int)w.platforms.size() - 1; i >= 0; i--) {
+        if (w.platforms[i].y + w.platforms[i].height <= y) return i;
+    }
+    return 0;
+}
+
+// Coins are placed in ascending order, so first (the lowest platform that
+// could still reach the current coin) only ever moves up.
+void placeCoin(World& w, Collectable& c, size_t& first) {
+    const std::vector<Platform>& platforms = w.platforms;
+    float feet = c.y - 25 - w.player.height / 2;
+    while (first < platforms.size() &&
+           platforms[first].y + platforms[first].height < feet - jumpApex(w)) {
+        first++;
+    }
+    int below = -1;
+    for (size_t i = first; i < platforms.size(); i++) {
+        const Platform& p = platforms[i];
+        if (p.y + p.height > feet + 50) break;
+        if (coinReachableFrom(w, p, c, w.player.height)) return;
+        if (p.y + p.height <= feet) below = (int)i;
+    }
+    float reach = below < 0 ? -1 : jumpReach(w, feet - (platforms[below].y + platforms[below].height));
+    if (reach < 0) {
+        w.levelUnreachable++;
+        return;
+    }
+
+    const Platform& p = platforms[below];
+    c.x = clampIntoReach(c.x - 25, 50, p, reach) + 25;
+    c.x = fmin(fmax(c.x, 20.0f), (float)WINDOW_WIDTH - 20);
+    if (w.fixedPoint) c.x = snapToPixel(c.x);
+    w.levelRepairs++;
+    if (!coinReachableFrom(w, p, c, w.player.height)) w.levelUnreachable++;
+}
+
+void placeDoor(World& w, Door& door) {
+    for (size_t i = 0; i < w.platforms.size(); i++) {
+        if (doorReachableFrom(w, w.platforms[i], door, w.player.height)) return;
+    }
+    const Platform& p = w.platforms[platformBelow(w, door.y)];
+    float reach = jumpReach(w, door.y - w.player.height + 1 - (p.y + p.height));
+    if (reach < 0) {
+        w.levelUnreachable++;
+        return;
+    }
+    door.x = clampIntoReach(door.x - 15, door.width + 30, p, reach) + 15;
+    door.x = fmin(fmax(door.x, 0.0f), (float)WINDOW_WIDTH - door.width);
+    if (w.fixedPoint) door.x = snapToPixel(door.x);
+    w.levelRepairs++;
+    if (!doorReachableFrom(w, p, door, w.player.height)) w.levelUnreachable++;
+}
+
+// The key goes somewhere a jump from a platform still clear of the lava can
+// touch. Falls back to anywhere above the lava when no platform is left.
+void placeKey(World& w, Key& key) {
+    int candidates[64];
+    int count = 0;
+    for (size_t i = 0; i < w.platforms.size() && count < 64; i++) {
+        const Platform& p = w.platforms[i];
+        if (!p.destroyed && p.y > w.lavaHeight + 60) candidates[count++] = (int)i;
+    }
+    if (count == 0) {
+        key.x = (worldRand(w) % (WINDOW_WIDTH - 100)) + 50;
+        float minY = w.lavaHeight + 100;
+        float maxY = w.levelHeight - 100;
+        if (minY < 200) minY = 200;
+        if (minY > maxY) minY = maxY - 50;
+        key.y = minY + (worldRand(w) % (int)(maxY - minY));
+        return;
+    }
+
+    const Platform& p = w.platforms[candidates[worldRand(w) % count]];
+    float rise = 30 + worldRand(w) % 150;
+    float reach = jumpReach(w, rise);
+    unsigned share = worldRand(w) % 1000;
+    float offset = share / 1000.0f * (p.width + reach) - reach / 2;
+    if (w.fixedPoint) offset = (float)((int)(share * (p.width + reach)) / 1000 - (int)reach / 2);   // whole pixels
+    key.x = fmin(fmax(p.x + offset, 50.0f), (float)WINDOW_WIDTH - 50);
+    key.y = fmin(p.y + p.height + w.player.height / 2 + rise, w.levelHeight - 60);
+    if (w.fixedPoint) key.x = snapToPixel(key.x);   // a moving platform can be between pixels
+}
+
+// Stacks count platforms from platformY up; returns the Y above the last one.
+float generatePlatforms(World& w, int count, float platformY) {
+    float platformWidths[] = {80, 120, 100, 90, 110, 85, 95, 105, 80, 90};
+    
+    for (int i = 0; i < count; i++) {
+        Platform p;
+        p.width = platformWidths[i % 10];
+        p.height = 20;
+        p.y = platformY;
+        p.x = worldRand(w) % (WINDOW_WIDTH - (int)p.width);
+        p.destroyed = false;
+        p.kind = PLATFORM_STATIC;
+        p.crumbling = false;
+        p.carry = 0;
+        addPlatform(w, p);
+        platformY += PLATFORM_SPACING;
+    }
+    return platformY;
+}
+
+// Sizes a world's storage for a whole level so ticks never grow it.
+void reserveWorld(World& w) {
+    w.platforms.reserve(w.levelPlatforms + 1);
+    w.platformLinks.reserve(w.levelPlatforms + 1);
+    w.collectables.reserve(COLLECTABLES_COUNT);
+    w.rocks.reserve(MAX_ROCKS);
+    w.fixedRocks.x.reserve(MAX_ROCKS);   // whatever the mode: autopilot scratch worlds take either
+    w.fixedRocks.y.reserve(MAX_ROCKS);
+    w.fixedRocks.speed.reserve(MAX_ROCKS);
+    w.fixedRocks.drift.reserve(MAX_ROCKS);
+    w.powerUps.reserve(MAX_POWERUPS);
+    w.events.reserve(MAX_ROCKS + MAX_TICK_EVENTS);
+    w.timers.pool.reserve(MAX_TIMERS);
+}
+
+const HazardScript& activeHazards();   // see "Hazard scripts"
+void startHazardScript(World& w, const HazardScript& program);
+
+// Platforms, coins and the door for w's level. The repairs keep almost
+// every layout reachable; one they could not fix is thrown away and built
+// again from where the random stream got to, up to LEVEL_ATTEMPTS times.
+void buildLayout(World& w) {
+    w.levelRepairs = 0;
+    w.levelUnreachable = 0;
+    w.platformLinks.clear();
+    w.platforms.clear();
+    w.collectables.clear();
+
+    // create starting platform, the player starts on top of it
+    Platform startP;
+    startP.width = 200;
+    startP.height = 20;
+    startP.x = WINDOW_WIDTH / 2 - startP.width / 2;
+    startP.y = 50;                 // visual Y for the starter platform
+    startP.destroyed = false;
+    startP.kind = PLATFORM_STATIC;
+    startP.crumbling = false;
+    startP.carry = 0;
+    addPlatform(w, startP);        // make it a real platform for collisions/rendering
+
+    float platformY = generatePlatforms(w, w.levelPlatforms, 100);
+    w.levelHeight = fmax((float)WINDOW_HEIGHT, platformY + 150);
+    
+    size_t coinWindow = 0;
+    for (int i = 0; i < COLLECTABLES_COUNT; i++) {
+        Collectable c;
+        c.x = worldRand(w) % (WINDOW_WIDTH - 40) + 20;
+        c.y = 150 + i * 70 * w.levelScreens;
+        c.size = 15;
+        c.collected = false;
+        c.rotation = 0;
+        placeCoin(w, c, coinWindow);
+        w.collectables.push_back(c);
+    }
+    
+    Door& door = w.door;
+    door.x = WINDOW_WIDTH / 2 - 40;
+    door.y = platformY - 100;
+    door.width = 80;
+    door.height = 60;
+    door.unlocked = false;
+    door.openAnimation = 0;
+    placeDoor(w, door);
+}
+
+// Builds a fresh level into w from the given seed, screens tall (about a
+// screen's worth of extra platforms per screen), on the fixed-point tick if
+// asked. Touches no GL or input state, so it can run on any World.
+void resetWorld(World& w, unsigned seed, int difficulty, int screens = 1, bool fixedPoint = false) {
+    Player& player = w.player;
+    std::vector<Platform>& platforms = w.platforms;
+    Key& key = w.key;
+
+    w.seed = seed;
+    w.rng = seed ? seed : 1;
+    w.difficulty = difficulty;
+    assert(!fixedPoint || screens <= FIXED_MAX_SCREENS);
+    w.fixedPoint = fixedPoint;
+    w.step = fixedPoint ? DIFFICULTIES[difficulty].fixedStep : DIFFICULTIES[difficulty].step;
+    clearDynamicPlatforms(w);
+    w.rocks.clear();
+    w.fixedRocks.x.clear();
+    w.fixedRocks.y.clear();
+    w.fixedRocks.speed.clear();
+    w.fixedRocks.drift.clear();
+    w.powerUps.clear();
+    w.events.clear();
+    w.coinsCollected = 0;
+    w.levelScreens = screens;
+    w.levelPlatforms = LEVEL_PLATFORMS + (screens - 1) * (int)(WINDOW_HEIGHT / PLATFORM_SPACING);
+    w.levelHeight = WINDOW_HEIGHT;
+    w.cameraY = 0;
+    reserveWorld(w);
+    w.lavaHeight = 0.0f;
+    w.lavaSpeed = DIFFICULTIES[difficulty].lavaInitialSpeed;
+    w.lavaIncrement = DIFFICULTIES[difficulty].lavaSpeedIncrement;
+    w.gameTime = 0;
+    memset(&w.wave, 0, sizeof(w.wave));
+    resetTimers(w.timers);
+
+   player.x = WINDOW_WIDTH / 2;
+    player.width = 30;
+    player.height = 40;
+    player.velocityY = 0;
+    player.isJumping = false;
+    player.lives = INITIAL_LIVES;
+    player.score = 0;
+    player.hasKey = false;
+    player.activePowerUp = 0;
+    player.powerUpEnds = 0;
+    player.standingOn = -1;
+    
+    for (w.levelAttempts = 1; ; w.levelAttempts++) {
+        buildLayout(w);
+        if (w.levelUnreachable == 0 || w.levelAttempts == LEVEL_ATTEMPTS) break;
+    }
+    player.y = platforms[0].y + platforms[0].height;   // on the starting platform
+    
+    key.spawned = false;
+    key.collected = false;
+    key.size = 20;
+    key.rotation = 0;
+    assignPlatformKinds(w);
+    
+    w.letsGo = true;
+    scheduleTimer(w, LETS_GO_TICKS, TIMER_BANNER_END);
+    
+    FixedBody& b = w.body;
+    b.playerX = toFixed(player.x);
+    b.playerY = toFixed(player.y);
+    b.velocityY = 0;
+    b.lavaHeight = 0;
+    b.lavaSpeed = toFixed(w.lavaSpeed);
+    b.lavaIncrement = toFixed(w.lavaIncrement);
+    b.cameraY = 0;
+    
+    startHazardScript(w, activeHazards());
+}
+
+// ---------------- Level prebuilder ----------------
+// While a run is played, a worker thread builds the next level into a spare
+// World. A restart then swaps the two Worlds. That moves vector buffers
+// rather than copying them, so a restart costs the same whatever the level
+// size, and the old level's buffers become the next build's storage. If
+// the player picked another difficulty since, or the build has not
+// finished, the restart builds the level itself and counts a miss.
+
+struct LevelPrebuilder {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    World spare;         // the worker's while building, ours once ready
+    unsigned seed;
+    int difficulty;
+    int screens;
+    bool fixedPoint;
+    bool wanted;         // a build was asked for and has not started
+    bool ready;          // spare holds the last level asked for
+    bool stopping;
+    long hits;
+    long misses;
+};
+
+LevelPrebuilder prebuilder;
+bool levelPrebuilding = false;   // only the windowed game builds ahead
+unsigned levelSeedState = 0;     // seeds the first level; each new level steps it
+unsigned firstLevelSeed = 0;     // --seed: the first level's, to race its ghost
+
+void ghostPrepare(const World& level);
+
+// A new seed for every level built, so a restart never repeats the level
+// just played, however quickly it comes (the clock only seeds the first).
+unsigned nextLevelSeed() {
+    if (firstLevelSeed) {
+        levelSeedState = firstLevelSeed;
+        firstLevelSeed = 0;
+        return levelSeedState;
+    }
+    if (levelSeedState == 0) levelSeedState = (unsigned)time(0);
+    levelSeedState = levelSeedState * 747796405u + 2891336453u;
+    unsigned seed = levelSeedState ^ (levelSeedState >> 16);
+    return seed ? seed : 1;
+}
+
+void prebuildWorker() {
+    LevelPrebuilder& p = prebuilder;
+    std::unique_lock<std::mutex> lock(p.mutex);
+    while (true) {
+        p.wake.wait(lock, [&] { return p.wanted || p.stopping; });
+        if (p.stopping) return;
+        unsigned seed = p.seed;
+        int difficulty = p.difficulty;
+        int screens = p.screens;
+        bool fixedPoint = p.fixedPoint;
+        p.wanted = false;
+        lock.unlock();
+        resetWorld(p.spare, seed, difficulty, screens, fixedPoint);
+        ghostPrepare(p.spare);
+        lock.lock();
+        if (!p.wanted) p.ready = true;   // otherwise go round with the newer request
+    }
+}
+
+// Asks for the level the next restart will want to be built ahead.
+void prebuildLevel() {
+    if (!levelPrebuilding) return;
+    LevelPrebuilder& p = prebuilder;
+    {
+        std::lock_guard<std::mutex> lock(p.mutex);
+        p.seed = nextLevelSeed();
+        p.difficulty = selectedDifficulty;
+        p.screens = levelScreens;
+        p.fixedPoint = fixedPointPhysics;
+        p.wanted = true;
+        p.ready = false;
+    }
+    if (!p.thread.joinable()) p.thread = std::thread(prebuildWorker);
+    p.wake.notify_one();
+}
+
+// Swaps a ready level matching difficulty, screens and number type into w.
+// Everything but the game state and the live flag comes from the built level.
+bool takePrebuiltLevel(World& w, int difficulty, int screens, bool fixedPoint) {
+    LevelPrebuilder& p = prebuilder;
+    std::lock_guard<std::mutex> lock(p.mutex);
+    if (!p.ready || p.spare.difficulty != difficulty || p.spare.levelScreens != screens ||
+        p.spare.fixedPoint != fixedPoint) {
+        if (levelPrebuilding) p.misses++;
+        return false;
+    }
+    GameState state = w.state;
+    bool live = w.live;
+    std::swap(w, p.spare);
+    w.state = state;
+    w.live = live;
+    p.ready = false;
+    p.hits++;
+    return true;
+}
+
+void prebuildStop() {
+    LevelPrebuilder& p = prebuilder;
+    {
+        std::lock_guard<std::mutex> lock(p.mutex);
+        p.stopping = true;
+    }
+    p.wake.notify_one();
+    if (p.thread.joinable()) p.thread.join();
+}
+
+void ghostBegin(bool prebuilt);
+void runBegin();
+
+// Starts a run on a new level: the prebuilt one when there is one.
+void startLevel() {
+    bool prebuilt = takePrebuiltLevel(world, selectedDifficulty, levelScreens, fixedPointPhysics);
+    if (!prebuilt) {
+        resetWorld(world, nextLevelSeed(), selectedDifficulty, levelScreens, fixedPointPhysics);
+    }
+    srand(world.seed);
+    ghostBegin(prebuilt);
+    runBegin();
+    telemetrySession++;
+    telemetryPush(TEL_SESSION_START, 0, 0, (int)world.seed);
+    
+    for (int i = 0; i < 256; i++) keys[i] = false;
+    prebuildLevel();
+}
+
+void initProjection() {
+   // glClearColor(0.53f, 0.81f, 0.92f, 1.0f);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluOrtho2D(0, WINDOW_WIDTH, 0, WINDOW_HEIGHT);
+}
+
+void init() {
+    initProjection();
+    startLevel();
+}
+
+// ---------------- Render backend ----------------
+// The draw code calls these gfx* wrappers rather than GL. Normally they
+// forward to GL. With --software (or headless with --swrender) they record
+// triangles instead. Lines and points become quads, bitmap text becomes
+// quads from a built-in 5x7 font. gfxFinishFrame() then rasterizes the
+// frame into a 1200x800 framebuffer on the CPU. Triangles are binned into
+// 64x64 tiles as they arrive. The tiles are shared out to a pool of threads,
+// and each walks its triangles in submission order, testing four pixels at
+// a time with SSE2 edge functions and blending with 16-bit integer maths.
+// Each triangle keeps the blend function it was drawn with, so the additive
+// rock halo and the premultiplied atlas blend the way GL blends them.
+// A window shows the result with one glDrawPixels call; --swrender writes
+// PPM files instead.
+
+const int SW_TILE = 64;
+const int SW_TILES_X = (WINDOW_WIDTH + SW_TILE - 1) / SW_TILE;
+const int SW_TILES_Y = (WINDOW_HEIGHT + SW_TILE - 1) / SW_TILE;
+const int SW_TILE_COUNT = SW_TILES_X * SW_TILES_Y;
+const int SW_MATRIX_DEPTH = 16;
+
+struct SwVertex {
+    float x, y;         // window pixels
+    float c[4];         // colour, 0..255
+};
+
+// How a triangle's pixels combine with what is already in the framebuffer.
+enum SwBlend : uint8_t {
+    SW_REPLACE,
+    SW_ALPHA,            // GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA
+    SW_ADD,              // GL_SRC_ALPHA, GL_ONE
+    SW_PREMULTIPLIED     // GL_ONE, GL_ONE_MINUS_SRC_ALPHA
+};
+
+struct SwTriangle {
+    float a[3], b[3], c[3];      // edge functions a*x + b*y + c, positive inside
+    bool topLeft[3];             // pixels exactly on these edges belong to the triangle
+    float cx[4], cy[4], c0[4];   // colour planes
+    uint32_t flat;               // packed colour when every vertex has the same one
+    bool isFlat;
+    uint8_t blend;               // SwBlend
+    int x0, y0, x1, y1;          // pixel bounds, end exclusive
+};
+
+struct SoftwareRenderer {
+    std::vector<uint32_t> framebuffer;   // RGBA bytes, bottom row first like GL
+    std::vector<SwTriangle> triangles;
+    std::vector<uint32_t> bins[SW_TILE_COUNT];
+    bool clearPending;
+
+    // immediate-mode state mirrored from the draw code
+    GLenum mode;
+    std::vector<SwVertex> vertices;
+    float color[4];
+    float matrix[6];             // 2D affine: x' = m0 x + m1 y + m2, y' = m3 x + m4 y + m5
+    float stack[SW_MATRIX_DEPTH][6];
+    int depth;
+    float lineWidth, pointSize;
+    bool blend;
+    GLenum blendSrc, blendDst;
+    float rasterX, rasterY;
+    float rasterColor[4];
+
+    // tile pool
+    std::vector<std::thread> threads;
+    std::mutex lock;
+    std::condition_variable wake;
+    long generation;
+    int activeThreads;           // including the thread calling gfxFinishFrame
+    std::atomic<int> nextTile;
+    std::atomic<int> tilesDone;
+
+    bool present;                // draw the frame into the window
+    long frames;
+    long triangleCount;
+    double rasterMs;
+};
+
+bool softwareRendering = false;
+SoftwareRenderer sw;
+long gfxVertexCount = 0;   // every backend
+bool gfxRecording = false; // between gfxClear() and gfxFinishFrame(), see Render commands
+
+// Classic 5x7 font, ASCII 32..126: five columns per glyph, bit 0 is the top row.
+const uint8_t SW_FONT[95][5] = {
+    {0x00,0x00,0x00,0x00,0x00}, {0x00,0x00,0x5F,0x00,0x00}, {0x00,0x07,0x00,0x07,0x00},
+    {0x14,0x7F,0x14,0x7F,0x14}, {0x24,0x2A,0x7F,0x2A,0x12}, {0x23,0x13,0x08,0x64,0x62},
+    {0x36,0x49,0x55,0x22,0x50}, {0x00,0x05,0x03,0x00,0x00}, {0x00,0x1C,0x22,0x41,0x00},
+    {0x00,0x41,0x22,0x1C,0x00}, {0x08,0x2A,0x1C,0x2A,0x08}, {0x08,0x08,0x3E,0x08,0x08},
+    {0x00,0x50,0x30,0x00,0x00}, {0x08,0x08,0x08,0x08,0x08}, {0x00,0x60,0x60,0x00,0x00},
+    {0x20,0x10,0x08,0x04,0x02}, {0x3E,0x51,0x49,0x45,0x3E}, {0x00,0x42,0x7F,0x40,0x00},
+    {0x42,0x61,0x51,0x49,0x46}, {0x21,0x41,0x45,0x4B,0x31}, {0x18,0x14,0x12,0x7F,0x10},
+    {0x27,0x45,0x45,0x45,0x39}, {0x3C,0x4A,0x49,0x49,0x30}, {0x01,0x71,0x09,0x05,0x03},
+    {0x36,0x49,0x49,0x49,0x36}, {0x06,0x49,0x49,0x29,0x1E}, {0x00,0x36,0x36,0x00,0x00},
+    {0x00,0x56,0x36,0x00,0x00}, {0x08,0x14,0x22,0x41,0x00}, {0x14,0x14,0x14,0x14,0x14},
+    {0x00,0x41,0x22,0x14,0x08}, {0x02,0x01,0x51,0x09,0x06}, {0x32,0x49,0x79,0x41,0x3E},
+    {0x7E,0x11,0x11,0x11,0x7E}, {0x7F,0x49,0x49,0x49,0x36}, {0x3E,0x41,0x41,0x41,0x22},
+    {0x7F,0x41,0x41,0x22,0x1C}, {0x7F,0x49,0x49,0x49,0x41}, {0x7F,0x09,0x09,0x01,0x01},
+    {0x3E,0x41,0x41,0x51,0x32}, {0x7F,0x08,0x08,0x08,0x7F}, {0x00,0x41,0x7F,0x41,0x00},
+    {0x20,0x40,0x41,0x3F,0x01}, {0x7F,0x08,0x14,0x22,0x41}, {0x7F,0x40,0x40,0x40,0x40},
+    {0x7F,0x02,0x04,0x02,0x7F}, {0x7F,0x04,0x08,0x10,0x7F}, {0x3E,0x41,0x41,0x41,0x3E},
+    {0x7F,0x09,0x09,0x09,0x06}, {0x3E,0x41,0x51,0x21,0x5E}, {0x7F,0x09,0x19,0x29,0x46},
+    {0x46,0x49,0x49,0x49,0x31}, {0x01,0x01,0x7F,0x01,0x01}, {0x3F,0x40,0x40,0x40,0x3F},
+    {0x1F,0x20,0x40,0x20,0x1F}, {0x7F,0x20,0x18,0x20,0x7F}, {0x63,0x14,0x08,0x14,0x63},
+    {0x03,0x04,0x78,0x04,0x03}, {0x61,0x51,0x49,0x45,0x43}, {0x00,0x7F,0x41,0x41,0x00},
+    {0x02,0x04,0x08,0x10,0x20}, {0x00,0x41,0x41,0x7F,0x00}, {0x04,0x02,0x01,0x02,0x04},
+    {0x40,0x40,0x40,0x40,0x40}, {0x00,0x01,0x02,0x04,0x00}, {0x20,0x54,0x54,0x54,0x78},
+    {0x7F,0x48,0x44,0x44,0x38}, {0x38,0x44,0x44,0x44,0x20}, {0x38,0x44,0x44,0x48,0x7F},
+    {0x38,0x54,0x54,0x54,0x18}, {0x08,0x7E,0x09,0x01,0x02}, {0x08,0x14,0x54,0x54,0x3C},
+    {0x7F,0x08,0x04,0x04,0x78}, {0x00,0x44,0x7D,0x40,0x00}, {0x20,0x40,0x44,0x3D,0x00},
+    {0x00,0x7F,0x10,0x28,0x44}, {0x00,0x41,0x7F,0x40,0x00}, {0x7C,0x04,0x18,0x04,0x78},
+    {0x7C,0x08,0x04,0x04,0x78}, {0x38,0x44,0x44,0x44,0x38}, {0x7C,0x14,0x14,0x14,0x08},
+    {0x08,0x14,0x14,0x18,0x7C}, {0x7C,0x08,0x04,0x04,0x08}, {0x48,0x54,0x54,0x54,0x20},
+    {0x04,0x3F,0x44,0x40,0x20}, {0x3C,0x40,0x40,0x20,0x7C}, {0x1C,0x20,0x40,0x20,0x1C},
+    {0x3C,0x40,0x30,0x40,0x3C}, {0x44,0x28,0x10,0x28,0x44}, {0x0C,0x50,0x50,0x50,0x3C},
+    {0x44,0x64,0x54,0x4C,0x44}, {0x00,0x08,0x36,0x41,0x00}, {0x00,0x00,0x7F,0x00,0x00},
+    {0x00,0x41,0x36,0x08,0x00}, {0x08,0x04,0x08,0x10,0x08},
+};
+
+uint32_t swPack(const float* c) {
+    uint32_t r = (uint32_t)std::min(255.0f, std::max(0.0f, c[0] + 0.5f));
+    uint32_t g = (uint32_t)std::min(255.0f, std::max(0.0f, c[1] + 0.5f));
+    uint32_t b = (uint32_t)std::min(255.0f, std::max(0.0f, c[2] + 0.5f));
+    uint32_t a = (uint32_t)std::min(255.0f, std::max(0.0f, c[3] + 0.5f));
+    return r | g << 8 | b << 16 | a << 24;
+}
+
+// The current GL blend state as one of the modes the tile blender knows.
+// Opaque triangles under the alpha modes simply replace what is there.
+uint8_t swBlendMode(float minAlpha) {
+    if (!sw.blend || (sw.blendSrc == GL_ONE && sw.blendDst == GL_ZERO)) return SW_REPLACE;
+    if (sw.blendSrc == GL_SRC_ALPHA && sw.blendDst == GL_ONE) return SW_ADD;
+    if (minAlpha >= 254.5f) return SW_REPLACE;
+    if (sw.blendSrc == GL_ONE && sw.blendDst == GL_ONE_MINUS_SRC_ALPHA) return SW_PREMULTIPLIED;
+    return SW_ALPHA;
+}
+
+void swAddTriangle(const SwVertex& p0, const SwVertex& p1, const SwVertex& p2) {
+    const SwVertex* v[3] = {&p0, &p1, &p2};
+    float area = (p1.x - p0.x) * (p2.y - p0.y) - (p2.x - p0.x) * (p1.y - p0.y);
+    if (fabs(area) < 1e-6f) return;
+    if (area < 0) {
+        std::swap(v[1], v[2]);
+        area = -area;
+    }
+    SwTriangle t;
+    float minX = std::min(v[0]->x, std::min(v[1]->x, v[2]->x));
+    float maxX = std::max(v[0]->x, std::max(v[1]->x, v[2]->x));
+    float minY = std::min(v[0]->y, std::min(v[1]->y, v[2]->y));
+    float maxY = std::max(v[0]->y, std::max(v[1]->y, v[2]->y));
+    t.x0 = std::max(0, (int)floor(minX));
+    t.y0 = std::max(0, (int)floor(minY));
+    t.x1 = std::min(WINDOW_WIDTH, (int)ceil(maxX) + 1);
+    t.y1 = std::min(WINDOW_HEIGHT, (int)ceil(maxY) + 1);
+    if (t.x0 >= t.x1 || t.y0 >= t.y1) return;
+
+    for (int i = 0; i < 3; i++) {
+        const SwVertex& s = *v[i];
+        const SwVertex& e = *v[(i + 1) % 3];
+        t.a[i] = s.y - e.y;
+        t.b[i] = e.x - s.x;
+        t.c[i] = -(t.a[i] * s.x + t.b[i] * s.y);
+        t.topLeft[i] = t.a[i] > 0 || (t.a[i] == 0 && t.b[i] < 0);
+    }
+    float dx1 = v[1]->x - v[0]->x, dy1 = v[1]->y - v[0]->y;
+    float dx2 = v[2]->x - v[0]->x, dy2 = v[2]->y - v[0]->y;
+    t.isFlat = true;
+    float minAlpha = 255;
+    for (int k = 0; k < 4; k++) {
+        float d1 = v[1]->c[k] - v[0]->c[k], d2 = v[2]->c[k] - v[0]->c[k];
+        t.cx[k] = (d1 * dy2 - d2 * dy1) / area;
+        t.cy[k] = (d2 * dx1 - d1 * dx2) / area;
+        t.c0[k] = v[0]->c[k] - t.cx[k] * v[0]->x - t.cy[k] * v[0]->y;
+        if (d1 != 0 || d2 != 0) t.isFlat = false;
+    }
+    for (int i = 0; i < 3; i++) minAlpha = std::min(minAlpha, v[i]->c[3]);
+    t.flat = swPack(v[0]->c);
+    t.blend = swBlendMode(minAlpha);
+
+    uint32_t index = (uint32_t)sw.triangles.size();
+    sw.triangles.push_back(t);
+    for (int ty = t.y0 / SW_TILE; ty <= (t.y1 - 1) / SW_TILE; ty++) {
+        for (int tx = t.x0 / SW_TILE; tx <= (t.x1 - 1) / SW_TILE; tx++) {
+            sw.bins[ty * SW_TILES_X + tx].push_back(index);
+        }
+    }
+}
+
+void swAddQuad(const SwVertex& a, const SwVertex& b, const SwVertex& c, const SwVertex& d) {
+    swAddTriangle(a, b, c);
+    swAddTriangle(a, c, d);
+}
+
+void swAddLine(const SwVertex& a, const SwVertex& b) {
+    float dx = b.x - a.x, dy = b.y - a.y;
+    float len = sqrt(dx * dx + dy * dy);
+    if (len < 1e-4f) return;
+    float nx = -dy / len * sw.lineWidth / 2, ny = dx / len * sw.lineWidth / 2;
+    SwVertex q[4] = {a, b, b, a};
+    q[0].x += nx; q[0].y += ny;
+    q[1].x += nx; q[1].y += ny;
+    q[2].x -= nx; q[2].y -= ny;
+    q[3].x -= nx; q[3].y -= ny;
+    swAddQuad(q[0], q[1], q[2], q[3]);
+}
+
+void swAddRect(float x, float y, float w, float h, const float* color) {
+    SwVertex q[4];
+    for (int i = 0; i < 4; i++) {
+        memcpy(q[i].c, color, sizeof(q[i].c));
+        q[i].x = x + (i == 1 || i == 2 ? w : 0);
+        q[i].y = y + (i >= 2 ? h : 0);
+    }
+    swAddQuad(q[0], q[1], q[2], q[3]);
+}
+
+// Assembles the vertices of one glBegin/glEnd pair into triangles.
+void swAssemble() {
+    const std::vector<SwVertex>& v = sw.vertices;
+    size_t n = v.size();
+    switch (sw.mode) {
+        case GL_TRIANGLES:
+            for (size_t i = 0; i + 2 < n; i += 3) swAddTriangle(v[i], v[i + 1], v[i + 2]);
+            break;
+        case GL_QUADS:
+            for (size_t i = 0; i + 3 < n; i += 4) swAddQuad(v[i], v[i + 1], v[i + 2], v[i + 3]);
+            break;
+        case GL_TRIANGLE_FAN:
+        case GL_POLYGON:
+            for (size_t i = 1; i + 1 < n; i++) swAddTriangle(v[0], v[i], v[i + 1]);
+            break;
+        case GL_LINES:
+            for (size_t i = 0; i + 1 < n; i += 2) swAddLine(v[i], v[i + 1]);
+            break;
+        case GL_LINE_LOOP:
+            for (size_t i = 0; n > 1 && i < n; i++) swAddLine(v[i], v[(i + 1) % n]);
+            break;
+        case GL_POINTS:
+            for (size_t i = 0; i < n; i++) {
+                swAddRect(v[i].x - sw.pointSize / 2, v[i].y - sw.pointSize / 2,
+                          sw.pointSize, sw.pointSize, v[i].c);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Software text: the 5x7 font at twice (or for the large font three times)
+// its size, one quad per run of lit pixels in a column.
+void swCharacter(void* font, int ch) {
+    int scale = font == GLUT_BITMAP_TIMES_ROMAN_24 ? 3 : 2;
+    if (ch >= 32 && ch < 127) {
+        const uint8_t* glyph = SW_FONT[ch - 32];
+        for (int col = 0; col < 5; col++) {
+            for (int row = 0; row < 7; ) {
+                if (!(glyph[col] >> row & 1)) {
+                    row++;
+                    continue;
+                }
+                int run = row;
+                while (run < 7 && (glyph[col] >> run & 1)) run++;
+                swAddRect(sw.rasterX + col * scale, sw.rasterY + (7 - run) * scale,
+                          scale, (run - row) * scale, sw.rasterColor);
+                row = run;
+            }
+        }
+    }
+    sw.rasterX += 6 * scale;
+}
+
+#ifdef SW_SSE2
+// x / 255 for the 16-bit products below, rounded, exact enough
+inline __m128i swDiv255(__m128i v) {
+    v = _mm_add_epi16(v, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(v, _mm_srli_epi16(v, 8)), 8);
+}
+
+// Four pixels of row at x, the ones in mask replaced by src under the given
+// SwBlend. Sums past 255 saturate in the final pack, as GL clamps them.
+inline void swStore4(uint32_t* row, __m128i src, __m128i mask, uint8_t blend) {
+    __m128i dst = _mm_loadu_si128((const __m128i*)row);
+    if (blend != SW_REPLACE) {
+        __m128i zero = _mm_setzero_si128();
+        __m128i full = _mm_set1_epi16(255);
+        __m128i out[2];
+        for (int h = 0; h < 2; h++) {
+            __m128i s = h ? _mm_unpackhi_epi8(src, zero) : _mm_unpacklo_epi8(src, zero);
+            __m128i d = h ? _mm_unpackhi_epi8(dst, zero) : _mm_unpacklo_epi8(dst, zero);
+            __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)),
+                                            _MM_SHUFFLE(3, 3, 3, 3));
+            if (blend == SW_ALPHA)
+                out[h] = swDiv255(_mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, _mm_sub_epi16(full, a))));
+            else if (blend == SW_ADD)
+                out[h] = _mm_add_epi16(swDiv255(_mm_mullo_epi16(s, a)), d);
+            else
+                out[h] = _mm_add_epi16(swDiv255(_mm_mullo_epi16(d, _mm_sub_epi16(full, a))), s);
+        }
+        src = _mm_or_si128(_mm_packus_epi16(out[0], out[1]), _mm_set1_epi32((int)0xff000000));
+    }
+    _mm_storeu_si128((__m128i*)row, _mm_or_si128(_mm_and_si128(mask, src), _mm_andnot_si128(mask, dst)));
+}
+
+void swSpan(const SwTriangle& t, uint32_t* row, int y, int x0, int x1) {
+    float py = y + 0.5f;
+    __m128 lanes = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+    __m128 zero = _mm_setzero_ps();
+    __m128 a[3], rowc[3];
+    for (int i = 0; i < 3; i++) {
+        a[i] = _mm_set1_ps(t.a[i]);
+        rowc[i] = _mm_set1_ps(t.b[i] * py + t.c[i]);
+    }
+    __m128i flat = _mm_set1_epi32((int)t.flat);
+    for (int x = x0 & ~3; x < x1; x += 4) {
+        __m128 px = _mm_add_ps(_mm_set1_ps((float)x), lanes);
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int i = 0; i < 3; i++) {
+            __m128 e = _mm_add_ps(_mm_mul_ps(a[i], px), rowc[i]);
+            inside = _mm_and_ps(inside, t.topLeft[i] ? _mm_cmpge_ps(e, zero) : _mm_cmpgt_ps(e, zero));
+        }
+        if (_mm_movemask_ps(inside) == 0) continue;
+        __m128i src = flat;
+        if (!t.isFlat) {
+            __m128i packed = _mm_setzero_si128();
+            for (int k = 0; k < 4; k++) {
+                __m128 c = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.cx[k]), px), _mm_set1_ps(t.cy[k] * py + t.c0[k]));
+                c = _mm_min_ps(_mm_max_ps(c, zero), _mm_set1_ps(255.0f));
+                packed = _mm_or_si128(packed, _mm_slli_epi32(_mm_cvtps_epi32(c), 8 * k));
+            }
+            src = packed;
+        }
+        swStore4(row + x, src, _mm_castps_si128(inside), t.blend);
+    }
+}
+#else
+void swSpan(const SwTriangle& t, uint32_t* row, int y, int x0, int x1) {
+    float py = y + 0.5f;
+    for (int x = x0; x < x1; x++) {
+        float px = x + 0.5f;
+        bool inside = true;
+        for (int i = 0; i < 3; i++) {
+            float e = t.a[i] * px + t.b[i] * py + t.c[i];
+            inside = inside && (t.topLeft[i] ? e >= 0 : e > 0);
+        }
+        if (!inside) continue;
+        uint32_t src = t.flat;
+        if (!t.isFlat) {
+            float c[4];
+            for (int k = 0; k < 4; k++) c[k] = t.cx[k] * px + t.cy[k] * py + t.c0[k] - 0.5f;
+            src = swPack(c);
+        }
+        if (t.blend != SW_REPLACE) {
+            uint32_t a = src >> 24, d = row[x], out = 0xff000000;
+            for (int k = 0; k < 24; k += 8) {
+                uint32_t s = (src >> k) & 255, v = (d >> k) & 255;
+                if (t.blend == SW_ALPHA) v = s * a + v * (255 - a) + 128, v = (v + (v >> 8)) >> 8;
+                else if (t.blend == SW_ADD) s = s * a + 128, v += (s + (s >> 8)) >> 8;
+                else v = v * (255 - a) + 128, v = ((v + (v >> 8)) >> 8) + s;
+                out |= std::min(v, 255u) << k;
+            }
+            src = out;
+        }
+        row[x] = src;
+    }
+}
+#endif
+
+void swRasterTile(int tile) {
+    int tx0 = (tile % SW_TILES_X) * SW_TILE, ty0 = (tile / SW_TILES_X) * SW_TILE;
+    int tx1 = std::min(tx0 + SW_TILE, WINDOW_WIDTH), ty1 = std::min(ty0 + SW_TILE, WINDOW_HEIGHT);
+    uint32_t* fb = sw.framebuffer.data();
+    if (sw.clearPending) {
+        for (int y = ty0; y < ty1; y++) std::fill(fb + y * WINDOW_WIDTH + tx0, fb + y * WINDOW_WIDTH + tx1, 0xff000000u);
+    }
+    for (uint32_t index : sw.bins[tile]) {
+        const SwTriangle& t = sw.triangles[index];
+        int x0 = std::max(t.x0, tx0), x1 = std::min(t.x1, tx1);
+        int y0 = std::max(t.y0, ty0), y1 = std::min(t.y1, ty1);
+        for (int y = y0; y < y1; y++) swSpan(t, fb + y * WINDOW_WIDTH, y, x0, x1);
+    }
+}
+
+void swRunTiles() {
+    int tile;
+    while ((tile = sw.nextTile.fetch_add(1)) < SW_TILE_COUNT) {
+        swRasterTile(tile);
+        sw.tilesDone.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void swWorker(int id) {
+    long seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> guard(sw.lock);
+            sw.wake.wait(guard, [&] { return sw.generation != seen; });
+            seen = sw.generation;
+        }
+        if (id < sw.activeThreads) swRunTiles();
+    }
+}
+
+// Worker threads live for the rest of the process; they sleep between frames.
+void swInit() {
+    sw.framebuffer.assign((size_t)WINDOW_WIDTH * WINDOW_HEIGHT, 0xff000000u);
+    sw.triangles.reserve(1 << 14);
+    sw.vertices.reserve(256);
+    sw.matrix[0] = sw.matrix[4] = 1;
+    sw.lineWidth = sw.pointSize = 1;
+    sw.blendSrc = GL_ONE;
+    sw.blendDst = GL_ZERO;
+    sw.color[0] = sw.color[1] = sw.color[2] = sw.color[3] = 255;
+    int cores = std::max(1u, std::thread::hardware_concurrency());
+    sw.activeThreads = cores;
+    for (int id = 1; id < cores; id++) {
+        sw.threads.push_back(std::thread(swWorker, id));
+        sw.threads.back().detach();
+    }
+}
+
+// ---------------- Render commands ----------------
+// With the command buffer on (C toggles it), the gfx* calls between
+// gfxClear() and gfxFinishFrame() are recorded instead of run. Each
+// glBegin/glEnd batch is transformed to window pixels and assembled into
+// triangles, lines or points. Each run of bitmap text keeps its raster
+// position. A batch becomes a command keyed by its layer, which the draw code
+// sets with gfxLayer(), and by its render state: primitive, blending, texture,
+// and line width or point size. gfxFinishFrame() radix-sorts the keys, merges
+// neighbours that share a state into one draw, and submits the draws. GL gets
+// vertex arrays and only the state that changes between draws. The software
+// renderer gets the same triangles in the same order.
+//
+// Layers paint in order. Within a layer, commands are grouped by state only
+// where that cannot change the picture: each gets a pass number one past
+// every earlier command of its layer whose bounds it overlaps with another
+// state, and no lower than one it overlaps with the same state. The key puts
+// the pass above the state and the sort is stable, so any two commands that
+// overlap still paint in the order they were drawn (an additive rock halo
+// stays over that rock and under the next), and the rest group by state.
+// A frame with overlaps too deep for the pass field is submitted unsorted.
+// Batches and state calls issued, and draws and state changes submitted, are
+// printed at exit.
+
+enum RenderLayer {
+    LAYER_BACKGROUND,
+    LAYER_LAVA,
+    LAYER_PLATFORMS,
+    LAYER_PICKUPS,       // coins, key and power-ups
+    LAYER_DOOR,
+    LAYER_DOOR_KNOB,     // over the door's panel lines
+    LAYER_ROCKS,
+    LAYER_GHOST,
+    LAYER_PLAYER,
+    LAYER_HUD,           // and the menus
+    LAYER_BANNER,
+    LAYER_OVERLAY,       // pause button and frame stats
+    LAYER_COUNT
+};
+
+enum CmdPrimitive { CMD_TRIANGLES, CMD_LINES, CMD_POINTS, CMD_TEXT };
+
+struct RenderState {
+    uint8_t primitive;
+    bool blend;
+    GLenum blendSrc, blendDst;   // GL_ONE, GL_ZERO unless blending
+    GLuint texture;              // 0 untextured
+    float size;                  // line width or point size, else 0
+};
+
+struct CmdVertex {
+    float x, y;         // window pixels
+    float u, v;
+    float c[4];         // colour, 0..1
+};
+
+struct TextRun {
+    float x, y;         // window pixels
+    float color[4];
+    void* font;
+    uint32_t first, count;   // in cmd.chars
+};
+
+// Key, most significant first: layer (8 bits), pass (12), then the state:
+// primitive (2), blending (2), textured (1), size in quarter pixels (7).
+struct RenderCommand {
+    uint32_t key;
+    RenderState state;
+    uint32_t first, count;   // vertices, or text runs
+};
+
+// Window rectangle a command can touch.
+struct CmdBounds {
+    float x0, y0, x1, y1;
+    uint32_t key;   // the command's, once its pass is set
+};
+
+struct CmdTileEntry {
+    uint32_t command;
+    uint32_t maxPass;   // the highest pass in the tile up to this entry
+};
+
+struct RenderCommands {
+    bool enabled;
+    RenderLayer layer;
+
+    // state as the draw code last set it; the matrix, line width, point
+    // size and software raster state are mirrored in sw
+    float color[4];
+    float texCoord[2];
+    bool blending, texturing;
+    GLenum blendSrc, blendDst;
+    GLuint texture;
+    float rasterX, rasterY, rasterColor[4];
+    bool textOpen;           // characters continue the last text run
+    GLenum mode;
+
+    std::vector<CmdVertex> batch;        // since gfxBegin()
+    std::vector<CmdVertex> vertices;
+    std::vector<TextRun> text;
+    std::vector<char> chars;
+    std::vector<RenderCommand> commands;
+    std::vector<CmdBounds> bounds;       // by command
+    std::vector<uint32_t> layerOrder;    // commands by layer, then as drawn
+    std::vector<CmdTileEntry> tiles[SW_TILE_COUNT];   // the layer's commands so far
+    std::vector<uint32_t> seen;          // by command: the last one tested against it
+    std::vector<uint32_t> order, scratch;
+    std::vector<CmdVertex> sortedVertices;
+    std::vector<TextRun> sortedText;
+    std::vector<RenderCommand> draws;    // merged, in submission order
+
+    long frames;
+    long batches, stateCalls;            // issued by the draw code
+    long submitted, stateChanges;        // draws and state changes made
+    long recorded;                       // commands, after joining neighbours while recording
+    long unsorted;                       // frames submitted in drawing order
+    double submitMs;
+};
+
+// On unless C turns it off.
+RenderCommands makeRenderCommands() {
+    RenderCommands c = RenderCommands();
+    c.enabled = true;
+    return c;
+}
+
+RenderCommands cmd = makeRenderCommands();
+
+int rockVertexBound();   // see "Quality tiers"
+
+// GL's defaults, for the mirrored state.
+void gfxInit() {
+    sw.matrix[0] = sw.matrix[4] = 1;
+    sw.lineWidth = sw.pointSize = 1;
+    sw.color[0] = sw.color[1] = sw.color[2] = sw.color[3] = 255;
+    cmd.color[0] = cmd.color[1] = cmd.color[2] = cmd.color[3] = 1;
+    sw.blendSrc = cmd.blendSrc = GL_ONE;
+    sw.blendDst = cmd.blendDst = GL_ZERO;
+    cmd.batch.reserve(256);
+    size_t vertices = (size_t)MAX_ROCKS * rockVertexBound() + (1 << 14);   // every rock in view, and the rest
+    cmd.vertices.reserve(vertices);
+    cmd.sortedVertices.reserve(vertices);
+    cmd.text.reserve(64);
+    cmd.sortedText.reserve(64);
+    cmd.chars.reserve(1024);
+    cmd.commands.reserve(1024);
+    cmd.bounds.reserve(1024);
+    cmd.layerOrder.reserve(1024);
+    cmd.seen.reserve(1024);
+    for (std::vector<CmdTileEntry>& tile : cmd.tiles) tile.reserve(64);
+    cmd.draws.reserve(1024);
+    cmd.order.reserve(1024);
+    cmd.scratch.reserve(1024);
+}
+
+void gfxLayer(RenderLayer layer) {
+    cmd.layer = layer;
+}
+
+RenderState cmdState(uint8_t primitive) {
+    RenderState s;
+    s.primitive = primitive;
+    s.blend = cmd.blending;
+    s.blendSrc = s.blend ? cmd.blendSrc : GL_ONE;
+    s.blendDst = s.blend ? cmd.blendDst : GL_ZERO;
+    s.texture = cmd.texturing ? cmd.texture : 0;
+    s.size = primitive == CMD_LINES ? sw.lineWidth : primitive == CMD_POINTS ? sw.pointSize : 0;
+    return s;
+}
+
+bool sameState(const RenderState& a, const RenderState& b) {
+    return a.primitive == b.primitive && a.blend == b.blend && a.blendSrc == b.blendSrc &&
+           a.blendDst == b.blendDst && a.texture == b.texture && a.size == b.size;
+}
+
+uint32_t cmdKey(const RenderState& s) {
+    int blend = 0;
+    if (s.blend) {
+        if (s.blendSrc == GL_SRC_ALPHA && s.blendDst == GL_ONE_MINUS_SRC_ALPHA) blend = 1;
+        else if (s.blendSrc == GL_ONE && s.blendDst == GL_ONE_MINUS_SRC_ALPHA) blend = 2;
+        else blend = 3;
+    }
+    int size = std::min(127, (int)(s.size * 4));
+    return (uint32_t)cmd.layer << 24 | s.primitive << 10 | blend << 8 | (s.texture != 0) << 7 | size;
+}
+
+const uint32_t CMD_STATE_BITS = 0xfff;
+const uint32_t CMD_MAX_PASS = 0xfff;
+
+// Joins the last command when nothing came between them.
+void cmdPush(const RenderState& s, uint32_t first, uint32_t count) {
+    uint32_t key = cmdKey(s);
+    if (!cmd.commands.empty()) {
+        RenderCommand& last = cmd.commands.back();
+        if (last.key == key && sameState(last.state, s) && last.first + last.count == first) {
+            last.count += count;
+            return;
+        }
+    }
+    RenderCommand c = {key, s, first, count};
+    cmd.commands.push_back(c);
+}
+
+void cmdBegin() {
+    gfxRecording = true;
+    cmd.vertices.clear();
+    cmd.text.clear();
+    cmd.chars.clear();
+    cmd.commands.clear();
+    cmd.textOpen = false;
+    cmd.layer = LAYER_BACKGROUND;
+    // Frames start from GL's identity modelview.
+    sw.matrix[0] = sw.matrix[4] = 1;
+    sw.matrix[1] = sw.matrix[2] = sw.matrix[3] = sw.matrix[5] = 0;
+    sw.depth = 0;
+}
+
+// The open batch, assembled like swAssemble() does.
+void cmdBatch() {
+    cmd.batches++;
+    const std::vector<CmdVertex>& v = cmd.batch;
+    std::vector<CmdVertex>& out = cmd.vertices;
+    size_t n = v.size(), first = out.size();
+    uint8_t primitive = CMD_TRIANGLES;
+    switch (cmd.mode) {
+        case GL_TRIANGLES:
+            out.insert(out.end(), v.begin(), v.begin() + n / 3 * 3);
+            break;
+        case GL_QUADS:
+            for (size_t i = 0; i + 3 < n; i += 4) {
+                out.push_back(v[i]); out.push_back(v[i + 1]); out.push_back(v[i + 2]);
+                out.push_back(v[i]); out.push_back(v[i + 2]); out.push_back(v[i + 3]);
+            }
+            break;
+        case GL_TRIANGLE_FAN:
+        case GL_POLYGON:
+            for (size_t i = 1; i + 1 < n; i++) {
+                out.push_back(v[0]); out.push_back(v[i]); out.push_back(v[i + 1]);
+            }
+            break;
+        case GL_LINES:
+            primitive = CMD_LINES;
+            out.insert(out.end(), v.begin(), v.begin() + n / 2 * 2);
+            break;
+        case GL_LINE_LOOP:
+            primitive = CMD_LINES;
+            for (size_t i = 0; n > 1 && i < n; i++) {
+                out.push_back(v[i]); out.push_back(v[(i + 1) % n]);
+            }
+            break;
+        case GL_POINTS:
+            primitive = CMD_POINTS;
+            out.insert(out.end(), v.begin(), v.end());
+            break;
+        default:
+            break;
+    }
+    if (out.size() > first) cmdPush(cmdState(primitive), (uint32_t)first, (uint32_t)(out.size() - first));
+}
+
+void cmdText(void* font, int ch) {
+    if (!cmd.textOpen) {
+        cmd.batches++;
+        TextRun run = {cmd.rasterX, cmd.rasterY, {0, 0, 0, 0}, font, (uint32_t)cmd.chars.size(), 0};
+        memcpy(run.color, cmd.rasterColor, sizeof(run.color));
+        cmd.text.push_back(run);
+        cmd.textOpen = true;
+        cmdPush(cmdState(CMD_TEXT), (uint32_t)cmd.text.size() - 1, 1);
+    }
+    cmd.chars.push_back((char)ch);
+    cmd.text.back().count++;
+}
+
+// What submission has set so far; -1, GL_INVALID_ENUM and ~0 mean not yet.
+struct CmdApplied {
+    int blend, texturing;
+    GLenum blendSrc, blendDst;
+    GLuint texture;
+    float lineWidth, pointSize;
+};
+
+void cmdBlend(CmdApplied& gl, bool on) {
+    if (gl.blend == (int)on) return;
+    gl.blend = on;
+    cmd.stateChanges++;
+    if (softwareRendering) sw.blend = on;
+    else if (on) glEnable(GL_BLEND);
+    else glDisable(GL_BLEND);
+}
+
+void cmdBlendFunc(CmdApplied& gl, GLenum src, GLenum dst) {
+    if (gl.blendSrc == src && gl.blendDst == dst) return;
+    gl.blendSrc = src;
+    gl.blendDst = dst;
+    cmd.stateChanges++;
+    if (softwareRendering) sw.blendSrc = src, sw.blendDst = dst;
+    else glBlendFunc(src, dst);
+}
+
+void cmdTexture(CmdApplied& gl, bool on, GLuint texture) {
+    if (softwareRendering) return;
+    if (gl.texturing != (int)on) {
+        gl.texturing = on;
+        cmd.stateChanges++;
+        if (on) glEnable(GL_TEXTURE_2D);
+        else glDisable(GL_TEXTURE_2D);
+    }
+    if (on && gl.texture != texture) {
+        gl.texture = texture;
+        cmd.stateChanges++;
+        glBindTexture(GL_TEXTURE_2D, texture);
+    }
+}
+
+void cmdLineWidth(CmdApplied& gl, float width) {
+    if (gl.lineWidth == width) return;
+    gl.lineWidth = width;
+    cmd.stateChanges++;
+    if (softwareRendering) sw.lineWidth = width;
+    else glLineWidth(width);
+}
+
+void cmdPointSize(CmdApplied& gl, float size) {
+    if (gl.pointSize == size) return;
+    gl.pointSize = size;
+    cmd.stateChanges++;
+    if (softwareRendering) sw.pointSize = size;
+    else glPointSize(size);
+}
+
+SwVertex swVertex(const CmdVertex& v) {
+    SwVertex s = {v.x, v.y, {v.c[0] * 255, v.c[1] * 255, v.c[2] * 255, v.c[3] * 255}};
+    return s;
+}
+
+void cmdDraw(const RenderCommand& d) {
+    if (d.state.primitive == CMD_TEXT) {
+        for (uint32_t i = d.first; i < d.first + d.count; i++) {
+            const TextRun& t = cmd.sortedText[i];
+            cmd.submitted++;
+            if (softwareRendering) {
+                sw.rasterX = t.x;
+                sw.rasterY = t.y;
+                for (int k = 0; k < 4; k++) sw.rasterColor[k] = t.color[k] * 255;
+                for (uint32_t c = t.first; c < t.first + t.count; c++) swCharacter(t.font, cmd.chars[c]);
+            } else {
+                glColor4fv(t.color);
+                glRasterPos2f(t.x, t.y);
+                for (uint32_t c = t.first; c < t.first + t.count; c++) glutBitmapCharacter(t.font, cmd.chars[c]);
+            }
+        }
+        return;
+    }
+    cmd.submitted++;
+    if (!softwareRendering) {
+        GLenum mode = d.state.primitive == CMD_LINES ? GL_LINES :
+                      d.state.primitive == CMD_POINTS ? GL_POINTS : GL_TRIANGLES;
+        glDrawArrays(mode, d.first, d.count);
+        return;
+    }
+    const CmdVertex* v = &cmd.sortedVertices[d.first];
+    if (d.state.primitive == CMD_TRIANGLES) {
+        for (uint32_t i = 0; i + 2 < d.count; i += 3) swAddTriangle(swVertex(v[i]), swVertex(v[i + 1]), swVertex(v[i + 2]));
+    } else if (d.state.primitive == CMD_LINES) {
+        for (uint32_t i = 0; i + 1 < d.count; i += 2) swAddLine(swVertex(v[i]), swVertex(v[i + 1]));
+    } else {
+        for (uint32_t i = 0; i < d.count; i++) {
+            SwVertex p = swVertex(v[i]);
+            swAddRect(p.x - sw.pointSize / 2, p.y - sw.pointSize / 2, sw.pointSize, sw.pointSize, p.c);
+        }
+    }
+}
+
+// Text is measured generously: the tallest font's cell for each character.
+CmdBounds cmdBounds(const RenderCommand& c) {
+    CmdBounds b = {1e30f, 1e30f, -1e30f, -1e30f, 0};
+    if (c.state.primitive == CMD_TEXT) {
+        for (uint32_t i = c.first; i < c.first + c.count; i++) {
+            const TextRun& t = cmd.text[i];
+            b.x0 = std::min(b.x0, t.x);
+            b.y0 = std::min(b.y0, t.y - 8.0f);
+            b.x1 = std::max(b.x1, t.x + 24.0f * t.count);
+            b.y1 = std::max(b.y1, t.y + 26.0f);
+        }
+        return b;
+    }
+    for (uint32_t i = c.first; i < c.first + c.count; i++) {
+        const CmdVertex& v = cmd.vertices[i];
+        b.x0 = std::min(b.x0, v.x);
+        b.y0 = std::min(b.y0, v.y);
+        b.x1 = std::max(b.x1, v.x);
+        b.y1 = std::max(b.y1, v.y);
+    }
+    float pad = c.state.size / 2 + 1;   // a line's or point's width, and a pixel for rounding
+    b.x0 -= pad;
+    b.y0 -= pad;
+    b.x1 += pad;
+    b.y1 += pad;
+    return b;
+}
+
+// Gives each command its pass, as described at the top of this section, or
+// returns false if a pass does not fit in the key. A layer's commands are
+// binned by the software renderer's tiles, so each is only tested against
+// the earlier ones sharing a tile, newest first, and the scan of a tile stops
+// once nothing older in it has a pass high enough to matter.
+bool cmdAssignPasses() {
+    size_t n = cmd.commands.size();
+    cmd.bounds.resize(n);
+    cmd.seen.assign(n, (uint32_t)n);
+
+    // Layer by layer, in drawing order within each.
+    uint32_t offset[257] = {0};
+    for (const RenderCommand& c : cmd.commands) offset[(c.key >> 24) + 1]++;
+    for (int d = 0; d < 256; d++) offset[d + 1] += offset[d];
+    cmd.layerOrder.resize(n);
+    for (size_t i = 0; i < n; i++) cmd.layerOrder[offset[cmd.commands[i].key >> 24]++] = (uint32_t)i;
+
+    bool fits = true;
+    uint32_t layer = ~0u;
+    for (uint32_t i : cmd.layerOrder) {
+        RenderCommand& c = cmd.commands[i];
+        if (c.key >> 24 != layer) {
+            layer = c.key >> 24;
+            for (std::vector<CmdTileEntry>& tile : cmd.tiles) tile.clear();
+        }
+        CmdBounds& b = cmd.bounds[i] = cmdBounds(c);
+        int tx0 = std::min(std::max((int)floorf(b.x0 / SW_TILE), 0), SW_TILES_X - 1);
+        int tx1 = std::min(std::max((int)floorf(b.x1 / SW_TILE), 0), SW_TILES_X - 1);
+        int ty0 = std::min(std::max((int)floorf(b.y0 / SW_TILE), 0), SW_TILES_Y - 1);
+        int ty1 = std::min(std::max((int)floorf(b.y1 / SW_TILE), 0), SW_TILES_Y - 1);
+        uint32_t state = c.key & CMD_STATE_BITS, pass = 0;
+        for (int ty = ty0; ty <= ty1; ty++) {
+            for (int tx = tx0; tx <= tx1; tx++) {
+                const std::vector<CmdTileEntry>& tile = cmd.tiles[ty * SW_TILES_X + tx];
+                for (size_t k = tile.size(); k-- > 0 && tile[k].maxPass >= pass;) {
+                    uint32_t j = tile[k].command;
+                    if (cmd.seen[j] == i) continue;   // met in another tile
+                    cmd.seen[j] = i;
+                    const CmdBounds& o = cmd.bounds[j];
+                    if (b.x0 > o.x1 || o.x0 > b.x1 || b.y0 > o.y1 || o.y0 > b.y1) continue;
+                    pass = std::max(pass, (o.key >> 12 & CMD_MAX_PASS) + ((o.key & CMD_STATE_BITS) != state));
+                }
+            }
+        }
+        if (pass > CMD_MAX_PASS) {
+            fits = false;
+            pass = CMD_MAX_PASS;
+        }
+        c.key |= pass << 12;
+        b.key = c.key;
+        for (int ty = ty0; ty <= ty1; ty++) {
+            for (int tx = tx0; tx <= tx1; tx++) {
+                std::vector<CmdTileEntry>& tile = cmd.tiles[ty * SW_TILES_X + tx];
+                CmdTileEntry e = {i, tile.empty() ? pass : std::max(pass, tile.back().maxPass)};
+                tile.push_back(e);
+            }
+        }
+    }
+    return fits;
+}
+
+void cmdSubmit() {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    gfxRecording = false;
+    size_t n = cmd.commands.size();
+    bool sorting = cmdAssignPasses();
+    if (!sorting) cmd.unsorted++;
+
+    // Stable LSD radix sort of the keys, a byte at a time. Overlaps too deep
+    // for the pass field leave the frame in drawing order.
+    cmd.order.resize(n);
+    cmd.scratch.resize(n);
+    for (size_t i = 0; i < n; i++) cmd.order[i] = (uint32_t)i;
+    for (int shift = 0; sorting && shift < 32; shift += 8) {
+        uint32_t offset[257] = {0};
+        for (const RenderCommand& c : cmd.commands) offset[(c.key >> shift & 255) + 1]++;
+        for (int d = 0; d < 256; d++) offset[d + 1] += offset[d];
+        for (uint32_t i : cmd.order) cmd.scratch[offset[cmd.commands[i].key >> shift & 255]++] = i;
+        cmd.order.swap(cmd.scratch);
+    }
+
+    // Lay the commands out in that order and merge neighbours.
+    cmd.sortedVertices.clear();
+    cmd.sortedText.clear();
+    cmd.draws.clear();
+    for (uint32_t i : cmd.order) {
+        const RenderCommand& c = cmd.commands[i];
+        uint32_t first;
+        if (c.state.primitive == CMD_TEXT) {
+            first = (uint32_t)cmd.sortedText.size();
+            cmd.sortedText.insert(cmd.sortedText.end(), cmd.text.begin() + c.first,
+                                  cmd.text.begin() + c.first + c.count);
+        } else {
+            first = (uint32_t)cmd.sortedVertices.size();
+            cmd.sortedVertices.insert(cmd.sortedVertices.end(), cmd.vertices.begin() + c.first,
+                                      cmd.vertices.begin() + c.first + c.count);
+        }
+        if (!cmd.draws.empty() && sameState(cmd.draws.back().state, c.state)) {
+            cmd.draws.back().count += c.count;
+        } else {
+            RenderCommand d = {c.key, c.state, first, c.count};
+            cmd.draws.push_back(d);
+        }
+    }
+
+    CmdApplied gl = {-1, -1, GL_INVALID_ENUM, GL_INVALID_ENUM, ~0u, -1, -1};
+    float lineWidth = sw.lineWidth, pointSize = sw.pointSize;
+    if (!softwareRendering && !cmd.sortedVertices.empty()) {
+        const CmdVertex* v = cmd.sortedVertices.data();
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glVertexPointer(2, GL_FLOAT, sizeof(CmdVertex), &v->x);
+        glTexCoordPointer(2, GL_FLOAT, sizeof(CmdVertex), &v->u);
+        glColorPointer(4, GL_FLOAT, sizeof(CmdVertex), v->c);
+    }
+    for (const RenderCommand& d : cmd.draws) {
+        const RenderState& s = d.state;
+        cmdBlend(gl, s.blend);
+        if (s.blend) cmdBlendFunc(gl, s.blendSrc, s.blendDst);
+        cmdTexture(gl, s.texture != 0, s.texture);
+        if (s.primitive == CMD_LINES) cmdLineWidth(gl, s.size);
+        if (s.primitive == CMD_POINTS) cmdPointSize(gl, s.size);
+        cmdDraw(d);
+    }
+    if (!softwareRendering && !cmd.sortedVertices.empty()) {
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glDisableClientState(GL_COLOR_ARRAY);
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    }
+
+    // Leave the state as the draw code set it, for anything drawn directly.
+    cmdBlend(gl, cmd.blending);
+    cmdBlendFunc(gl, cmd.blendSrc, cmd.blendDst);
+    cmdTexture(gl, cmd.texturing, cmd.texture);
+    if (!softwareRendering && gl.texture != cmd.texture) {
+        glBindTexture(GL_TEXTURE_2D, cmd.texture);
+        cmd.stateChanges++;
+    }
+    cmdLineWidth(gl, lineWidth);
+    cmdPointSize(gl, pointSize);
+    if (!softwareRendering) glColor4fv(cmd.color);
+
+    cmd.frames++;
+    cmd.recorded += n;
+    cmd.submitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void printCommandStats() {
+    if (cmd.frames == 0) return;
+    double frames = cmd.frames;
+    fprintf(stderr, "render commands: %.0f batches and %.0f state calls issued per frame, "
+                    "%.0f draws and %.0f state changes submitted (%.0f commands, %.3f ms sort and submit); "
+                    "%ld frames unsorted\n",
+            cmd.batches / frames, cmd.stateCalls / frames, cmd.submitted / frames,
+            cmd.stateChanges / frames, cmd.recorded / frames, cmd.submitMs / frames, cmd.unsorted);
+}
+
+// Starts a frame, recorded when the command buffer is on.
+void gfxClear(GLbitfield mask) {
+    if (cmd.enabled) cmdBegin();
+    if (!softwareRendering) {
+        glClear(mask);
+        return;
+    }
+    sw.triangles.clear();
+    for (std::vector<uint32_t>& bin : sw.bins) bin.clear();
+    sw.clearPending = true;
+}
+
+// Submits the recorded commands. The software renderer then rasterizes
+// everything since gfxClear(); in a window, it also shows it.
+void gfxFinishFrame() {
+    if (gfxRecording) cmdSubmit();
+    if (!softwareRendering) return;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    sw.tilesDone.store(0);
+    sw.nextTile.store(0);
+    if (sw.activeThreads > 1) {
+        {
+            std::lock_guard<std::mutex> guard(sw.lock);
+            sw.generation++;
+        }
+        sw.wake.notify_all();
+    }
+    swRunTiles();
+    while (sw.tilesDone.load(std::memory_order_acquire) < SW_TILE_COUNT) std::this_thread::yield();
+    sw.clearPending = false;
+    sw.rasterMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    sw.frames++;
+    sw.triangleCount += sw.triangles.size();
+    if (sw.present) {
+        glRasterPos2i(0, 0);
+        glDrawPixels(WINDOW_WIDTH, WINDOW_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, sw.framebuffer.data());
+    }
+}
+
+void printSoftwareStats() {
+    if (sw.frames == 0) return;
+    fprintf(stderr, "software renderer: %ld frames, %.0f triangles and %.2f ms raster per frame on %d threads\n",
+            sw.frames, (double)sw.triangleCount / sw.frames, sw.rasterMs / sw.frames, sw.activeThreads);
+}
+
+void swTransform(float x, float y, float& ox, float& oy) {
+    const float* m = sw.matrix;
+    ox = m[0] * x + m[1] * y + m[2];
+    oy = m[3] * x + m[4] * y + m[5];
+}
+
+// Right-multiplies the current matrix by [a b c; d e f].
+void swMultiply(float a, float b, float c, float d, float e, float f) {
+    float* m = sw.matrix;
+    float r[6] = {m[0] * a + m[1] * d, m[0] * b + m[1] * e, m[0] * c + m[1] * f + m[2],
+                  m[3] * a + m[4] * d, m[3] * b + m[4] * e, m[3] * c + m[4] * f + m[5]};
+    memcpy(m, r, sizeof(r));
+}
+
+// GL itself only when neither recording nor rendering in software.
+bool gfxDirect() {
+    return !softwareRendering && !gfxRecording;
+}
+
+void gfxBegin(GLenum mode) {
+    if (gfxRecording) {
+        cmd.mode = mode;
+        cmd.batch.clear();
+        return;
+    }
+    if (!softwareRendering) {
+        glBegin(mode);
+        return;
+    }
+    sw.mode = mode;
+    sw.vertices.clear();
+}
+
+void gfxEnd() {
+    if (gfxRecording) {
+        cmdBatch();
+        return;
+    }
+    if (!softwareRendering) {
+        glEnd();
+        return;
+    }
+    swAssemble();
+}
+
+void gfxVertex2f(float x, float y) {
+    gfxVertexCount++;
+    if (gfxRecording) {
+        CmdVertex v;
+        swTransform(x, y, v.x, v.y);
+        v.u = cmd.texCoord[0];
+        v.v = cmd.texCoord[1];
+        memcpy(v.c, cmd.color, sizeof(v.c));
+        cmd.batch.push_back(v);
+        return;
+    }
+    if (!softwareRendering) {
+        glVertex2f(x, y);
+        return;
+    }
+    SwVertex v;
+    swTransform(x, y, v.x, v.y);
+    memcpy(v.c, sw.color, sizeof(v.c));
+    sw.vertices.push_back(v);
+}
+
+void gfxColor4f(float r, float g, float b, float a) {
+    cmd.color[0] = r;
+    cmd.color[1] = g;
+    cmd.color[2] = b;
+    cmd.color[3] = a;
+    if (gfxDirect()) {
+        glColor4f(r, g, b, a);
+        return;
+    }
+    sw.color[0] = r * 255;
+    sw.color[1] = g * 255;
+    sw.color[2] = b * 255;
+    sw.color[3] = a * 255;
+}
+
+void gfxColor3f(float r, float g, float b) {
+    gfxColor4f(r, g, b, 1.0f);
+}
+
+void gfxLineWidth(float width) {
+    if (gfxRecording) cmd.stateCalls++;
+    else if (!softwareRendering) glLineWidth(width);
+    sw.lineWidth = width;
+}
+
+void gfxPointSize(float size) {
+    if (gfxRecording) cmd.stateCalls++;
+    else if (!softwareRendering) glPointSize(size);
+    sw.pointSize = size;
+}
+
+void gfxPushMatrix() {
+    if (gfxDirect()) {
+        glPushMatrix();
+        return;
+    }
+    if (sw.depth < SW_MATRIX_DEPTH) memcpy(sw.stack[sw.depth], sw.matrix, sizeof(sw.matrix));
+    sw.depth++;
+}
+
+void gfxPopMatrix() {
+    if (gfxDirect()) {
+        glPopMatrix();
+        return;
+    }
+    sw.depth--;
+    if (sw.depth < SW_MATRIX_DEPTH) memcpy(sw.matrix, sw.stack[sw.depth], sizeof(sw.matrix));
+}
+
+void gfxTranslatef(float x, float y, float z) {
+    if (gfxDirect()) {
+        glTranslatef(x, y, z);
+        return;
+    }
+    swMultiply(1, 0, x, 0, 1, y);
+}
+
+void gfxRotatef(float degrees, float x, float y, float z) {
+    if (gfxDirect()) {
+        glRotatef(degrees, x, y, z);
+        return;
+    }
+    float r = degrees * 3.14159265f / 180.0f;   // only ever about z
+    swMultiply(cos(r), -sin(r), 0, sin(r), cos(r), 0);
+}
+
+void gfxScalef(float x, float y, float z) {
+    if (gfxDirect()) {
+        glScalef(x, y, z);
+        return;
+    }
+    swMultiply(x, 0, 0, 0, y, 0);
+}
+
+void gfxEnable(GLenum cap) {
+    if (cap == GL_BLEND) cmd.blending = true;
+    if (cap == GL_TEXTURE_2D) cmd.texturing = true;
+    if (gfxRecording) cmd.stateCalls++;
+    else if (!softwareRendering) glEnable(cap);
+    else if (cap == GL_BLEND) sw.blend = true;
+}
+
+void gfxDisable(GLenum cap) {
+    if (cap == GL_BLEND) cmd.blending = false;
+    if (cap == GL_TEXTURE_2D) cmd.texturing = false;
+    if (gfxRecording) cmd.stateCalls++;
+    else if (!softwareRendering) glDisable(cap);
+    else if (cap == GL_BLEND) sw.blend = false;
+}
+
+void gfxBlendFunc(GLenum src, GLenum dst) {
+    cmd.blendSrc = src;
+    cmd.blendDst = dst;
+    if (gfxRecording) cmd.stateCalls++;
+    else if (!softwareRendering) glBlendFunc(src, dst);
+    else sw.blendSrc = src, sw.blendDst = dst;
+}
+
+void gfxBindTexture(GLuint texture) {
+    cmd.texture = texture;
+    if (gfxRecording) cmd.stateCalls++;
+    else if (!softwareRendering) glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+void gfxTexCoord2f(float s, float t) {
+    cmd.texCoord[0] = s;
+    cmd.texCoord[1] = t;
+    if (gfxDirect()) glTexCoord2f(s, t);
+}
+
+void gfxRasterPos2f(float x, float y) {
+    if (gfxRecording) {
+        swTransform(x, y, cmd.rasterX, cmd.rasterY);
+        memcpy(cmd.rasterColor, cmd.color, sizeof(cmd.color));
+        cmd.textOpen = false;
+        return;
+    }
+    if (!softwareRendering) {
+        glRasterPos2f(x, y);
+        return;
+    }
+    swTransform(x, y, sw.rasterX, sw.rasterY);
+    memcpy(sw.rasterColor, sw.color, sizeof(sw.color));
+}
+
+void gfxBitmapCharacter(void* font, int ch) {
+    if (gfxRecording) {
+        cmdText(font, ch);
+        return;
+    }
+    if (!softwareRendering) {
+        glutBitmapCharacter(font, ch);
+        return;
+    }
+    swCharacter(font, ch);
+}
+void drawText(float x, float y, const char* text) {
+    gfxRasterPos2f(x, y);
+    while (*text) {
+        gfxBitmapCharacter(GLUT_BITMAP_HELVETICA_18, *text);
+        text++;
+    }
+}
+
+void drawLargeText(float x, float y, const char* text) {
+    gfxRasterPos2f(x, y);
+    while (*text) {
+        gfxBitmapCharacter(GLUT_BITMAP_TIMES_ROMAN_24, *text);
+        text++;
+    }
+}
+
+// ---------------- Level of detail ----------------
+// The procedural shapes with the most geometry (rocks, the shield aura and
+// coins) take their segment and layer counts from the current quality tier.
+// The governor in the frame pacing section moves between tiers based on
+// measured frame time; --quality N pins a tier instead.
+
+struct QualityTier {
+    const char* name;
+    int rockLayers;       // gradient polygons per rock
+    int rockSegments;     // vertices per layer
+    int rockCracks;
+    int rockHaloSegments; // 0: no additive halo
+    int auraSegments;
+    int coinSegments;
+};
+
+const QualityTier QUALITY_TIERS[] = {
+    {"full",   6, 12, 3, 20, 40, 20},
+    {"high",   4, 10, 2, 12, 24, 14},
+    {"medium", 2,  8, 1,  0, 16, 10},
+    {"low",    1,  6, 0,  0, 12,  8},
+};
+const int QUALITY_TIER_COUNT = 4;
+
+int qualityTier = 0;          // index into QUALITY_TIERS; 0 is the original look
+bool qualityPinned = false;   // set by --quality
+
+const QualityTier& quality() {
+    return QUALITY_TIERS[qualityTier];
+}
+
+// Most vertices drawRocks() emits for one rock on any tier: the gradient
+// polygons and the halo as triangle fans, and three per crack.
+int rockVertexBound() {
+    int most = 0;
+    for (const QualityTier& q : QUALITY_TIERS) {
+        int fan = (q.rockSegments - 2) * 3;
+        int halo = q.rockHaloSegments > 2 ? (q.rockHaloSegments - 2) * 3 : 0;
+        most = std::max(most, q.rockLayers * fan + q.rockCracks * 3 + halo);
+    }
+    return most;
+}
+
+// The sprites below are drawn at an explicit position so the atlas can
+// rasterize them once; the draw* functions that place them in the level
+// live in the sprite atlas section.
+void drawPlayerShape(float x, float y, float w, float h, bool aura) {
+    // Power-up aura (glow)
+    if (aura) {
+        gfxColor4f(0.2f, 0.6f, 1.0f, 0.4f); // soft blue aura with transparency
+        gfxBegin(GL_TRIANGLE_FAN);
+        gfxVertex2f(x, y + h / 2);
+        int segments = quality().auraSegments;
+        for (int i = 0; i <= segments; i++) {
+            float angle = i * 2.0f * 3.14159f / segments;
+            gfxVertex2f(x + cos(angle) * (w / 2 + 10), y + h / 2 + sin(angle) * (h / 2 + 10));
+        }
+        gfxEnd();
+    }
+
+    // === BODY (Shirt) ===
+    gfxColor3f(0.2f, 0.4f, 0.9f); // bright blue shirt
+    gfxBegin(GL_QUADS);
+    gfxVertex2f(x - w / 2, y + h * 0.25f);
+    gfxVertex2f(x + w / 2, y + h * 0.25f);
+    gfxVertex2f(x + w / 2, y + h * 0.7f);
+    gfxVertex2f(x - w / 2, y + h * 0.7f);
+    gfxEnd();
+
+    // === LEGS ===
+    gfxColor3f(0.1f, 0.1f, 0.2f); // dark navy pants
+    float legWidth = w / 3.5f;
+    float legHeight = h * 0.25f;
+
+    // Left leg
+    gfxBegin(GL_QUADS);
+    gfxVertex2f(x - legWidth - 2, y);
+    gfxVertex2f(x - 2, y);
+    gfxVertex2f(x - 2, y + legHeight);
+    gfxVertex2f(x - legWidth - 2, y + legHeight);
+    gfxEnd();
+
+    // Right leg
+    gfxBegin(GL_QUADS);
+    gfxVertex2f(x + 2, y);
+    gfxVertex2f(x + legWidth + 2, y);
+    gfxVertex2f(x + legWidth + 2, y + legHeight);
+    gfxVertex2f(x + 2, y + legHeight);
+    gfxEnd();
+
+    // === SHOES ===
+    gfxColor3f(0.2f, 0.05f, 0.05f); // brown shoes
+    float shoeHeight = 4.0f;
+    gfxBegin(GL_QUADS);
+    // left shoe
+    gfxVertex2f(x - legWidth - 2, y);
+    gfxVertex2f(x - 2, y);
+    gfxVertex2f(x - 2, y - shoeHeight);
+    gfxVertex2f(x - legWidth - 2, y - shoeHeight);
+    // right shoe
+    gfxVertex2f(x + 2, y);
+    gfxVertex2f(x + legWidth + 2, y);
+    gfxVertex2f(x + legWidth + 2, y - shoeHeight);
+    gfxVertex2f(x + 2, y - shoeHeight);
+    gfxEnd();
+
+    // === HEAD ===
+    gfxColor3f(0.95f, 0.78f, 0.55f); // lighter, warmer skin tone
+    gfxBegin(GL_TRIANGLE_FAN);
+    gfxVertex2f(x, y + h * 0.88f);
+    for (int i = 0; i <= 20; i++) {
+        float angle = i * 2.0f * 3.14159f / 20;
+        gfxVertex2f(x + cos(angle) * w / 3, y + h * 0.88f + sin(angle) * w / 3);
+    }
+    gfxEnd();
+
+    // === CAP ===
+    gfxColor3f(0.8f, 0.1f, 0.1f); // deep red
+    gfxBegin(GL_POLYGON);
+    gfxVertex2f(x - w / 2.5f, y + h * 0.97f);
+    gfxVertex2f(x + w / 2.5f, y + h * 0.97f);
+    gfxVertex2f(x + w / 2.2f, y + h * 1.05f);
+    gfxVertex2f(x - w / 2.2f, y + h * 1.05f);
+    gfxEnd();
+
+    // Cap brim
+    gfxColor3f(0.6f, 0.05f, 0.05f);
+    gfxBegin(GL_QUADS);
+    gfxVertex2f(x - w / 2, y + h * 0.95f);
+    gfxVertex2f(x + w / 2, y + h * 0.95f);
+    gfxVertex2f(x + w / 2, y + h * 0.97f);
+    gfxVertex2f(x - w / 2, y + h * 0.97f);
+    gfxEnd();
+
+    // Cap button
+    gfxColor3f(0.95f, 0.95f, 0.95f);
+    gfxBegin(GL_TRIANGLE_FAN);
+    gfxVertex2f(x, y + h * 1.05f);
+    for (int i = 0; i <= 12; i++) {
+        float angle = i * 2.0f * 3.14159f / 12;
+        gfxVertex2f(x + cos(angle) * 3, y + h * 1.05f + sin(angle) * 3);
+    }
+    gfxEnd();
+
+    // === EYES ===
+    gfxColor3f(0.1f, 0.1f, 0.1f);
+    gfxPointSize(4);
+    gfxBegin(GL_POINTS);
+    gfxVertex2f(x - w / 6, y + h * 0.88f);
+    gfxVertex2f(x + w / 6, y + h * 0.88f);
+    gfxEnd();
+
+    // === ARMS ===
+    gfxLineWidth(3);
+    gfxColor3f(0.95f, 0.78f, 0.55f);
+    gfxBegin(GL_LINES);
+    gfxVertex2f(x - w / 2, y + h * 0.55f);
+    gfxVertex2f(x - w / 2 - 8, y + h * 0.35f);
+    gfxVertex2f(x + w / 2, y + h * 0.55f);
+    gfxVertex2f(x + w / 2 + 8, y + h * 0.35f);
+    gfxEnd();
+}
+
+// ---------------- View ----------------
+// Levels can be taller than the window (--tall). drawScene() draws the world
+// layers shifted down by world.cameraY, and each draw function skips
+// anything wholly outside [viewBottom, viewTop] before it emits geometry.
+// Platforms are generated bottom-up, so the visible ones are a contiguous
+// run found by binary search. The other lists are short, or (rocks) spawn
+// near the view and die below it. Either way, the vertices a frame emits
+// follow what is on screen rather than the level's size.
+
+float viewBottom = 0;
+float viewTop = WINDOW_HEIGHT;
+bool viewCulling = true;   // V toggles, for comparison
+
+struct ViewStats {
+    long frames;
+    long vertices;         // emitted while drawing the scene
+    long platformsDrawn;
+    long platformsTotal;
+};
+
+ViewStats viewStats;
+
+void setView(float cameraY) {
+    viewBottom = cameraY;
+    viewTop = cameraY + WINDOW_HEIGHT;
+}
+
+bool inView(float y0, float y1) {
+    return !viewCulling || (y1 >= viewBottom && y0 <= viewTop);
+}
+
+// Index of the lowest platform that reaches up into the view.
+size_t firstVisiblePlatform() {
+    if (!viewCulling) return 0;
+    return std::partition_point(platforms.begin(), platforms.end(),
+                                [](const Platform& p) { return p.y + p.height < viewBottom; }) -
+           platforms.begin();
+}
+
+void printViewStats() {
+    if (viewStats.frames == 0) return;
+    fprintf(stderr, "view: %.0f vertices per frame, %.1f of %.1f platforms drawn\n",
+            (double)viewStats.vertices / viewStats.frames,
+            (double)viewStats.platformsDrawn / viewStats.frames,
+            (double)viewStats.platformsTotal / viewStats.frames);
+}
+
+// Body and highlight colours by PlatformKind: grey rock, then cooler and
+// warmer stone for the moving kinds, sandstone for crumbling and dark
+// slate under a conveyor's chevrons.
+const float PLATFORM_TINTS[PLATFORM_KINDS][6] = {
+    {0.4f, 0.4f, 0.42f, 0.55f, 0.55f, 0.58f},
+    {0.36f, 0.42f, 0.5f, 0.5f, 0.57f, 0.66f},
+    {0.46f, 0.4f, 0.5f, 0.61f, 0.55f, 0.66f},
+    {0.52f, 0.43f, 0.32f, 0.66f, 0.57f, 0.44f},
+    {0.3f, 0.32f, 0.35f, 0.45f, 0.47f, 0.5f},
+};
+
+void drawPlatforms() {
+    viewStats.platformsTotal += platforms.size();
+    for (size_t i = firstVisiblePlatform(); i < platforms.size(); i++) {
+        const Platform& p = platforms[i];
+        if (viewCulling && p.y > viewTop) break;
+        if (p.destroyed) continue;
+        viewStats.platformsDrawn++;
+
+        float x = p.x;
+        float y = p.y;
+        float w = p.width;
+        float h = p.height;
+        const float* tint = PLATFORM_TINTS[p.kind];
+        if (p.crumbling) x += (gameTime & 2) ? 1.5f : -1.5f;   // shaking loose
+
+        // Rock base color
+        gfxColor3f(tint[0], tint[1], tint[2]);
+        
+        // Main rock body (irregular polygon to look like a rock)
+        gfxBegin(GL_POLYGON);
+        gfxVertex2f(x + w * 0.1f, y);
+        gfxVertex2f(x + w * 0.9f, y);
+        gfxVertex2f(x + w, y + h * 0.3f);
+        gfxVertex2f(x + w * 0.95f, y + h * 0.7f);
+        gfxVertex2f(x + w * 0.7f, y + h);
+        gfxVertex2f(x + w * 0.3f, y + h);
+        gfxVertex2f(x + w * 0.05f, y + h * 0.7f);
+        gfxVertex2f(x, y + h * 0.3f);
+        gfxEnd();
+        
+        // Rock highlights (lighter triangles for texture)
+        gfxColor3f(tint[3], tint[4], tint[5]);
+        gfxBegin(GL_TRIANGLES);
+        // Top left highlight
+        gfxVertex2f(x + w * 0.2f, y + h * 0.6f);
+        gfxVertex2f(x + w * 0.35f, y + h * 0.8f);
+        gfxVertex2f(x + w * 0.15f, y + h * 0.9f);
+        
+        // Top right highlight
+        gfxVertex2f(x + w * 0.7f, y + h * 0.7f);
+        gfxVertex2f(x + w * 0.85f, y + h * 0.6f);
+        gfxVertex2f(x + w * 0.8f, y + h * 0.9f);
+        gfxEnd();
+        
+        // Rock cracks/lines (dark lines for detail)
+        gfxColor3f(0.25f, 0.25f, 0.27f);
+        gfxLineWidth(2);
+        gfxBegin(GL_LINES);
+        // Crack 1
+        gfxVertex2f(x + w * 0.3f, y + h * 0.2f);
+        gfxVertex2f(x + w * 0.4f, y + h * 0.8f);
+        // Crack 2
+        gfxVertex2f(x + w * 0.6f, y + h * 0.1f);
+        gfxVertex2f(x + w * 0.7f, y + h * 0.7f);
+        gfxEnd();
+        
+        // Rock outline for definition
+        gfxColor3f(0.2f, 0.2f, 0.22f);
+        gfxLineWidth(2);
+        gfxBegin(GL_LINE_LOOP);
+        gfxVertex2f(x + w * 0.1f, y);
+        gfxVertex2f(x + w * 0.9f, y);
+        gfxVertex2f(x + w, y + h * 0.3f);
+        gfxVertex2f(x + w * 0.95f, y + h * 0.7f);
+        gfxVertex2f(x + w * 0.7f, y + h);
+        gfxVertex2f(x + w * 0.3f, y + h);
+        gfxVertex2f(x + w * 0.05f, y + h * 0.7f);
+        gfxVertex2f(x, y + h * 0.3f);
+        gfxEnd();
+
+        // Conveyor chevrons, crawling the way the belt carries
+        if (p.kind == PLATFORM_CONVEYOR) {
+            float dir = p.carry > 0 ? 1.0f : -1.0f;
+            float shift = fmodf(gameTime * fabsf(p.carry), 20.0f);
+            gfxColor3f(0.85f, 0.7f, 0.2f);
+            gfxBegin(GL_LINES);
+            for (float cx = x + 10 + (dir > 0 ? shift : 20 - shift); cx < x + w - 10; cx += 20) {
+                gfxVertex2f(cx - 4 * dir, y + h * 0.25f);
+                gfxVertex2f(cx + 4 * dir, y + h * 0.5f);
+                gfxVertex2f(cx + 4 * dir, y + h * 0.5f);
+                gfxVertex2f(cx - 4 * dir, y + h * 0.75f);
+            }
+            gfxEnd();
+        }
+    }
+}
+
+void drawCoinShape(float size) {
+    int segments = quality().coinSegments;
+    gfxColor3f(1.0f, 0.85f, 0.2f);
+    gfxBegin(GL_TRIANGLE_FAN);
+    gfxVertex2f(0, 0);
+    for (int i = 0; i <= segments; i++) {
+        float angle = i * 2.0f * 3.14159f / segments;
+        gfxVertex2f(cos(angle) * size, sin(angle) * size);
+    }
+    gfxEnd();
+    
+    gfxColor3f(0.9f, 0.7f, 0.1f);
+    gfxBegin(GL_TRIANGLE_FAN);
+    gfxVertex2f(0, 0);
+    for (int i = 0; i <= segments; i++) {
+        float angle = i * 2.0f * 3.14159f / segments;
+        gfxVertex2f(cos(angle) * size * 0.6f, sin(angle) * size * 0.6f);
+    }
+    gfxEnd();
+    
+    gfxColor3f(1.0f, 0.95f, 0.5f);
+    gfxBegin(GL_TRIANGLES);
+    for (int i = 0; i < 4; i++) {
+        float angle = i * 3.14159f / 2;
+        gfxVertex2f(0, 0);
+        gfxVertex2f(cos(angle) * size * 0.4f, sin(angle) * size * 0.4f);
+        gfxVertex2f(cos(angle + 3.14159f/2) * size * 0.4f, sin(angle + 3.14159f/2) * size * 0.4f);
+    }
+    gfxEnd();
+}
+
+void drawRocks() {
+    const QualityTier& q = quality();
+    for (auto& r : rocks) {
+        if (!r.active || !inView(r.y - r.size * 2, r.y + r.size * 2)) continue;
+
+        int layers = q.rockLayers; // number of gradient layers
+        float maxSize = r.size;
+
+        // Draw layered glow (outer dark -> inner bright)
+        for (int l = 0; l < layers; l++) {
+            float t = layers > 1 ? (float)l / (layers - 1) : 0.5f;
+            float radius = maxSize * (1.0f - 0.12f * l);
+
+            // Color gradient: from dark gray to fiery orange
+            float rColor = 0.2f + 0.8f * (1 - t);
+            float gColor = 0.1f + 0.4f * (1 - t);
+            float bColor = 0.05f + 0.1f * (1 - t);
+
+            gfxColor3f(rColor, gColor, bColor);
+
+            gfxBegin(GL_POLYGON);
+            for (int i = 0; i < q.rockSegments; i++) {
+                float angle = i * 2.0f * 3.14159f / q.rockSegments;
+                float randOffset = (rand() % 10 - 5) * 0.01f * radius; // jagged edges
+                float x = r.x + cos(angle) * (radius + randOffset);
+                float y = r.y + sin(angle) * (radius + randOffset);
+                gfxVertex2f(x, y);
+            }
+            gfxEnd();
+        }
+
+        // Add fiery cracks (random thin triangles)
+        gfxColor3f(1.0f, 0.6f, 0.0f); // bright orange
+        for (int i = 0; i < q.rockCracks; i++) {
+            float angle = (rand() % 360) * 3.14159f / 180.0f;
+            float innerR = r.size * 0.2f;
+            float outerR = r.size * (0.5f + (rand() % 50) / 100.0f);
+
+            gfxBegin(GL_TRIANGLES);
+                gfxVertex2f(r.x, r.y);
+                gfxVertex2f(r.x + cos(angle) * innerR, r.y + sin(angle) * innerR);
+                gfxVertex2f(r.x + cos(angle) * outerR, r.y + sin(angle) * outerR);
+            gfxEnd();
+        }
+
+        // Subtle glowing halo (transparency)
+        if (q.rockHaloSegments == 0) continue;
+        gfxEnable(GL_BLEND);
+        gfxBlendFunc(GL_SRC_ALPHA, GL_ONE);
+        gfxColor4f(1.0f, 0.4f, 0.1f, 0.15f); // soft orange glow
+        gfxBegin(GL_POLYGON);
+        for (int i = 0; i < q.rockHaloSegments; i++) {
+            float angle = i * 2.0f * 3.14159f / q.rockHaloSegments;
+            gfxVertex2f(r.x + cos(angle) * (r.size * 1.3f),
+                       r.y + sin(angle) * (r.size * 1.3f));
+        }
+        gfxEnd();
+        gfxDisable(GL_BLEND);
+    }
+}
+
+
+void drawLava() {
+    if (!inView(0, lavaHeight + 25)) return;
+    float bottom = viewCulling ? fmax(viewBottom, 0.0f) : 0;
+    gfxColor3f(1.0f, 0.4f, 0.0f); 
+    gfxBegin(GL_QUADS);
+    gfxVertex2f(0, bottom);
+    gfxVertex2f(WINDOW_WIDTH, bottom);
+    gfxVertex2f(WINDOW_WIDTH, lavaHeight);
+    gfxVertex2f(0, lavaHeight);
+    gfxEnd();
+    
+    gfxColor3f(1.0f, 0.4f, 0.0f); 
+    gfxBegin(GL_TRIANGLES);
+    for (int i = 0; i < WINDOW_WIDTH; i += 40) {
+        float wave = sin((i + gameTime * 0.1f) * 0.1f) * 10;
+        gfxVertex2f(i, lavaHeight);
+        gfxVertex2f(i + 20, lavaHeight + 15 + wave);
+        gfxVertex2f(i + 40, lavaHeight);
+    }
+    gfxEnd();
+}
+
+void drawKeyShape(float size) {
+    gfxColor3f(1.0f, 0.85f, 0.2f);
+    gfxBegin(GL_TRIANGLE_FAN);
+    gfxVertex2f(0, 0);
+    for (int i = 0; i <= 20; i++) {
+        float angle = i * 2.0f * 3.14159f / 20;
+        gfxVertex2f(cos(angle) * size * 0.6f, sin(angle) * size * 0.6f);
+    }
+    gfxEnd();
+    
+    gfxColor3f(0.4f, 0.25f, 0.05f);
+    gfxBegin(GL_TRIANGLE_FAN);
+    gfxVertex2f(0, 0);
+    for (int i = 0; i <= 20; i++) {
+        float angle = i * 2.0f * 3.14159f / 20;
+        gfxVertex2f(cos(angle) * size * 0.2f, sin(angle) * size * 0.2f);
+    }
+    gfxEnd();
+    
+    gfxColor3f(1.0f, 0.85f, 0.2f);
+    gfxBegin(GL_QUADS);
+    gfxVertex2f(size * 0.3f, -size * 0.2f);
+    gfxVertex2f(size * 1.5f, -size * 0.2f);
+    gfxVertex2f(size * 1.5f, size * 0.2f);
+    gfxVertex2f(size * 0.3f, size * 0.2f);
+    gfxEnd();
+    
+    gfxBegin(GL_TRIANGLES);
+    gfxVertex2f(size * 1.2f, -size * 0.2f);
+    gfxVertex2f(size * 1.3f, -size * 0.2f);
+    gfxVertex2f(size * 1.25f, -size * 0.5f);
+    
+    gfxVertex2f(size * 1.4f, -size * 0.2f);
+    gfxVertex2f(size * 1.5f, -size * 0.2f);
+    gfxVertex2f(size * 1.45f, -size * 0.4f);
+    gfxEnd();
+}
+
+void drawPowerUps() {
+    for (auto& pu : powerUps) {
+        if (pu.collected || !inView(pu.y - pu.size * 2, pu.y + pu.size * 2)) continue;
+        
+        gfxPushMatrix();
+        gfxTranslatef(pu.x, pu.y, 0);
+        
+        if (pu.type == 1) {
+            gfxRotatef(pu.rotation, 0, 0, 1);
+            gfxColor3f(0.2f, 0.55f, 0.95f);
+            
+            gfxBegin(GL_TRIANGLE_FAN);
+            gfxVertex2f(0, 0);
+            for (int i = 0; i <= 20; i++) {
+                float angle = i * 2.0f * 3.14159f / 20;
+                gfxVertex2f(cos(angle) * pu.size, sin(angle) * pu.size);
+            }
+            gfxEnd();
+            
+            gfxColor3f(0.4f, 0.7f, 1.0f);
+            gfxBegin(GL_POLYGON);
+            gfxVertex2f(0, pu.size * 0.7f);
+            gfxVertex2f(-pu.size * 0.5f, pu.size * 0.3f);
+            gfxVertex2f(-pu.size * 0.5f, -pu.size * 0.5f);
+            gfxVertex2f(0, -pu.size * 0.7f);
+            gfxVertex2f(pu.size * 0.5f, -pu.size * 0.5f);
+            gfxVertex2f(pu.size * 0.5f, pu.size * 0.3f);
+            gfxEnd();
+            
+            gfxColor3f(1.0f, 1.0f, 1.0f);
+            gfxBegin(GL_QUADS);
+            gfxVertex2f(-pu.size * 0.1f, -pu.size * 0.4f);
+            gfxVertex2f(pu.size * 0.1f, -pu.size * 0.4f);
+            gfxVertex2f(pu.size * 0.1f, pu.size * 0.4f);
+            gfxVertex2f(-pu.size * 0.1f, pu.size * 0.4f);
+            
+            gfxVertex2f(-pu.size * 0.4f, -pu.size * 0.1f);
+            gfxVertex2f(pu.size * 0.4f, -pu.size * 0.1f);
+            gfxVertex2f(pu.size * 0.4f, pu.size * 0.1f);
+            gfxVertex2f(-pu.size * 0.4f, pu.size * 0.1f);
+            gfxEnd();
+            
+        } else {
+            float scale = 1.0f + sin(pu.rotation * 0.05f) * 0.2f;
+            gfxScalef(scale, scale, 1.0f);
+            
+            gfxColor3f(0.1f, 0.75f, 0.95f);
+            
+            gfxBegin(GL_TRIANGLE_FAN);
+            gfxVertex2f(0, 0);
+            for (int i = 0; i <= 20; i++) {
+                float angle = i * 2.0f * 3.14159f / 20;
+                gfxVertex2f(cos(angle) * pu.size * 0.3f, sin(angle) * pu.size * 0.3f);
+            }
+            gfxEnd();
+            
+            gfxColor3f(0.5f, 0.85f, 1.0f);
+            gfxBegin(GL_TRIANGLES);
+            for (int i = 0; i < 6; i++) {
+                float angle = i * 3.14159f / 3;
+                gfxVertex2f(0, 0);
+                gfxVertex2f(cos(angle) * pu.size * 0.3f, sin(angle) * pu.size * 0.3f);
+                gfxVertex2f(cos(angle) * pu.size, sin(angle) * pu.size);
+            }
+            gfxEnd();
+            
+            gfxLineWidth(2);
+            gfxColor3f(1.0f, 1.0f, 1.0f);
+            gfxBegin(GL_LINES);
+            for (int i = 0; i < 6; i++) {
+                float angle = i * 3.14159f / 3;
+                gfxVertex2f(0, 0);
+                gfxVertex2f(cos(angle) * pu.size * 0.8f, sin(angle) * pu.size * 0.8f);
+            }
+            gfxEnd();
+        }
+        
+        gfxPopMatrix();
+    }
+}
+
+void drawDoorShape(float x, float y, float w, float h, bool unlocked, float openAnimation) {
+    // Draw the frame first (dark brown)
+    gfxColor3f(0.20f, 0.12f, 0.04f);
+    gfxBegin(GL_QUADS);
+    gfxVertex2f(x - 5, y - 5);
+    gfxVertex2f(x + w + 5, y - 5);
+    gfxVertex2f(x + w + 5, y + h + 5);
+    gfxVertex2f(x - 5, y + h + 5);
+    gfxEnd();
+
+    // Door open/close transformation
+    if (unlocked) {
+        gfxPushMatrix();
+        gfxTranslatef(x, y, 0);
+        gfxRotatef(-openAnimation * 90, 0, 0, 1);
+        gfxTranslatef(-x, -y, 0);
+    }
+
+    // --- Door body (wood gradient) ---
+    gfxBegin(GL_QUADS);
+    // darker side (simulate shading)
+    gfxColor3f(0.35f, 0.22f, 0.08f);  // left side
+    gfxVertex2f(x, y);
+    gfxVertex2f(x + w * 0.4f, y);
+    gfxVertex2f(x + w * 0.4f, y + h);
+    gfxVertex2f(x, y + h);
+
+    // lighter side (simulate light reflection)
+    gfxColor3f(0.45f, 0.30f, 0.10f);  // right side
+    gfxVertex2f(x + w * 0.4f, y);
+    gfxVertex2f(x + w, y);
+    gfxVertex2f(x + w, y + h);
+    gfxVertex2f(x + w * 0.4f, y + h);
+    gfxEnd();
+
+    // --- Decorative horizontal panels (for realism) ---
+    gfxColor3f(0.25f, 0.15f, 0.05f);
+    for (int i = 1; i <= 3; i++) {
+        float panelY = y + (h / 4.0f) * i;
+        gfxBegin(GL_LINES);
+        gfxVertex2f(x + 10, panelY);
+        gfxVertex2f(x + w - 10, panelY);
+        gfxEnd();
+    }
+
+    // --- Door knob (metallic with highlight) ---
+    gfxLayer(LAYER_DOOR_KNOB);
+    float knobX = x + w - 15;
+    float knobY = y + h / 2;
+
+    gfxBegin(GL_TRIANGLE_FAN);
+    gfxColor3f(0.8f, 0.7f, 0.1f);  // gold base
+    gfxVertex2f(knobX, knobY);
+    for (int i = 0; i <= 20; i++) {
+        float angle = i * 2.0f * 3.14159f / 20;
+        gfxColor3f(0.9f, 0.8f, 0.3f);  // light edge
+        gfxVertex2f(knobX + cos(angle) * 5, knobY + sin(angle) * 5);
+    }
+    gfxEnd();
+
+    // Small highlight on knob (simulated light)
+    gfxColor3f(1.0f, 1.0f, 0.6f);
+    gfxBegin(GL_TRIANGLE_FAN);
+    gfxVertex2f(knobX + 1.5f, knobY + 1.5f);
+    for (int i = 0; i <= 20; i++) {
+        float angle = i * 2.0f * 3.14159f / 20;
+        gfxVertex2f(knobX + 1.5f + cos(angle) * 1.5f, knobY + 1.5f + sin(angle) * 1.5f);
+    }
+    gfxEnd();
+
+    // --- Door open shadow effect ---
+    if (unlocked && openAnimation > 0.1f) {
+        gfxColor4f(0.0f, 0.0f, 0.0f, 0.3f); // semi-transparent
+        gfxBegin(GL_QUADS);
+        gfxVertex2f(x + w + 2, y);
+        gfxVertex2f(x + w + 10, y);
+        gfxVertex2f(x + w + 10, y + h);
+        gfxVertex2f(x + w + 2, y + h);
+        gfxEnd();
+    }
+
+    if (unlocked)
+        gfxPopMatrix();
+}
+
+// ---------------- Sprite atlas ----------------
+// The player, coins, key and door are made of many small GL batches. On the
+// first frame each pose is rasterized once into an RGBA atlas texture by
+// the shape functions above: two player poses, coin and key rotations, and
+// the door's opening frames. Afterwards each object is one textured quad.
+// Every pose is rendered over black and then over white. The two read-backs
+// give premultiplied colour and alpha, so whatever the shapes blend comes
+// out the same. G switches between the atlas and the shapes. Build cost and
+// batch savings are printed at exit.
+
+const int ATLAS_WIDTH = 1024;
+const int COIN_FRAMES = 32;      // over 90 degrees; the coin looks the same every quarter turn
+const int KEY_FRAMES = 64;       // over a full turn
+const int DOOR_FRAMES = 21;      // opening steps; frame 0 of the set is the locked door
+
+// GL batches (glBegin/glEnd pairs) each shape issues.
+const int PLAYER_BATCHES = 10;   // + 1 with the aura
+const int COIN_BATCHES = 3;
+const int KEY_BATCHES = 4;
+const int DOOR_BATCHES = 7;      // + 1 for the shadow while open
+
+enum SpriteKind { SPRITE_PLAYER, SPRITE_COIN, SPRITE_KEY, SPRITE_DOOR, SPRITE_KINDS };
+
+struct SpriteFrame {
+    int x, y;        // cell in the atlas
+};
+
+struct SpriteSet {
+    int first, count;            // frames in atlas.frames
+    int left, bottom, w, h;      // cell extent relative to the anchor point
+};
+
+struct SpriteAtlas {
+    bool built;
+    bool enabled;
+    GLuint texture;
+    int width, height;
+    SpriteSet sets[SPRITE_KINDS];
+    std::vector<SpriteFrame> frames;
+    // object sizes the poses were drawn at; anything else falls back to shapes
+    float playerW, playerH, coinSize, keySize, doorW, doorH;
+    double buildMs;
+    long drawnFrames;
+    long batches;          // issued for sprites
+    long shapeBatches;     // the shapes would have issued
+};
+
+// Not built until the first frame, and on until 'g' turns it off.
+SpriteAtlas makeAtlas() {
+    SpriteAtlas a = SpriteAtlas();
+    a.built = false;
+    a.enabled = true;
+    return a;
+}
+
+SpriteAtlas atlas = makeAtlas();
+
+int atlasPoseCount(SpriteKind kind) {
+    switch (kind) {
+        case SPRITE_PLAYER: return 2;
+        case SPRITE_COIN:   return COIN_FRAMES;
+        case SPRITE_KEY:    return KEY_FRAMES;
+        case SPRITE_DOOR:   return 1 + DOOR_FRAMES;
+        default:            return 0;
+    }
+}
+
+// Draws one pose with its anchor at (ax, ay).
+void drawSpritePose(SpriteKind kind, int pose, float ax, float ay) {
+    gfxPushMatrix();
+    switch (kind) {
+        case SPRITE_PLAYER:
+            drawPlayerShape(ax, ay, atlas.playerW, atlas.playerH, pose == 1);
+            break;
+        case SPRITE_COIN:
+            gfxTranslatef(ax, ay, 0);
+            gfxRotatef(pose * 90.0f / COIN_FRAMES, 0, 0, 1);
+            drawCoinShape(atlas.coinSize);
+            break;
+        case SPRITE_KEY:
+            gfxTranslatef(ax, ay, 0);
+            gfxRotatef(pose * 360.0f / KEY_FRAMES, 0, 0, 1);
+            drawKeyShape(atlas.keySize);
+            break;
+        case SPRITE_DOOR:
+            drawDoorShape(ax, ay, atlas.doorW, atlas.doorH, pose > 0,
+                          pose > 0 ? (pose - 1) / (float)(DOOR_FRAMES - 1) : 0.0f);
+            break;
+        default:
+            break;
+    }
+    gfxPopMatrix();
+}
+
+// Cell extents generous enough for every pose of each shape.
+void atlasMeasure() {
+    float pw = atlas.playerW, ph = atlas.playerH;
+    SpriteSet* s = atlas.sets;
+    s[SPRITE_PLAYER].left = (int)floor(-pw / 2 - 12);
+    s[SPRITE_PLAYER].bottom = (int)floor(-12);
+    s[SPRITE_PLAYER].w = -2 * s[SPRITE_PLAYER].left;
+    s[SPRITE_PLAYER].h = (int)ceil(ph * 1.05f + 16);
+
+    int coin = (int)ceil(atlas.coinSize + 2);
+    s[SPRITE_COIN].left = s[SPRITE_COIN].bottom = -coin;
+    s[SPRITE_COIN].w = s[SPRITE_COIN].h = 2 * coin;
+
+    int key = (int)ceil(atlas.keySize * 1.6f + 2);
+    s[SPRITE_KEY].left = s[SPRITE_KEY].bottom = -key;
+    s[SPRITE_KEY].w = s[SPRITE_KEY].h = 2 * key;
+
+    // The body swings a quarter turn clockwise about the bottom-left corner,
+    // with its shadow 10 px to the right.
+    float reach = sqrt((atlas.doorW + 10) * (atlas.doorW + 10) + atlas.doorH * atlas.doorH);
+    s[SPRITE_DOOR].left = -7;
+    s[SPRITE_DOOR].bottom = (int)floor(-atlas.doorW - 12);
+    s[SPRITE_DOOR].w = (int)ceil(reach + 2) - s[SPRITE_DOOR].left;
+    s[SPRITE_DOOR].h = (int)ceil(atlas.doorH + 7) - s[SPRITE_DOOR].bottom;
+}
+
+// Renders one pose into the corner of the back buffer over black and over
+// white, and stores the result premultiplied in image at the frame's cell.
+void atlasRasterize(SpriteKind kind, int pose, const SpriteFrame& f, std::vector<uint32_t>& image,
+                    std::vector<uint8_t>& black, std::vector<uint8_t>& white) {
+    const SpriteSet& s = atlas.sets[kind];
+    for (int pass = 0; pass < 2; pass++) {
+        float bg = pass == 0 ? 0.0f : 1.0f;
+        glClearColor(bg, bg, bg, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        drawSpritePose(kind, pose, (float)-s.left, (float)-s.bottom);
+        glReadPixels(0, 0, s.w, s.h, GL_RGB, GL_UNSIGNED_BYTE, pass == 0 ? black.data() : white.data());
+    }
+    for (int y = 0; y < s.h; y++) {
+        for (int x = 0; x < s.w; x++) {
+            const uint8_t* b = &black[(y * s.w + x) * 3];
+            const uint8_t* w = &white[(y * s.w + x) * 3];
+            // over black: a*c; over white: a*c + (1 - a)
+            int coverage = 255 - ((w[0] - b[0]) + (w[1] - b[1]) + (w[2] - b[2])) / 3;
+            coverage = std::max(0, std::min(255, coverage));
+            uint32_t r = std::min<int>(b[0], coverage);
+            uint32_t g = std::min<int>(b[1], coverage);
+            uint32_t bl = std::min<int>(b[2], coverage);
+            image[(f.y + y) * atlas.width + f.x + x] = r | g << 8 | bl << 16 | (uint32_t)coverage << 24;
+        }
+    }
+}
+
+// Needs a current GL context with a back buffer of at least the largest cell.
+void atlasBuild() {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool recording = gfxRecording;
+    gfxRecording = false;   // the poses are read straight back
+    atlas.built = true;
+    atlas.playerW = player.width;
+    atlas.playerH = player.height;
+    atlas.coinSize = collectables.empty() ? 15.0f : collectables[0].size;
+    atlas.keySize = key.size;
+    atlas.doorW = door.width;
+    atlas.doorH = door.height;
+    atlasMeasure();
+
+    // Shelf packing, biggest cells first.
+    SpriteKind order[] = {SPRITE_DOOR, SPRITE_KEY, SPRITE_PLAYER, SPRITE_COIN};
+    atlas.frames.clear();
+    int x = 0, y = 0, rowHeight = 0;
+    for (SpriteKind kind : order) {
+        SpriteSet& s = atlas.sets[kind];
+        s.first = (int)atlas.frames.size();
+        s.count = atlasPoseCount(kind);
+        for (int i = 0; i < s.count; i++) {
+            if (x + s.w > ATLAS_WIDTH) {
+                x = 0;
+                y += rowHeight;
+                rowHeight = 0;
+            }
+            SpriteFrame f = {x, y};
+            atlas.frames.push_back(f);
+            x += s.w;
+            rowHeight = std::max(rowHeight, s.h);
+        }
+    }
+    atlas.width = ATLAS_WIDTH;
+    atlas.height = 1;
+    while (atlas.height < y + rowHeight) atlas.height *= 2;
+
+    GLint viewport[4];
+    GLfloat clearColor[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+    glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+    glEnable(GL_SCISSOR_TEST);
+    // In a running game the door's panel lines inherit the width the
+    // player's arms leave behind.
+    gfxLineWidth(3);
+    int tier = qualityTier;
+    qualityTier = 0;   // sprites are baked at full detail whatever the governor says
+
+    std::vector<uint32_t> image((size_t)atlas.width * atlas.height, 0);
+    std::vector<uint8_t> black, white;
+    for (SpriteKind kind : order) {
+        const SpriteSet& s = atlas.sets[kind];
+        black.resize((size_t)s.w * s.h * 3);
+        white.resize(black.size());
+        glScissor(0, 0, s.w, s.h);
+        for (int i = 0; i < s.count; i++) {
+            atlasRasterize(kind, i, atlas.frames[s.first + i], image, black, white);
+        }
+    }
+    qualityTier = tier;
+
+    glScissor(0, 0, atlas.sets[SPRITE_DOOR].w, atlas.sets[SPRITE_DOOR].h);
+    glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+    glClear(GL_COLOR_BUFFER_BIT);   // leave the frame as display() cleared it
+    glDisable(GL_SCISSOR_TEST);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    glGenTextures(1, &atlas.texture);
+    glBindTexture(GL_TEXTURE_2D, atlas.texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, atlas.width, atlas.height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                 image.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    gfxRecording = recording;
+    atlas.buildMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+void printAtlasStats() {
+    if (!atlas.built) return;
+    fprintf(stderr, "sprite atlas: %zu poses in %dx%d (%d KB), built in %.1f ms\n",
+            atlas.frames.size(), atlas.width, atlas.height, atlas.width * atlas.height * 4 / 1024,
+            atlas.buildMs);
+    if (atlas.drawnFrames > 0) {
+        fprintf(stderr, "  %.1f sprite batches per frame instead of %.1f\n",
+                (double)atlas.batches / atlas.drawnFrames, (double)atlas.shapeBatches / atlas.drawnFrames);
+    }
+}
+
+// Sprite quads go between atlasBegin() and atlasEnd(), all in one batch.
+void atlasBegin() {
+    gfxEnable(GL_TEXTURE_2D);
+    gfxBindTexture(atlas.texture);
+    gfxEnable(GL_BLEND);
+    gfxBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);   // the atlas is premultiplied
+    gfxColor4f(1, 1, 1, 1);
+    gfxBegin(GL_QUADS);
+    atlas.batches++;
+}
+
+void atlasEnd() {
+    gfxEnd();
+    gfxDisable(GL_BLEND);
+    gfxDisable(GL_TEXTURE_2D);
+}
+
+// Anchors snap to whole pixels so nearest sampling reproduces the pose exactly.
+void atlasQuad(SpriteKind kind, int pose, float ax, float ay) {
+    const SpriteSet& s = atlas.sets[kind];
+    const SpriteFrame& f = atlas.frames[s.first + pose];
+    float x0 = floor(ax + 0.5f) + s.left, y0 = floor(ay + 0.5f) + s.bottom;
+    float u0 = (float)f.x / atlas.width, v0 = (float)f.y / atlas.height;
+    float u1 = (float)(f.x + s.w) / atlas.width, v1 = (float)(f.y + s.h) / atlas.height;
+    gfxTexCoord2f(u0, v0); gfxVertex2f(x0, y0);
+    gfxTexCoord2f(u1, v0); gfxVertex2f(x0 + s.w, y0);
+    gfxTexCoord2f(u1, v1); gfxVertex2f(x0 + s.w, y0 + s.h);
+    gfxTexCoord2f(u0, v1); gfxVertex2f(x0, y0 + s.h);
+}
+
+int rotationPose(float degrees, float period, int frames) {
+    int pose = (int)floor(fmod(degrees, period) / period * frames + 0.5f);
+    return ((pose % frames) + frames) % frames;
+}
+
+bool atlasUsable() {
+    return atlas.built && atlas.enabled && !softwareRendering;
+}
+
+void drawPlayer() {
+    bool aura = POWERUP_EFFECTS[player.activePowerUp].shield;
+    atlas.shapeBatches += PLAYER_BATCHES + aura;
+    if (!atlasUsable() || player.width != atlas.playerW || player.height != atlas.playerH) {
+        drawPlayerShape(player.x, player.y, player.width, player.height, aura);
+        return;
+    }
+    atlasBegin();
+    atlasQuad(SPRITE_PLAYER, aura, player.x, player.y);
+    atlasEnd();
+}
+
+void drawCollectables() {
+    bool batched = false;
+    for (auto& c : collectables) {
+        if (c.collected || !inView(c.y - c.size, c.y + c.size)) continue;
+        atlas.shapeBatches += COIN_BATCHES;
+        if (atlasUsable() && c.size == atlas.coinSize) {
+            if (!batched) atlasBegin();
+            batched = true;
+            atlasQuad(SPRITE_COIN, rotationPose(c.rotation, 90.0f, COIN_FRAMES), c.x, c.y);
+            continue;
+        }
+        if (batched) atlasEnd();
+        batched = false;
+        gfxPushMatrix();
+        gfxTranslatef(c.x, c.y, 0);
+        gfxRotatef(c.rotation, 0, 0, 1);
+        drawCoinShape(c.size);
+        gfxPopMatrix();
+    }
+    if (batched) atlasEnd();
+}
+
+void drawKey() {
+    if (!key.spawned || key.collected || !inView(key.y - key.size, key.y + key.size)) return;
+    atlas.shapeBatches += KEY_BATCHES;
+    if (!atlasUsable() || key.size != atlas.keySize) {
+        gfxPushMatrix();
+        gfxTranslatef(key.x, key.y, 0);
+        gfxRotatef(key.rotation, 0, 0, 1);
+        drawKeyShape(key.size);
+        gfxPopMatrix();
+        return;
+    }
+    atlasBegin();
+    atlasQuad(SPRITE_KEY, rotationPose(key.rotation, 360.0f, KEY_FRAMES), key.x, key.y);
+    atlasEnd();
+}
+
+void drawDoor() {
+    if (!inView(door.y, door.y + door.height)) return;
+    atlas.shapeBatches += DOOR_BATCHES + (door.unlocked && door.openAnimation > 0.1f);
+    if (!atlasUsable() || door.width != atlas.doorW || door.height != atlas.doorH) {
+        drawDoorShape(door.x, door.y, door.width, door.height, door.unlocked, door.openAnimation);
+        return;
+    }
+    int pose = 0;
+    if (door.unlocked) {
+        float open = fmin(fmax(door.openAnimation, 0.0f), 1.0f);
+        pose = 1 + (int)floor(open * (DOOR_FRAMES - 1) + 0.5f);
+    }
+    atlasBegin();
+    atlasQuad(SPRITE_DOOR, pose, door.x, door.y);
+    atlasEnd();
+}
+
+void drawHUD() {
+    gfxColor3f(0.2f, 0.2f, 0.25f);
+    gfxBegin(GL_QUADS);
+    gfxVertex2f(10, WINDOW_HEIGHT - 30);
+    gfxVertex2f(160, WINDOW_HEIGHT - 30);
+    gfxVertex2f(160, WINDOW_HEIGHT - 10);
+    gfxVertex2f(10, WINDOW_HEIGHT - 10);
+    gfxEnd();
+    
+    for (int i = 0; i < player.lives; i++) {
+        gfxColor3f(0.95f, 0.15f, 0.15f);
+        gfxBegin(GL_TRIANGLE_FAN);
+        float cx = 25 + i * 50;
+        float cy = WINDOW_HEIGHT - 20;
+        gfxVertex2f(cx, cy);
+        for (int j = 0; j <= 20; j++) {
+            float angle = j * 2.0f * 3.14159f / 20;
+            gfxVertex2f(cx + cos(angle) * 15, cy + sin(angle) * 12);
+        }
+        gfxEnd();
+    }
+    
+    gfxColor3f(0.2f, 0.2f, 0.25f);
+    gfxBegin(GL_QUADS);
+    gfxVertex2f(10, WINDOW_HEIGHT - 60);
+    gfxVertex2f(210, WINDOW_HEIGHT - 60);
+    gfxVertex2f(210, WINDOW_HEIGHT - 40);
+    gfxVertex2f(10, WINDOW_HEIGHT - 40);
+    gfxEnd();
+    
+    float danger = lavaHeight / WINDOW_HEIGHT;
+    float barWidth = 200 * danger;
+    
+    if (danger < 0.5f) {
+        gfxColor3f(0.2f, 0.8f, 0.2f);
+    } else if (danger < 0.75f) {
+        gfxColor3f(0.95f, 0.75f, 0.1f);
+    } else {
+        gfxColor3f(0.95f, 0.2f, 0.1f);
+    }
+    
+    gfxBegin(GL_QUADS);
+    gfxVertex2f(10, WINDOW_HEIGHT - 60);
+    gfxVertex2f(10 + barWidth, WINDOW_HEIGHT - 60);
+    gfxVertex2f(10 + barWidth, WINDOW_HEIGHT - 40);
+    gfxVertex2f(10, WINDOW_HEIGHT - 40);
+    gfxEnd();
+    
+    gfxColor3f(0.95f, 0.95f, 0.95f);
+    drawText(WINDOW_WIDTH - 150, WINDOW_HEIGHT - 25, frameFormat("Score: %d", player.score));
+}
+
+void drawMainMenu() {
+    gfxColor3f(0.1f, 0.1f, 0.1f);
+    gfxBegin(GL_QUADS);
+    gfxVertex2f(0, 0);
+    gfxVertex2f(WINDOW_WIDTH, 0);
+    gfxVertex2f(WINDOW_WIDTH, WINDOW_HEIGHT);
+    gfxVertex2f(0, WINDOW_HEIGHT);
+    gfxEnd();
+    
+    // Title
+    gfxColor3f(0.95f, 0.85f, 0.2f);
+    drawLargeText(WINDOW_WIDTH/2 - 80, WINDOW_HEIGHT - 100, "ICY TOWER");
+    
+    gfxColor3f(0.7f, 0.7f, 0.75f);
+    drawText(WINDOW_WIDTH/2 - 90, WINDOW_HEIGHT - 140, "ASCEND TO VICTORY");
+    
+    // Start button with gradient effect
+    gfxColor3f(0.15f, 0.55f, 0.25f);
+    gfxBegin(GL_QUADS);
+    gfxVertex2f(startButtonX, startButtonY);
+    gfxVertex2f(startButtonX + startButtonWidth, startButtonY);
+    gfxColor3f(0.2f, 0.65f, 0.35f);
+    gfxVertex2f(startButtonX + startButtonWidth, startButtonY + startButtonHeight);
+    gfxVertex2f(startButtonX, startButtonY + startButtonHeight);
+    gfxEnd();
+    
+    // Button border
+    gfxColor3f(0.0f, 0.0f, 0.0f);
+    gfxLineWidth(2);
+    gfxBegin(GL_LINE_LOOP);
+    gfxVertex2f(startButtonX, startButtonY);
+    gfxVertex2f(startButtonX + startButtonWidth, startButtonY);
+    gfxVertex2f(startButtonX + startButtonWidth, startButtonY + startButtonHeight);
+    gfxVertex2f(startButtonX, startButtonY + startButtonHeight);
+    gfxEnd();
+    
+    gfxColor3f(1.0f, 1.0f, 1.0f);
+    drawLargeText(startButtonX , startButtonY + 18, "START GAME");
+    
+    // Instructions
+    gfxColor3f(0.6f, 0.6f, 0.65f);
+    drawText(WINDOW_WIDTH/2 - 130, 200, "WASD / Arrow Keys - Move & Jump");
+    drawText(WINDOW_WIDTH/2 - 100, 170, "Collect at least 5 coins unlock door");
+    drawText(WINDOW_WIDTH/2 - 80, 140, "Avoid rocks and lava!");
+    drawText(WINDOW_WIDTH/2 - 70, 110, "B - Toggle autopilot");
+
+    gfxColor3f(0.95f, 0.85f, 0.2f);
+    drawText(WINDOW_WIDTH/2 - 110, startButtonY - 40,
+             frameFormat("Difficulty: %s  (1 / 2 / 3)", DIFFICULTIES[selectedDifficulty].name));
+    
+    // Decorative elements
+    gfxColor3f(0.95f, 0.25f, 0.05f);
+    gfxBegin(GL_TRIANGLES);
+    for (int i = 0; i < 10; i++) {
+        float x = 50 + i * 75;
+        gfxVertex2f(x, 80);
+        gfxVertex2f(x + 20, 95);
+        gfxVertex2f(x + 40, 80);
+    }
+    gfxEnd();
+}
+
+void drawGameOver() {
+    if (gameState == WIN) {
+        gfxColor3f(0.2f, 0.8f, 0.3f);
+        drawLargeText(WINDOW_WIDTH/2 - 50, WINDOW_HEIGHT/1.5, "YOU WIN!");
+    } else {
+        gfxColor3f(0.95f, 0.2f, 0.2f);
+        drawLargeText(WINDOW_WIDTH/2 - 70, WINDOW_HEIGHT/1.5, "GAME OVER!");
+    }
+    
+    gfxColor3f(0.9f, 0.9f, 0.95f);
+    drawText(WINDOW_WIDTH/2 - 50, WINDOW_HEIGHT/2 , frameFormat("Final Score: %d", player.score));
+    if (lastResultRank > 0) {
+        drawText(WINDOW_WIDTH/2 - 50, WINDOW_HEIGHT/2 + 30,
+                 frameFormat("Rank #%llu of %llu", (unsigned long long)lastResultRank,
+                             (unsigned long long)leaderboardSize(leaderboard)));
+    }
+
+    LeaderboardRecord top[5];
+    int shown = leaderboardTop(leaderboard, 5, top);
+    if (shown > 0) {
+        gfxColor3f(0.95f, 0.85f, 0.2f);
+        drawText(WINDOW_WIDTH - 260, WINDOW_HEIGHT/2 + 120, "Best runs");
+        gfxColor3f(0.9f, 0.9f, 0.95f);
+        for (int i = 0; i < shown; i++) {
+            drawText(WINDOW_WIDTH - 260, WINDOW_HEIGHT/2 + 90 - i * 25,
+                     frameFormat("%d. %5d  %d coins%s%s", i + 1, top[i].score, top[i].coins,
+                                 top[i].flags & RESULT_WON ? "  won" : "",
+                                 top[i].flags & RESULT_AUTOPILOT ? "  (bot)" : ""));
+        }
+    }
+    
+    // Restart button with gradient
+    gfxColor3f(0.15f, 0.55f, 0.25f);
+    gfxBegin(GL_QUADS);
+    gfxVertex2f(restartButtonX, restartButtonY);
+    gfxVertex2f(restartButtonX + restartButtonWidth, restartButtonY);
+    gfxColor3f(0.2f, 0.65f, 0.35f);
+    gfxVertex2f(restartButtonX + restartButtonWidth, restartButtonY + restartButtonHeight);
+    gfxVertex2f(restartButtonX, restartButtonY + restartButtonHeight);
+    gfxEnd();
+    
+    // Button border
+    gfxColor3f(0.3f, 0.75f, 0.45f);
+    gfxLineWidth(2);
+    gfxBegin(GL_LINE_LOOP);
+    gfxVertex2f(restartButtonX, restartButtonY);
+    gfxVertex2f(restartButtonX + restartButtonWidth, restartButtonY);
+    gfxVertex2f(restartButtonX + restartButtonWidth, restartButtonY + restartButtonHeight);
+    gfxVertex2f(restartButtonX, restartButtonY + restartButtonHeight);
+    gfxEnd();
+    
+    gfxColor3f(1.0f, 1.0f, 1.0f);
+    drawLargeText(restartButtonX , restartButtonY + 10, "PLAY AGAIN");
+}
+
+
+bool checkCollision(float x1, float y1, float w1, float h1, float x2, float y2, float w2, float h2) {
+    return (x1 < x2 + w2 && x1 + w1 > x2 && y1 < y2 + h2 && y1 + h1 > y2);
+}
+
+bool checkCircleCollision(float x1, float y1, float r1, float x2, float y2, float r2) {
+    float dx = x2 - x1;
+    float dy = y2 - y1;
+    float distance = sqrt(dx * dx + dy * dy);
+    return distance < (r1 + r2);
+}
+
+// Circle test between the player and something standing still.
+template <class P>
+bool playerTouches(const World& w, float x, float y, float radius) {
+    const Player& player = w.player;
+    if (P::fixedPoint()) {
+        return fixedCircles(w.body.playerX, w.body.playerY + toFixed(player.height / 2),
+                            toFixed(player.width / 2), toFixed(x), toFixed(y), toFixed(radius));
+    }
+    return checkCircleCollision(player.x, player.y + player.height/2, player.width/2, x, y, radius);
+}
+
+void worldEvent(const World& w, TelemetryType type, float x, float y, int value = 0) {
+    if (w.live) telemetryPush(type, x, y, value);
+}
+
+// ---------------- Hazard waves ----------------
+// Besides the odd single rock, when the hazard script says, a wave emits
+// waveRocks() times its number of rocks over ROCK_WAVE_TICKS in one of three
+// patterns, each of which leaves a way through:
+//   rain:  across the whole width except a drifting lane
+//   fan:   from one point at the top, the aim sweeping from side to side
+//   sweep: a shallow curtain in from one side, under the platforms' cover
+
+void startRockWave(World& w, int waveRocks) {
+    RockWave& wave = w.wave;
+    wave.number++;
+    wave.pattern = worldRand(w) % WAVE_PATTERNS;
+    wave.count = waveRocks * wave.number;
+    wave.left = wave.count;
+    wave.ticksLeft = ROCK_WAVE_TICKS;
+    int lane = ROCK_WAVE_LANE / 2 + worldRand(w) % (int)(WINDOW_WIDTH - ROCK_WAVE_LANE);
+    int sign = worldRand(w) % 2 ? 1 : -1;
+    int driftRoll = worldRand(w) % 100;
+    wave.laneX = lane;
+    wave.laneDrift = sign * (0.5f + driftRoll / 100.0f);
+    wave.fixedLaneX = toFixed(lane);
+    wave.fixedLaneDrift = sign * (FIXED_ONE / 2 + driftRoll * FIXED_ONE / 100);
+}
+
+// The random draws are the same in both modes; the fixed-point one works
+// the rock out from them in integers.
+void emitWaveRock(World& w, RockWave& wave) {
+    Rock r;
+    r.size = 6 + worldRand(w) % 9;
+    r.active = true;
+    r.contact = 0;
+    const FixedBody& b = w.body;
+    const fixed top = b.cameraY + toFixed(WINDOW_HEIGHT + r.size);
+    if (wave.pattern == WAVE_RAIN) {
+        int x = worldRand(w) % (int)(WINDOW_WIDTH - ROCK_WAVE_LANE);
+        int speedRoll = worldRand(w) % 150;
+        r.x = x;
+        if (r.x > wave.laneX - ROCK_WAVE_LANE / 2) r.x += ROCK_WAVE_LANE;
+        r.y = w.cameraY + WINDOW_HEIGHT + r.size;
+        r.speed = 2.0f + speedRoll / 100.0f;
+        r.drift = wave.laneDrift;
+        if (w.fixedPoint) {
+            fixed fx = toFixed(x);
+            if (fx > wave.fixedLaneX - toFixed(ROCK_WAVE_LANE / 2)) fx += toFixed(ROCK_WAVE_LANE);
+            pushFixedRock(w, r, fx, top, 2 * FIXED_ONE + speedRoll * FIXED_ONE / 100, wave.fixedLaneDrift);
+        }
+    } else if (wave.pattern == WAVE_FAN) {
+        int spreadRoll = worldRand(w) % 100;
+        int speedRoll = worldRand(w) % 100;
+        float done = 1.0f - (float)wave.left / wave.count;
+        float angle = (done * 2 - 1) * 1.1f + (spreadRoll / 100.0f - 0.5f) * 0.15f;
+        float speed = 3.0f + speedRoll / 100.0f;
+        r.x = wave.laneX;
+        r.y = w.cameraY + WINDOW_HEIGHT + r.size;
+        r.speed = cos(angle) * speed;
+        r.drift = sin(angle) * speed;
+        if (w.fixedPoint) {
+            fixed fdone = FIXED_ONE - (fixed)((int64_t)wave.left * FIXED_ONE / wave.count);
+            fixed fangle = fixedMul(2 * fdone - FIXED_ONE, toFixed(1.1)) +
+                           fixedMul(spreadRoll * FIXED_ONE / 100 - FIXED_ONE / 2, toFixed(0.15));
+            fixed fspeed = 3 * FIXED_ONE + speedRoll * FIXED_ONE / 100;
+            pushFixedRock(w, r, wave.fixedLaneX, top, fixedMul(fixedCos(fangle), fspeed),
+                         fixedMul(fixedSin(fangle), fspeed));
+        }
+    } else {
+        int yRoll = worldRand(w) % (WINDOW_HEIGHT / 2);
+        int speedRoll = worldRand(w) % 60;
+        int driftRoll = worldRand(w) % 100;
+        bool fromLeft = wave.laneX < WINDOW_WIDTH / 2;
+        if (w.fixedPoint) fromLeft = wave.fixedLaneX < toFixed(WINDOW_WIDTH / 2);
+        r.x = fromLeft ? -r.size : WINDOW_WIDTH + r.size;
+        r.y = w.cameraY + WINDOW_HEIGHT / 2 + yRoll;
+        r.speed = 1.0f + speedRoll / 100.0f;
+        r.drift = (fromLeft ? 1 : -1) * (2.0f + driftRoll / 100.0f);
+        if (w.fixedPoint) {
+            pushFixedRock(w, r, toFixed(r.x), b.cameraY + toFixed(WINDOW_HEIGHT / 2 + yRoll),
+                         FIXED_ONE + speedRoll * FIXED_ONE / 100,
+                         (fromLeft ? 1 : -1) * (2 * FIXED_ONE + driftRoll * FIXED_ONE / 100));
+        }
+    }
+    w.rocks.push_back(r);
+}
+
+// Emits the running wave's share of rocks for this tick.
+void updateRockWave(World& w) {
+    RockWave& wave = w.wave;
+    if (wave.ticksLeft <= 0) return;
+    int emit = (wave.left + wave.ticksLeft - 1) / wave.ticksLeft;
+    for (int i = 0; i < emit && w.rocks.size() < (size_t)MAX_ROCKS; i++) emitWaveRock(w, wave);
+    wave.left -= emit;   // rocks over the cap are dropped, not deferred
+    wave.ticksLeft--;
+    if (w.fixedPoint) {
+        wave.fixedLaneX += wave.fixedLaneDrift;
+        if (wave.fixedLaneX < toFixed(ROCK_WAVE_LANE / 2) ||
+            wave.fixedLaneX > toFixed(WINDOW_WIDTH - ROCK_WAVE_LANE / 2)) {
+            wave.fixedLaneDrift = -wave.fixedLaneDrift;
+        }
+        wave.laneX = fromFixed(wave.fixedLaneX);
+        wave.laneDrift = fromFixed(wave.fixedLaneDrift);
+        return;
+    }
+    wave.laneX += wave.laneDrift;
+    if (wave.laneX < ROCK_WAVE_LANE / 2 || wave.laneX > WINDOW_WIDTH - ROCK_WAVE_LANE / 2) {
+        wave.laneDrift = -wave.laneDrift;
+    }
+}
+
+// ---------------- Hazard scripts ----------------
+// What falls on a level and when is a small script, compiled to bytecode
+// when it is loaded and run by the world's timer wheel. A script is a few
+// threads, started together with the level, each running until it waits:
+//
+//   thread NAME ... end      one thread; a script has up to eight
+//   set VAR EXPR             variables are shared by the threads, 0 at start
+//   wait EXPR                ticks, at least one
+//   rock EXPR, EXPR          a rock at x, falling hundredths of a pixel a tick
+//   wave                     a hazard wave (see "Hazard waves")
+//   powerup                  while fewer than MAX_POWERUPS have come
+//   lava EXPR                lava acceleration, in 1/100000 px per tick per tick
+//   loop ... end             forever
+//   repeat EXPR ... end
+//   while EXPR ... end
+//   if EXPR ... [else ...] end
+//
+// Expressions are integer: + - * / % and the comparisons, rand N (0 to
+// N - 1), tick, rocks, waves, screens, height (the player's, in pixels) and
+// coins. # starts a comment. The interpreter keeps its state in the World,
+// so clones and replays run it alike, and never allocates. A tick runs at
+// most SCRIPT_TICK_BUDGET ops across all threads: a thread that uses them up
+// is put off to the next tick at its next loop, so a script that loops
+// without waiting costs a bounded amount a tick rather than hanging the game.
+
+const int SCRIPT_TICK_BUDGET = 4096;
+const int SCRIPT_STACK = 16;
+const int SCRIPT_MAX_CODE = 0xffff;
+
+enum ScriptOp {
+    OP_PUSH8, OP_PUSH, OP_LOAD, OP_STORE,
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD, OP_NEG,
+    OP_LT, OP_LE, OP_GT, OP_GE, OP_EQ, OP_NE,
+    OP_RAND, OP_TICK, OP_ROCKS, OP_WAVES, OP_SCREENS, OP_HEIGHT, OP_COINS,
+    OP_JUMP, OP_JZ,
+    OP_WAIT, OP_ROCK, OP_WAVE, OP_POWERUP, OP_LAVA, OP_END
+};
+
+struct HazardScript {
+    std::vector<uint8_t> code;
+    uint16_t entry[SCRIPT_MAX_THREADS];
+    int threads;
+    int vars;
+    uint32_t hash;   // of the bytecode, recorded with runs
+};
+
+// The original schedule: a lone rock every so often, a wave from tick 600
+// every 900 ticks, and two power-ups 600 ticks apart.
+const char* CLASSIC_HAZARDS =
+    "thread rocks\n"
+    "    loop\n"
+    "        # past 120 ticks, each tick a 1 in 180 better chance of one\n"
+    "        set gap 121\n"
+    "        while gap - 120 <= rand 180\n"
+    "            set gap gap + 1\n"
+    "        end\n"
+    "        wait gap\n"
+    "        rock rand 1200, 200 + rand 100\n"
+    "    end\n"
+    "end\n"
+    "thread waves\n"
+    "    wait 600\n"
+    "    loop\n"
+    "        wave\n"
+    "        wait 900\n"
+    "    end\n"
+    "end\n"
+    "thread powerups\n"
+    "    repeat 2\n"
+    "        wait 600\n"
+    "        powerup\n"
+    "    end\n"
+    "end\n";
+
+enum ScriptToken { TOK_END, TOK_NEWLINE, TOK_NUMBER, TOK_NAME, TOK_OP };
+
+struct ScriptCompiler {
+    const char* p;
+    int line;
+    ScriptToken token;
+    char text[32];
+    int32_t number;
+    HazardScript* out;
+    char varNames[SCRIPT_MAX_VARS][32];
+    int depth;    // of the stack at this point of the expression
+    char error[96];
+};
+
+bool scriptFail(ScriptCompiler& c, const char* message) {
+    if (!c.error[0]) snprintf(c.error, sizeof(c.error), "line %d: %s", c.line, message);
+    return false;
+}
+
+void scriptNext(ScriptCompiler& c) {
+    while (*c.p == ' ' || *c.p == '\t' || *c.p == '\r') c.p++;
+    if (*c.p == '#') {
+        while (*c.p && *c.p != '\n') c.p++;
+    }
+    c.text[0] = 0;
+    if (!*c.p) {
+        c.token = TOK_END;
+    } else if (*c.p == '\n') {
+        c.token = TOK_NEWLINE;
+        c.p++;
+    } else if (isdigit((unsigned char)*c.p)) {
+        c.token = TOK_NUMBER;
+        int64_t v = 0;
+        while (isdigit((unsigned char)*c.p)) {
+            v = v * 10 + (*c.p++ - '0');
+            if (v > INT32_MAX) v = INT32_MAX + 1LL;
+        }
+        if (v > INT32_MAX) scriptFail(c, "number too big");
+        c.number = (int32_t)std::min(v, (int64_t)INT32_MAX);
+    } else if (isalpha((unsigned char)*c.p) || *c.p == '_') {
+        c.token = TOK_NAME;
+        size_t n = 0;
+        while (isalnum((unsigned char)*c.p) || *c.p == '_') {
+            if (n + 1 < sizeof(c.text)) c.text[n++] = *c.p;
+            c.p++;
+        }
+        c.text[n] = 0;
+    } else {
+        c.token = TOK_OP;
+        c.text[0] = *c.p++;
+        c.text[1] = 0;
+        if (*c.p == '=' && strchr("<>=!", c.text[0])) {
+            c.text[1] = *c.p++;
+            c.text[2] = 0;
+        }
+    }
+}
+
+bool scriptIs(const ScriptCompiler& c, const char* text) {
+    return (c.token == TOK_NAME || c.token == TOK_OP) && strcmp(c.text, text) == 0;
+}
+
+void scriptEmit(ScriptCompiler& c, int op, int pushes = 0) {
+    c.out->code.push_back((uint8_t)op);
+    c.depth += pushes;
+    if (c.depth > SCRIPT_STACK) scriptFail(c, "expression too deep");
+}
+
+void scriptEmit16(ScriptCompiler& c, int v) {
+    c.out->code.push_back((uint8_t)v);
+    c.out->code.push_back((uint8_t)(v >> 8));
+}
+
+void scriptPatch(ScriptCompiler& c, size_t at, size_t target) {
+    c.out->code[at] = (uint8_t)target;
+    c.out->code[at + 1] = (uint8_t)(target >> 8);
+}
+
+void scriptPush(ScriptCompiler& c, int32_t v) {
+    if (v >= -128 && v <= 127) {
+        scriptEmit(c, OP_PUSH8, 1);
+        c.out->code.push_back((uint8_t)(int8_t)v);
+        return;
+    }
+    scriptEmit(c, OP_PUSH, 1);
+    uint8_t bytes[4];
+    memcpy(bytes, &v, 4);
+    c.out->code.insert(c.out->code.end(), bytes, bytes + 4);
+}
+
+// Index of a variable, made on first use.
+int scriptVar(ScriptCompiler& c, const char* name) {
+    for (int i = 0; i < c.out->vars; i++) {
+        if (strcmp(c.varNames[i], name) == 0) return i;
+    }
+    if (c.out->vars == SCRIPT_MAX_VARS) {
+        scriptFail(c, "too many variables");
+        return 0;
+    }
+    snprintf(c.varNames[c.out->vars], sizeof(c.varNames[0]), "%s", name);
+    return c.out->vars++;
+}
+
+const char* const SCRIPT_KEYWORDS[] = {
+    "thread", "end", "set", "wait", "rock", "wave", "powerup", "lava", "loop", "repeat",
+    "while", "if", "else", "rand"
+};
+
+struct ScriptValue {
+    const char* name;
+    ScriptOp op;
+};
+
+const ScriptValue SCRIPT_VALUES[] = {
+    {"tick", OP_TICK}, {"rocks", OP_ROCKS}, {"waves", OP_WAVES}, {"screens", OP_SCREENS},
+    {"height", OP_HEIGHT}, {"coins", OP_COINS},
+};
+
+bool scriptReserved(const char* name) {
+    for (const char* keyword : SCRIPT_KEYWORDS) {
+        if (strcmp(name, keyword) == 0) return true;
+    }
+    for (const ScriptValue& v : SCRIPT_VALUES) {
+        if (strcmp(name, v.name) == 0) return true;
+    }
+    return false;
+}
+
+bool scriptExpression(ScriptCompiler& c);
+
+bool scriptUnary(ScriptCompiler& c) {
+    if (scriptIs(c, "-") || scriptIs(c, "rand")) {
+        int op = scriptIs(c, "-") ? OP_NEG : OP_RAND;
+        scriptNext(c);
+        if (!scriptUnary(c)) return false;
+        scriptEmit(c, op);
+        return true;
+    }
+    if (c.token == TOK_NUMBER) {
+        scriptPush(c, c.number);
+    } else if (scriptIs(c, "(")) {
+        scriptNext(c);
+        if (!scriptExpression(c)) return false;
+        if (!scriptIs(c, ")")) return scriptFail(c, "missing )");
+    } else if (c.token == TOK_NAME) {
+        for (const ScriptValue& v : SCRIPT_VALUES) {
+            if (strcmp(c.text, v.name) == 0) {
+                scriptEmit(c, v.op, 1);
+                scriptNext(c);
+                return true;
+            }
+        }
+        if (scriptReserved(c.text)) return scriptFail(c, "expected a value");
+        int var = scriptVar(c, c.text);
+        scriptEmit(c, OP_LOAD, 1);
+        c.out->code.push_back((uint8_t)var);
+    } else {
+        return scriptFail(c, "expected a value");
+    }
+    scriptNext(c);
+    return true;
+}
+
+// Left to right within a level: comparisons, then + -, then * / %.
+bool scriptBinary(ScriptCompiler& c, int level) {
+    static const char* const OPERATORS[3][7] = {
+        {"<", "<=", ">", ">=", "==", "!=", NULL},
+        {"+", "-", NULL},
+        {"*", "/", "%", NULL},
+    };
+    static const ScriptOp OPS[3][6] = {
+        {OP_LT, OP_LE, OP_GT, OP_GE, OP_EQ, OP_NE},
+        {OP_ADD, OP_SUB},
+        {OP_MUL, OP_DIV, OP_MOD},
+    };
+    if (level == 3) return scriptUnary(c);
+    if (!scriptBinary(c, level + 1)) return false;
+    while (c.token == TOK_OP) {
+        int k = 0;
+        while (OPERATORS[level][k] && strcmp(OPERATORS[level][k], c.text) != 0) k++;
+        if (!OPERATORS[level][k]) break;
+        scriptNext(c);
+        if (!scriptBinary(c, level + 1)) return false;
+        scriptEmit(c, OPS[level][k], -1);
+    }
+    return true;
+}
+
+bool scriptExpression(ScriptCompiler& c) {
+    return scriptBinary(c, 0) && !c.error[0];
+}
+
+// An expression whose value is consumed by the statement that follows.
+bool scriptArgument(ScriptCompiler& c) {
+    if (!scriptExpression(c)) return false;
+    c.depth--;
+    return true;
+}
+
+bool scriptEndOfLine(ScriptCompiler& c) {
+    if (c.token != TOK_NEWLINE && c.token != TOK_END) return scriptFail(c, "expected end of line");
+    if (c.token == TOK_NEWLINE) {
+        c.line++;
+        scriptNext(c);
+    }
+    return true;
+}
+
+void scriptJump(ScriptCompiler& c, int op, size_t target) {
+    scriptEmit(c, op, op == OP_JZ ? -1 : 0);
+    scriptEmit16(c, (int)target);
+}
+
+bool scriptBlock(ScriptCompiler& c);
+
+bool scriptStatement(ScriptCompiler& c) {
+    std::vector<uint8_t>& code = c.out->code;
+    char word[32];
+    snprintf(word, sizeof(word), "%s", c.text);
+    if (c.token != TOK_NAME) return scriptFail(c, "expected a statement");
+    scriptNext(c);
+    if (strcmp(word, "set") == 0) {
+        if (c.token != TOK_NAME || scriptReserved(c.text)) return scriptFail(c, "expected a variable");
+        char name[32];
+        snprintf(name, sizeof(name), "%s", c.text);
+        scriptNext(c);
+        if (!scriptArgument(c)) return false;
+        int var = scriptVar(c, name);
+        scriptEmit(c, OP_STORE);
+        code.push_back((uint8_t)var);
+    } else if (strcmp(word, "wait") == 0 || strcmp(word, "lava") == 0) {
+        if (!scriptArgument(c)) return false;
+        scriptEmit(c, word[0] == 'w' ? OP_WAIT : OP_LAVA);
+    } else if (strcmp(word, "rock") == 0) {
+        // x stays on the stack while speed is worked out
+        if (!scriptExpression(c)) return false;
+        if (!scriptIs(c, ",")) return scriptFail(c, "rock takes x, speed");
+        scriptNext(c);
+        if (!scriptExpression(c)) return false;
+        scriptEmit(c, OP_ROCK, -2);
+    } else if (strcmp(word, "wave") == 0) {
+        scriptEmit(c, OP_WAVE);
+    } else if (strcmp(word, "powerup") == 0) {
+        scriptEmit(c, OP_POWERUP);
+    } else if (strcmp(word, "loop") == 0) {
+        size_t top = code.size();
+        if (!scriptEndOfLine(c) || !scriptBlock(c)) return false;
+        scriptJump(c, OP_JUMP, top);
+    } else if (strcmp(word, "while") == 0) {
+        size_t top = code.size();
+        if (!scriptArgument(c)) return false;
+        c.depth++;
+        scriptJump(c, OP_JZ, 0);
+        size_t exit = code.size() - 2;
+        if (!scriptEndOfLine(c) || !scriptBlock(c)) return false;
+        scriptJump(c, OP_JUMP, top);
+        scriptPatch(c, exit, code.size());
+    } else if (strcmp(word, "repeat") == 0) {
+        // The count lives in a variable of its own, named so scripts can't
+        char hidden[32];
+        snprintf(hidden, sizeof(hidden), " repeat %d", (int)code.size());
+        int var = scriptVar(c, hidden);
+        if (!scriptArgument(c)) return false;
+        scriptEmit(c, OP_STORE);
+        code.push_back((uint8_t)var);
+        size_t top = code.size();
+        scriptEmit(c, OP_LOAD, 1);
+        code.push_back((uint8_t)var);
+        scriptPush(c, 0);
+        scriptEmit(c, OP_GT, -1);
+        scriptJump(c, OP_JZ, 0);
+        size_t exit = code.size() - 2;
+        if (!scriptEndOfLine(c) || !scriptBlock(c)) return false;
+        scriptEmit(c, OP_LOAD, 1);
+        code.push_back((uint8_t)var);
+        scriptPush(c, 1);
+        scriptEmit(c, OP_SUB, -1);
+        scriptEmit(c, OP_STORE, -1);
+        code.push_back((uint8_t)var);
+        scriptJump(c, OP_JUMP, top);
+        scriptPatch(c, exit, code.size());
+    } else if (strcmp(word, "if") == 0) {
+        if (!scriptArgument(c)) return false;
+        c.depth++;
+        scriptJump(c, OP_JZ, 0);
+        size_t skip = code.size() - 2;
+        if (!scriptEndOfLine(c) || !scriptBlock(c)) return false;
+        if (scriptIs(c, "else")) {
+            scriptNext(c);
+            scriptJump(c, OP_JUMP, 0);
+            size_t over = code.size() - 2;
+            scriptPatch(c, skip, code.size());
+            if (!scriptEndOfLine(c) || !scriptBlock(c)) return false;
+            scriptPatch(c, over, code.size());
+        } else {
+            scriptPatch(c, skip, code.size());
+        }
+    } else {
+        return scriptFail(c, "unknown statement");
+    }
+    if (strcmp(word, "loop") == 0 || strcmp(word, "while") == 0 || strcmp(word, "repeat") == 0 ||
+        strcmp(word, "if") == 0) {
+        if (!scriptIs(c, "end")) return scriptFail(c, "missing end");
+        scriptNext(c);
+    }
+    if (code.size() > (size_t)SCRIPT_MAX_CODE) return scriptFail(c, "script too long");
+    return scriptEndOfLine(c);
+}
+
+// Statements up to the "end" or "else" that closes them, left unread.
+bool scriptBlock(ScriptCompiler& c) {
+    while (!scriptIs(c, "end") && !scriptIs(c, "else")) {
+        if (c.token == TOK_END) return scriptFail(c, "missing end");
+        if (c.token == TOK_NEWLINE) {
+            scriptEndOfLine(c);
+            continue;
+        }
+        if (!scriptStatement(c)) return false;
+    }
+    return true;
+}
+
+// Compiles source into out. On failure returns false with the reason, by
+// line, in error.
+bool compileHazardScript(const char* source, HazardScript& out, char* error, size_t errorSize) {
+    ScriptCompiler c;
+    memset(&c, 0, sizeof(c));
+    c.p = source;
+    c.line = 1;
+    c.out = &out;
+    out.code.clear();
+    out.threads = 0;
+    out.vars = 0;
+    scriptNext(c);
+    while (c.token != TOK_END && !c.error[0]) {
+        if (c.token == TOK_NEWLINE) {
+            scriptEndOfLine(c);
+            continue;
+        }
+        if (!scriptIs(c, "thread")) {
+            scriptFail(c, "expected thread");
+            break;
+        }
+        if (out.threads == SCRIPT_MAX_THREADS) {
+            scriptFail(c, "too many threads");
+            break;
+        }
+        scriptNext(c);
+        if (c.token != TOK_NAME) {
+            scriptFail(c, "thread needs a name");
+            break;
+        }
+        scriptNext(c);
+        out.entry[out.threads++] = (uint16_t)out.code.size();
+        if (!scriptEndOfLine(c) || !scriptBlock(c)) break;
+        if (!scriptIs(c, "end")) {
+            scriptFail(c, "else without if");
+            break;
+        }
+        scriptNext(c);
+        scriptEmit(c, OP_END);
+        scriptEndOfLine(c);
+    }
+    // FNV-1a
+    out.hash = 2166136261u;
+    for (uint8_t b : out.code) out.hash = (out.hash ^ b) * 16777619u;
+    for (int i = 0; i < out.threads; i++) out.hash = (out.hash ^ out.entry[i]) * 16777619u;
+    snprintf(error, errorSize, "%s", c.error);
+    return !c.error[0];
+}
+
+const HazardScript* hazardScript = NULL;   // --hazards FILE; the classic script otherwise
+
+const HazardScript& activeHazards() {
+    if (hazardScript) return *hazardScript;
+    static HazardScript classic;
+    static bool compiled = [] {
+        char error[96];
+        bool ok = compileHazardScript(CLASSIC_HAZARDS, classic, error, sizeof(error));
+        assert(ok);
+        return ok;
+    }();
+    (void)compiled;
+    return classic;
+}
+
+bool loadHazardScript(const char* path, HazardScript& out) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return false;
+    }
+    std::string source;
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) source.append(buffer, n);
+    fclose(f);
+    char error[96];
+    if (!compileHazardScript(source.c_str(), out, error, sizeof(error))) {
+        fprintf(stderr, "%s: %s\n", path, error);
+        return false;
+    }
+    return true;
+}
+
+// Makes new levels use the script at path.
+bool useHazardScript(const char* path) {
+    static HazardScript loaded;
+    if (!loadHazardScript(path, loaded)) return false;
+    hazardScript = &loaded;
+    return true;
+}
+
+void scriptRock(World& w, int32_t x, int32_t speed) {
+    if (w.rocks.size() >= (size_t)MAX_ROCKS) return;
+    x = std::min(std::max(x, 0), (int32_t)WINDOW_WIDTH);
+    speed = std::min(std::max(speed, 10), 1000);
+    Rock r;
+    r.x = x;
+    r.y = w.cameraY + WINDOW_HEIGHT;
+    r.size = 15;
+    r.speed = speed / 100.0f;
+    r.drift = 0;
+    r.active = true;
+    r.contact = 0;
+    if (w.fixedPoint) {
+        pushFixedRock(w, r, toFixed(r.x), w.body.cameraY + toFixed(WINDOW_HEIGHT), speed * FIXED_ONE / 100, 0);
+    }
+    w.rocks.push_back(r);
+}
+
+void scriptPowerUp(World& w) {
+    if (w.powerUps.size() >= (size_t)MAX_POWERUPS) return;
+    PowerUp pu;
+    pu.x = worldRand(w) % (WINDOW_WIDTH - 100) + 50;
+    pu.y = w.lavaHeight + 150 + worldRand(w) % 200;
+    pu.size = 20;
+    pu.type = 1 + w.powerUps.size() % (POWERUP_KINDS - 1);
+    pu.collected = false;
+    pu.rotation = 0;
+    scheduleTimer(w, POWERUP_PICKUP_TICKS, TIMER_PICKUP_EXPIRE, (int)w.powerUps.size());
+    w.powerUps.push_back(pu);
+}
+
+void scriptLava(World& w, int32_t acceleration) {
+    acceleration = std::min(std::max(acceleration, 0), 1000);
+    w.lavaIncrement = acceleration / 100000.0f;
+    w.body.lavaIncrement = toFixed(acceleration / 100000.0);
+}
+
+// Arithmetic wraps rather than overflowing; division by zero gives 0.
+inline int32_t wrapped(int64_t v) {
+    return (int32_t)(uint32_t)(uint64_t)v;
+}
+
+// Runs a thread from where it left off to its next wait, its end, or its
+// first loop once the tick's budget is gone.
+void runScriptThread(World& w, int thread) {
+    ScriptState& s = w.script;
+    const uint8_t* code = s.program->code.data();
+    int32_t stack[SCRIPT_STACK];
+    int sp = 0;
+    int pc = s.pc[thread];
+    int budget = s.budget;   // in a local: the ops below may touch the World
+    bool running = true;
+    while (running) {
+        assert(sp >= 0 && sp <= SCRIPT_STACK);   // the compiler bounds the depth
+        budget--;
+        int32_t a, b;
+        switch (code[pc++]) {
+            case OP_PUSH8: stack[sp++] = (int8_t)code[pc++]; break;
+            case OP_PUSH:  memcpy(&stack[sp++], code + pc, 4); pc += 4; break;
+            case OP_LOAD:  stack[sp++] = s.vars[code[pc++]]; break;
+            case OP_STORE: s.vars[code[pc++]] = stack[--sp]; break;
+#define SCRIPT_BINARY(expr) b = stack[--sp]; a = stack[sp - 1]; stack[sp - 1] = (expr); break
+            case OP_ADD: SCRIPT_BINARY(wrapped((int64_t)a + b));
+            case OP_SUB: SCRIPT_BINARY(wrapped((int64_t)a - b));
+            case OP_MUL: SCRIPT_BINARY(wrapped((int64_t)a * b));
+            case OP_DIV: SCRIPT_BINARY(b == 0 ? 0 : wrapped((int64_t)a / b));
+            case OP_MOD: SCRIPT_BINARY(b == 0 ? 0 : (int32_t)((int64_t)a % b));
+            case OP_LT:  SCRIPT_BINARY(a < b);
+            case OP_LE:  SCRIPT_BINARY(a <= b);
+            case OP_GT:  SCRIPT_BINARY(a > b);
+            case OP_GE:  SCRIPT_BINARY(a >= b);
+            case OP_EQ:  SCRIPT_BINARY(a == b);
+            case OP_NE:  SCRIPT_BINARY(a != b);
+#undef SCRIPT_BINARY
+            case OP_NEG: stack[sp - 1] = wrapped(-(int64_t)stack[sp - 1]); break;
+            case OP_RAND: stack[sp - 1] = stack[sp - 1] > 0 ? worldRand(w) % stack[sp - 1] : 0; break;
+            case OP_TICK:    stack[sp++] = w.gameTime; break;
+            case OP_ROCKS:   stack[sp++] = (int32_t)w.rocks.size(); break;
+            case OP_WAVES:   stack[sp++] = w.wave.number; break;
+            case OP_SCREENS: stack[sp++] = w.levelScreens; break;
+            case OP_HEIGHT:  stack[sp++] = (int32_t)w.player.y; break;
+            case OP_COINS:   stack[sp++] = w.coinsCollected; break;
+            case OP_JUMP: {
+                int target = code[pc] | code[pc + 1] << 8;
+                if (target < pc && budget <= 0) {
+                    s.pc[thread] = (uint16_t)target;
+                    s.overruns++;
+                    scheduleTimer(w, 1, TIMER_SCRIPT, thread);
+                    running = false;
+                    break;
+                }
+                pc = target;
+                break;
             }
-            glEnd();
-            
-            glColor3f(0.5f, 0.85f, 1.0f);
-            glBegin(GL_TRIANGLES);
-            for (int i = 0; i < 6; i++) {
-                float angle = i * 3.14159f / 3;
-                glVertex2f(0, 0);
-                glVertex2f(cos(angle) * pu.size * 0.3f, sin(angle) * pu.size * 0.3f);
-                glVertex2f(cos(angle) * pu.size, sin(angle) * pu.size);
+            case OP_JZ:
+                pc = stack[--sp] ? pc + 2 : (code[pc] | code[pc + 1] << 8);
+                break;
+            case OP_WAIT:
+                s.pc[thread] = (uint16_t)pc;
+                scheduleTimer(w, std::max(stack[--sp], 1), TIMER_SCRIPT, thread);
+                running = false;
+                break;
+            case OP_ROCK:
+                sp -= 2;
+                scriptRock(w, stack[sp], stack[sp + 1]);
+                break;
+            case OP_WAVE:    startRockWave(w, DIFFICULTIES[w.difficulty].waveRocks); break;
+            case OP_POWERUP: scriptPowerUp(w); break;
+            case OP_LAVA:    scriptLava(w, stack[--sp]); break;
+            case OP_END:
+                s.pc[thread] = (uint16_t)(pc - 1);
+                running = false;
+                break;
+        }
+    }
+    s.ops += s.budget - budget;
+    s.budget = budget;
+}
+
+void startHazardScript(World& w, const HazardScript& program) {
+    ScriptState& s = w.script;
+    s.program = &program;
+    memset(s.vars, 0, sizeof(s.vars));
+    s.budget = SCRIPT_TICK_BUDGET;
+    s.ops = 0;
+    s.overruns = 0;
+    for (int i = 0; i < program.threads; i++) {
+        s.pc[i] = program.entry[i];
+        runScriptThread(w, i);
+    }
+}
+
+// ---------------- Broadphase ----------------
+// Rock contacts by sort and sweep along x. w.rocks is kept ordered by left
+// edge: rocks barely move between ticks, so an insertion sort after moving
+// them is close to linear. The few statics (live platforms and the player)
+// are sorted separately and the two lists merged in one sweep. A rock
+// entering the sweep is tested against the statics still open, and a static
+// against the rocks still open; rock pairs are never looked at. Once every
+// static has been passed, the remaining rocks are skipped. Platforms are
+// stored by height, so only those level with the rocks are swept at all;
+// in a tall level that is a screen's worth rather than the whole tower.
+
+enum { ROCK_HIT_PLAYER = 1, ROCK_HIT_PLATFORM = 2 };
+
+struct SweepBox {
+    float x0, x1, y0, y1;
+    int platform;   // index into platforms, or -1 for the player
+};
+
+// Per thread: the verifier steps worlds on several at once.
+thread_local std::vector<SweepBox> sweepStatics;
+thread_local std::vector<int> sweepOpenStatics;
+thread_local std::vector<int> sweepOpenRocks;
+
+void moveRocks(World& w) {
+    for (Rock& r : w.rocks) {
+        r.y -= r.speed;
+        r.x += r.drift;
+    }
+}
+
+// The same in fixed point: one straight pass down the integer arrays that
+// also writes the floats the rest of the game reads. The adds are exact and
+// the scaling a power of two, so the vector loop gives the scalar one's bits.
+void moveFixedRocks(World& w) {
+    FixedRocks& f = w.fixedRocks;
+    size_t n = w.rocks.size();
+    fixed* x = f.x.data();
+    fixed* y = f.y.data();
+    const fixed* speed = f.speed.data();
+    const fixed* drift = f.drift.data();
+    Rock* rocks = w.rocks.data();
+    size_t i = 0;
+#ifdef SW_SSE2
+    // Four rocks at a time; each rock's x and y go out as one pair.
+    __m128 scale = _mm_set1_ps(1.0f / FIXED_ONE);
+    for (; i + 4 <= n; i += 4) {
+        __m128i xs = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(x + i)), _mm_loadu_si128((const __m128i*)(drift + i)));
+        __m128i ys = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(y + i)), _mm_loadu_si128((const __m128i*)(speed + i)));
+        _mm_storeu_si128((__m128i*)(x + i), xs);
+        _mm_storeu_si128((__m128i*)(y + i), ys);
+        __m128 fx = _mm_mul_ps(_mm_cvtepi32_ps(xs), scale);
+        __m128 fy = _mm_mul_ps(_mm_cvtepi32_ps(ys), scale);
+        __m128 lo = _mm_unpacklo_ps(fx, fy);
+        __m128 hi = _mm_unpackhi_ps(fx, fy);
+        _mm_storel_pi((__m64*)&rocks[i].x, lo);
+        _mm_storeh_pi((__m64*)&rocks[i + 1].x, lo);
+        _mm_storel_pi((__m64*)&rocks[i + 2].x, hi);
+        _mm_storeh_pi((__m64*)&rocks[i + 3].x, hi);
+    }
+#endif
+    for (; i < n; i++) {
+        x[i] += drift[i];
+        y[i] -= speed[i];
+        rocks[i].x = fromFixed(x[i]);
+        rocks[i].y = fromFixed(y[i]);
+    }
+}
+
+bool rockBefore(const Rock& a, const Rock& b) {
+    return a.x - a.size < b.x - b.size;
+}
+
+// In fixed-point mode the rocks' integers move with them.
+void sortRocks(World& w) {
+    std::vector<Rock>& rocks = w.rocks;
+    FixedRocks& f = w.fixedRocks;
+    for (size_t i = 1; i < rocks.size(); i++) {
+        if (!rockBefore(rocks[i], rocks[i - 1])) continue;
+        Rock r = rocks[i];
+        size_t j = i;
+        if (w.fixedPoint) {
+            fixed x = f.x[i], y = f.y[i], speed = f.speed[i], drift = f.drift[i];
+            for (; j > 0 && rockBefore(r, rocks[j - 1]); j--) {
+                rocks[j] = rocks[j - 1];
+                f.x[j] = f.x[j - 1];
+                f.y[j] = f.y[j - 1];
+                f.speed[j] = f.speed[j - 1];
+                f.drift[j] = f.drift[j - 1];
             }
-            glEnd();
-            
-            glLineWidth(2);
-            glColor3f(1.0f, 1.0f, 1.0f);
-            glBegin(GL_LINES);
-            for (int i = 0; i < 6; i++) {
-                float angle = i * 3.14159f / 3;
-                glVertex2f(0, 0);
-                glVertex2f(cos(angle) * pu.size * 0.8f, sin(angle) * pu.size * 0.8f);
+            f.x[j] = x;
+            f.y[j] = y;
+            f.speed[j] = speed;
+            f.drift[j] = drift;
+        } else {
+            for (; j > 0 && rockBefore(r, rocks[j - 1]); j--) rocks[j] = rocks[j - 1];
+        }
+        rocks[j] = r;
+    }
+}
+
+bool circleHitsRect(float cx, float cy, float radius, float x, float y, float w, float h) {
+    float dx = cx - std::max(x, std::min(cx, x + w));
+    float dy = cy - std::max(y, std::min(cy, y + h));
+    return dx * dx + dy * dy < radius * radius;
+}
+
+void rockContact(World& w, int i, const SweepBox& box, float playerRadius) {
+    Rock& r = w.rocks[i];
+    if (r.y + r.size <= box.y0 || r.y - r.size >= box.y1) return;
+    if (w.fixedPoint) {
+        const FixedBody& b = w.body;
+        fixed x = w.fixedRocks.x[i], y = w.fixedRocks.y[i];
+        fixed size = toFixed(r.size);
+        if (box.platform < 0) {
+            if (fixedCircles(b.playerX, b.playerY + toFixed(w.player.height / 2), toFixed(playerRadius),
+                             x, y, size)) {
+                r.contact |= ROCK_HIT_PLAYER;
+            }
+        } else {
+            const Platform& p = w.platforms[box.platform];
+            if (fixedCircleHitsRect(x, y, size, pixelsToFixed(p.x), pixelsToFixed(p.y),
+                                    pixelsToFixed(p.width), pixelsToFixed(p.height))) {
+                r.contact |= ROCK_HIT_PLATFORM;
+            }
+        }
+        return;
+    }
+    if (box.platform < 0) {
+        const Player& player = w.player;
+        if (checkCircleCollision(player.x, player.y + player.height/2, playerRadius, r.x, r.y, r.size)) {
+            r.contact |= ROCK_HIT_PLAYER;
+        }
+    } else {
+        const Platform& p = w.platforms[box.platform];
+        if (circleHitsRect(r.x, r.y, r.size, p.x, p.y, p.width, p.height)) r.contact |= ROCK_HIT_PLATFORM;
+    }
+}
+
+// Sets every rock's contact bits. The rocks must be in sortRocks() order.
+void sweepRockContacts(World& w, float playerRadius) {
+    std::vector<Rock>& rocks = w.rocks;
+    std::vector<SweepBox>& statics = sweepStatics;
+    std::vector<int>& openStatics = sweepOpenStatics;
+    std::vector<int>& openRocks = sweepOpenRocks;
+    statics.clear();
+    openStatics.clear();
+    openRocks.clear();
+    // Reserved per thread to stay off the heap: the band can take in every
+    // platform of a tall level, so that and the player is the bound.
+    size_t staticsBound = w.platforms.size() + 1;
+    if (statics.capacity() < staticsBound) {
+        statics.reserve(staticsBound);
+        openStatics.reserve(staticsBound);
+    }
+    if (openRocks.capacity() < (size_t)MAX_ROCKS) openRocks.reserve(MAX_ROCKS);
+    if (rocks.empty()) return;
+    float low = rocks[0].y, high = rocks[0].y;
+    for (Rock& r : rocks) {
+        r.contact = 0;
+        low = fmin(low, r.y - r.size);
+        high = fmax(high, r.y + r.size);
+    }
+    // Platforms are ordered by height: only the band the rocks are in counts
+    size_t first = std::partition_point(w.platforms.begin(), w.platforms.end(),
+                                        [low](const Platform& p) { return p.y + p.height < low; }) -
+                   w.platforms.begin();
+    for (size_t i = first; i < w.platforms.size() && w.platforms[i].y <= high; i++) {
+        const Platform& p = w.platforms[i];
+        if (p.destroyed) continue;
+        SweepBox box = {p.x, p.x + p.width, p.y, p.y + p.height, (int)i};
+        statics.push_back(box);
+    }
+    const Player& player = w.player;
+    float playerY = player.y + player.height/2;
+    SweepBox self = {player.x - playerRadius, player.x + playerRadius,
+                     playerY - playerRadius, playerY + playerRadius, -1};
+    statics.push_back(self);
+    std::sort(statics.begin(), statics.end(),
+              [](const SweepBox& a, const SweepBox& b) { return a.x0 < b.x0; });
+
+    size_t i = 0, j = 0;
+    while (i < rocks.size()) {
+        if (j == statics.size() || rocks[i].x - rocks[i].size <= statics[j].x0) {
+            if (j == statics.size() && openStatics.empty()) break;
+            Rock& r = rocks[i];
+            float left = r.x - r.size;
+            for (size_t k = 0; k < openStatics.size(); ) {
+                const SweepBox& box = statics[openStatics[k]];
+                if (box.x1 < left) {
+                    openStatics[k] = openStatics.back();
+                    openStatics.pop_back();
+                    continue;
+                }
+                rockContact(w, (int)i, box, playerRadius);
+                k++;
+            }
+            if (j < statics.size()) openRocks.push_back((int)i);
+            i++;
+        } else {
+            const SweepBox& box = statics[j];
+            for (size_t k = 0; k < openRocks.size(); ) {
+                Rock& r = rocks[openRocks[k]];
+                if (r.x + r.size < box.x0) {
+                    openRocks[k] = openRocks.back();
+                    openRocks.pop_back();
+                    continue;
+                }
+                rockContact(w, openRocks[k], box, playerRadius);
+                k++;
+            }
+            openStatics.push_back((int)j);
+            j++;
+        }
+    }
+}
+
+// ---------------- Gameplay rules ----------------
+// The tick only moves things and detects contacts; what a contact means is
+// decided by rules. Detection pushes a GameEvent, and runGameRules() hands
+// the tick's events in order to every rule registered for their type once
+// the tick is done. Rules keep their own counters rather than rescanning
+// the world, and a new rule is one function plus a GAME_RULES entry. Events
+// a rule pushes are handled in the same batch.
+
+const int KEY_COINS = 5;   // coins that make the key appear
+
+void ruleCoinScore(World& w, const GameEvent&) {
+    w.player.score += 10;
+}
+
+void ruleKeySpawn(World& w, const GameEvent&) {
+    w.coinsCollected++;
+    if (w.coinsCollected < KEY_COINS || w.key.spawned) return;
+    w.key.spawned = true;
+    worldEvent(w, TEL_FIVE_COINS, w.player.x, w.player.y, w.coinsCollected);
+    
+    // Somewhere a jump from a platform above the lava can reach
+    placeKey(w, w.key);
+    worldEvent(w, TEL_KEY_SPAWN, w.key.x, w.key.y);
+}
+
+void ruleUnlockDoor(World& w, const GameEvent&) {
+    w.player.hasKey = true;
+    w.door.unlocked = true;
+    scheduleTimer(w, 1, TIMER_DOOR_SWING);
+}
+
+void ruleRockDamage(World& w, const GameEvent& e) {
+    if (e.value) return;   // the shield took it
+    Player& player = w.player;
+    if (player.lives <= 0) return;   // an earlier rock this tick ended it
+    player.lives--;
+    worldEvent(w, TEL_LIFE_LOST, player.x, player.y, player.lives);
+    if (player.lives <= 0) {
+        w.state = LOSE;
+        worldEvent(w, TEL_DEATH_ROCK, player.x, player.y, player.score);
+    }
+}
+
+void ruleLavaDeath(World& w, const GameEvent&) {
+    w.state = LOSE;
+    worldEvent(w, TEL_DEATH_LAVA, w.player.x, w.player.y, w.player.score);
+}
+
+void rulePowerUpStart(World& w, const GameEvent& e) {
+    const PowerUpEffect& effect = POWERUP_EFFECTS[e.value];
+    w.player.activePowerUp = e.value;
+    w.player.powerUpEnds = w.gameTime + effect.ticks;
+    scheduleTimer(w, effect.ticks, TIMER_POWERUP_EXPIRE);
+    worldEvent(w, TEL_POWERUP_PICKUP, e.x, e.y, e.value);
+}
+
+void rulePowerUpEnd(World& w, const GameEvent&) {
+    if (w.gameTime >= w.player.powerUpEnds) w.player.activePowerUp = 0;   // not if one was picked up since
+}
+
+void ruleWin(World& w, const GameEvent&) {
+    w.state = WIN;
+    worldEvent(w, TEL_WIN, w.player.x, w.player.y, w.player.score);
+}
+
+struct GameRule {
+    GameEventType type;
+    void (*apply)(World&, const GameEvent&);
+};
+
+const GameRule GAME_RULES[] = {
+    {EV_COIN_COLLECTED, ruleCoinScore},
+    {EV_COIN_COLLECTED, ruleKeySpawn},
+    {EV_KEY_COLLECTED, ruleUnlockDoor},
+    {EV_ROCK_HIT, ruleRockDamage},
+    {EV_LAVA_TOUCHED, ruleLavaDeath},
+    {EV_POWERUP_COLLECTED, rulePowerUpStart},
+    {EV_POWERUP_EXPIRED, rulePowerUpEnd},
+    {EV_DOOR_REACHED, ruleWin},
+};
+
+void pushGameEvent(World& w, GameEventType type, float x, float y, int value = 0) {
+    GameEvent e = {type, x, y, value};
+    w.events.push_back(e);
+}
+
+// What the timer wheel runs; see "Timer wheel".
+
+void timerBannerEnd(World& w, int) {
+    w.letsGo = false;
+}
+
+void timerScript(World& w, int arg) {
+    runScriptThread(w, arg);
+}
+
+void timerPickupExpire(World& w, int arg) {
+    w.powerUps[arg].collected = true;
+}
+
+void timerPowerUpExpire(World& w, int) {
+    const Player& player = w.player;
+    if (player.activePowerUp > 0 && w.gameTime >= player.powerUpEnds) {
+        pushGameEvent(w, EV_POWERUP_EXPIRED, player.x, player.y);
+    }
+}
+
+void timerDoorSwing(World& w, int) {
+    w.door.openAnimation += 0.02f;
+    if (w.door.openAnimation < 1.0f) scheduleTimer(w, 1, TIMER_DOOR_SWING);
+}
+
+struct TimedEffect {
+    TimerKind kind;
+    void (*fire)(World&, int arg);
+};
+
+// In TimerKind order.
+const TimedEffect TIMED_EFFECTS[TIMER_KINDS] = {
+    {TIMER_BANNER_END, timerBannerEnd},
+    {TIMER_SCRIPT, timerScript},
+    {TIMER_PICKUP_EXPIRE, timerPickupExpire},
+    {TIMER_POWERUP_EXPIRE, timerPowerUpExpire},
+    {TIMER_DOOR_SWING, timerDoorSwing},
+};
+
+void fireTimer(World& w, const Timer& t) {
+    assert(TIMED_EFFECTS[t.kind].kind == t.kind);
+    TIMED_EFFECTS[t.kind].fire(w, t.arg);
+}
+
+void runGameRules(World& w) {
+    for (size_t i = 0; i < w.events.size(); i++) {
+        GameEvent e = w.events[i];   // a copy: rules may push more
+        for (const GameRule& rule : GAME_RULES) {
+            if (rule.type == e.type) rule.apply(w, e);
+        }
+    }
+    w.events.clear();
+}
+
+// One 16 ms game tick under preset P. Pure simulation: no GL, GLUT or
+// keyboard access, so it runs the same for the live world and for planner
+// clones.
+template <class P>
+void stepWorldT(World& w, const TickInput& in) {
+    Player& player = w.player;
+    std::vector<Platform>& platforms = w.platforms;
+    std::vector<Collectable>& collectables = w.collectables;
+    std::vector<Rock>& rocks = w.rocks;
+    std::vector<PowerUp>& powerUps = w.powerUps;
+    Key& key = w.key;
+    Door& door = w.door;
+    float& lavaHeight = w.lavaHeight;
+    float& lavaSpeed = w.lavaSpeed;
+    int& gameTime = w.gameTime;
+    const PowerUpEffect& effect = POWERUP_EFFECTS[player.activePowerUp];
+
+    gameTime++;
+    w.script.budget = SCRIPT_TICK_BUDGET;
+    w.script.ops = 0;
+    movePlatforms<P>(w);
+    
+    if (P::fixedPoint()) {
+        fixedMovePlayer<P>(w, in);
+    } else {
+        if (in.left) {
+            player.x -= P::moveSpeed() * 16;
+            if (player.x < player.width/2) player.x = player.width/2;
+        }
+        if (in.right) {
+            player.x += P::moveSpeed() * 16;
+            if (player.x > WINDOW_WIDTH - player.width/2) player.x = WINDOW_WIDTH - player.width/2;
+        }
+    
+        if (in.jump && !player.isJumping) {
+            player.velocityY = P::jumpVelocity();
+            player.isJumping = true;
+        }
+    
+        player.velocityY += P::gravity() * 16;
+        player.y += player.velocityY * 16;
+    
+        player.standingOn = -1;
+        for (size_t i = 0; i < platforms.size(); i++) {
+            const Platform& p = platforms[i];
+            if (p.destroyed) continue;
+        
+            if (player.velocityY <= 0 && 
+                checkCollision(player.x - player.width/2, player.y, player.width, 5,
+                              p.x, p.y + p.height - 5, p.width, 10)) {
+                player.y = p.y + p.height;
+                player.velocityY = 0;
+                player.isJumping = false;
+                player.standingOn = (int)i;
+            }
+        }
+        // Moving and conveyor platforms take the player with them
+        if (player.standingOn >= 0) {
+            player.x += platforms[player.standingOn].carry;
+            player.x = fmin(fmax(player.x, player.width/2), WINDOW_WIDTH - player.width/2);
+        }
+    
+        if (player.y <= 30) {
+            player.y = 30;
+            player.velocityY = 0;
+            player.isJumping = false;
+        }
+    
+        if (player.y > w.levelHeight) player.y = w.levelHeight;
+    
+        // The camera eases towards keeping the player 40% up the screen
+        float cameraTarget = fmin(fmax(player.y - WINDOW_HEIGHT * 0.4f, 0.0f), w.levelHeight - WINDOW_HEIGHT);
+        w.cameraY += (cameraTarget - w.cameraY) * 0.1f;
+    }
+    
+    const FixedBody& body = w.body;
+    if (P::fixedPoint()) {
+        fixedMoveLava<P>(w);
+    } else {
+        float currentLavaSpeed = lavaSpeed * effect.lavaScale;
+        lavaHeight += currentLavaSpeed;
+        lavaSpeed += w.lavaIncrement;
+    }
+    
+    bool inLava = P::fixedPoint() ? body.playerY < body.lavaHeight + toFixed(20) : player.y < lavaHeight + 20;
+    if (inLava) pushGameEvent(w, EV_LAVA_TOUCHED, player.x, player.y);
+    
+    for (auto& p : platforms) {
+        bool under = P::fixedPoint() ? pixelsToFixed(p.y) < body.lavaHeight : p.y < lavaHeight;
+        if (!p.destroyed && under) {
+            p.destroyed = true;
+        }
+    }
+    
+    runTimers(w);
+    updateRockWave(w);
+    
+    if (P::fixedPoint()) {
+        moveFixedRocks(w);
+    } else {
+        moveRocks(w);
+    }
+    sortRocks(w);
+    sweepRockContacts(w, player.width/2 + effect.reach);
+    
+    FixedRocks& fixedRocks = w.fixedRocks;
+    for (size_t i = 0; i < rocks.size(); i++) {
+        Rock& r = rocks[i];
+        if (r.contact & ROCK_HIT_PLAYER) {
+            r.active = false;
+            pushGameEvent(w, EV_ROCK_HIT, r.x, r.y, effect.shield);
+        } else if (r.contact & ROCK_HIT_PLATFORM) {
+            r.active = false;   // shattered
+        }
+        
+        bool gone;
+        if (P::fixedPoint()) {
+            fixed size = toFixed(r.size);
+            fixed x = fixedRocks.x[i];
+            gone = fixedRocks.y[i] < body.cameraY - size || x < -2 * size || x > toFixed(WINDOW_WIDTH) + 2 * size;
+        } else {
+            gone = r.y < w.cameraY - r.size || r.x < -2 * r.size || r.x > WINDOW_WIDTH + 2 * r.size;
+        }
+        if (gone) r.active = false;
+    }
+    // Dead rocks are dropped in place, keeping the order sortRocks() left
+    size_t kept = 0;
+    for (size_t i = 0; i < rocks.size(); i++) {
+        if (!rocks[i].active) continue;
+        rocks[kept] = rocks[i];
+        if (P::fixedPoint()) {
+            fixedRocks.x[kept] = fixedRocks.x[i];
+            fixedRocks.y[kept] = fixedRocks.y[i];
+            fixedRocks.speed[kept] = fixedRocks.speed[i];
+            fixedRocks.drift[kept] = fixedRocks.drift[i];
+        }
+        kept++;
+    }
+    rocks.erase(rocks.begin() + kept, rocks.end());
+    if (P::fixedPoint()) {
+        fixedRocks.x.erase(fixedRocks.x.begin() + kept, fixedRocks.x.end());
+        fixedRocks.y.erase(fixedRocks.y.begin() + kept, fixedRocks.y.end());
+        fixedRocks.speed.erase(fixedRocks.speed.begin() + kept, fixedRocks.speed.end());
+        fixedRocks.drift.erase(fixedRocks.drift.begin() + kept, fixedRocks.drift.end());
+    }
+    
+    for (auto& c : collectables) {
+        if (c.collected) continue;
+        
+        c.rotation += 2.0f;
+        
+        if (playerTouches<P>(w, c.x, c.y, c.size)) {
+            c.collected = true;
+            pushGameEvent(w, EV_COIN_COLLECTED, c.x, c.y);
+        }
+    }
+    
+    if (key.spawned && !key.collected) {
+        key.rotation += 3.0f;
+        
+        if (playerTouches<P>(w, key.x, key.y, key.size)) {
+            key.collected = true;
+            pushGameEvent(w, EV_KEY_COLLECTED, key.x, key.y);
+        }
+    }
+    
+    for (auto& pu : powerUps) {
+        if (pu.collected) continue;
+        
+        pu.rotation += 5.0f;
+        
+        if (playerTouches<P>(w, pu.x, pu.y, pu.size)) {
+            pu.collected = true;
+            pushGameEvent(w, EV_POWERUP_COLLECTED, pu.x, pu.y, pu.type);
+        }
+    }
+    
+    bool atDoor = P::fixedPoint()
+        ? fixedBoxes(body.playerX - toFixed(player.width / 2), body.playerY, toFixed(player.width),
+                     toFixed(player.height), toFixed(door.x), toFixed(door.y), toFixed(door.width),
+                     toFixed(door.height))
+        : checkCollision(player.x - player.width/2, player.y, player.width, player.height,
+                         door.x, door.y, door.width, door.height);
+    if (door.unlocked && atDoor) {
+        pushGameEvent(w, EV_DOOR_REACHED, player.x, player.y);
+    }
+    
+    runGameRules(w);
+}
+
+void stepWorld(World& w, const TickInput& in) {
+    w.step(w, in);
+}
+
+TickInput keyboardInput() {
+    TickInput in;
+    in.left = keys['a'] || keys['A'];
+    in.right = keys['d'] || keys['D'];
+    in.jump = keys['w'] || keys['W'] || keys[' '];
+    return in;
+}
+
+// ---------------- Autopilot ----------------
+// Plays by searching over short input sequences on copies of the world. A
+// sequence is built from macros (walk, or jump while holding a direction for
+// a while) that each run until the player is standing again, so one search
+// step covers a whole jump arc. The best macros at the first level are
+// expanded once more and the winning first macro is then played out. The
+// copies share the live world's random state, so what is planned is exactly
+// what happens. Used as a load generator and as an automatic playtester.
+
+struct AutopilotMacro {
+    int dir;      // -1 left, 0 none, 1 right
+    bool jump;
+    int hold;     // ticks the direction is held
+    int delay;    // ticks before the direction is pressed
+};
+
+const AutopilotMacro AUTOPILOT_MACROS[] = {
+    {0, true, 0, 0},
+    {-1, true, 10, 0}, {-1, true, 25, 0}, {-1, true, 45, 0}, {-1, true, 70, 0}, {-1, true, 110, 0},
+    {1, true, 10, 0}, {1, true, 25, 0}, {1, true, 45, 0}, {1, true, 70, 0}, {1, true, 110, 0},
+    {-1, true, 30, 50}, {-1, true, 60, 50}, {1, true, 30, 50}, {1, true, 60, 50},
+    {-1, false, 6, 0}, {-1, false, 16, 0}, {-1, false, 32, 0},
+    {1, false, 6, 0}, {1, false, 16, 0}, {1, false, 32, 0},
+    {0, false, 8, 0}
+};
+const int AUTOPILOT_MACRO_COUNT = sizeof(AUTOPILOT_MACROS) / sizeof(AUTOPILOT_MACROS[0]);
+const int AUTOPILOT_MAX_MACRO_TICKS = 140;
+const int AUTOPILOT_BEAM = 6;                   // first-level macros expanded again
+const double AUTOPILOT_BUDGET_MS = 16.0;        // one tick
+const double AUTOPILOT_SOFT_BUDGET_MS = 12.0;   // stop expanding past this
+
+struct AutopilotStats {
+    long decisions;
+    long overBudget;        // decisions that took longer than a tick
+    long simulatedTicks;
+    double lastMs;
+    double maxMs;
+    double totalMs;
+};
+
+bool autopilotEnabled = false;
+AutopilotStats autopilotStats;
+
+int autopilotMacro = -1;        // macro being played out, -1 when a new plan is needed
+int autopilotMacroTick = 0;
+int autopilotExpectedTime = -1; // world time the next input is for
+const int AUTOPILOT_GIVE_UP_TICKS = 300;
+unsigned long long autopilotGaveUp = 0;   // coins the bot failed to reach in time
+int autopilotChasing = -1;
+int autopilotChasingSince = 0;
+
+TickInput autopilotInput(const AutopilotMacro& m, int t) {
+    TickInput in;
+    bool held = t >= m.delay && t < m.delay + m.hold;
+    in.left = m.dir < 0 && held;
+    in.right = m.dir > 0 && held;
+    in.jump = m.jump && t == 0;
+    return in;
+}
+
+bool autopilotMacroDone(const World& w, const AutopilotMacro& m, int t) {
+    if (t >= AUTOPILOT_MAX_MACRO_TICKS) return true;
+    return t >= 1 && t >= m.delay + m.hold && w.player.velocityY == 0 && !w.player.isJumping;
+}
+
+// Where the bot wants to be: the key, then the door, otherwise the cheapest
+// coin still above the lava. Coins below the player cost extra (dropping down
+// is risky) and coins close to the lava are taken before it swallows them;
+// coins in autopilotGaveUp are skipped. Targets out of jump range are replaced
+// by the platform that best serves as a stepping stone towards them. Returns
+// the index of the targeted coin, or -1.
+int autopilotTarget(const World& w, float& tx, float& ty) {
+    const Player& p = w.player;
+    int coin = -1;
+    if (w.key.spawned && !w.key.collected) {
+        tx = w.key.x;
+        ty = w.key.y;
+    } else if (w.key.collected) {
+        tx = w.door.x + w.door.width / 2;
+        ty = w.door.y + w.door.height / 2;
+    } else {
+        float best = 1e30f;
+        tx = p.x;
+        ty = WINDOW_HEIGHT;
+        for (size_t i = 0; i < w.collectables.size(); i++) {
+            const Collectable& c = w.collectables[i];
+            if (c.collected || c.y < w.lavaHeight + 40) continue;
+            if (i < 64 && (autopilotGaveUp >> i) & 1) continue;
+            float d = fabs(c.x - p.x) + (c.y < p.y ? 3.0f : 1.5f) * fabs(c.y - p.y)
+                    + (c.y - w.lavaHeight);   // the lava takes the low ones first
+            if (d < best) {
+                best = d;
+                tx = c.x;
+                ty = c.y;
+                coin = (int)i;
             }
-            glEnd();
         }
-        
-        glPopMatrix();
+    }
+
+    const float reach = jumpApex(w) - 50;   // comfortably inside the apex
+    if (ty - p.y > reach) {
+        float best = 1e30f;
+        for (const Platform& pl : w.platforms) {
+            if (pl.destroyed) continue;
+            float top = pl.y + pl.height;
+            if (top <= p.y + 30 || top > p.y + reach) continue;
+            float d = fabs(pl.x + pl.width / 2 - tx) - (top - p.y);
+            if (d < best) {
+                best = d;
+                tx = pl.x + pl.width / 2;
+                ty = top;
+            }
+        }
+    }
+    return coin;
+}
+
+float autopilotDistance(const World& w, float tx, float ty) {
+    float dx = w.player.x - tx;
+    float dy = w.player.y + w.player.height / 2 - ty;
+    return sqrt(dx * dx + dy * dy);
+}
+
+// Runs one macro on w, tracking the nearest approach to the target.
+void autopilotRun(World& w, const AutopilotMacro& m, float tx, float ty, float& closest) {
+    for (int t = 0; w.state == PLAYING && !autopilotMacroDone(w, m, t); t++) {
+        stepWorld(w, autopilotInput(m, t));
+        closest = fmin(closest, autopilotDistance(w, tx, ty));
+        autopilotStats.simulatedTicks++;
+    }
+}
+
+// closest is the nearest the player got to the target anywhere along the
+// sequence, so arcs that pass through a coin or the key count as reaching it.
+float autopilotScore(const World& w, const World& root, float closest) {
+    if (w.state == LOSE) return -1e9f + w.gameTime;
+    if (w.state == WIN) return 1e9f - w.gameTime;
+
+    const Player& p = w.player;
+    float score = 0;
+    score += (p.score - root.player.score) * 100.0f;
+    score -= (root.player.lives - p.lives) * 3000.0f;
+    if (w.key.collected && !root.key.collected) score += 5000;
+    score -= closest;
+    score -= (w.gameTime - root.gameTime) * 0.5f;   // sooner is better, the lava is rising
+
+    float margin = p.y - w.lavaHeight;
+    if (margin < 150) score -= (150 - margin) * 10;
+    return score;
+}
+
+double autopilotElapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+struct AutopilotCandidate {
+    World w;
+    float closest;
+    float score;
+};
+
+// Planning scratch lives across decisions so the World copies below reuse
+// the vectors' capacity instead of allocating on every call.
+World autopilotRoot;
+World autopilotNext;
+AutopilotCandidate autopilotFirst[AUTOPILOT_MACRO_COUNT];
+
+int autopilotPlan(const World& w) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    static bool scratchReserved = false;
+    if (!scratchReserved) {
+        reserveWorld(autopilotRoot);
+        reserveWorld(autopilotNext);
+        for (AutopilotCandidate& c : autopilotFirst) reserveWorld(c.w);
+        scratchReserved = true;
+    }
+    World& root = autopilotRoot;
+    root = w;
+    root.live = false;
+    float tx, ty;
+    int coin = autopilotTarget(root, tx, ty);
+    if (coin != autopilotChasing) {
+        autopilotChasing = coin;
+        autopilotChasingSince = root.gameTime;
+    } else if (coin >= 0 && coin < 64 &&
+               root.gameTime - autopilotChasingSince > AUTOPILOT_GIVE_UP_TICKS) {
+        autopilotGaveUp |= 1ULL << coin;
+        coin = autopilotTarget(root, tx, ty);
+        autopilotChasing = coin;
+        autopilotChasingSince = root.gameTime;
+    }
+    float startDistance = autopilotDistance(root, tx, ty);
+
+    AutopilotCandidate* first = autopilotFirst;
+    float best[AUTOPILOT_MACRO_COUNT];
+    int evaluated = 0;   // the soft budget can stop this level too, after the first macro
+    while (evaluated < AUTOPILOT_MACRO_COUNT &&
+           (evaluated == 0 || autopilotElapsedMs(start) <= AUTOPILOT_SOFT_BUDGET_MS)) {
+        int i = evaluated++;
+        AutopilotCandidate& c = first[i];
+        c.w = root;
+        c.closest = startDistance;
+        autopilotRun(c.w, AUTOPILOT_MACROS[i], tx, ty, c.closest);
+        c.score = autopilotScore(c.w, root, c.closest);
+        best[i] = c.score;
+    }
+
+    // Expand the most promising first moves by one more macro.
+    int order[AUTOPILOT_MACRO_COUNT];
+    int beam = std::min(AUTOPILOT_BEAM, evaluated);
+    for (int i = 0; i < evaluated; i++) order[i] = i;
+    for (int i = 0; i < beam; i++) {
+        for (int j = i + 1; j < evaluated; j++) {
+            if (first[order[j]].score > first[order[i]].score) std::swap(order[i], order[j]);
+        }
+    }
+    for (int b = 0; b < beam; b++) {
+        const AutopilotCandidate& c = first[order[b]];
+        if (c.w.state != PLAYING) continue;
+        float followBest = -1e30f;
+        for (int j = 0; j < AUTOPILOT_MACRO_COUNT; j++) {
+            if (autopilotElapsedMs(start) > AUTOPILOT_SOFT_BUDGET_MS) break;
+            World& next = autopilotNext;
+            next = c.w;
+            float closest = c.closest;
+            autopilotRun(next, AUTOPILOT_MACROS[j], tx, ty, closest);
+            followBest = fmax(followBest, autopilotScore(next, root, closest));
+        }
+        if (followBest > -1e30f) best[order[b]] = fmax(best[order[b]], followBest);
+    }
+
+    int choice = 0;
+    for (int i = 1; i < evaluated; i++) {
+        if (best[i] > best[choice]) choice = i;
+    }
+
+    double ms = autopilotElapsedMs(start);
+    autopilotStats.decisions++;
+    autopilotStats.lastMs = ms;
+    autopilotStats.totalMs += ms;
+    if (ms > autopilotStats.maxMs) autopilotStats.maxMs = ms;
+    if (ms > AUTOPILOT_BUDGET_MS) autopilotStats.overBudget++;
+    return choice;
+}
+
+// Input for the next tick of w. Plans when the current macro has finished or
+// the world has moved on without us (restart, manual play in between).
+TickInput autopilotDecide(const World& w) {
+    if (w.gameTime < autopilotExpectedTime - 1) {
+        autopilotGaveUp = 0;   // a new level
+        autopilotChasing = -1;
+    }
+    if (autopilotMacro < 0 || w.gameTime != autopilotExpectedTime ||
+        autopilotMacroDone(w, AUTOPILOT_MACROS[autopilotMacro], autopilotMacroTick)) {
+        autopilotMacro = autopilotPlan(w);
+        autopilotMacroTick = 0;
+    }
+    autopilotExpectedTime = w.gameTime + 1;
+    return autopilotInput(AUTOPILOT_MACROS[autopilotMacro], autopilotMacroTick++);
+}
+
+void printAutopilotStats() {
+    const AutopilotStats& s = autopilotStats;
+    printf("autopilot: %ld decisions, avg %.3f ms, max %.3f ms, %ld over the %.0f ms budget, "
+           "%ld simulated ticks\n",
+           s.decisions, s.decisions ? s.totalMs / s.decisions : 0.0, s.maxMs,
+           s.overBudget, AUTOPILOT_BUDGET_MS, s.simulatedTicks);
+}
+
+// Headless playtest: ./game --autopilot [games]
+int runAutopilot(int games) {
+    if (!leaderboardOpen(leaderboard, "leaderboard")) fprintf(stderr, "leaderboard unavailable\n");
+    int wins = 0;
+    long ticks = 0;
+    for (int g = 0; g < games; g++) {
+        World w;
+        w.live = false;
+        w.state = PLAYING;
+        resetWorld(w, (unsigned)time(0) + g * 7919, selectedDifficulty);
+        while (w.state == PLAYING) {
+            stepWorld(w, autopilotDecide(w));
+            ticks++;
+        }
+        if (w.state == WIN) wins++;
+        leaderboardAdd(leaderboard, resultOf(w, RESULT_AUTOPILOT));
+        printf("game %d: %s at tick %d, score %d, lives %d\n", g + 1,
+               w.state == WIN ? "WIN" : "LOSE", w.gameTime, w.player.score, w.player.lives);
+    }
+    printf("%d/%d games won, %ld ticks played\n", wins, games, ticks);
+    printAutopilotStats();
+    return 0;
+}
+
+// ---------------- Input latency ----------------
+// Key events are stamped when they arrive. The timer callback no longer runs
+// the simulation; it only asks for a redraw, and display() runs the ticks
+// that have fallen due right before drawing. The keyboard is therefore
+// sampled as late as possible for the frame it feeds. In debug builds the
+// time from the oldest key event a tick consumed to glutSwapBuffers() of the
+// frame showing it is collected into a histogram printed at exit.
+
+typedef std::chrono::steady_clock::time_point Stamp;
+
+bool inputPending = false;   // key events not yet seen by a tick
+Stamp inputArrival;          // arrival of the oldest of them
+bool latencyArmed = false;   // the frame being drawn shows a tick that consumed input
+Stamp latencyFrom;
+
+void noteInput() {
+    if (!inputPending) {
+        inputPending = true;
+        inputArrival = std::chrono::steady_clock::now();
+    }
+}
+
+#ifndef NDEBUG
+const int LATENCY_BUCKETS = 50;   // 1 ms wide; the last one collects everything slower
+long latencyHistogram[LATENCY_BUCKETS];
+long latencySamples = 0;
+double latencyTotalMs = 0;
+
+void recordLatency(double ms) {
+    int bucket = (int)ms;
+    if (bucket >= LATENCY_BUCKETS) bucket = LATENCY_BUCKETS - 1;
+    latencyHistogram[bucket]++;
+    latencySamples++;
+    latencyTotalMs += ms;
+}
+
+void printLatencyHistogram() {
+    if (latencySamples == 0) return;
+    fprintf(stderr, "input-to-swap latency: %ld samples, mean %.2f ms\n",
+            latencySamples, latencyTotalMs / latencySamples);
+    long seen = 0;
+    bool p50 = false, p99 = false;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += latencyHistogram[i];
+        if (!p50 && seen * 2 >= latencySamples) {
+            fprintf(stderr, "  p50 < %d ms\n", i + 1);
+            p50 = true;
+        }
+        if (!p99 && seen * 100 >= latencySamples * 99) {
+            fprintf(stderr, "  p99 < %d ms\n", i + 1);
+            p99 = true;
+        }
+    }
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        if (latencyHistogram[i] == 0) continue;
+        fprintf(stderr, "  %2d-%2d%s ms %6ld  ", i, i + 1, i == LATENCY_BUCKETS - 1 ? "+" : " ",
+                latencyHistogram[i]);
+        for (long n = latencyHistogram[i] * 60 / latencySamples; n > 0; n--) fputc('#', stderr);
+        fputc('\n', stderr);
+    }
+}
+#endif
+
+// ---------------- Frame pacing ----------------
+// Ticks follow an absolute schedule on the monotonic clock: tick n is due at
+// pacer.start + n * TICK_MS, however late the callbacks that notice it are,
+// so the game runs at exactly 62.5 ticks per second without drift. Frames are
+// driven by vsync where the swap interval can be set, and otherwise by a
+// timer aimed at the next tick deadline. Counters are shown with F and
+// printed at exit.
+
+const double TICK_MS = 16.0;              // game time per tick; physics is tuned for it
+const int MAX_TICKS_PER_FRAME = 4;        // catch up at most this much after a stall
+const double LATE_FRAME_MS = 2.0;         // timer mode: a frame this far past its deadline is late
+
+struct FramePacer {
+    Stamp start;              // tick n is due at start + n * TICK_MS
+    long ticksScheduled;      // ticks handed to the simulation so far
+    bool vsync;               // swap interval 1 is in effect
+    double refreshMs;         // vsync mode: measured display refresh period
+    Stamp lastFrame;
+    long frames;
+    long lateFrames;          // frames shown after their deadline
+    long missedDeadlines;     // tick or refresh deadlines that passed without a frame
+    double fps;               // achieved over the last second
+    Stamp fpsWindowStart;
+    long fpsWindowFrames;
+    bool showStats;
+};
+
+FramePacer pacer;
+
+double msBetween(Stamp from, Stamp to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+// Asks the driver to sync swaps to the display refresh. Returns false when
+// there is no way to do that here, in which case the timer paces frames.
+bool enableVsync() {
+#ifdef __APPLE__
+    GLint interval = 1;
+    return CGLSetParameter(CGLGetCurrentContext(), kCGLCPSwapInterval, &interval) == kCGLNoError;
+#elif defined(__linux__)
+    typedef int (*SwapIntervalFn)(int);
+    SwapIntervalFn swapInterval =
+        (SwapIntervalFn)glXGetProcAddress((const GLubyte*)"glXSwapIntervalMESA");
+    if (!swapInterval)
+        swapInterval = (SwapIntervalFn)glXGetProcAddress((const GLubyte*)"glXSwapIntervalSGI");
+    return swapInterval && swapInterval(1) == 0;
+#else
+    return false;
+#endif
+}
+
+void pacerStart() {
+    Stamp now = std::chrono::steady_clock::now();
+    pacer.start = now;
+    pacer.ticksScheduled = 0;
+    pacer.lastFrame = now;
+    pacer.fpsWindowStart = now;
+    pacer.refreshMs = 1000.0 / 60;
+    pacer.vsync = enableVsync();
+}
+
+// Ticks whose deadline has passed since the last call. On the result screen
+// the schedule just follows the clock so that a restart does not catch up.
+int pacerDueTicks() {
+    long reached = (long)(msBetween(pacer.start, std::chrono::steady_clock::now()) / TICK_MS);
+    long due = reached - pacer.ticksScheduled;
+    pacer.ticksScheduled = reached;
+    if (gameState == WIN || gameState == LOSE) return 0;
+    if (!pacer.vsync && due > 1) pacer.missedDeadlines += due - 1;
+    return (int)due;
+}
+
+// Milliseconds until the next tick deadline, for glutTimerFunc. Rounded up:
+// truncating fires the timer before the deadline, and that wake-up finds
+// no tick due and costs another timer round.
+unsigned pacerDelayMs() {
+    double next = (pacer.ticksScheduled + 1) * TICK_MS;
+    double wait = next - msBetween(pacer.start, std::chrono::steady_clock::now());
+    return wait > 0 ? (unsigned)ceil(wait) : 0;
+}
+
+void pacerFrameShown() {
+    Stamp now = std::chrono::steady_clock::now();
+    double interval = msBetween(pacer.lastFrame, now);
+    pacer.lastFrame = now;
+    pacer.frames++;
+
+    if (pacer.vsync) {
+        // Track the refresh period from well-behaved frames, count the rest.
+        if (interval < pacer.refreshMs * 1.5) {
+            pacer.refreshMs += (interval - pacer.refreshMs) * 0.05;
+        } else {
+            pacer.lateFrames++;
+            pacer.missedDeadlines += (long)(interval / pacer.refreshMs + 0.5) - 1;
+        }
+    } else {
+        double deadline = pacer.ticksScheduled * TICK_MS;
+        if (msBetween(pacer.start, now) - deadline > LATE_FRAME_MS) pacer.lateFrames++;
+    }
+
+    pacer.fpsWindowFrames++;
+    double window = msBetween(pacer.fpsWindowStart, now);
+    if (window >= 1000) {
+        pacer.fps = pacer.fpsWindowFrames * 1000.0 / window;
+        pacer.fpsWindowStart = now;
+        pacer.fpsWindowFrames = 0;
+    }
+
+    // With vsync the swap does the waiting, so go straight on to the next frame.
+    if (pacer.vsync && gameState != WIN && gameState != LOSE) glutPostRedisplay();
+}
+
+void drawPacerStats() {
+    gfxColor3f(0.8f, 0.8f, 0.8f);
+    drawText(WINDOW_WIDTH - 460, 15,
+             frameFormat("FPS %.1f  late %ld  missed %ld  %s  LOD %s",
+                         pacer.fps, pacer.lateFrames, pacer.missedDeadlines,
+                         pacer.vsync ? "vsync" : "timer", quality().name));
+}
+
+// ---------------- Quality governor ----------------
+// Picks the level-of-detail tier from measured frame cost: the time from
+// the end of the frame's ticks to just before the swap (drawing, plus
+// rasterizing with the software backend). The swap is left out because
+// with vsync it includes the wait. A smoothed cost over GOVERNOR_HIGH_MS
+// steps one tier down. GOVERNOR_RAISE_FRAMES frames in a row under
+// GOVERNOR_LOW_MS step one tier back up. Changes are at least
+// GOVERNOR_SETTLE_FRAMES apart, and a raise that has to be taken back
+// straight away doubles the wait before the next one, so a load sitting
+// between two tiers does not flicker.
+// What the lowest tier can hold, measured with --lodbench in the software
+// backend on one core at -O2: about 9 ms a frame with no rocks (the sky
+// and lava fills) and about 5 us per rock in view, so 60 FPS up to about
+// 1000 rocks; 2000 take 15-20 ms. At -O0 the empty scene alone is 40 ms.
+// There the rocks are one batch and the command buffer costs well under a
+// millisecond, so it is not one of the governor's steps.
+
+const double FRAME_BUDGET_MS = 1000.0 / 60;
+const double GOVERNOR_HIGH_MS = FRAME_BUDGET_MS * 0.85;
+const double GOVERNOR_LOW_MS = FRAME_BUDGET_MS * 0.45;
+const int GOVERNOR_RAISE_FRAMES = 120;
+const int GOVERNOR_SETTLE_FRAMES = 30;
+
+struct QualityGovernor {
+    double averageMs;     // exponential, over about ten frames
+    int quietFrames;      // in a row under GOVERNOR_LOW_MS
+    int sinceChange;
+    int raiseAfter;       // quiet frames needed to step up
+    bool lastWasRaise;
+    long lowered;
+    long raised;
+    long framesAt[QUALITY_TIER_COUNT];
+};
+
+QualityGovernor governor = {0, 0, 0, GOVERNOR_RAISE_FRAMES, false, 0, 0, {0}};
+
+void governorFrame(double ms) {
+    QualityGovernor& g = governor;
+    g.framesAt[qualityTier]++;
+    g.averageMs += (ms - g.averageMs) * 0.1;
+    g.quietFrames = ms < GOVERNOR_LOW_MS ? g.quietFrames + 1 : 0;
+    g.sinceChange++;
+    if (qualityPinned || g.sinceChange < GOVERNOR_SETTLE_FRAMES) return;
+    if (g.averageMs > GOVERNOR_HIGH_MS && qualityTier + 1 < QUALITY_TIER_COUNT) {
+        if (g.lastWasRaise && g.sinceChange < 4 * GOVERNOR_SETTLE_FRAMES) {
+            g.raiseAfter = std::min(g.raiseAfter * 2, 16 * GOVERNOR_RAISE_FRAMES);
+        }
+        qualityTier++;
+        g.lowered++;
+        g.lastWasRaise = false;
+        g.sinceChange = 0;
+        g.quietFrames = 0;
+    } else if (g.quietFrames >= g.raiseAfter && qualityTier > 0) {
+        qualityTier--;
+        g.raised++;
+        g.lastWasRaise = true;
+        g.sinceChange = 0;
+        g.quietFrames = 0;
+    }
+}
+
+void printGovernorStats() {
+    long frames = 0;
+    for (int i = 0; i < QUALITY_TIER_COUNT; i++) frames += governor.framesAt[i];
+    if (frames == 0) return;
+    fprintf(stderr, "quality: %s now, %ld steps down, %ld up; frames at", quality().name,
+            governor.lowered, governor.raised);
+    for (int i = 0; i < QUALITY_TIER_COUNT; i++) {
+        fprintf(stderr, " %s %.0f%%", QUALITY_TIERS[i].name, 100.0 * governor.framesAt[i] / frames);
+    }
+    fprintf(stderr, "\n");
+}
+
+void printPacerStats() {
+    fprintf(stderr, "frames: %ld shown, %.1f fps, %ld late, %ld deadlines missed, %s paced\n",
+            pacer.frames, pacer.fps, pacer.lateFrames, pacer.missedDeadlines,
+            pacer.vsync ? "vsync" : "timer");
+}
+
+// Restarts are timed twice: the work done on the input thread, and from
+// the key or click to the swap of the first frame of the new level.
+struct RestartStats {
+    long count;
+    long overFrame;      // first frames later than FRAME_BUDGET_MS
+    double workMs, worstWorkMs;
+    double frameMs, worstFrameMs;
+};
+
+RestartStats restartStats;
+bool restartArmed = false;
+Stamp restartFrom;
+
+void restartLevel() {
+    restartFrom = std::chrono::steady_clock::now();
+    gameState = PLAYING;
+    startLevel();
+    double ms = msBetween(restartFrom, std::chrono::steady_clock::now());
+    restartStats.workMs += ms;
+    restartStats.worstWorkMs = std::max(restartStats.worstWorkMs, ms);
+    restartArmed = true;
+    glutPostRedisplay();   // don't wait for the timer to show it
+}
+
+void restartFrameShown() {
+    restartArmed = false;
+    double ms = msBetween(restartFrom, std::chrono::steady_clock::now());
+    RestartStats& r = restartStats;
+    r.count++;
+    r.frameMs += ms;
+    r.worstFrameMs = std::max(r.worstFrameMs, ms);
+    if (ms > FRAME_BUDGET_MS) r.overFrame++;
+}
+
+void printRestartStats() {
+    const RestartStats& r = restartStats;
+    if (r.count == 0) return;
+    fprintf(stderr, "restarts: %ld (%ld prebuilt, %ld built on the spot), work %.3f ms average "
+            "%.3f worst, first frame %.2f ms average %.2f worst, %ld over a frame\n",
+            r.count, prebuilder.hits, prebuilder.misses, r.workMs / r.count, r.worstWorkMs,
+            r.frameMs / r.count, r.worstFrameMs, r.overFrame);
+}
+
+// Called after glutSwapBuffers().
+void frameShown() {
+    pacerFrameShown();
+    if (restartArmed) restartFrameShown();
+    if (!latencyArmed) return;
+    latencyArmed = false;
+#ifndef NDEBUG
+    recordLatency(std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - latencyFrom).count());
+#endif
+}
+
+// ---------------- Spectator stream ----------------
+// Live games are broadcast to spectator processes on the same machine over a
+// Unix domain socket (./game --broadcast, watched with ./game --spectate).
+// Every tick the world is quantized into a flat array of ints, a snapshot.
+// Each spectator is sent that snapshot delta-encoded against the last one it
+// acknowledged, or a keyframe when it has acknowledged nothing recent and on
+// a fixed interval. Clients that acknowledged the same snapshot get the same
+// bytes, so one encode per tick serves any number of them. A delta is a list
+// of (unchanged fields to skip, zigzag change) varint pairs, so an unchanged
+// world costs a few bytes. Only the platforms in the camera's view are sent
+// (they are sorted by height), so a --tall level costs no more than a short
+// one; every rock, coin and power-up is sent.
+
+const char* SPECTATOR_SOCKET = "/tmp/icytower-spectator.sock";
+const int SPECTATOR_HISTORY = 64;          // power of two; snapshots a delta may be based on
+const int SPECTATOR_KEYFRAME_TICKS = 120;  // everyone gets a keyframe this often
+const int SPECTATOR_MAX_CLIENTS = 16;
+const int SPECTATOR_QUANT = 8;             // positions are sent in 1/8 pixel steps
+
+// Entities beyond these caps are not sent, and the header says so. Only
+// the platform cap can be reached: a view holds about 15 platforms.
+const int SNAP_MAX_PLATFORMS = 64;
+const int SNAP_MAX_COLLECTABLES = COLLECTABLES_COUNT;
+const int SNAP_MAX_ROCKS = MAX_ROCKS;
+const int SNAP_MAX_POWERUPS = MAX_POWERUPS;
+const int SNAP_HEADER_FIELDS = 30;
+const int SNAP_COUNTS_AT = 22;             // header index of the four entity counts
+const int SNAP_TRUNCATED_AT = 27;          // header index of the SnapTruncated bits
+
+// Which lists a snapshot left entities out of.
+enum SnapTruncated {
+    SNAP_CUT_PLATFORMS = 1,
+    SNAP_CUT_COLLECTABLES = 2,
+    SNAP_CUT_ROCKS = 4,
+    SNAP_CUT_POWERUPS = 8
+};
+const int SPECTATOR_MAX_FIELDS = SNAP_HEADER_FIELDS + SNAP_MAX_PLATFORMS * 5 +
+                                 SNAP_MAX_COLLECTABLES * 4 + SNAP_MAX_ROCKS * 4 +
+                                 SNAP_MAX_POWERUPS * 5;
+// length, seq, base, field count, then at most two 5 byte varints per field
+const int SPECTATOR_MAX_MESSAGE = 12 + 5 + SPECTATOR_MAX_FIELDS * 10;
+
+struct Snapshot {
+    uint32_t seq;    // 0: empty, the base of a keyframe
+    int count;
+    int32_t f[SPECTATOR_MAX_FIELDS];
+};
+
+int32_t quantize(float v) {
+    return (int32_t)lround(v * SPECTATOR_QUANT);
+}
+
+float dequantize(int32_t v) {
+    return (float)v / SPECTATOR_QUANT;
+}
+
+void snapshotWorld(const World& w, Snapshot& s) {
+    int32_t* f = s.f;
+    int n = 0;
+    float top = w.cameraY + WINDOW_HEIGHT;
+    int firstPlatform = std::partition_point(w.platforms.begin(), w.platforms.end(),
+                                             [&](const Platform& p) { return p.y + p.height < w.cameraY; }) -
+                        w.platforms.begin();
+    int lastPlatform = firstPlatform;
+    while (lastPlatform < (int)w.platforms.size() && w.platforms[lastPlatform].y <= top) lastPlatform++;
+    int platformCount = std::min(lastPlatform - firstPlatform, SNAP_MAX_PLATFORMS);
+    int collectableCount = std::min((int)w.collectables.size(), SNAP_MAX_COLLECTABLES);
+    int rockCount = std::min((int)w.rocks.size(), SNAP_MAX_ROCKS);
+    int powerUpCount = std::min((int)w.powerUps.size(), SNAP_MAX_POWERUPS);
+    int truncated = (platformCount < lastPlatform - firstPlatform) * SNAP_CUT_PLATFORMS |
+                    (collectableCount < (int)w.collectables.size()) * SNAP_CUT_COLLECTABLES |
+                    (rockCount < (int)w.rocks.size()) * SNAP_CUT_ROCKS |
+                    (powerUpCount < (int)w.powerUps.size()) * SNAP_CUT_POWERUPS;
+
+    f[n++] = w.state;
+    f[n++] = w.gameTime;
+    f[n++] = w.letsGo;
+    f[n++] = quantize(w.lavaHeight);
+    f[n++] = quantize(w.player.x);
+    f[n++] = quantize(w.player.y);
+    f[n++] = quantize(w.player.width);
+    f[n++] = quantize(w.player.height);
+    f[n++] = w.player.lives;
+    f[n++] = w.player.score;
+    f[n++] = w.player.activePowerUp;
+    f[n++] = w.player.hasKey;
+    f[n++] = quantize(w.key.x);
+    f[n++] = quantize(w.key.y);
+    f[n++] = quantize(w.key.size);
+    f[n++] = w.key.spawned | w.key.collected << 1;
+    f[n++] = quantize(w.door.x);
+    f[n++] = quantize(w.door.y);
+    f[n++] = quantize(w.door.width);
+    f[n++] = quantize(w.door.height);
+    f[n++] = w.door.unlocked;
+    f[n++] = (int32_t)lround(w.door.openAnimation * 256);
+    assert(n == SNAP_COUNTS_AT);
+    f[n++] = platformCount;
+    f[n++] = collectableCount;
+    f[n++] = rockCount;
+    f[n++] = powerUpCount;
+    f[n++] = quantize(w.cameraY);
+    assert(n == SNAP_TRUNCATED_AT);
+    f[n++] = truncated;
+    f[n++] = firstPlatform;
+    while (n < SNAP_HEADER_FIELDS) f[n++] = 0;   // room to grow without renumbering
+
+    for (int i = firstPlatform; i < firstPlatform + platformCount; i++) {
+        const Platform& p = w.platforms[i];
+        f[n++] = quantize(p.x);
+        f[n++] = quantize(p.y);
+        f[n++] = quantize(p.width);
+        f[n++] = quantize(p.height);
+        f[n++] = p.destroyed | p.crumbling << 1 | p.kind << 2;
+    }
+    for (int i = 0; i < collectableCount; i++) {
+        const Collectable& c = w.collectables[i];
+        f[n++] = quantize(c.x);
+        f[n++] = quantize(c.y);
+        f[n++] = quantize(c.size);
+        f[n++] = c.collected;
+    }
+    for (int i = 0; i < rockCount; i++) {
+        const Rock& r = w.rocks[i];
+        f[n++] = quantize(r.x);
+        f[n++] = quantize(r.y);
+        f[n++] = quantize(r.size);
+        f[n++] = r.active;
+    }
+    for (int i = 0; i < powerUpCount; i++) {
+        const PowerUp& pu = w.powerUps[i];
+        f[n++] = quantize(pu.x);
+        f[n++] = quantize(pu.y);
+        f[n++] = quantize(pu.size);
+        f[n++] = pu.type;
+        f[n++] = pu.collected;
+    }
+    s.count = n;
+}
+
+// The inverse, for the spectator's copy of the world. Rotations are cosmetic
+// and not sent; they are derived from the game clock instead. The copy
+// holds only the platforms in view.
+void applySnapshot(const Snapshot& s, World& w) {
+    const int32_t* f = s.f;
+    int n = 0;
+    w.state = (GameState)f[n++];
+    w.gameTime = f[n++];
+    w.letsGo = f[n++] != 0;
+    w.lavaHeight = dequantize(f[n++]);
+    w.player.x = dequantize(f[n++]);
+    w.player.y = dequantize(f[n++]);
+    w.player.width = dequantize(f[n++]);
+    w.player.height = dequantize(f[n++]);
+    w.player.lives = f[n++];
+    w.player.score = f[n++];
+    w.player.activePowerUp = f[n++];
+    w.player.hasKey = f[n++];
+    w.key.x = dequantize(f[n++]);
+    w.key.y = dequantize(f[n++]);
+    w.key.size = dequantize(f[n++]);
+    w.key.spawned = f[n] & 1;
+    w.key.collected = (f[n++] & 2) != 0;
+    w.key.rotation = w.gameTime * 3.0f;
+    w.door.x = dequantize(f[n++]);
+    w.door.y = dequantize(f[n++]);
+    w.door.width = dequantize(f[n++]);
+    w.door.height = dequantize(f[n++]);
+    w.door.unlocked = f[n++];
+    w.door.openAnimation = f[n++] / 256.0f;
+    w.platforms.resize(f[n++]);
+    w.collectables.resize(f[n++]);
+    w.rocks.resize(f[n++]);
+    w.powerUps.resize(f[n++]);
+    w.cameraY = dequantize(f[n++]);
+    n = SNAP_HEADER_FIELDS;
+
+    for (Platform& p : w.platforms) {
+        p.x = dequantize(f[n++]);
+        p.y = dequantize(f[n++]);
+        p.width = dequantize(f[n++]);
+        p.height = dequantize(f[n++]);
+        p.destroyed = f[n] & 1;
+        p.crumbling = (f[n] >> 1) & 1;
+        p.kind = (uint8_t)(f[n++] >> 2);
+    }
+    for (Collectable& c : w.collectables) {
+        c.x = dequantize(f[n++]);
+        c.y = dequantize(f[n++]);
+        c.size = dequantize(f[n++]);
+        c.collected = f[n++];
+        c.rotation = w.gameTime * 2.0f;
+    }
+    for (Rock& r : w.rocks) {
+        r.x = dequantize(f[n++]);
+        r.y = dequantize(f[n++]);
+        r.size = dequantize(f[n++]);
+        r.active = f[n++];
+    }
+    for (PowerUp& pu : w.powerUps) {
+        pu.x = dequantize(f[n++]);
+        pu.y = dequantize(f[n++]);
+        pu.size = dequantize(f[n++]);
+        pu.type = f[n++];
+        pu.collected = f[n++];
+        pu.rotation = w.gameTime * 5.0f;
+    }
+}
+
+size_t putVarint(uint8_t* out, uint32_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+// Returns false on a truncated varint.
+bool getVarint(const uint8_t*& p, const uint8_t* end, uint32_t& v) {
+    v = 0;
+    for (int shift = 0; p < end && shift < 35; shift += 7) {
+        uint8_t b = *p++;
+        v |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+void putU32(uint8_t* out, uint32_t v) {
+    memcpy(out, &v, 4);
+}
+
+uint32_t getU32(const uint8_t* in) {
+    uint32_t v;
+    memcpy(&v, in, 4);
+    return v;
+}
+
+// Message: u32 length of the rest, u32 seq, u32 base seq (0 for a keyframe),
+// varint field count, then the delta pairs. Returns the message size.
+size_t encodeSnapshot(const Snapshot& s, const Snapshot& base, uint8_t* out) {
+    size_t n = 12;
+    n += putVarint(out + n, s.count);
+    int skip = 0;
+    for (int i = 0; i < s.count; i++) {
+        int32_t d = s.f[i] - (i < base.count ? base.f[i] : 0);
+        if (d == 0) {
+            skip++;
+            continue;
+        }
+        n += putVarint(out + n, skip);
+        n += putVarint(out + n, ((uint32_t)d << 1) ^ (uint32_t)(d >> 31));
+        skip = 0;
+    }
+    putU32(out, (uint32_t)(n - 4));
+    putU32(out + 4, s.seq);
+    putU32(out + 8, base.seq);
+    return n;
+}
+
+// Decodes the body of one message (after the length) against base, which
+// must be the snapshot it names. Returns false if the message is malformed.
+bool decodeSnapshot(const uint8_t* p, const uint8_t* end, const Snapshot& base, Snapshot& s) {
+    if (end - p < 8) return false;
+    s.seq = getU32(p);
+    p += 8;
+    uint32_t count;
+    if (!getVarint(p, end, count) || count > (uint32_t)SPECTATOR_MAX_FIELDS ||
+        count < (uint32_t)SNAP_HEADER_FIELDS) return false;
+    s.count = count;
+    for (int i = 0; i < s.count; i++) s.f[i] = i < base.count ? base.f[i] : 0;
+    uint32_t at = 0;
+    while (p < end) {
+        uint32_t skip, zz;
+        if (!getVarint(p, end, skip) || !getVarint(p, end, zz)) return false;
+        at += skip;
+        if (at >= count) return false;
+        s.f[at++] += (int32_t)(zz >> 1) ^ -(int32_t)(zz & 1);
+    }
+    // The entity counts must agree with the number of fields.
+    const int32_t* n = s.f + SNAP_COUNTS_AT;
+    return n[0] >= 0 && n[0] <= SNAP_MAX_PLATFORMS && n[1] >= 0 && n[1] <= SNAP_MAX_COLLECTABLES &&
+           n[2] >= 0 && n[2] <= SNAP_MAX_ROCKS && n[3] >= 0 && n[3] <= SNAP_MAX_POWERUPS &&
+           SNAP_HEADER_FIELDS + n[0] * 5 + n[1] * 4 + n[2] * 4 + n[3] * 5 == s.count;
+}
+
+struct SpectatorClient {
+    int fd;
+    uint32_t acked;        // newest snapshot the client has confirmed, 0 for none
+    uint8_t ackBuf[4];     // a partially received ack
+    int ackLen;
+    long bytesSent;
+    long snapshotsSent;
+    long keyframesSent;
+};
+
+struct SpectatorServer {
+    int listenFd;
+    SpectatorClient clients[SPECTATOR_MAX_CLIENTS];
+    int clientCount;
+    Snapshot history[SPECTATOR_HISTORY];
+    Snapshot empty;
+    uint32_t seq;
+
+    // Per-tick encode cache: one message per distinct base.
+    uint8_t out[SPECTATOR_MAX_CLIENTS][SPECTATOR_MAX_MESSAGE];
+    uint32_t outBase[SPECTATOR_MAX_CLIENTS];
+    size_t outLen[SPECTATOR_MAX_CLIENTS];
+
+    long ticks;            // ticks with at least one spectator
+    long encodes;
+    double encodeNs;
+    long servedClients;
+    long servedBytes;      // from clients that have left
+    long servedSnapshots;
+};
+
+SpectatorServer* spectators = NULL;   // set by --broadcast
+
+bool spectatorNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+void spectatorDrop(SpectatorServer& s, int i) {
+    SpectatorClient& c = s.clients[i];
+    fprintf(stderr, "spectator left: %ld snapshots (%ld keyframes), %.1f bytes/snapshot\n",
+            c.snapshotsSent, c.keyframesSent,
+            c.snapshotsSent ? (double)c.bytesSent / c.snapshotsSent : 0.0);
+    s.servedBytes += c.bytesSent;
+    s.servedSnapshots += c.snapshotsSent;
+    close(c.fd);
+    s.clients[i] = s.clients[--s.clientCount];
+}
+
+void spectatorAccept(SpectatorServer& s) {
+    for (;;) {
+        int fd = accept(s.listenFd, NULL, NULL);
+        if (fd < 0) return;
+        if (s.clientCount == SPECTATOR_MAX_CLIENTS || !spectatorNonBlocking(fd)) {
+            close(fd);
+            continue;
+        }
+        int sndbuf = 256 * 1024;
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+        SpectatorClient& c = s.clients[s.clientCount++];
+        memset(&c, 0, sizeof(c));
+        c.fd = fd;
+        s.servedClients++;
+    }
+}
+
+// Acks are u32 sequence numbers; only the newest one matters. Returns false
+// once the client has hung up.
+bool spectatorReadAcks(SpectatorClient& c) {
+    uint8_t buf[256];
+    for (;;) {
+        ssize_t got = recv(c.fd, buf, sizeof(buf), 0);
+        if (got == 0) return false;
+        if (got < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        for (ssize_t i = 0; i < got; i++) {
+            c.ackBuf[c.ackLen++] = buf[i];
+            if (c.ackLen < 4) continue;
+            c.ackLen = 0;
+            uint32_t ack = getU32(c.ackBuf);
+            if ((int32_t)(ack - c.acked) > 0) c.acked = ack;
+        }
+    }
+}
+
+// Called after every tick of the live world.
+void spectatorBroadcast(const World& w) {
+    if (!spectators) return;
+    SpectatorServer& s = *spectators;
+    spectatorAccept(s);
+    if (s.clientCount == 0) return;
+
+    s.ticks++;
+    Snapshot& snap = s.history[++s.seq & (SPECTATOR_HISTORY - 1)];
+    snap.seq = s.seq;
+    snapshotWorld(w, snap);
+    bool keyframeDue = s.seq % SPECTATOR_KEYFRAME_TICKS == 0;
+
+    int encoded = 0;
+    for (int i = 0; i < s.clientCount; i++) {
+        SpectatorClient& c = s.clients[i];
+        if (!spectatorReadAcks(c)) {
+            spectatorDrop(s, i--);
+            continue;
+        }
+        const Snapshot* base = &s.empty;
+        if (!keyframeDue && c.acked != 0 && s.seq - c.acked < SPECTATOR_HISTORY &&
+            s.history[c.acked & (SPECTATOR_HISTORY - 1)].seq == c.acked) {
+            base = &s.history[c.acked & (SPECTATOR_HISTORY - 1)];
+        }
+
+        int m = 0;
+        while (m < encoded && s.outBase[m] != base->seq) m++;
+        if (m == encoded) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            s.outLen[m] = encodeSnapshot(snap, *base, s.out[m]);
+            s.encodeNs += std::chrono::duration<double, std::nano>(
+                std::chrono::steady_clock::now() - start).count();
+            s.outBase[m] = base->seq;
+            s.encodes++;
+            encoded++;
+        }
+
+        // A client too slow to take a whole message is dropped rather than
+        // letting it stall the game or desynchronise its stream.
+        ssize_t sent = send(c.fd, s.out[m], s.outLen[m], 0);
+        if (sent != (ssize_t)s.outLen[m]) {
+            spectatorDrop(s, i--);
+            continue;
+        }
+        c.bytesSent += sent;
+        c.snapshotsSent++;
+        if (base == &s.empty) c.keyframesSent++;
+    }
+}
+
+void printSpectatorStats() {
+    SpectatorServer& s = *spectators;
+    long bytes = s.servedBytes, snapshots = s.servedSnapshots;
+    for (int i = 0; i < s.clientCount; i++) {
+        bytes += s.clients[i].bytesSent;
+        snapshots += s.clients[i].snapshotsSent;
+    }
+    if (snapshots == 0) return;
+    double perSnapshot = (double)bytes / snapshots;
+    fprintf(stderr, "spectators: %ld served, %.1f bytes/snapshot (%.2f KB/s each), "
+            "encode %.0f ns/tick, %ld encodes for %ld snapshots sent\n",
+            s.servedClients, perSnapshot, perSnapshot * (1000.0 / TICK_MS) / 1024,
+            s.ticks ? s.encodeNs / s.ticks : 0.0, s.encodes, snapshots);
+}
+
+void spectatorStop() {
+    printSpectatorStats();
+    for (int i = 0; i < spectators->clientCount; i++) close(spectators->clients[i].fd);
+    close(spectators->listenFd);
+    unlink(SPECTATOR_SOCKET);
+}
+
+bool spectatorStart() {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, SPECTATOR_SOCKET, sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+    unlink(SPECTATOR_SOCKET);
+    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, SPECTATOR_MAX_CLIENTS) != 0 ||
+        !spectatorNonBlocking(fd)) {
+        close(fd);
+        return false;
+    }
+    signal(SIGPIPE, SIG_IGN);   // a spectator vanishing mid-send is handled by send()
+    spectators = new SpectatorServer();
+    spectators->listenFd = fd;
+    atexit(spectatorStop);
+    return true;
+}
+
+// ---------------- Ghost runs ----------------
+// The live player is sampled every tick into a byte stream. x and y are
+// quantized like the spectator stream. Per tick the stream holds
+// zigzag(dx) << 1 | state changed, then zigzag(dy), then the state byte
+// only when it changed, all as varints. A steady walk costs two bytes per
+// tick. When a game beats the stored best run on its level (higher score,
+// then fewer ticks), or was played on a different level, its stream
+// replaces ghost.bin. A later game on the same level (seed, difficulty,
+// height and number type; --seed replays one) shows it as a translucent
+// ghost. The replay streams from the open file through a fixed buffer, so
+// it costs the same memory however long the run. The prebuild worker opens
+// and checks the file along with the level, so a prebuilt restart does no
+// file I/O; a level built on the spot opens it there.
+
+const char* GHOST_FILE = "ghost.bin";
+const uint32_t GHOST_MAGIC = 0x32545347;      // "GST2"; GST1 did not record the level
+const size_t GHOST_RESERVE = 1 << 16;         // bytes; a long game fits without growing
+const size_t GHOST_BUFFER = 4096;             // replay read-ahead
+const size_t GHOST_MAX_SAMPLE = 11;           // two 5 byte varints and a state byte
+
+struct GhostHeader {
+    uint32_t magic;
+    int32_t score;
+    int32_t ticks;
+    uint32_t seed;
+    int16_t difficulty;
+    int16_t screens;
+    int32_t fixedPoint;
+    uint64_t bytes;
+};
+
+struct GhostSample {
+    int32_t x, y;    // quantized
+    uint8_t state;   // isJumping | activePowerUp << 1 | hasKey << 4
+};
+
+struct GhostCursor {
+    GhostSample sample;
+    int32_t tick;
+    bool done;
+};
+
+// A best run being replayed: the file, positioned after what buffer holds.
+struct GhostReplay {
+    FILE* file;           // NULL: nothing to replay on this level
+    GhostHeader header;
+    uint64_t unread;      // stream bytes still in the file
+    size_t at, length;    // buffer[at, length) is decoded next
+    uint8_t buffer[GHOST_BUFFER];
+};
+
+uint8_t ghostState(const Player& p) {
+    return (uint8_t)(p.isJumping | (p.activePowerUp & 7) << 1 | p.hasKey << 4);
+}
+
+// Appends one sample, delta-coded against prev, which it then becomes.
+void ghostEncode(std::vector<uint8_t>& out, GhostSample& prev, const GhostSample& s) {
+    uint8_t buf[16];
+    size_t n = 0;
+    int32_t dx = s.x - prev.x, dy = s.y - prev.y;
+    bool changed = s.state != prev.state;
+    uint32_t zx = ((uint32_t)dx << 1) ^ (uint32_t)(dx >> 31);
+    n += putVarint(buf + n, zx << 1 | changed);   // per-tick moves are nowhere near 2^30
+    n += putVarint(buf + n, ((uint32_t)dy << 1) ^ (uint32_t)(dy >> 31));
+    if (changed) buf[n++] = s.state;
+    out.insert(out.end(), buf, buf + n);
+    prev = s;
+}
+
+void ghostClose(GhostReplay& r) {
+    if (r.file) fclose(r.file);
+    r.file = NULL;
+}
+
+// Tops the buffer up once less than a whole sample is left in it.
+void ghostRefill(GhostReplay& r) {
+    if (r.length - r.at >= GHOST_MAX_SAMPLE || r.unread == 0) return;
+    memmove(r.buffer, r.buffer + r.at, r.length - r.at);
+    r.length -= r.at;
+    r.at = 0;
+    size_t want = (size_t)std::min<uint64_t>(r.unread, GHOST_BUFFER - r.length);
+    size_t got = fread(r.buffer + r.length, 1, want, r.file);
+    r.length += got;
+    r.unread = got == want ? r.unread - got : 0;   // a short read ends the stream
+}
+
+// Opens ghost.bin for replay on level, if it holds a run on that level.
+// The stream length must fit in the file, whatever the header claims.
+bool ghostOpen(GhostReplay& r, const World& level) {
+    ghostClose(r);
+    FILE* f = fopen(GHOST_FILE, "rb");
+    if (!f) return false;
+    GhostHeader& h = r.header;
+    struct stat info;
+    bool ok = fread(&h, sizeof(h), 1, f) == 1 && h.magic == GHOST_MAGIC &&
+              fstat(fileno(f), &info) == 0 && h.bytes <= (uint64_t)info.st_size - sizeof(h) &&
+              h.seed == level.seed && h.difficulty == level.difficulty &&
+              h.screens == level.levelScreens && (h.fixedPoint != 0) == level.fixedPoint;
+    if (!ok) {
+        fclose(f);
+        return false;
+    }
+    r.file = f;
+    r.unread = h.bytes;
+    r.at = r.length = 0;
+    ghostRefill(r);
+    return true;
+}
+
+// Steps the cursor one sample. Returns false at the end of the stream.
+bool ghostDecode(GhostReplay& r, GhostCursor& c) {
+    if (c.done) return false;
+    ghostRefill(r);
+    const uint8_t* p = r.buffer + r.at;
+    const uint8_t* end = r.buffer + r.length;
+    uint32_t zx, zy;
+    if (!getVarint(p, end, zx) || !getVarint(p, end, zy)) {
+        c.done = true;
+        return false;
+    }
+    bool changed = zx & 1;
+    zx >>= 1;
+    c.sample.x += (int32_t)(zx >> 1) ^ -(int32_t)(zx & 1);
+    c.sample.y += (int32_t)(zy >> 1) ^ -(int32_t)(zy & 1);
+    if (changed) {
+        if (p == end) {
+            c.done = true;
+            return false;
+        }
+        c.sample.state = *p++;
+    }
+    r.at = p - r.buffer;
+    c.tick++;
+    return true;
+}
+
+struct Ghost {
+    // recording of the current game
+    std::vector<uint8_t> recording;
+    GhostSample recorded;
+    // best run on this level, being replayed, and the one the prebuild
+    // worker opened for the level it built
+    GhostReplay slots[2];
+    int replaying;   // index of the slot being replayed; the other is next
+    GhostCursor cursor;
+    // cost
+    long encodes, decodes;
+    long encodedBytes;
+    double encodeNs, decodeNs;
+};
+
+Ghost ghost;
+
+GhostReplay& ghostReplay() {
+    return ghost.slots[ghost.replaying];
+}
+
+GhostReplay& ghostNext() {
+    return ghost.slots[1 - ghost.replaying];
+}
+
+// On the prebuild worker, after building level. startLevel() only reads
+// ghostNext() once the build is handed over, and asks for the next build
+// after, so the two threads never use it at once.
+void ghostPrepare(const World& level) {
+    ghostOpen(ghostNext(), level);
+}
+
+// Called when a level starts: takes the replay opened with a prebuilt
+// level, or opens it here for one built on the spot, and starts recording.
+void ghostBegin(bool prebuilt) {
+    ghost.recording.clear();
+    ghost.recording.reserve(GHOST_RESERVE);
+    memset(&ghost.recorded, 0, sizeof(ghost.recorded));
+    memset(&ghost.cursor, 0, sizeof(ghost.cursor));
+    if (prebuilt) {
+        ghost.replaying = 1 - ghost.replaying;
+        ghostClose(ghostNext());
+    } else {
+        ghostOpen(ghostReplay(), world);
+    }
+}
+
+// After every live tick.
+void ghostTick(const World& w) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    GhostSample s;
+    s.x = quantize(w.player.x);
+    s.y = quantize(w.player.y);
+    s.state = ghostState(w.player);
+    size_t before = ghost.recording.size();
+    ghostEncode(ghost.recording, ghost.recorded, s);
+    ghost.encodedBytes += ghost.recording.size() - before;
+    std::chrono::steady_clock::time_point mid = std::chrono::steady_clock::now();
+    ghost.encodeNs += std::chrono::duration<double, std::nano>(mid - start).count();
+    ghost.encodes++;
+
+    if (ghostReplay().file && ghostDecode(ghostReplay(), ghost.cursor)) {
+        ghost.decodeNs += std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - mid).count();
+        ghost.decodes++;
+    }
+}
+
+// At the end of a live game: keep the run if it is the new best on its
+// level. A run on any other level replaces the stored one.
+void ghostFinish(const World& w) {
+    const GhostHeader& best = ghostReplay().header;
+    if (ghostReplay().file && (w.player.score < best.score ||
+                               (w.player.score == best.score && w.gameTime >= best.ticks))) {
+        return;
+    }
+    GhostHeader h;
+    h.magic = GHOST_MAGIC;
+    h.score = w.player.score;
+    h.ticks = w.gameTime;
+    h.seed = w.seed;
+    h.difficulty = (int16_t)w.difficulty;
+    h.screens = (int16_t)w.levelScreens;
+    h.fixedPoint = w.fixedPoint;
+    h.bytes = ghost.recording.size();
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", GHOST_FILE);
+    FILE* f = fopen(tmp, "wb");
+    if (!f) return;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+              fwrite(ghost.recording.data(), 1, h.bytes, f) == h.bytes;
+    ok = fclose(f) == 0 && ok;
+    if (ok && rename(tmp, GHOST_FILE) == 0) {   // a crash never leaves half a ghost
+        fprintf(stderr, "ghost: best run on seed %u saved; race it with --seed %u\n", h.seed, h.seed);
+    }
+}
+
+void drawGhost() {
+    if (!ghostReplay().file || ghost.cursor.tick == 0 || ghost.cursor.done) return;
+    float x = dequantize(ghost.cursor.sample.x);
+    float y = dequantize(ghost.cursor.sample.y);
+    float w = player.width;
+    float h = player.height;
+    if (!inView(y, y + h)) return;
+
+    gfxEnable(GL_BLEND);
+    gfxBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    gfxColor4f(0.8f, 0.9f, 1.0f, 0.3f);
+    gfxBegin(GL_QUADS);
+    gfxVertex2f(x - w / 2, y);
+    gfxVertex2f(x + w / 2, y);
+    gfxVertex2f(x + w / 2, y + h * 0.7f);
+    gfxVertex2f(x - w / 2, y + h * 0.7f);
+    gfxEnd();
+    gfxBegin(GL_TRIANGLE_FAN);
+    gfxVertex2f(x, y + h * 0.85f);
+    for (int i = 0; i <= 20; i++) {
+        float angle = i * 2.0f * 3.14159f / 20;
+        gfxVertex2f(x + cos(angle) * w * 0.35f, y + h * 0.85f + sin(angle) * w * 0.35f);
+    }
+    gfxEnd();
+    gfxDisable(GL_BLEND);
+}
+
+void printGhostStats() {
+    if (ghost.encodes == 0) return;
+    fprintf(stderr, "ghost: %.2f bytes/tick, encode %.0f ns/tick, decode %.0f ns/tick\n",
+            (double)ghost.encodedBytes / ghost.encodes, ghost.encodeNs / ghost.encodes,
+            ghost.decodes ? ghost.decodeNs / ghost.decodes : 0.0);
+}
+
+// ---------------- State inspector ----------------
+// With --inspect the game copies a summary of the live world and the frame
+// pacer's counters into the POSIX shared memory object INSPECT_SHM after
+// every tick. The summary covers the player, lava, game state, power-ups and
+// up to INSPECT_MAX_ROCKS rocks. ./game --inspector [ms] attaches from
+// another terminal and redraws it every ms, or prints it once with 0.
+// The segment is a seqlock with one writer. The game makes seq odd, writes,
+// then makes it even again. A reader copies between two loads of seq and
+// retries if they differ or are odd. The game never waits for a reader. The
+// copy is a few KB, so a publish stays well under a microsecond; the game
+// measures it and prints the figure at exit. Readers check the magic,
+// version and size before trusting the layout. One game publishes at a
+// time: a second --inspect is refused while the first is running, and a
+// game only removes the segment at exit if it is still the one in it.
+
+const char* INSPECT_SHM = "/icytower-inspect";
+const uint32_t INSPECT_MAGIC = 0x50534e49;   // "INSP"
+const uint32_t INSPECT_VERSION = 1;          // bump with any change to InspectSegment
+const int INSPECT_MAX_ROCKS = 256;           // in the broadphase's order; the count is exact
+const int INSPECT_READ_TRIES = 1000;
+const int INSPECT_ROCK_ROWS = 12;            // the inspector lists the ones nearest the player
+
+struct InspectRock {
+    float x, y, size, speed;
+};
+
+struct InspectPowerUp {
+    float x, y;
+    int32_t type, collected;
+};
+
+struct InspectState {
+    int32_t state, difficulty, fixedPoint, gameTime;
+    uint32_t seed;
+    float playerX, playerY, velocityY;
+    int32_t isJumping, lives, score, hasKey, activePowerUp, powerUpEnds, standingOn;
+    float lavaHeight, lavaSpeed, cameraY, levelHeight;
+    int32_t coinsCollected, keySpawned, keyCollected, doorUnlocked;
+    int32_t waveNumber, platformCount, rockCount, rocksShown, powerUpCount;
+    InspectRock rocks[INSPECT_MAX_ROCKS];
+    InspectPowerUp powerUps[MAX_POWERUPS];
+    // frame pacer and game loop
+    int64_t ticksScheduled, frames, lateFrames, missedDeadlines;
+    float fps;
+    int32_t qualityTier, paused, autopilot;
+    // the publisher's own cost, up to the previous publish
+    int64_t publishes;
+    float publishNsAverage, publishNsMax;
+};
+
+struct InspectSegment {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;               // sizeof(InspectSegment)
+    int32_t pid;                 // the publishing game
+    std::atomic<uint32_t> seq;   // odd while the game is writing
+    InspectState state;
+};
+
+struct InspectPublisher {
+    InspectSegment* segment;   // NULL unless --inspect
+    long publishes;
+    double publishNs, publishNsMax;
+};
+
+InspectPublisher inspector;
+
+// After every live tick. Only plain stores between the two seq updates.
+void inspectorPublish(const World& w) {
+    InspectSegment* s = inspector.segment;
+    if (!s) return;
+    Stamp start = std::chrono::steady_clock::now();
+    uint32_t seq = s->seq.load(std::memory_order_relaxed);
+    s->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    InspectState& st = s->state;
+    const Player& p = w.player;
+    st.state = w.state;
+    st.difficulty = w.difficulty;
+    st.fixedPoint = w.fixedPoint;
+    st.gameTime = w.gameTime;
+    st.seed = w.seed;
+    st.playerX = p.x;
+    st.playerY = p.y;
+    st.velocityY = p.velocityY;
+    st.isJumping = p.isJumping;
+    st.lives = p.lives;
+    st.score = p.score;
+    st.hasKey = p.hasKey;
+    st.activePowerUp = p.activePowerUp;
+    st.powerUpEnds = p.powerUpEnds;
+    st.standingOn = p.standingOn;
+    st.lavaHeight = w.lavaHeight;
+    st.lavaSpeed = w.lavaSpeed;
+    st.cameraY = w.cameraY;
+    st.levelHeight = w.levelHeight;
+    st.coinsCollected = w.coinsCollected;
+    st.keySpawned = w.key.spawned;
+    st.keyCollected = w.key.collected;
+    st.doorUnlocked = w.door.unlocked;
+    st.waveNumber = w.wave.number;
+    st.platformCount = (int32_t)w.platforms.size();
+    st.rockCount = (int32_t)w.rocks.size();
+    st.rocksShown = std::min(st.rockCount, INSPECT_MAX_ROCKS);
+    for (int i = 0; i < st.rocksShown; i++) {
+        const Rock& r = w.rocks[i];
+        InspectRock& out = st.rocks[i];
+        out.x = r.x;
+        out.y = r.y;
+        out.size = r.size;
+        out.speed = r.speed;
+    }
+    st.powerUpCount = std::min((int32_t)w.powerUps.size(), (int32_t)MAX_POWERUPS);
+    for (int i = 0; i < st.powerUpCount; i++) {
+        const PowerUp& pu = w.powerUps[i];
+        st.powerUps[i].x = pu.x;
+        st.powerUps[i].y = pu.y;
+        st.powerUps[i].type = pu.type;
+        st.powerUps[i].collected = pu.collected;
+    }
+    st.ticksScheduled = pacer.ticksScheduled;
+    st.frames = pacer.frames;
+    st.lateFrames = pacer.lateFrames;
+    st.missedDeadlines = pacer.missedDeadlines;
+    st.fps = (float)pacer.fps;
+    st.qualityTier = qualityTier;
+    st.paused = isPaused;
+    st.autopilot = autopilotEnabled;
+    st.publishes = inspector.publishes;
+    st.publishNsAverage = inspector.publishes ? (float)(inspector.publishNs / inspector.publishes) : 0;
+    st.publishNsMax = (float)inspector.publishNsMax;
+
+    s->seq.store(seq + 2, std::memory_order_release);
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    inspector.publishes++;
+    inspector.publishNs += ns;
+    inspector.publishNsMax = std::max(inspector.publishNsMax, ns);
+}
+
+void printInspectorStats() {
+    if (inspector.publishes == 0) return;
+    fprintf(stderr, "inspector: %ld publishes, %.0f ns average, %.0f ns max\n", inspector.publishes,
+            inspector.publishNs / inspector.publishes, inspector.publishNsMax);
+}
+
+// The pid of the game publishing in INSPECT_SHM, 0 if its header is not
+// complete, or -1 if there is no segment.
+int32_t inspectSegmentOwner() {
+    int fd = shm_open(INSPECT_SHM, O_RDONLY, 0);
+    if (fd < 0) return -1;
+    struct stat info;
+    int32_t owner = 0;
+    if (fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(InspectSegment)) {
+        void* mem = mmap(NULL, sizeof(InspectSegment), PROT_READ, MAP_SHARED, fd, 0);
+        if (mem != MAP_FAILED) {
+            const InspectSegment* s = (const InspectSegment*)mem;
+            if (s->magic == INSPECT_MAGIC) owner = s->pid;
+            munmap(mem, sizeof(InspectSegment));
+        }
+    }
+    close(fd);
+    return owner;
+}
+
+void inspectorStop() {
+    printInspectorStats();
+    munmap(inspector.segment, sizeof(InspectSegment));
+    inspector.segment = NULL;
+    if (inspectSegmentOwner() == (int32_t)getpid()) shm_unlink(INSPECT_SHM);
+}
+
+// The segment is created exclusively. One left by a game that has exited is
+// taken over; one whose game is still running is left alone and the start
+// fails. A header still incomplete after a short wait counts as left over.
+bool inspectorStart() {
+    int fd = -1;
+    for (int attempt = 0; attempt < 3 && fd < 0; attempt++) {
+        fd = shm_open(INSPECT_SHM, O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd >= 0 || errno != EEXIST) break;
+        int32_t owner = inspectSegmentOwner();
+        if (owner < 0) continue;   // removed since
+        if (owner == 0 && attempt == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            continue;
+        }
+        if (owner > 0 && !(kill(owner, 0) != 0 && errno == ESRCH)) {
+            fprintf(stderr, "game %d is already publishing in %s\n", owner, INSPECT_SHM);
+            return false;
+        }
+        shm_unlink(INSPECT_SHM);
+    }
+    if (fd < 0) return false;
+    if (ftruncate(fd, sizeof(InspectSegment)) != 0) {
+        close(fd);
+        shm_unlink(INSPECT_SHM);
+        return false;
+    }
+    void* mem = mmap(NULL, sizeof(InspectSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        shm_unlink(INSPECT_SHM);
+        return false;
+    }
+    InspectSegment* s = new (mem) InspectSegment;
+    s->magic = 0;   // not valid until the header is complete
+    s->version = INSPECT_VERSION;
+    s->size = sizeof(InspectSegment);
+    s->pid = (int32_t)getpid();
+    s->seq.store(0, std::memory_order_relaxed);
+    memset(&s->state, 0, sizeof(s->state));
+    std::atomic_thread_fence(std::memory_order_release);
+    s->magic = INSPECT_MAGIC;
+    inspector.segment = s;
+    atexit(inspectorStop);
+    return true;
+}
+
+// A consistent copy of the state, or false if the game kept it busy for
+// INSPECT_READ_TRIES attempts (or died mid-write). retries counts torn reads.
+bool inspectorRead(const InspectSegment* s, InspectState& out, long& retries) {
+    for (int i = 0; i < INSPECT_READ_TRIES; i++) {
+        uint32_t before = s->seq.load(std::memory_order_acquire);
+        if (before & 1) {
+            retries++;
+            std::this_thread::yield();
+            continue;
+        }
+        memcpy(&out, (const void*)&s->state, sizeof(out));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s->seq.load(std::memory_order_relaxed) == before) return true;
+        retries++;
+    }
+    return false;
+}
+
+const char* GAME_STATE_NAMES[] = {"MENU", "PLAYING", "WIN", "LOSE"};
+
+void printInspectState(const InspectSegment* s, const InspectState& st, long retries) {
+    int state = std::min(std::max((int)st.state, 0), 3);
+    int difficulty = std::min(std::max((int)st.difficulty, 0), DIFFICULTY_COUNT - 1);
+    int tier = std::min(std::max((int)st.qualityTier, 0), QUALITY_TIER_COUNT - 1);
+    printf("game %d  tick %d  %s%s%s  %s  seed %u  %s\n", s->pid, st.gameTime, GAME_STATE_NAMES[state],
+           st.paused ? " (paused)" : "", st.autopilot ? " (autopilot)" : "",
+           DIFFICULTIES[difficulty].name, st.seed, st.fixedPoint ? "fixed-point" : "float");
+    printf("player   x %.1f  y %.1f  vy %.3f  %s  lives %d  score %d  key %s  power-up %d until %d"
+           "  on platform %d\n",
+           st.playerX, st.playerY, st.velocityY, st.isJumping ? "jumping" : "standing", st.lives, st.score,
+           st.hasKey ? "yes" : "no", st.activePowerUp, st.powerUpEnds, st.standingOn);
+    printf("lava     height %.1f  speed %.3f  %.1f below the player  camera %.1f  level %.0f\n",
+           st.lavaHeight, st.lavaSpeed, st.playerY - st.lavaHeight, st.cameraY, st.levelHeight);
+    printf("world    coins %d  key %s  door %s  wave %d  platforms %d  rocks %d  power-ups %d\n",
+           st.coinsCollected, st.keyCollected ? "collected" : st.keySpawned ? "out" : "not yet",
+           st.doorUnlocked ? "open" : "locked", st.waveNumber, st.platformCount, st.rockCount,
+           st.powerUpCount);
+    printf("frames   %lld shown  %.1f fps  late %lld  missed %lld  ticks %lld  LOD %s\n",
+           (long long)st.frames, st.fps, (long long)st.lateFrames, (long long)st.missedDeadlines,
+           (long long)st.ticksScheduled, QUALITY_TIERS[tier].name);
+    printf("publish  %lld times, %.0f ns average, %.0f ns max; %ld torn reads retried\n",
+           (long long)st.publishes, st.publishNsAverage, st.publishNsMax, retries);
+    for (int i = 0; i < st.powerUpCount && i < MAX_POWERUPS; i++) {
+        const InspectPowerUp& pu = st.powerUps[i];
+        printf("power-up type %d at %.1f, %.1f%s\n", pu.type, pu.x, pu.y, pu.collected ? " (taken)" : "");
+    }
+
+    // The rocks come in x order; list those nearest the player
+    int shown = std::min(std::max((int)st.rocksShown, 0), INSPECT_MAX_ROCKS);
+    int order[INSPECT_MAX_ROCKS];
+    for (int i = 0; i < shown; i++) order[i] = i;
+    int rows = std::min(shown, INSPECT_ROCK_ROWS);
+    std::partial_sort(order, order + rows, order + shown, [&](int a, int b) {
+        return fabsf(st.rocks[a].x - st.playerX) + fabsf(st.rocks[a].y - st.playerY) <
+               fabsf(st.rocks[b].x - st.playerX) + fabsf(st.rocks[b].y - st.playerY);
+    });
+    if (rows > 0) printf("rocks nearest the player%s:\n", shown < st.rockCount ? " (of the first sent)" : "");
+    for (int i = 0; i < rows; i++) {
+        const InspectRock& r = st.rocks[order[i]];
+        printf("  x %7.1f  y %7.1f  size %4.1f  speed %5.2f\n", r.x, r.y, r.size, r.speed);
     }
 }
 
-void drawDoor() {
-    float x = door.x;
-    float y = door.y;
-    float w = door.width;
-    float h = door.height;
+// ./game --inspector [ms]: attaches to a game started with --inspect and
+// shows its state every ms until it exits; with 0, once.
+int runInspector(int intervalMs) {
+    int fd = shm_open(INSPECT_SHM, O_RDONLY, 0);
+    if (fd < 0) {
+        fprintf(stderr, "no game to inspect; start one with --inspect\n");
+        return 1;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(InspectSegment)) {
+        fprintf(stderr, "%s is too small for this build\n", INSPECT_SHM);
+        close(fd);
+        return 1;
+    }
+    void* mem = mmap(NULL, sizeof(InspectSegment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        fprintf(stderr, "cannot map %s\n", INSPECT_SHM);
+        return 1;
+    }
+    const InspectSegment* s = (const InspectSegment*)mem;
+    if (s->magic != INSPECT_MAGIC || s->version != INSPECT_VERSION || s->size != sizeof(InspectSegment)) {
+        fprintf(stderr, "%s is version %u, this inspector reads version %u\n", INSPECT_SHM, s->version,
+                INSPECT_VERSION);
+        munmap(mem, sizeof(InspectSegment));
+        return 1;
+    }
 
-    // Draw the frame first (dark brown)
-    glColor3f(0.20f, 0.12f, 0.04f);
-    glBegin(GL_QUADS);
-    glVertex2f(x - 5, y - 5);
-    glVertex2f(x + w + 5, y - 5);
-    glVertex2f(x + w + 5, y + h + 5);
-    glVertex2f(x - 5, y + h + 5);
-    glEnd();
+    InspectState st;
+    long retries = 0;
+    for (;;) {
+        bool read = inspectorRead(s, st, retries);
+        if (intervalMs > 0) printf("\033[H\033[J");   // home and clear, so it redraws in place
+        if (read) {
+            printInspectState(s, st, retries);
+        } else {
+            printf("game %d is mid-write; no consistent state after %d tries\n", s->pid, INSPECT_READ_TRIES);
+        }
+        fflush(stdout);
+        if (intervalMs <= 0) break;
+        if (kill(s->pid, 0) != 0 && errno == ESRCH) {
+            printf("game %d has exited\n", s->pid);
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+    }
+    munmap(mem, sizeof(InspectSegment));
+    return 0;
+}
 
-    // Door open/close transformation
-    if (door.unlocked) {
-        glPushMatrix();
-        glTranslatef(x, y, 0);
-        glRotatef(-door.openAnimation * 90, 0, 0, 1);
-        glTranslatef(-x, -y, 0);
+// Publish cost with a reader attached: ./game --inspectbench [ticks] plays the
+// autopilot headlessly, publishing every tick, while a second thread reads
+// the segment as fast as it can.
+int runInspectBench(int ticks) {
+    if (!inspectorStart()) {
+        fprintf(stderr, "cannot publish state in %s\n", INSPECT_SHM);
+        return 1;
     }
+    std::atomic<bool> done(false);
+    long reads = 0, retries = 0;
+    std::thread reader([&]() {
+        InspectState st;
+        while (!done.load(std::memory_order_relaxed)) {
+            if (inspectorRead(inspector.segment, st, retries)) reads++;
+        }
+    });
+    world.live = false;
+    resetWorld(world, 4242, 1);
+    gameState = PLAYING;
+    for (int t = 0; t < ticks; t++) {
+        stepWorld(world, autopilotDecide(world));
+        if (world.state != PLAYING) {
+            resetWorld(world, 4242 + t, 1);
+            gameState = PLAYING;
+        }
+        inspectorPublish(world);
+    }
+    done = true;
+    reader.join();
+    printf("%d ticks: %ld consistent reads, %ld retried\n", ticks, reads, retries);   // cost at exit
+    return 0;
+}
 
-    // --- Door body (wood gradient) ---
-    glBegin(GL_QUADS);
-    // darker side (simulate shading)
-    glColor3f(0.35f, 0.22f, 0.08f);  // left side
-    glVertex2f(x, y);
-    glVertex2f(x + w * 0.4f, y);
-    glVertex2f(x + w * 0.4f, y + h);
-    glVertex2f(x, y + h);
+// ---------------- Run verification ----------------
+// A run file is the level seed, difficulty, height and number type, the claimed outcome
+// and the per-tick input as (input bits, varint repeat count) pairs. The
+// live game writes one at the end of every game. ./game --verify
+// re-simulates run files headlessly with stepWorld, the same tick the game
+// uses. It accepts a run only if the final score, win or loss, and tick
+// count all match the claim. Runs are spread over a work-stealing pool:
+// every worker drains its own deque from the back and steals from the front
+// of the others when it runs dry.
 
-    // lighter side (simulate light reflection)
-    glColor3f(0.45f, 0.30f, 0.10f);  // right side
-    glVertex2f(x + w * 0.4f, y);
-    glVertex2f(x + w, y);
-    glVertex2f(x + w, y + h);
-    glVertex2f(x + w * 0.4f, y + h);
-    glEnd();
+const uint32_t RUN_MAGIC = 0x394e5552;   // "RUN9"; RUN8 kept fixed-point paths by ticks modulo the period,
+                                         // RUN7 built fixed-point levels on the float arc,
+                                         // RUN6 repaired levels to the edge of the reach,
+                                         // RUN5 had no dynamic platforms, RUN4 no hazard script,
+                                         // RUN3 rolled spawns per tick, RUN2 had no fixed-point
+                                         // flag, RUN1 no level height
+const int MAX_LEVEL_SCREENS = 64;
 
-    // --- Decorative horizontal panels (for realism) ---
-    glColor3f(0.25f, 0.15f, 0.05f);
-    for (int i = 1; i <= 3; i++) {
-        float panelY = y + (h / 4.0f) * i;
-        glBegin(GL_LINES);
-        glVertex2f(x + 10, panelY);
-        glVertex2f(x + w - 10, panelY);
-        glEnd();
-    }
+struct RunHeader {
+    uint32_t magic;
+    uint32_t seed;
+    int32_t difficulty;
+    int32_t screens;    // level height, see resetWorld()
+    int32_t fixedPoint; // played on the fixed-point tick
+    uint32_t script;    // HazardScript::hash of the level's hazards
+    int32_t score;      // claimed outcome
+    int32_t won;
+    int32_t ticks;
+    uint64_t inputBytes;
+};
 
-    // --- Door knob (metallic with highlight) ---
-    float knobX = x + w - 15;
-    float knobY = y + h / 2;
+struct RunFile {
+    RunHeader header;
+    std::vector<uint8_t> inputs;
+};
 
-    glBegin(GL_TRIANGLE_FAN);
-    glColor3f(0.8f, 0.7f, 0.1f);  // gold base
-    glVertex2f(knobX, knobY);
-    for (int i = 0; i <= 20; i++) {
-        float angle = i * 2.0f * 3.14159f / 20;
-        glColor3f(0.9f, 0.8f, 0.3f);  // light edge
-        glVertex2f(knobX + cos(angle) * 5, knobY + sin(angle) * 5);
+enum RunVerdict { RUN_OK, RUN_BAD_SCORE, RUN_BAD_RESULT, RUN_BAD_TICKS, RUN_MALFORMED };
+
+const char* runVerdictName(RunVerdict v) {
+    switch (v) {
+        case RUN_OK:         return "ok";
+        case RUN_BAD_SCORE:  return "score mismatch";
+        case RUN_BAD_RESULT: return "result mismatch";
+        case RUN_BAD_TICKS:  return "tick count mismatch";
+        case RUN_MALFORMED:  return "malformed";
     }
-    glEnd();
+    return "unknown";
+}
 
-    // Small highlight on knob (simulated light)
-    glColor3f(1.0f, 1.0f, 0.6f);
-    glBegin(GL_TRIANGLE_FAN);
-    glVertex2f(knobX + 1.5f, knobY + 1.5f);
-    for (int i = 0; i <= 20; i++) {
-        float angle = i * 2.0f * 3.14159f / 20;
-        glVertex2f(knobX + 1.5f + cos(angle) * 1.5f, knobY + 1.5f + sin(angle) * 1.5f);
+uint8_t packInput(const TickInput& in) {
+    return (uint8_t)(in.left | in.right << 1 | in.jump << 2);
+}
+
+TickInput unpackInput(uint8_t bits) {
+    TickInput in;
+    in.left = bits & 1;
+    in.right = (bits & 2) != 0;
+    in.jump = (bits & 4) != 0;
+    return in;
+}
+
+// Collects input while a game is played; flushed into a RunFile at the end.
+struct RunRecorder {
+    std::vector<uint8_t> inputs;
+    uint8_t last;
+    uint32_t repeat;
+};
+
+RunRecorder runRecorder;
+
+void runFlush() {
+    RunRecorder& r = runRecorder;
+    if (r.repeat == 0) return;
+    uint8_t buf[8];
+    size_t n = 0;
+    buf[n++] = r.last;
+    n += putVarint(buf + n, r.repeat);
+    r.inputs.insert(r.inputs.end(), buf, buf + n);
+    r.repeat = 0;
+}
+
+void runBegin() {
+    RunRecorder& r = runRecorder;
+    r.inputs.clear();
+    r.inputs.reserve(GHOST_RESERVE);
+    r.repeat = 0;
+}
+
+void runRecord(const TickInput& in) {
+    RunRecorder& r = runRecorder;
+    uint8_t bits = packInput(in);
+    if (r.repeat > 0 && bits != r.last) runFlush();
+    r.last = bits;
+    r.repeat++;
+}
+
+void runFinish(const World& w, RunFile& out) {
+    RunRecorder& r = runRecorder;
+    runFlush();
+    out.header.magic = RUN_MAGIC;
+    out.header.seed = w.seed;
+    out.header.difficulty = w.difficulty;
+    out.header.screens = w.levelScreens;
+    out.header.fixedPoint = w.fixedPoint;
+    out.header.script = w.script.program->hash;
+    out.header.score = w.player.score;
+    out.header.won = w.state == WIN;
+    out.header.ticks = w.gameTime;
+    out.header.inputBytes = r.inputs.size();
+    out.inputs.swap(r.inputs);
+}
+
+int runsSaved = 0;   // by this game, so two in the same second get different names
+
+bool saveRun(const RunFile& run, const char* path) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+    bool ok = fwrite(&run.header, sizeof(run.header), 1, f) == 1 &&
+              fwrite(run.inputs.data(), 1, run.inputs.size(), f) == run.inputs.size();
+    return fclose(f) == 0 && ok;
+}
+
+bool loadRun(const char* path, RunFile& run) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    bool ok = fread(&run.header, sizeof(run.header), 1, f) == 1 && run.header.magic == RUN_MAGIC &&
+              run.header.inputBytes < (1u << 30);
+    if (ok) {
+        run.inputs.resize(run.header.inputBytes);
+        ok = fread(run.inputs.data(), 1, run.inputs.size(), f) == run.inputs.size();
     }
-    glEnd();
+    fclose(f);
+    return ok;
+}
 
-    // --- Door open shadow effect ---
-    if (door.unlocked && door.openAnimation > 0.1f) {
-        glColor4f(0.0f, 0.0f, 0.0f, 0.3f); // semi-transparent
-        glBegin(GL_QUADS);
-        glVertex2f(x + w + 2, y);
-        glVertex2f(x + w + 10, y);
-        glVertex2f(x + w + 10, y + h);
-        glVertex2f(x + w + 2, y + h);
-        glEnd();
+// The game must end exactly on the last recorded tick.
+RunVerdict verifyRun(const RunFile& run) {
+    const RunHeader& h = run.header;
+    if (h.magic != RUN_MAGIC || h.difficulty < 0 || h.difficulty >= DIFFICULTY_COUNT ||
+        h.screens < 1 || h.screens > (h.fixedPoint ? FIXED_MAX_SCREENS : MAX_LEVEL_SCREENS) ||
+        h.script != activeHazards().hash) {
+        return RUN_MALFORMED;   // or played under hazards this verifier wasn't given
     }
+    World w;
+    w.live = false;
+    w.state = PLAYING;
+    resetWorld(w, h.seed, h.difficulty, h.screens, h.fixedPoint != 0);
 
-    if (door.unlocked)
-        glPopMatrix();
+    const uint8_t* p = run.inputs.data();
+    const uint8_t* end = p + run.inputs.size();
+    while (p < end) {
+        TickInput in = unpackInput(*p++);
+        uint32_t repeat;
+        if (!getVarint(p, end, repeat)) return RUN_MALFORMED;
+        for (; repeat > 0; repeat--) {
+            if (w.state != PLAYING) return RUN_BAD_TICKS;
+            stepWorld(w, in);
+        }
+    }
+    if (w.state == PLAYING || w.gameTime != h.ticks) return RUN_BAD_TICKS;
+    if ((w.state == WIN) != (h.won != 0)) return RUN_BAD_RESULT;
+    if (w.player.score != h.score) return RUN_BAD_SCORE;
+    return RUN_OK;
 }
 
-void drawHUD() {
-    glColor3f(0.2f, 0.2f, 0.25f);
-    glBegin(GL_QUADS);
-    glVertex2f(10, WINDOW_HEIGHT - 30);
-    glVertex2f(160, WINDOW_HEIGHT - 30);
-    glVertex2f(160, WINDOW_HEIGHT - 10);
-    glVertex2f(10, WINDOW_HEIGHT - 10);
-    glEnd();
-    
-    for (int i = 0; i < player.lives; i++) {
-        glColor3f(0.95f, 0.15f, 0.15f);
-        glBegin(GL_TRIANGLE_FAN);
-        float cx = 25 + i * 50;
-        float cy = WINDOW_HEIGHT - 20;
-        glVertex2f(cx, cy);
-        for (int j = 0; j <= 20; j++) {
-            float angle = j * 2.0f * 3.14159f / 20;
-            glVertex2f(cx + cos(angle) * 15, cy + sin(angle) * 12);
+struct VerifyWorker {
+    std::mutex lock;
+    std::deque<int> runs;   // indices into the batch
+    long verified;
+    long stolen;
+};
+
+struct VerifyPool {
+    const std::vector<RunFile>* batch;
+    std::vector<RunVerdict> verdicts;
+    VerifyWorker* workers;
+    int threads;
+};
+
+bool verifyNextRun(VerifyPool& pool, int self, int& run) {
+    VerifyWorker& mine = pool.workers[self];
+    {
+        std::lock_guard<std::mutex> guard(mine.lock);
+        if (!mine.runs.empty()) {
+            run = mine.runs.back();
+            mine.runs.pop_back();
+            return true;
         }
-        glEnd();
     }
-    
-    glColor3f(0.2f, 0.2f, 0.25f);
-    glBegin(GL_QUADS);
-    glVertex2f(10, WINDOW_HEIGHT - 60);
-    glVertex2f(210, WINDOW_HEIGHT - 60);
-    glVertex2f(210, WINDOW_HEIGHT - 40);
-    glVertex2f(10, WINDOW_HEIGHT - 40);
-    glEnd();
-    
-    float danger = lavaHeight / WINDOW_HEIGHT;
-    float barWidth = 200 * danger;
-    
-    if (danger < 0.5f) {
-        glColor3f(0.2f, 0.8f, 0.2f);
-    } else if (danger < 0.75f) {
-        glColor3f(0.95f, 0.75f, 0.1f);
-    } else {
-        glColor3f(0.95f, 0.2f, 0.1f);
+    // Nothing is ever added once the pool runs, so one empty sweep means done.
+    for (int i = 1; i < pool.threads; i++) {
+        VerifyWorker& victim = pool.workers[(self + i) % pool.threads];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.runs.empty()) {
+            run = victim.runs.front();
+            victim.runs.pop_front();
+            mine.stolen++;
+            return true;
+        }
     }
-    
-    glBegin(GL_QUADS);
-    glVertex2f(10, WINDOW_HEIGHT - 60);
-    glVertex2f(10 + barWidth, WINDOW_HEIGHT - 60);
-    glVertex2f(10 + barWidth, WINDOW_HEIGHT - 40);
-    glVertex2f(10, WINDOW_HEIGHT - 40);
-    glEnd();
-    
-    glColor3f(0.95f, 0.95f, 0.95f);
-    char scoreText[50];
-    snprintf(scoreText, sizeof(scoreText), "Score: %d", player.score);
-    drawText(WINDOW_WIDTH - 150, WINDOW_HEIGHT - 25, scoreText);
+    return false;
 }
 
-void drawMainMenu() {
-    glColor3f(0.1f, 0.1f, 0.1f);
-    glBegin(GL_QUADS);
-    glVertex2f(0, 0);
-    glVertex2f(WINDOW_WIDTH, 0);
-    glVertex2f(WINDOW_WIDTH, WINDOW_HEIGHT);
-    glVertex2f(0, WINDOW_HEIGHT);
-    glEnd();
-    
-    // Title
-    glColor3f(0.95f, 0.85f, 0.2f);
-    drawLargeText(WINDOW_WIDTH/2 - 80, WINDOW_HEIGHT - 100, "ICY TOWER");
-    
-    glColor3f(0.7f, 0.7f, 0.75f);
-    drawText(WINDOW_WIDTH/2 - 90, WINDOW_HEIGHT - 140, "ASCEND TO VICTORY");
-    
-    // Start button with gradient effect
-    glColor3f(0.15f, 0.55f, 0.25f);
-    glBegin(GL_QUADS);
-    glVertex2f(startButtonX, startButtonY);
-    glVertex2f(startButtonX + startButtonWidth, startButtonY);
-    glColor3f(0.2f, 0.65f, 0.35f);
-    glVertex2f(startButtonX + startButtonWidth, startButtonY + startButtonHeight);
-    glVertex2f(startButtonX, startButtonY + startButtonHeight);
-    glEnd();
-    
-    // Button border
-    glColor3f(0.0f, 0.0f, 0.0f);
-    glLineWidth(2);
-    glBegin(GL_LINE_LOOP);
-    glVertex2f(startButtonX, startButtonY);
-    glVertex2f(startButtonX + startButtonWidth, startButtonY);
-    glVertex2f(startButtonX + startButtonWidth, startButtonY + startButtonHeight);
-    glVertex2f(startButtonX, startButtonY + startButtonHeight);
-    glEnd();
-    
-    glColor3f(1.0f, 1.0f, 1.0f);
-    drawLargeText(startButtonX , startButtonY + 18, "START GAME");
-    
-    // Instructions
-    glColor3f(0.6f, 0.6f, 0.65f);
-    drawText(WINDOW_WIDTH/2 - 130, 200, "WASD / Arrow Keys - Move & Jump");
-    drawText(WINDOW_WIDTH/2 - 100, 170, "Collect at least 5 coins unlock door");
-    drawText(WINDOW_WIDTH/2 - 80, 140, "Avoid rocks and lava!");
-    
-    // Decorative elements
-    glColor3f(0.95f, 0.25f, 0.05f);
-    glBegin(GL_TRIANGLES);
-    for (int i = 0; i < 10; i++) {
-        float x = 50 + i * 75;
-        glVertex2f(x, 80);
-        glVertex2f(x + 20, 95);
-        glVertex2f(x + 40, 80);
+void verifyWorker(VerifyPool& pool, int self) {
+    int run;
+    while (verifyNextRun(pool, self, run)) {
+        pool.verdicts[run] = verifyRun((*pool.batch)[run]);
+        pool.workers[self].verified++;
     }
-    glEnd();
 }
 
-void drawGameOver() {
-    if (gameState == WIN) {
-        glColor3f(0.2f, 0.8f, 0.3f);
-        drawLargeText(WINDOW_WIDTH/2 - 50, WINDOW_HEIGHT/1.5, "YOU WIN!");
-    } else {
-        glColor3f(0.95f, 0.2f, 0.2f);
-        drawLargeText(WINDOW_WIDTH/2 - 70, WINDOW_HEIGHT/1.5, "GAME OVER!");
+// Verifies the batch on the given number of threads and prints throughput.
+std::vector<RunVerdict> verifyBatch(const std::vector<RunFile>& batch, int threads) {
+    VerifyPool pool;
+    pool.batch = &batch;
+    pool.verdicts.assign(batch.size(), RUN_MALFORMED);
+    pool.threads = threads;
+    pool.workers = new VerifyWorker[threads];
+    for (int t = 0; t < threads; t++) {
+        pool.workers[t].verified = 0;
+        pool.workers[t].stolen = 0;
     }
-    
-    char scoreText[50];
-    snprintf(scoreText, sizeof(scoreText), "Final Score: %d", player.score);
-    glColor3f(0.9f, 0.9f, 0.95f);
-    drawText(WINDOW_WIDTH/2 - 50, WINDOW_HEIGHT/2 , scoreText);
-    
-    // Restart button with gradient
-    glColor3f(0.15f, 0.55f, 0.25f);
-    glBegin(GL_QUADS);
-    glVertex2f(restartButtonX, restartButtonY);
-    glVertex2f(restartButtonX + restartButtonWidth, restartButtonY);
-    glColor3f(0.2f, 0.65f, 0.35f);
-    glVertex2f(restartButtonX + restartButtonWidth, restartButtonY + restartButtonHeight);
-    glVertex2f(restartButtonX, restartButtonY + restartButtonHeight);
-    glEnd();
-    
-    // Button border
-    glColor3f(0.3f, 0.75f, 0.45f);
-    glLineWidth(2);
-    glBegin(GL_LINE_LOOP);
-    glVertex2f(restartButtonX, restartButtonY);
-    glVertex2f(restartButtonX + restartButtonWidth, restartButtonY);
-    glVertex2f(restartButtonX + restartButtonWidth, restartButtonY + restartButtonHeight);
-    glVertex2f(restartButtonX, restartButtonY + restartButtonHeight);
-    glEnd();
-    
-    glColor3f(1.0f, 1.0f, 1.0f);
-    drawLargeText(restartButtonX , restartButtonY + 10, "PLAY AGAIN");
+    for (size_t i = 0; i < batch.size(); i++) pool.workers[i % threads].runs.push_back((int)i);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> helpers;
+    for (int t = 1; t < threads; t++) helpers.push_back(std::thread(verifyWorker, std::ref(pool), t));
+    verifyWorker(pool, 0);
+    for (std::thread& t : helpers) t.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    long stolen = 0, rejected = 0;
+    for (int t = 0; t < threads; t++) stolen += pool.workers[t].stolen;
+    for (RunVerdict v : pool.verdicts) rejected += v != RUN_OK;
+    printf("%2d threads: %zu runs in %.3f s, %.0f runs/s, %.0f runs/s per core, %ld stolen, %ld rejected\n",
+           threads, batch.size(), seconds, batch.size() / seconds, batch.size() / seconds / threads,
+           stolen, rejected);
+    delete[] pool.workers;
+    return pool.verdicts;
 }
 
+// ---------------- Simulation fuzzer ----------------
+// ./game --fuzz [seconds] [seed] drives stepWorld headlessly with random
+// levels and input and checks invariants after every tick. The input is
+// held for random stretches, like a player would. Cases that reach
+// something new (a lives count, height band, power-up, door state, lava
+// distance and so on) join a corpus. Later cases replay a corpus entry's
+// input up to a random tick and improvise from there, so play gets further
+// into levels than fresh random input would. After each game the world is
+// rebuilt in place and compared with a freshly built one, so no state can
+// leak from one run into the next. Meanwhile the main thread restarts the
+// game's own world through startLevel() with the prebuilder running, and
+// checks the swapped-in level the same way, along with what startLevel()
+// must carry over (state, live) and reset (keys, ghost, run recording).
+// A failing case is minimized: cut at the failing tick, then stretches of
+// input blanked out while it keeps failing the same way. It is saved as
+// fuzz-N.run in the run file format. ./game --fuzz file... replays
+// reproducers against the same checks.
 
-bool checkCollision(float x1, float y1, float w1, float h1, float x2, float y2, float w2, float h2) {
-    return (x1 < x2 + w2 && x1 + w1 > x2 && y1 < y2 + h2 && y1 + h1 > y2);
+const int FUZZ_MAX_TICKS = 20000;
+const int FUZZ_FEATURES = 2048;   // per difficulty
+const int FUZZ_CORPUS_MAX = 4096;
+
+struct FuzzCase {
+    unsigned seed;
+    int difficulty;
+    int screens;
+    bool fixedPoint;
+    std::vector<uint8_t> inputs;   // packInput() bits, one per tick
+};
+
+unsigned fuzzRand(unsigned& s) {
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    return s;
 }
 
-bool checkCircleCollision(float x1, float y1, float r1, float x2, float y2, float r2) {
-    float dx = x2 - x1;
-    float dy = y2 - y1;
-    float distance = sqrt(dx * dx + dy * dy);
-    return distance < (r1 + r2);
+bool fuzzFinite(float v) {
+    return std::isfinite(v);
 }
 
-void update(int value) {
-    if (gameState == MENU) {
-        gameTime++;
-        glutPostRedisplay();
-        glutTimerFunc(16, update, 0);
-        return;
+// What the last tick left, for the checks that compare against it.
+struct FuzzWatch {
+    float lavaHeight;
+    GameState state;
+};
+
+// Returns what broke after a tick, or NULL.
+const char* fuzzCheck(const World& w, const FuzzWatch& was) {
+    const Player& p = w.player;
+    if (!fuzzFinite(p.x) || !fuzzFinite(p.y) || !fuzzFinite(p.velocityY)) return "player position is not a number";
+    if (!fuzzFinite(w.lavaHeight) || !fuzzFinite(w.lavaSpeed) || !fuzzFinite(w.cameraY))
+        return "lava or camera is not a number";
+    for (const Rock& r : w.rocks) {
+        if (!fuzzFinite(r.x) || !fuzzFinite(r.y)) return "rock position is not a number";
     }
-    
-    if (gameState != PLAYING) {
-        glutTimerFunc(16, update, 0);
-        return;
-    } 
-    if (isPaused) {
-        glutPostRedisplay();           // still redraw the scene (so Pause UI shows)
-        glutTimerFunc(16, update, 0);  // keep timer running
-        return;                        // exit early to freeze game logic
+    for (const PowerUp& pu : w.powerUps) {
+        if (!fuzzFinite(pu.x) || !fuzzFinite(pu.y))
+            return "power-up is not a number";
     }
-        if (letsGoTimer > 0) --letsGoTimer;
-    
-    gameTime++;
-    
-    if (keys['a'] || keys['A']) {
-        player.x -= MOVE_SPEED * 16;
-        if (player.x < player.width/2) player.x = player.width/2;
+    if (p.x < p.width / 2 || p.x > WINDOW_WIDTH - p.width / 2) return "player outside the walls";
+    if (p.y < 30 || p.y > w.levelHeight) return "player outside the level";
+    if (p.standingOn >= (int)w.platforms.size()) return "standing on a platform that is not there";
+    for (const Platform& pl : w.platforms) {
+        if (pl.x < -0.01f || pl.x + pl.width > WINDOW_WIDTH + 0.01f) return "platform outside the walls";
     }
-    if (keys['d'] || keys['D']) {
-        player.x += MOVE_SPEED * 16;
-        if (player.x > WINDOW_WIDTH - player.width/2) player.x = WINDOW_WIDTH - player.width/2;
+    const PlatformPaths* paths[] = {&w.sliding, &w.swinging};
+    for (const PlatformPaths* path : paths) {
+        for (size_t i = 0; i < path->platform.size(); i++) {
+            if (fabsf(w.platforms[path->platform[i]].x - path->originX[i]) > path->range[i] + 0.01f)
+                return "platform off its path";
+        }
     }
-    
-    if ((keys['w'] || keys['W'] || keys[' ']) && !player.isJumping) {
-        player.velocityY = JUMP_VELOCITY;
-        player.isJumping = true;
+    for (size_t i = 0; i < w.crumbling.timer.size(); i++) {
+        int t = w.crumbling.timer[i];
+        if (t < 0 || t > CRUMBLE_TICKS + REGROW_TICKS) return "crumbling timer out of range";
+        if (t > 0 && t <= REGROW_TICKS && !w.platforms[w.crumbling.platform[i]].destroyed)
+            return "fallen platform still standing";
     }
-    
-    player.velocityY += GRAVITY * 16;
-    player.y += player.velocityY * 16;
-    
-    for (auto& p : platforms) {
-        if (p.destroyed) continue;
-        
-        if (player.velocityY <= 0 && 
-            checkCollision(player.x - player.width/2, player.y, player.width, 5,
-                          p.x, p.y + p.height - 5, p.width, 10)) {
-            player.y = p.y + p.height;
-            player.velocityY = 0;
-            player.isJumping = false;
-        }
+    if (p.lives < 0) return "lives went negative";
+    if (p.lives > INITIAL_LIVES) return "lives above the start";
+    if (w.lavaHeight < was.lavaHeight) return "lava went down";
+    if (w.cameraY < 0 || w.cameraY > w.levelHeight - WINDOW_HEIGHT + 1) return "camera outside the level";
+    if (w.rocks.size() > (size_t)MAX_ROCKS || w.powerUps.size() > (size_t)MAX_POWERUPS)
+        return "more rocks or power-ups than reserved";
+    if (w.fixedPoint && (w.fixedRocks.x.size() != w.rocks.size() || w.fixedRocks.y.size() != w.rocks.size() ||
+                         w.fixedRocks.speed.size() != w.rocks.size() || w.fixedRocks.drift.size() != w.rocks.size()))
+        return "fixed-point rocks out of step with the rocks";
+    if (w.coinsCollected > COLLECTABLES_COUNT) return "more coins collected than exist";
+    if (w.events.size() != 0) return "events left over after the tick";
+    if (w.timers.now != w.gameTime) return "timer wheel behind the game";
+    if (w.timers.pending > 16) return "timers piling up";
+    if (was.state != PLAYING) return "stepped a finished game";
+    if (w.state != PLAYING && w.state != WIN && w.state != LOSE) return "left play for the menu";
+    if (w.state == WIN && !w.door.unlocked) return "won through a locked door";
+    if (w.state == WIN && p.lives <= 0) return "won with no lives";
+    if (w.state == LOSE && p.lives > 0 && p.y >= w.lavaHeight + 20) return "lost with lives left above the lava";
+    return NULL;
+}
+
+// Names the first thing a rebuilt world kept from its last run, or NULL.
+const char* fuzzStale(const World& a, const World& b) {
+#define FUZZ_SAME(field) if (!(a.field == b.field)) return #field
+    FUZZ_SAME(player.x); FUZZ_SAME(player.y); FUZZ_SAME(player.velocityY);
+    FUZZ_SAME(player.isJumping); FUZZ_SAME(player.lives); FUZZ_SAME(player.score);
+    FUZZ_SAME(player.hasKey); FUZZ_SAME(player.activePowerUp); FUZZ_SAME(player.powerUpEnds);
+    FUZZ_SAME(player.standingOn);
+    FUZZ_SAME(sliding.platform); FUZZ_SAME(sliding.originX); FUZZ_SAME(sliding.range);
+    FUZZ_SAME(sliding.period); FUZZ_SAME(sliding.offset); FUZZ_SAME(sliding.x);
+    FUZZ_SAME(sliding.phaseStep); FUZZ_SAME(sliding.phaseStart);
+    FUZZ_SAME(swinging.platform); FUZZ_SAME(swinging.originX); FUZZ_SAME(swinging.range);
+    FUZZ_SAME(swinging.period); FUZZ_SAME(swinging.offset); FUZZ_SAME(swinging.x);
+    FUZZ_SAME(swinging.phaseStep); FUZZ_SAME(swinging.phaseStart);
+    FUZZ_SAME(crumbling.platform); FUZZ_SAME(crumbling.timer);
+    FUZZ_SAME(platforms.size()); FUZZ_SAME(platformLinks); FUZZ_SAME(collectables.size());
+    FUZZ_SAME(rocks.size()); FUZZ_SAME(powerUps.size()); FUZZ_SAME(events.size());
+    FUZZ_SAME(key.spawned); FUZZ_SAME(key.collected); FUZZ_SAME(key.rotation);
+    FUZZ_SAME(door.x); FUZZ_SAME(door.y); FUZZ_SAME(door.unlocked); FUZZ_SAME(door.openAnimation);
+    FUZZ_SAME(coinsCollected); FUZZ_SAME(lavaHeight); FUZZ_SAME(lavaSpeed);
+    FUZZ_SAME(levelPlatforms); FUZZ_SAME(levelHeight); FUZZ_SAME(cameraY);
+    FUZZ_SAME(wave.number); FUZZ_SAME(wave.left);
+    FUZZ_SAME(wave.ticksLeft); FUZZ_SAME(gameTime); FUZZ_SAME(timers.now); FUZZ_SAME(timers.pending);
+    FUZZ_SAME(timers.pool.size()); FUZZ_SAME(letsGo); FUZZ_SAME(step); FUZZ_SAME(rng);
+    FUZZ_SAME(lavaIncrement); FUZZ_SAME(body.lavaIncrement); FUZZ_SAME(script.program);
+    FUZZ_SAME(script.overruns);
+    for (int i = 0; i < SCRIPT_MAX_VARS; i++) FUZZ_SAME(script.vars[i]);
+    FUZZ_SAME(seed); FUZZ_SAME(difficulty); FUZZ_SAME(levelScreens);
+    FUZZ_SAME(levelRepairs); FUZZ_SAME(levelUnreachable); FUZZ_SAME(levelAttempts); FUZZ_SAME(fixedPoint); FUZZ_SAME(body.playerX); FUZZ_SAME(body.playerY);
+    FUZZ_SAME(body.velocityY); FUZZ_SAME(body.lavaHeight); FUZZ_SAME(body.lavaSpeed);
+    FUZZ_SAME(body.cameraY); FUZZ_SAME(wave.fixedLaneX);
+    FUZZ_SAME(fixedRocks.x); FUZZ_SAME(fixedRocks.y); FUZZ_SAME(fixedRocks.speed); FUZZ_SAME(fixedRocks.drift);
+    for (size_t i = 0; i < a.platforms.size(); i++) {
+        FUZZ_SAME(platforms[i].x); FUZZ_SAME(platforms[i].y); FUZZ_SAME(platforms[i].destroyed);
+        FUZZ_SAME(platforms[i].kind); FUZZ_SAME(platforms[i].crumbling); FUZZ_SAME(platforms[i].carry);
     }
-    
-    if (player.y <= 30) {
-        player.y = 30;
-        player.velocityY = 0;
-        player.isJumping = false;
+    for (size_t i = 0; i < a.collectables.size(); i++) {
+        FUZZ_SAME(collectables[i].x); FUZZ_SAME(collectables[i].y);
+        FUZZ_SAME(collectables[i].collected); FUZZ_SAME(collectables[i].rotation);
     }
-    
-    if (player.y > WINDOW_HEIGHT) player.y = WINDOW_HEIGHT;
-    
-    float currentLavaSpeed = lavaSpeed;
-    if (player.activePowerUp == 2) {
-        currentLavaSpeed *= 0.3f;
+#undef FUZZ_SAME
+    return NULL;
+}
+
+// Sets bits for what this tick reached; true if any was new.
+bool fuzzCover(const World& w, uint8_t* seen) {
+    const Player& p = w.player;
+    int base = w.difficulty * FUZZ_FEATURES;
+    int lavaGap = (int)((p.y - w.lavaHeight) / 50);
+    int rocks = 0;
+    while (rocks < 12 && (1 << rocks) < (int)w.rocks.size()) rocks++;
+    int features[] = {
+        p.lives,
+        8 + w.state,
+        16 + p.activePowerUp,
+        24 + w.key.spawned + 2 * w.key.collected + 4 * w.door.unlocked,
+        32 + w.coinsCollected,
+        48 + rocks,
+        64 + (w.wave.left > 0) * 4 + w.wave.pattern,
+        128 + std::min(std::max(lavaGap, 0), 63),
+        256 + std::min((int)(p.y / 100), 1023),
+        1280 + (p.standingOn >= 0 ? (int)w.platforms[p.standingOn].kind : (int)PLATFORM_KINDS),
+    };
+    bool fresh = false;
+    for (int f : features) {
+        uint8_t& bit = seen[base + f];
+        fresh |= bit == 0;
+        bit = 1;
     }
-    lavaHeight += currentLavaSpeed;
-    lavaSpeed += LAVA_SPEED_INCREMENT;
-    
-    if (player.y < lavaHeight + 20) {
-        gameState = LOSE;
+    return fresh;
+}
+
+// Plays a case from the start. Returns the tick that broke an invariant
+// (and what broke in failure) or -1.
+int fuzzReplay(const FuzzCase& c, World& w, const char*& failure) {
+    w.live = false;
+    w.state = PLAYING;
+    resetWorld(w, c.seed, c.difficulty, c.screens, c.fixedPoint);
+    for (size_t t = 0; t < c.inputs.size() && w.state == PLAYING; t++) {
+        FuzzWatch was = {w.lavaHeight, w.state};
+        stepWorld(w, unpackInput(c.inputs[t]));
+        failure = fuzzCheck(w, was);
+        if (failure) return (int)t;
     }
-    
-    for (auto& p : platforms) {
-        if (!p.destroyed && p.y < lavaHeight) {
-            p.destroyed = true;
+    return -1;
+}
+
+// Shortest prefix that still fails, then as much of it idle as can be.
+void fuzzMinimize(FuzzCase& c, int failTick, const char* failure, World& w) {
+    c.inputs.resize(failTick + 1);
+    for (size_t chunk = c.inputs.size() / 2; chunk >= 1; chunk /= 2) {
+        for (size_t start = 0; start < c.inputs.size(); start += chunk) {
+            size_t end = std::min(start + chunk, c.inputs.size());
+            bool idle = true;
+            for (size_t i = start; i < end; i++) idle &= c.inputs[i] == 0;
+            if (idle) continue;
+            FuzzCase trial = c;
+            std::fill(trial.inputs.begin() + start, trial.inputs.begin() + end, 0);
+            const char* why = NULL;
+            int tick = fuzzReplay(trial, w, why);
+            if (tick < 0 || strcmp(why, failure) != 0) continue;
+            trial.inputs.resize(tick + 1);
+            c = trial;
         }
     }
-    
-    if (gameTime - lastRockSpawn > 120 + rand() % 180) {
-        Rock r;
-        r.x = rand() % WINDOW_WIDTH;
-        r.y = WINDOW_HEIGHT;
-        r.size = 15;
-        r.speed = 2.0f + (rand() % 100) / 100.0f;
-        r.active = true;
-        rocks.push_back(r);
-        lastRockSpawn = gameTime;
+}
+
+struct FuzzShared {
+    std::atomic<long> ticks;
+    std::atomic<long> cases;
+    std::atomic<long> restarts;
+    long levelStarts;                    // main thread only
+    std::atomic<long> wins;
+    std::atomic<bool> stop;
+    std::mutex lock;                     // guards the rest
+    std::vector<std::string> failures;   // one reproducer per distinct failure
+    long corpus;
+};
+
+void fuzzReport(FuzzShared& shared, FuzzCase& c, int tick, const char* failure, World& w) {
+    {
+        std::lock_guard<std::mutex> guard(shared.lock);
+        for (const std::string& seen : shared.failures) {
+            if (seen == failure) return;
+        }
+        shared.failures.push_back(failure);
     }
-    
-    for (auto& r : rocks) {
-        if (!r.active) continue;
-        
-        r.y -= r.speed;
-        
-        if (player.activePowerUp != 1) {
-            if (checkCircleCollision(player.x, player.y + player.height/2, player.width/2,
-                                    r.x, r.y, r.size)) {
-                player.lives--;
-                r.active = false;
-                
-                if (player.lives <= 0) {
-                    gameState = LOSE;
-                }
-            }
+    fuzzMinimize(c, tick, failure, w);
+    const char* again = NULL;
+    fuzzReplay(c, w, again);
+
+    RunFile run;
+    run.header.magic = RUN_MAGIC;
+    run.header.seed = c.seed;
+    run.header.difficulty = c.difficulty;
+    run.header.screens = c.screens;
+    run.header.fixedPoint = c.fixedPoint;
+    run.header.script = w.script.program->hash;
+    run.header.score = w.player.score;
+    run.header.won = w.state == WIN;
+    run.header.ticks = w.gameTime;
+    for (size_t i = 0; i < c.inputs.size(); i++) {
+        uint8_t buf[8];
+        size_t n = 0;
+        buf[n++] = c.inputs[i];
+        n += putVarint(buf + n, 1);
+        run.inputs.insert(run.inputs.end(), buf, buf + n);
+    }
+    run.header.inputBytes = run.inputs.size();
+
+    std::lock_guard<std::mutex> guard(shared.lock);
+    char name[64];
+    snprintf(name, sizeof(name), "fuzz-%zu.run", shared.failures.size());
+    saveRun(run, name);
+    printf("%s: %s at tick %d (seed %u, difficulty %d, %d screens%s, %zu ticks of input after minimizing)\n",
+           name, failure, (int)c.inputs.size() - 1, c.seed, c.difficulty, c.screens,
+           c.fixedPoint ? ", fixed point" : "", c.inputs.size());
+}
+
+void fuzzWorker(FuzzShared& shared, unsigned seed) {
+    std::vector<FuzzCase> corpus;
+    corpus.reserve(FUZZ_CORPUS_MAX);
+    std::vector<uint8_t> seen(FUZZ_FEATURES * DIFFICULTY_COUNT, 0);
+    World w, rebuilt;
+    FuzzCase c;
+    c.inputs.reserve(FUZZ_MAX_TICKS);
+    unsigned r = seed ? seed : 1;
+    const int heights[] = {1, 1, 1, 2, 4, 16};
+
+    while (!shared.stop.load(std::memory_order_relaxed)) {
+        // Half the time improvise on from part of an earlier case.
+        size_t keep = 0;
+        if (!corpus.empty() && fuzzRand(r) % 2) {
+            const FuzzCase& from = corpus[fuzzRand(r) % corpus.size()];
+            c.seed = from.seed;
+            c.difficulty = from.difficulty;
+            c.screens = from.screens;
+            c.fixedPoint = from.fixedPoint;
+            keep = from.inputs.empty() ? 0 : fuzzRand(r) % from.inputs.size();
+            c.inputs.assign(from.inputs.begin(), from.inputs.begin() + keep);
         } else {
-            if (checkCircleCollision(player.x, player.y + player.height/2, player.width/2 + 10,
-                                    r.x, r.y, r.size)) {
-                r.active = false;
+            c.seed = fuzzRand(r);
+            c.difficulty = fuzzRand(r) % DIFFICULTY_COUNT;
+            c.screens = heights[fuzzRand(r) % 6];
+            c.fixedPoint = fuzzRand(r) % 2;
+            c.inputs.clear();
+        }
+
+        w.live = false;
+        w.state = PLAYING;
+        resetWorld(w, c.seed, c.difficulty, c.screens, c.fixedPoint);
+        bool fresh = false;
+        const char* failure = NULL;
+        int held = 0;
+        uint8_t bits = 0;
+        int t = 0;
+        for (; w.state == PLAYING && t < FUZZ_MAX_TICKS; t++) {
+            if ((size_t)t >= keep) {
+                if (held-- <= 0) {
+                    unsigned roll = fuzzRand(r);
+                    bits = (uint8_t)(roll & 7);
+                    held = 1 + (roll >> 8) % 40;
+                }
+                if ((size_t)t == c.inputs.size()) c.inputs.push_back(bits);
             }
+            FuzzWatch was = {w.lavaHeight, w.state};
+            stepWorld(w, unpackInput(c.inputs[t]));
+            failure = fuzzCheck(w, was);
+            if (failure) break;
+            fresh |= fuzzCover(w, seen.data());
         }
-        
-        if (r.y < -r.size) {
-            r.active = false;
+        shared.ticks.fetch_add(t, std::memory_order_relaxed);
+        shared.cases.fetch_add(1, std::memory_order_relaxed);
+        if (w.state == WIN) shared.wins.fetch_add(1, std::memory_order_relaxed);
+        if (failure) {
+            fuzzReport(shared, c, t, failure, w);
+            continue;
+        }
+        if (fresh && corpus.size() < (size_t)FUZZ_CORPUS_MAX) {
+            corpus.push_back(c);
+            std::lock_guard<std::mutex> guard(shared.lock);
+            shared.corpus++;
         }
-    }
-    
-    for (auto& c : collectables) {
-        if (c.collected) continue;
-        
-        c.rotation += 2.0f;
-        
-        if (checkCircleCollision(player.x, player.y + player.height/2, player.width/2,
-                                c.x, c.y, c.size)) {
-            if (!c.collected) {
-                c.collected = true;
-                player.score += 10;
-            }
 
-            // spawn key once player has collected 5 or more coins
-            int collectedCount = 0;
-            for (auto& col : collectables) {
-                if (col.collected) ++collectedCount;
+        // The restart check: rebuild the played world and a new one alike.
+        unsigned next = fuzzRand(r);
+        int difficulty = fuzzRand(r) % DIFFICULTY_COUNT;
+        int screens = heights[fuzzRand(r) % 6];
+        bool fixedPoint = fuzzRand(r) % 2;
+        resetWorld(w, next, difficulty, screens, fixedPoint);
+        rebuilt.live = false;
+        resetWorld(rebuilt, next, difficulty, screens, fixedPoint);
+        const char* stale = fuzzStale(w, rebuilt);
+        shared.restarts.fetch_add(1, std::memory_order_relaxed);
+        if (stale) {
+            char what[96];
+            snprintf(what, sizeof(what), "restart kept %s", stale);
+            std::lock_guard<std::mutex> guard(shared.lock);
+            bool known = false;
+            for (const std::string& s : shared.failures) known |= s == what;
+            if (!known) {
+                shared.failures.push_back(what);
+                printf("%s (seed %u after seed %u)\n", what, next, c.seed);
             }
-            if (collectedCount >= 5 && !key.spawned) {
-    key.spawned = true;
-    
-    // Random X position (keep away from edges)
-    key.x = (rand() % (WINDOW_WIDTH - 100)) + 50;
-    
-    // Random Y position ABOVE lava (at least 100 pixels above current lava level)
-    float minY = lavaHeight + 100;  // minimum safe height above lava
-    float maxY = WINDOW_HEIGHT - 100; // not too close to top
-    
-    // Make sure minY is valid
-    if (minY < 200) minY = 200;
-    if (minY > maxY) minY = maxY - 50;
-    
-    // Random Y between minY and maxY
-    key.y = minY + (rand() % (int)(maxY - minY));
-}
         }
     }
-    
-    if (key.spawned && !key.collected) {
-        key.rotation += 3.0f;
-        
-        if (checkCircleCollision(player.x, player.y + player.height/2, player.width/2,
-                                key.x, key.y, key.size)) {
-            key.collected = true;
-            player.hasKey = true;
-            door.unlocked = true;
+}
+
+void fuzzFail(FuzzShared& shared, const char* what, unsigned seed) {
+    std::lock_guard<std::mutex> guard(shared.lock);
+    for (const std::string& s : shared.failures) {
+        if (s == what) return;
+    }
+    shared.failures.push_back(what);
+    printf("%s (seed %u)\n", what, seed);
+}
+
+// One restart of the game's own world: play a little, dirty the keys, then
+// startLevel() as the restart key does. Settings mostly stay put, so the
+// prebuilt level is usually ready and taken; sometimes they change, or the
+// build is not waited for, and the level is built on the spot.
+void fuzzRestart(FuzzShared& shared, unsigned& r) {
+    if (fuzzRand(r) % 4 == 0) {
+        selectedDifficulty = fuzzRand(r) % DIFFICULTY_COUNT;
+        const int heights[] = {1, 2, 4, 16};
+        levelScreens = heights[fuzzRand(r) % 4];
+        fixedPointPhysics = fuzzRand(r) % 2;
+    } else if (fuzzRand(r) % 8) {
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(prebuilder.mutex);
+                if (prebuilder.ready) break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
         }
     }
-    
-    if (gameTime - powerUpSpawnTime > 600 && powerUps.size() < 2) {
-        PowerUp pu;
-        pu.x = rand() % (WINDOW_WIDTH - 100) + 50;
-        pu.y = lavaHeight + 150 + rand() % 200;
-        pu.size = 20;
-        pu.type = (powerUps.size() == 0) ? 1 : 2;
-        pu.collected = false;
-        pu.timer = 300;
-        pu.rotation = 0;
-        powerUps.push_back(pu);
-        powerUpSpawnTime = gameTime;
+
+    world.live = false;   // no telemetry from the fuzzer's play
+    int ticks = fuzzRand(r) % 600;
+    for (int t = 0; t < ticks && world.state == PLAYING; t++) {
+        TickInput in = unpackInput((uint8_t)(fuzzRand(r) & 7));
+        stepWorld(world, in);
+        runRecord(in);
+        ghostTick(world);
     }
-    
-    for (auto& pu : powerUps) {
-        if (pu.collected) continue;
-        
-        pu.rotation += 5.0f;
-        pu.timer--;
-        
-        if (pu.timer <= 0) {
-            pu.collected = true;
+    for (int i = 0; i < 256; i++) keys[i] = fuzzRand(r) % 2;
+    GameState state = (GameState)(fuzzRand(r) % 4);
+    bool live = fuzzRand(r) % 2;
+    world.state = state;
+    world.live = live;
+    long hits = prebuilder.hits;
+
+    startLevel();
+    shared.levelStarts++;
+    unsigned seed = world.seed;
+    if (world.state != state) fuzzFail(shared, "startLevel changed the game state", seed);
+    if (world.live != live) fuzzFail(shared, "startLevel changed the live flag", seed);
+    bool keyHeld = false;
+    for (int i = 0; i < 256; i++) keyHeld |= keys[i];
+    if (keyHeld) fuzzFail(shared, "startLevel kept a held key", seed);
+    if (!ghost.recording.empty() || ghost.cursor.tick != 0 || ghost.recorded.x != 0 || ghost.recorded.y != 0)
+        fuzzFail(shared, "startLevel kept the ghost recording", seed);
+    if (ghostReplay().file && ghostReplay().header.seed != seed)
+        fuzzFail(shared, "startLevel kept another level's ghost", seed);
+    if (!runRecorder.inputs.empty() || runRecorder.repeat != 0)
+        fuzzFail(shared, "startLevel kept the run recording", seed);
+
+    static World fresh;
+    fresh.live = false;
+    resetWorld(fresh, seed, selectedDifficulty, levelScreens, fixedPointPhysics);
+    const char* stale = fuzzStale(world, fresh);
+    if (stale) {
+        char what[96];
+        snprintf(what, sizeof(what), "%s level kept %s", prebuilder.hits > hits ? "prebuilt" : "rebuilt", stale);
+        fuzzFail(shared, what, seed);
+    }
+    world.state = PLAYING;
+}
+
+int runFuzzer(double seconds, unsigned seed) {
+    FuzzShared shared;
+    shared.ticks = 0;
+    shared.cases = 0;
+    shared.restarts = 0;
+    shared.wins = 0;
+    shared.stop = false;
+    shared.corpus = 0;
+    shared.levelStarts = 0;
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> workers;
+    Stamp start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++) workers.push_back(std::thread(fuzzWorker, std::ref(shared), seed + t * 7919));
+
+    levelPrebuilding = true;
+    levelSeedState = seed;
+    world.state = PLAYING;
+    startLevel();
+    unsigned r = seed * 2654435761u | 1;
+    double elapsed = 0;
+    while (elapsed < seconds) {
+        fuzzRestart(shared, r);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));   // leave the cores to the workers
+        elapsed = msBetween(start, std::chrono::steady_clock::now()) / 1000;
+    }
+    shared.stop = true;
+    for (std::thread& t : workers) t.join();
+    prebuildStop();
+    printf("%d threads, %.1f s: %ld cases (%ld won), %ld ticks, %.2f M ticks/s, %ld restarts checked, "
+           "%ld through startLevel (%ld prebuilt), corpus %ld, %zu distinct failures\n",
+           threads, elapsed, shared.cases.load(), shared.wins.load(), shared.ticks.load(),
+           shared.ticks.load() / elapsed / 1e6, shared.restarts.load(), shared.levelStarts,
+           prebuilder.hits, shared.corpus, shared.failures.size());
+    return shared.failures.empty() ? 0 : 1;
+}
+
+// Replays saved reproducers against the invariants.
+int runFuzzReplay(int argc, char** argv) {
+    int failing = 0;
+    World w;
+    for (int i = 2; i < argc; i++) {
+        RunFile run;
+        if (!loadRun(argv[i], run)) {
+            printf("%s: unreadable\n", argv[i]);
+            failing++;
+            continue;
         }
-        
-        if (checkCircleCollision(player.x, player.y + player.height/2, player.width/2,
-                                pu.x, pu.y, pu.size)) {
-            pu.collected = true;
-            player.activePowerUp = pu.type;
-            player.powerUpTimer = 180;
+        FuzzCase c;
+        c.seed = run.header.seed;
+        c.difficulty = std::min(std::max((int)run.header.difficulty, 0), DIFFICULTY_COUNT - 1);
+        c.fixedPoint = run.header.fixedPoint != 0;
+        c.screens = std::min(std::max((int)run.header.screens, 1),
+                             c.fixedPoint ? FIXED_MAX_SCREENS : MAX_LEVEL_SCREENS);
+        const uint8_t* p = run.inputs.data();
+        const uint8_t* end = p + run.inputs.size();
+        while (p < end) {
+            uint8_t bits = *p++;
+            uint32_t repeat;
+            if (!getVarint(p, end, repeat)) break;
+            c.inputs.insert(c.inputs.end(), std::min(repeat, (uint32_t)FUZZ_MAX_TICKS), bits);
         }
-    }
-    
-    if (player.activePowerUp > 0) {
-        player.powerUpTimer--;
-        if (player.powerUpTimer <= 0) {
-            player.activePowerUp = 0;
+        const char* failure = NULL;
+        int tick = fuzzReplay(c, w, failure);
+        if (tick < 0) {
+            printf("%s: passes\n", argv[i]);
+        } else {
+            printf("%s: %s at tick %d\n", argv[i], failure, tick);
+            failing++;
         }
     }
-    
-    if (door.unlocked && door.openAnimation < 1.0f) {
-        door.openAnimation += 0.02f;
+    return failing ? 1 : 0;
+}
+
+// One tick of game logic, run from display() just before drawing.
+void tick() {
+    if (gameState == MENU) {
+        gameTime++;
+        spectatorBroadcast(world);
+        inspectorPublish(world);
+        return;
+    }
+    if (gameState != PLAYING || isPaused) return;
+
+    if (inputPending) {
+        inputPending = false;
+        latencyArmed = true;
+        latencyFrom = inputArrival;
+    }
+    TickInput in = autopilotEnabled ? autopilotDecide(world) : keyboardInput();
+    runRecord(in);
+    stepWorld(world, in);
+    spectatorBroadcast(world);
+    inspectorPublish(world);
+    ghostTick(world);
+    if (gameState == WIN || gameState == LOSE) {
+        ghostFinish(world);
+        RunFile run;
+        runFinish(world, run);
+        char name[64];
+        snprintf(name, sizeof(name), "run-%ld-%d-%d.run", (long)time(0), (int)getpid(), ++runsSaved);
+        saveRun(run, name);
+        bool recorded = leaderboardAdd(leaderboard, resultOf(world, autopilotEnabled ? RESULT_AUTOPILOT : 0));
+        lastResultRank = recorded ? leaderboardRank(leaderboard, player.score) : 0;
+    }
+}
+
+void runDueTicks() {
+    int due = pacerDueTicks();
+    if (due > MAX_TICKS_PER_FRAME) due = MAX_TICKS_PER_FRAME;
+    while (due-- > 0) tick();
+}
+
+// Re-armed for the next tick deadline rather than a fixed 16 ms after this
+// callback, so processing time does not add up into drift.
+void update(int value) {
+    if (gameState != WIN && gameState != LOSE) {
+        glutPostRedisplay();           // also while paused, so the Pause UI shows
     }
-    
-    if (door.unlocked && 
-        checkCollision(player.x - player.width/2, player.y, player.width, player.height,
-                      door.x, door.y, door.width, door.height)) {
-        gameState = WIN;
+    glutTimerFunc(pacerDelayMs(), update, 0);
+}
+// Parallax cave walls down both screen edges, scrolling at depth times the
+// camera's speed. Segment widths come from a hash of the segment's index, so
+// the walls stay put as they scroll; only the segments on screen are drawn.
+float caveWallWidth(int segment, int side, float width) {
+    unsigned h = (unsigned)(segment * 2 + side) * 2654435761u;
+    return width * (0.4f + 0.6f * ((h >> 16) & 0xffff) / 65535.0f);
+}
+
+void drawCaveWalls(float depth, float width, float r, float g, float b) {
+    const float SEGMENT = 80;
+    float offset = world.cameraY * depth;
+    int first = (int)floor(offset / SEGMENT);
+    gfxColor3f(r, g, b);
+    gfxBegin(GL_QUADS);
+    for (int k = first; (k - first) * SEGMENT <= WINDOW_HEIGHT + SEGMENT; k++) {
+        float y0 = k * SEGMENT - offset;
+        float y1 = y0 + SEGMENT;
+        float l0 = caveWallWidth(k, 0, width), l1 = caveWallWidth(k + 1, 0, width);
+        float r0 = caveWallWidth(k, 1, width), r1 = caveWallWidth(k + 1, 1, width);
+        gfxVertex2f(0, y0);
+        gfxVertex2f(l0, y0);
+        gfxVertex2f(l1, y1);
+        gfxVertex2f(0, y1);
+        gfxVertex2f(WINDOW_WIDTH - r0, y0);
+        gfxVertex2f(WINDOW_WIDTH, y0);
+        gfxVertex2f(WINDOW_WIDTH, y1);
+        gfxVertex2f(WINDOW_WIDTH - r1, y1);
     }
-    
-    glutPostRedisplay();
-    glutTimerFunc(16, update, 0);
-    
+    gfxEnd();
 }
+
 void drawBackground() {
-    glBegin(GL_QUADS);
+    gfxBegin(GL_QUADS);
     
     // Top color (dark charcoal)
-    glColor3f(0.07f, 0.05f, 0.05f);
-    glVertex2f(0, WINDOW_HEIGHT);
-    glVertex2f(WINDOW_WIDTH, WINDOW_HEIGHT);
+    gfxColor3f(0.07f, 0.05f, 0.05f);
+    gfxVertex2f(0, WINDOW_HEIGHT);
+    gfxVertex2f(WINDOW_WIDTH, WINDOW_HEIGHT);
     
     // Bottom color (lava orange glow)
-    glColor3f(0.35f, 0.12f, 0.05f);
-    glVertex2f(WINDOW_WIDTH, 0);
-    glVertex2f(0, 0);
+    gfxColor3f(0.35f, 0.12f, 0.05f);
+    gfxVertex2f(WINDOW_WIDTH, 0);
+    gfxVertex2f(0, 0);
     
-    glEnd();
+    gfxEnd();
+
+    drawCaveWalls(0.25f, 70, 0.13f, 0.06f, 0.05f);   // far
+    drawCaveWalls(0.5f, 45, 0.2f, 0.08f, 0.05f);     // near
 }
 void drawPauseButton() {
-    glColor3f(0.2f, 0.2f, 0.2f);
-    glBegin(GL_QUADS);
-        glVertex2f(pauseButtonX, pauseButtonY);
-        glVertex2f(pauseButtonX + pauseButtonWidth, pauseButtonY);
-        glVertex2f(pauseButtonX + pauseButtonWidth, pauseButtonY + pauseButtonHeight);
-        glVertex2f(pauseButtonX, pauseButtonY + pauseButtonHeight);
-    glEnd();
+    gfxColor3f(0.2f, 0.2f, 0.2f);
+    gfxBegin(GL_QUADS);
+        gfxVertex2f(pauseButtonX, pauseButtonY);
+        gfxVertex2f(pauseButtonX + pauseButtonWidth, pauseButtonY);
+        gfxVertex2f(pauseButtonX + pauseButtonWidth, pauseButtonY + pauseButtonHeight);
+        gfxVertex2f(pauseButtonX, pauseButtonY + pauseButtonHeight);
+    gfxEnd();
 
     // Button border
-    glColor3f(1.0f, 0.5f, 0.0f);
-    glLineWidth(2);
-    glBegin(GL_LINE_LOOP);
-        glVertex2f(pauseButtonX, pauseButtonY);
-        glVertex2f(pauseButtonX + pauseButtonWidth, pauseButtonY);
-        glVertex2f(pauseButtonX + pauseButtonWidth, pauseButtonY + pauseButtonHeight);
-        glVertex2f(pauseButtonX, pauseButtonY + pauseButtonHeight);
-    glEnd();
+    gfxColor3f(1.0f, 0.5f, 0.0f);
+    gfxLineWidth(2);
+    gfxBegin(GL_LINE_LOOP);
+        gfxVertex2f(pauseButtonX, pauseButtonY);
+        gfxVertex2f(pauseButtonX + pauseButtonWidth, pauseButtonY);
+        gfxVertex2f(pauseButtonX + pauseButtonWidth, pauseButtonY + pauseButtonHeight);
+        gfxVertex2f(pauseButtonX, pauseButtonY + pauseButtonHeight);
+    gfxEnd();
 
     // Button text
-    glColor3f(1.0f, 1.0f, 1.0f);
-    glRasterPos2f(pauseButtonX + 20, pauseButtonY + 12);
-    std::string text = isPaused ? "Resume" : "Pause";
-    for (char c : text) {
-        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
+    gfxColor3f(1.0f, 1.0f, 1.0f);
+    gfxRasterPos2f(pauseButtonX + 20, pauseButtonY + 12);
+    for (const char* c = isPaused ? "Resume" : "Pause"; *c; c++) {
+        gfxBitmapCharacter(GLUT_BITMAP_HELVETICA_18, *c);
     }
 }
 
-void display() {
-    glClear(GL_COLOR_BUFFER_BIT);
-    
+void drawAutopilotStatus() {
+    gfxColor3f(0.4f, 0.9f, 1.0f);
+    drawText(WINDOW_WIDTH - 470, WINDOW_HEIGHT - 55,
+             frameFormat("AUTOPILOT  plan %.2f ms  max %.2f ms  over %ld",
+                         autopilotStats.lastMs, autopilotStats.maxMs, autopilotStats.overBudget));
+}
+
+// Everything but the local-only overlays; shared with the spectator view.
+void drawScene() {
+    if (!atlas.built && !softwareRendering) atlasBuild();   // the first frame, once the window exists
     if (gameState == MENU) {
+        gfxLayer(LAYER_HUD);
         drawMainMenu();
     } else if (gameState == PLAYING) {
+        atlas.drawnFrames++;
+        long vertices = gfxVertexCount;
+        gfxLayer(LAYER_BACKGROUND);
         drawBackground();
+        setView(world.cameraY);
+        gfxPushMatrix();
+        gfxTranslatef(0, -world.cameraY, 0);
+        gfxLayer(LAYER_LAVA);
         drawLava();
+        gfxLayer(LAYER_PLATFORMS);
         drawPlatforms();
+        gfxLayer(LAYER_PICKUPS);
         drawCollectables();
         drawKey();
         drawPowerUps();
+        gfxLayer(LAYER_DOOR);
         drawDoor();
+        gfxLayer(LAYER_ROCKS);
         drawRocks();
+        gfxLayer(LAYER_GHOST);
+        drawGhost();
+        gfxLayer(LAYER_PLAYER);
         drawPlayer();
+        gfxPopMatrix();
+        viewStats.frames++;
+        viewStats.vertices += gfxVertexCount - vertices;
+        gfxLayer(LAYER_HUD);
         drawHUD();
+        if (autopilotEnabled) drawAutopilotStatus();
     } else {
+        gfxLayer(LAYER_HUD);
         drawGameOver();
     }
-    if (gameState == PLAYING) {
-    drawPauseButton();
-}
-if (gameState == PLAYING && letsGoTimer > 0) {
+    if (gameState == PLAYING && letsGo) {
+        gfxLayer(LAYER_BANNER);
         float cx = WINDOW_WIDTH / 2.0f;
         float cy = WINDOW_HEIGHT / 2.0f;
         float bw = 420.0f;
         float bh = 110.0f;
 
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        gfxEnable(GL_BLEND);
+        gfxBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
         // Background band
-        glColor4f(0.0f, 0.0f, 0.0f, 0.6f);
-        glBegin(GL_QUADS);
-            glVertex2f(cx - bw/2, cy - bh/2);
-            glVertex2f(cx + bw/2, cy - bh/2);
-            glVertex2f(cx + bw/2, cy + bh/2);
-            glVertex2f(cx - bw/2, cy + bh/2);
-        glEnd();
+        gfxColor4f(0.0f, 0.0f, 0.0f, 0.6f);
+        gfxBegin(GL_QUADS);
+            gfxVertex2f(cx - bw/2, cy - bh/2);
+            gfxVertex2f(cx + bw/2, cy - bh/2);
+            gfxVertex2f(cx + bw/2, cy + bh/2);
+            gfxVertex2f(cx - bw/2, cy + bh/2);
+        gfxEnd();
 
-        glDisable(GL_BLEND);
+        gfxDisable(GL_BLEND);
 
         // Text
-        glColor3f(1.0f, 0.9f, 0.2f);
+        gfxColor3f(1.0f, 0.9f, 0.2f);
         drawLargeText(cx - 50.0f, cy + 6.0f, "LET'S GO!");
     }
+}
+
+void display() {
+#ifndef NDEBUG
+    long allocationsBefore = allocationCount;
+#endif
+    frameArenaReset();
+    runDueTicks();
+    Stamp drawStart = std::chrono::steady_clock::now();
+    gfxClear(GL_COLOR_BUFFER_BIT);
+    drawScene();
+    gfxLayer(LAYER_OVERLAY);
+    if (gameState == PLAYING) {
+        drawPauseButton();
+    }
+    
+    if (pacer.showStats) drawPacerStats();
     
+    gfxFinishFrame();
+    if (gameState == PLAYING) governorFrame(msBetween(drawStart, std::chrono::steady_clock::now()));
     glutSwapBuffers();
+    frameShown();
+#ifndef NDEBUG
+    drawnFrames++;
+    if (allocationCount != allocationsBefore) allocatingFrames++;
+#endif
 }
 
 void keyDown(unsigned char key, int x, int y) {
+    noteInput();
     keys[key] = true;
+    if (gameState == PLAYING && (key == 'b' || key == 'B')) {
+        autopilotEnabled = !autopilotEnabled;
+    }
+    if (gameState != PLAYING && key >= '1' && key < '1' + DIFFICULTY_COUNT) {
+        selectedDifficulty = key - '1';   // used by the next level built
+        prebuildLevel();
+    }
+    if (key == 'g' || key == 'G') {
+        atlas.enabled = !atlas.enabled;
+    }
+    if (key == 'v' || key == 'V') {
+        viewCulling = !viewCulling;
+    }
+    if (key == 'c' || key == 'C') {
+        cmd.enabled = !cmd.enabled;
+    }
+    if (key == 'f' || key == 'F') {
+        pacer.showStats = !pacer.showStats;
+    }
     if ((gameState == WIN || gameState == LOSE) && key == 'r') {
-        platforms.clear();
-        collectables.clear();
-        rocks.clear();
-        powerUps.clear();
-        lavaHeight = 0.0f;
-        lavaSpeed = LAVA_INITIAL_SPEED;
-        gameTime = 0;
-        lastRockSpawn = 0;
-        powerUpSpawnTime = 0;
-        letsGoTimer = 0;
-        gameState = PLAYING;
-        init();
+        restartLevel();
     }
     }
 
 
     void keyUp(unsigned char key, int x, int y) {
+    noteInput();
     keys[key] = false;
     }
 
     void specialKeyDown(int key, int x, int y) {
+    noteInput();
     if (key == GLUT_KEY_LEFT) keys['a'] = true;
     if (key == GLUT_KEY_RIGHT) keys['d'] = true;
     if (key == GLUT_KEY_UP) keys['w'] = true;
     }
 
     void specialKeyUp(int key, int x, int y) {
+    noteInput();
     if (key == GLUT_KEY_LEFT) keys['a'] = false;
     if (key == GLUT_KEY_RIGHT) keys['d'] = false;
     if (key == GLUT_KEY_UP) keys['w'] = false;
@@ -1227,9 +8326,7 @@ void keyDown(unsigned char key, int x, int y) {
         if (gameState == MENU) {
             if (x >= startButtonX && x <= startButtonX + startButtonWidth &&
                 glY >= startButtonY && glY <= startButtonY + startButtonHeight) {
-                gameState = PLAYING;
-                init();
-                glutPostRedisplay();
+                restartLevel();
             }
         }
 
@@ -1246,30 +8343,1144 @@ void keyDown(unsigned char key, int x, int y) {
         if (gameState == WIN || gameState == LOSE) {
             if (x >= restartButtonX && x <= restartButtonX + restartButtonWidth &&
                 glY >= restartButtonY && glY <= restartButtonY + restartButtonHeight) {
-                platforms.clear();
-                collectables.clear();
-                rocks.clear();
-                powerUps.clear();
-                lavaHeight = 0.0f;
-                lavaSpeed = LAVA_INITIAL_SPEED;
-                gameTime = 0;
-                lastRockSpawn = 0;
-                powerUpSpawnTime = 0;
-                gameState = PLAYING;
-                init();
-                glutPostRedisplay();
+                restartLevel();
+            }
+        }
+    }
+}
+
+// ---------------- Spectator client ----------------
+// ./game --spectate: rebuilds the broadcast game from the snapshot stream and
+// draws it with the normal scene code. Each decoded snapshot is acknowledged
+// so the next delta can be based on it.
+
+int spectateFd = -1;
+uint8_t spectateBuf[4 + SPECTATOR_MAX_MESSAGE];   // room for the longest message
+size_t spectateLen = 0;
+Snapshot* spectateHistory = NULL;   // SPECTATOR_HISTORY entries, by seq
+Snapshot spectateEmpty;
+long spectateBytes = 0;
+long spectateSnapshots = 0;
+long spectateKeyframes = 0;
+long spectateUndecodable = 0;
+int spectateTruncated = 0;          // SnapTruncated bits already reported
+Stamp spectateStart;
+
+// Decodes one message, updates w and acknowledges it.
+void spectateMessage(const uint8_t* body, size_t len, World& w) {
+    if (len < 8) {
+        spectateUndecodable++;
+        return;
+    }
+    uint32_t seq = getU32(body);
+    uint32_t baseSeq = getU32(body + 4);
+    const Snapshot* base = &spectateEmpty;
+    if (baseSeq != 0) {
+        base = &spectateHistory[baseSeq & (SPECTATOR_HISTORY - 1)];
+        if (base->seq != baseSeq) {
+            spectateUndecodable++;   // never had it; wait for a keyframe
+            return;
+        }
+    }
+    Snapshot& s = spectateHistory[seq & (SPECTATOR_HISTORY - 1)];
+    if (!decodeSnapshot(body, body + len, *base, s)) {
+        s.seq = 0;
+        spectateUndecodable++;
+        return;
+    }
+    applySnapshot(s, w);
+    int cut = s.f[SNAP_TRUNCATED_AT] & ~spectateTruncated;
+    if (cut) {
+        fprintf(stderr, "spectate: the game has more%s%s%s%s than a snapshot carries; the rest are not shown\n",
+                cut & SNAP_CUT_PLATFORMS ? " platforms" : "", cut & SNAP_CUT_COLLECTABLES ? " coins" : "",
+                cut & SNAP_CUT_ROCKS ? " rocks" : "", cut & SNAP_CUT_POWERUPS ? " power-ups" : "");
+        spectateTruncated |= cut;
+    }
+    spectateSnapshots++;
+    if (baseSeq == 0) spectateKeyframes++;
+    uint8_t ack[4];
+    putU32(ack, seq);
+    send(spectateFd, ack, sizeof(ack), 0);
+}
+
+// Returns false once the game has stopped broadcasting.
+bool spectatePoll(World& w) {
+    for (;;) {
+        ssize_t got = recv(spectateFd, spectateBuf + spectateLen, sizeof(spectateBuf) - spectateLen, 0);
+        if (got == 0) return false;
+        if (got < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) break;
+            return false;
+        }
+        spectateBytes += got;
+        spectateLen += got;
+
+        size_t at = 0;
+        while (spectateLen - at >= 4) {
+            size_t len = getU32(spectateBuf + at);
+            if (len > (size_t)SPECTATOR_MAX_MESSAGE) return false;
+            if (spectateLen - at - 4 < len) break;
+            spectateMessage(spectateBuf + at + 4, len, w);
+            at += 4 + len;
+        }
+        memmove(spectateBuf, spectateBuf + at, spectateLen - at);
+        spectateLen -= at;
+    }
+    return true;
+}
+
+void printSpectateStats() {
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - spectateStart).count();
+    fprintf(stderr, "spectated: %ld snapshots (%ld keyframes, %ld undecodable), "
+            "%.1f bytes/snapshot, %.2f KB/s\n",
+            spectateSnapshots, spectateKeyframes, spectateUndecodable,
+            spectateSnapshots ? (double)spectateBytes / spectateSnapshots : 0.0,
+            seconds > 0 ? spectateBytes / seconds / 1024 : 0.0);
+}
+
+void spectateDisplay() {
+    frameArenaReset();
+    if (!spectatePoll(world)) {
+        fprintf(stderr, "broadcast ended\n");
+        exit(0);
+    }
+    gfxClear(GL_COLOR_BUFFER_BIT);
+    drawScene();
+    gfxFinishFrame();
+    glutSwapBuffers();
+}
+
+void spectateUpdate(int) {
+    glutPostRedisplay();
+    glutTimerFunc((unsigned)TICK_MS, spectateUpdate, 0);
+}
+
+int runSpectator(int argc, char** argv) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, SPECTATOR_SOCKET, sizeof(addr.sun_path) - 1);
+    spectateFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (spectateFd < 0 || connect(spectateFd, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+        !spectatorNonBlocking(spectateFd)) {
+        fprintf(stderr, "no game is broadcasting on %s (start one with --broadcast)\n",
+                SPECTATOR_SOCKET);
+        return 1;
+    }
+    spectateHistory = new Snapshot[SPECTATOR_HISTORY]();
+    spectateStart = std::chrono::steady_clock::now();
+    atexit(printSpectateStats);
+
+    glutInit(&argc, argv);
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
+    glutInitWindowSize(WINDOW_WIDTH, WINDOW_HEIGHT);
+    glutInitWindowPosition(140, 140);
+    glutCreateWindow("Icy Tower Platformer - Spectating");
+    initProjection();
+    resetWorld(world, 1, selectedDifficulty);   // drawn until the first snapshot replaces it
+    glutDisplayFunc(spectateDisplay);
+    glutTimerFunc((unsigned)TICK_MS, spectateUpdate, 0);
+    glutMainLoop();
+    return 0;
+}
+
+// Placements in w that nothing can reach, found by testing every platform
+// in jumping range rather than trusting the links or the repairs. Moving
+// platforms are tested where their paths are centred, as the generator
+// placed them.
+struct LevelGaps {
+    long platforms, coins, doors;
+};
+
+void countLevelGaps(const World& w, LevelGaps& gaps) {
+    std::vector<Platform> placed = w.platforms;
+    const PlatformPaths* paths[] = {&w.sliding, &w.swinging};
+    for (const PlatformPaths* path : paths) {
+        for (size_t i = 0; i < path->platform.size(); i++) placed[path->platform[i]].x = path->originX[i];
+    }
+    for (size_t i = 1; i < placed.size(); i++) {
+        bool reached = false;
+        for (size_t j = i; j-- > 0 && !reached;) {
+            if (placed[i].y - placed[j].y > jumpApex(w)) break;
+            reached = platformReaches(w, placed[j], placed[i]);
+        }
+        gaps.platforms += !reached;
+    }
+    for (const Collectable& c : w.collectables) {
+        bool reached = false;
+        for (size_t j = 0; j < placed.size() && !reached; j++) {
+            reached = coinReachableFrom(w, placed[j], c, w.player.height);
+        }
+        gaps.coins += !reached;
+    }
+    bool doorReached = false;
+    for (size_t j = 0; j < placed.size() && !doorReached; j++) {
+        doorReached = doorReachableFrom(w, placed[j], w.door, w.player.height);
+    }
+    gaps.doors += !doorReached;
+}
+
+// Generation cost per platform for growing towers, then whole levels checked
+// for gaps: ./game --levelgen
+int runLevelBench() {
+    int heights[] = {10, 100, 1000, 10000, 100000};
+    for (int h : heights) {
+        World w;
+        w.rng = 12345;
+        w.difficulty = 1;
+        w.fixedPoint = false;
+        w.player.height = 40;
+        int reps = 1000000 / h;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int r = 0; r < reps; r++) {
+            w.platforms.clear();
+            w.platformLinks.clear();
+            w.levelRepairs = 0;
+            w.levelUnreachable = 0;
+            generatePlatforms(w, h, 100);
+        }
+        double ns = std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - start).count();
+        LevelGaps gaps = {0, 0, 0};
+        w.collectables.clear();
+        countLevelGaps(w, gaps);
+        printf("%6d platforms: %7.1f ns/platform, %d repaired, %d left unreachable, %ld found unreachable\n",
+               h, ns / ((double)reps * h), w.levelRepairs, w.levelUnreachable, gaps.platforms);
+    }
+
+    int screens[] = {1, 8, MAX_LEVEL_SCREENS, -FIXED_MAX_SCREENS};   // negative: fixed point
+    for (int d = 0; d < DIFFICULTY_COUNT; d++) {
+        for (int tall : screens) {
+            bool fixedPoint = tall < 0;
+            tall = abs(tall);
+            World w;
+            w.live = false;
+            LevelGaps gaps = {0, 0, 0};
+            long rebuilt = 0, kept = 0;
+            const int levels = 200;
+            for (int seed = 1; seed <= levels; seed++) {
+                resetWorld(w, seed, d, tall, fixedPoint);
+                rebuilt += w.levelAttempts - 1;
+                kept += w.levelUnreachable > 0;
+                countLevelGaps(w, gaps);
+            }
+            printf("%-6s %2d screens%s: %d levels, %ld layouts rebuilt, %ld kept with gaps; "
+                   "unreachable %ld platforms, %ld coins, %ld doors\n",
+                   DIFFICULTIES[d].name, tall, fixedPoint ? " fixed" : "", levels, rebuilt, kept, gaps.platforms, gaps.coins, gaps.doors);
+        }
+    }
+    return 0;
+}
+
+// Per-tick cost of the dynamic platform passes as their number grows, an even
+// mix of the four kinds: ./game --platformbench
+template <class P>
+double benchPlatformPasses(World& w, int ticks) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int t = 0; t < ticks; t++) {
+        w.gameTime++;
+        movePlatforms<P>(w);
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+           ticks;
+}
+
+int runPlatformBench() {
+    int counts[] = {1000, 2000, 4000, 8000, 16000};
+    for (int n : counts) {
+        World w;
+        w.rng = 12345;
+        w.difficulty = 1;
+        w.fixedPoint = false;
+        w.levelRepairs = 0;
+        w.gameTime = 0;
+        w.player.height = 40;
+        w.player.standingOn = -1;
+        clearDynamicPlatforms(w);
+        generatePlatforms(w, n, 100);
+        for (int i = 0; i < n; i++) {
+            Platform& p = w.platforms[i];
+            p.x = floorf(p.x);
+            p.kind = (uint8_t)(PLATFORM_SLIDING + i % 4);
+            if (p.kind == PLATFORM_CRUMBLING) {
+                w.crumbling.platform.push_back(i);
+                w.crumbling.timer.push_back(0);
+            } else if (p.kind == PLATFORM_CONVEYOR) {
+                p.carry = CONVEYOR_CARRY;
+            } else {
+                float range = fmin(100.0f, fmin(p.x, WINDOW_WIDTH - p.width - p.x));
+                addPlatformPath(p.kind == PLATFORM_SLIDING ? w.sliding : w.swinging, i, p.x, range,
+                                120 + i % 240, i % 120);
+            }
+        }
+        int ticks = 20000000 / n;
+        double floatNs = benchPlatformPasses<NormalPreset>(w, ticks);
+        double fixedNs = benchPlatformPasses<FixedPointPreset<NormalPreset> >(w, ticks);
+        printf("%6d platforms: float %8.1f ns/tick (%4.2f ns/platform), fixed %8.1f ns/tick (%4.2f ns/platform)\n",
+               n, floatNs, floatNs / n, fixedNs, fixedNs / n);
+    }
+    return 0;
+}
+
+// Tuning read from plain globals: what the tick would cost if the presets
+// were runtime variables. Only used as the reference in --physbench.
+float tunableGravity = GRAVITY;
+float tunableJumpVelocity = JUMP_VELOCITY;
+float tunableMoveSpeed = MOVE_SPEED;
+float tunableLavaSpeedIncrement = LAVA_SPEED_INCREMENT;
+int tunableWaveRocks = NormalPreset::waveRocks();
+
+struct RuntimePreset {
+    static float gravity() { return tunableGravity; }
+    static float jumpVelocity() { return tunableJumpVelocity; }
+    static float moveSpeed() { return tunableMoveSpeed; }
+    static float lavaSpeedIncrement() { return tunableLavaSpeedIncrement; }
+    static int waveRocks() { return tunableWaveRocks; }
+    static bool fixedPoint() { return false; }
+};
+
+// One run of a pseudo-random input stream, restarting on game over. step
+// is a lambda, so a tick it calls directly can be inlined.
+template <class Step>
+double benchTicks(Step step, int difficulty, bool fixedPoint, long ticks) {
+    World w;
+    w.live = false;
+    w.state = PLAYING;
+    resetWorld(w, 777, difficulty, 1, fixedPoint);
+    unsigned r = 99;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (long t = 0; t < ticks; t++) {
+        r ^= r << 13;
+        r ^= r >> 17;
+        r ^= r << 5;
+        TickInput in;
+        in.left = (r & 3) == 1;
+        in.right = (r & 3) == 2;
+        in.jump = (r & 12) == 0;
+        step(w, in);
+        if (w.state != PLAYING) {
+            w.state = PLAYING;
+            resetWorld(w, r, difficulty, 1, fixedPoint);
+        }
+    }
+    return std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count() / ticks;
+}
+
+// Best of five of the preset's tick called directly and through
+// stepWorld(), taken in turns so that drift hits both alike.
+template <class P>
+void benchPreset(const char* name, int difficulty, long ticks) {
+    auto direct = [](World& w, const TickInput& in) { stepWorldT<P>(w, in); };
+    auto pointer = [](World& w, const TickInput& in) { stepWorld(w, in); };
+    double a = 1e30, b = 1e30;
+    for (int run = 0; run < 5; run++) {
+        a = std::min(a, benchTicks(direct, difficulty, P::fixedPoint(), ticks));
+        b = std::min(b, benchTicks(pointer, difficulty, P::fixedPoint(), ticks));
+    }
+    printf("%-14s %8.1f %11.1f %+8.1f%%\n", name, a, b, (b / a - 1) * 100);
+}
+
+// Tick cost per preset: ./game --physbench
+// The game ticks through stepWorld(), a call through the World's step
+// pointer. Each preset's tick is timed that way and called directly; the
+// direct Normal tick is the code the hard-coded constants compiled to
+// before there were presets, so the NORMAL row is the cost of the presets
+// as the game uses them. The last line reads Normal's tuning from mutable
+// globals instead, the runtime-variable design the presets avoid. Rows
+// only compare within themselves: the presets play different games.
+int runPhysicsBench() {
+    const long ticks = 1000000;
+    printf("ns/tick          direct   stepWorld   change\n");
+    benchPreset<EasyPreset>("EASY", 0, ticks);
+    benchPreset<NormalPreset>("NORMAL", 1, ticks);
+    benchPreset<HardPreset>("HARD", 2, ticks);
+    benchPreset<FixedPointPreset<EasyPreset> >("EASY fixed", 0, ticks);
+    benchPreset<FixedPointPreset<NormalPreset> >("NORMAL fixed", 1, ticks);
+    benchPreset<FixedPointPreset<HardPreset> >("HARD fixed", 2, ticks);
+
+    auto normal = [](World& w, const TickInput& in) { stepWorldT<NormalPreset>(w, in); };
+    auto runtime = [](World& w, const TickInput& in) { stepWorldT<RuntimePreset>(w, in); };
+    double a = 1e30, b = 1e30;
+    for (int run = 0; run < 5; run++) {
+        a = std::min(a, benchTicks(normal, 1, false, ticks));
+        b = std::min(b, benchTicks(runtime, 1, false, ticks));
+    }
+    printf("NORMAL tuning from globals: %.1f ns/tick, %+.1f%% on the constants\n", b, (b / a - 1) * 100);
+    return 0;
+}
+
+// Float against fixed-point ticks: ./game --fixedbench [games]
+// Plays the same games (levels, and input held for random stretches) both
+// ways, and prints the time per tick and a digest of every tick's state.
+// The fixed-point digest should come out the same from any build of the
+// game; the float one may change with compiler, flags or FPU. Last it times
+// the rocks' move alone, MAX_ROCKS of them.
+int runFixedBench(int games) {
+    for (int fixedPoint = 0; fixedPoint < 2; fixedPoint++) {
+        uint64_t digest = 1469598103934665603ull;
+        auto mix = [&digest](uint32_t v) { digest = (digest ^ v) * 1099511628211ull; };
+        long ticks = 0, rocks = 0;
+        int wins = 0;
+        World w;
+        Stamp start = std::chrono::steady_clock::now();
+        for (int g = 0; g < games; g++) {
+            w.live = false;
+            w.state = PLAYING;
+            resetWorld(w, 500 + g, g % DIFFICULTY_COUNT, 1 + g % 4, fixedPoint);
+            unsigned r = 9 + g;
+            TickInput in = {false, false, false};
+            for (int hold = 0; w.state == PLAYING && w.gameTime < 20000; hold--) {
+                if (hold <= 0) {
+                    in = unpackInput((uint8_t)(fuzzRand(r) & 7));
+                    hold = 1 + (r >> 8) % 30;
+                }
+                stepWorld(w, in);
+                uint32_t x, y;
+                memcpy(&x, &w.player.x, 4);
+                memcpy(&y, &w.player.y, 4);
+                mix(x);
+                mix(y);
+                mix((uint32_t)w.rocks.size());
+                rocks += w.rocks.size();
+            }
+            ticks += w.gameTime;
+            wins += w.state == WIN;
+            mix(w.gameTime);
+            mix(w.player.score);
+            mix(w.player.lives);
+        }
+        double ns = msBetween(start, std::chrono::steady_clock::now()) * 1e6 / ticks;
+        printf("%-6s %d games, %ld ticks (%.0f rocks a tick), %d won: %6.1f ns/tick, digest %016llx\n",
+               fixedPoint ? "fixed" : "float", games, ticks, (double)rocks / ticks, wins, ns,
+               (unsigned long long)digest);
+    }
+    // The rocks' move on its own, a full load of them
+    for (int fixedPoint = 0; fixedPoint < 2; fixedPoint++) {
+        World w;
+        resetWorld(w, 500, 1, 1, fixedPoint);
+        World dice;
+        dice.rng = 7;
+        for (int i = 0; i < MAX_ROCKS; i++) {
+            int x = worldRand(dice) % WINDOW_WIDTH;
+            int speed = 100 + worldRand(dice) % 200;
+            int drift = worldRand(dice) % 300 - 150;
+            Rock r;
+            r.x = x;
+            r.y = WINDOW_HEIGHT;
+            r.size = 10;
+            r.speed = speed / 100.0f;
+            r.drift = drift / 100.0f;
+            r.active = true;
+            r.contact = 0;
+            if (fixedPoint) {
+                pushFixedRock(w, r, toFixed(x), toFixed(WINDOW_HEIGHT), speed * FIXED_ONE / 100,
+                              drift * FIXED_ONE / 100);
+            }
+            w.rocks.push_back(r);
+        }
+        const int reps = 2000;
+        Stamp start = std::chrono::steady_clock::now();
+        for (int i = 0; i < reps; i++) {
+            if (fixedPoint) moveFixedRocks(w);
+            else moveRocks(w);
+        }
+        double ns = msBetween(start, std::chrono::steady_clock::now()) * 1e6 / ((double)reps * MAX_ROCKS);
+        printf("%-6s rock move, %d rocks: %5.2f ns/rock\n", fixedPoint ? "fixed" : "float", MAX_ROCKS, ns);
+    }
+    return 0;
+}
+
+// Hazard script cost: ./game --scriptbench [script]
+// Plays the same games under no script, the classic one, the classic one
+// with a thread that loops without ever waiting, and the given script, and
+// prints the ops run per tick and the time per whole tick.
+int runScriptBench(const char* path) {
+    struct Entry {
+        const char* name;
+        HazardScript program;
+    };
+    std::vector<Entry> scripts(3);
+    std::string spinning = std::string(CLASSIC_HAZARDS) + "thread spin\n    loop\n        set n n + 1\n    end\nend\n";
+    const char* sources[] = {"", CLASSIC_HAZARDS, spinning.c_str()};
+    const char* names[] = {"none", "classic", "classic+spin"};
+    char error[96];
+    for (int i = 0; i < 3; i++) {
+        scripts[i].name = names[i];
+        compileHazardScript(sources[i], scripts[i].program, error, sizeof(error));
+    }
+    if (path) {
+        scripts.push_back(Entry());
+        scripts.back().name = path;
+        if (!loadHazardScript(path, scripts.back().program)) return 1;
+    }
+    const int games = 100;
+    for (Entry& e : scripts) {
+        hazardScript = &e.program;
+        long ticks = 0, ops = 0;
+        int most = 0, overruns = 0;
+        World w;
+        Stamp start = std::chrono::steady_clock::now();
+        for (int g = 0; g < games; g++) {
+            w.live = false;
+            w.state = PLAYING;
+            resetWorld(w, 500 + g, g % DIFFICULTY_COUNT);
+            unsigned r = 9 + g;
+            TickInput in = {false, false, false};
+            for (int hold = 0; w.state == PLAYING && w.gameTime < 20000; hold--) {
+                if (hold <= 0) {
+                    in = unpackInput((uint8_t)(fuzzRand(r) & 7));
+                    hold = 1 + (r >> 8) % 30;
+                }
+                stepWorld(w, in);
+                ops += w.script.ops;
+                most = std::max(most, w.script.ops);
+            }
+            ticks += w.gameTime;
+            overruns += w.script.overruns;
+        }
+        double ns = msBetween(start, std::chrono::steady_clock::now()) * 1e6 / ticks;
+        printf("%-14s %4zu bytes, %6ld ticks: %7.1f ops/tick (most %4d), %6d put off, %7.1f ns/tick\n",
+               e.name, e.program.code.size(), ticks, (double)ops / ticks, most, overruns, ns);
+    }
+    hazardScript = NULL;
+    return 0;
+}
+
+// Rock broadphase at scale: ./game --rockbench [rocks]
+// Keeps the given number of rocks in the air on random trajectories (the
+// player is kept alive and the lava down), times whole ticks, and checks
+// the sweep's contacts against testing every rock against everything.
+int runRockBench(int count) {
+    World w;
+    w.live = false;
+    w.state = PLAYING;
+    resetWorld(w, 77, 1);
+    w.rocks.reserve(count + MAX_ROCKS);
+    World dice;
+    dice.rng = 2024;
+    auto refill = [&]() {
+        while ((int)w.rocks.size() < count) {
+            Rock r;
+            r.size = 6 + worldRand(dice) % 9;
+            r.x = worldRand(dice) % WINDOW_WIDTH;
+            r.y = worldRand(dice) % (WINDOW_HEIGHT + 100);
+            r.speed = 0.5f + (worldRand(dice) % 300) / 100.0f;
+            r.drift = (worldRand(dice) % 300) / 100.0f - 1.5f;
+            r.active = true;
+            r.contact = 0;
+            w.rocks.push_back(r);
+        }
+    };
+
+    const int ticks = 2000;
+    double tickNs = 0;
+    for (int t = 0; t < ticks; t++) {
+        refill();
+        w.state = PLAYING;
+        w.player.lives = INITIAL_LIVES;
+        w.lavaHeight = 0;
+        TickInput in = {t % 300 < 150, t % 300 >= 150, t % 50 == 0};
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        stepWorld(w, in);
+        tickNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    w.rocks.clear();   // a fresh scatter, so some rocks overlap the platforms
+    refill();
+    sortRocks(w);
+    float radius = w.player.width/2;
+    const int reps = 200;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < reps; i++) sweepRockContacts(w, radius);
+    double sweepNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / reps;
+    std::vector<uint8_t> swept(w.rocks.size());
+    for (size_t i = 0; i < w.rocks.size(); i++) swept[i] = w.rocks[i].contact;
+
+    const Player& player = w.player;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < reps; i++) {
+        for (Rock& r : w.rocks) {
+            r.contact = 0;
+            if (checkCircleCollision(player.x, player.y + player.height/2, radius, r.x, r.y, r.size)) {
+                r.contact |= ROCK_HIT_PLAYER;
+            }
+            for (const Platform& p : w.platforms) {
+                if (!p.destroyed && circleHitsRect(r.x, r.y, r.size, p.x, p.y, p.width, p.height)) {
+                    r.contact |= ROCK_HIT_PLATFORM;
+                }
+            }
+        }
+    }
+    double bruteNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / reps;
+    long contacts = 0, mismatches = 0;
+    for (size_t i = 0; i < w.rocks.size(); i++) {
+        if (w.rocks[i].contact) contacts++;
+        if (w.rocks[i].contact != swept[i]) mismatches++;
+    }
+
+    printf("%d rocks: tick %.1f us (%.1f%% of a %d ms tick); contacts: sweep %.1f us, "
+           "every pair %.1f us, %ld touching, %ld mismatched\n",
+           count, tickNs / ticks / 1000, tickNs / ticks / 1e6 / 16 * 100, 16, sweepNs / 1000,
+           bruteNs / 1000, contacts, mismatches);
+    return mismatches ? 1 : 0;
+}
+
+// The quality governor under a heavy rock wave: ./game --lodbench [rocks]
+// Draws through the software backend (rasterizing included) with the given
+// number of rocks on screen and feeds the governor the measured cost, then
+// reports what each tier costs and where the governor settled. It starts
+// with the lowest tier and no rocks, the floor no tier can shed.
+int runLodBench(int count) {
+    softwareRendering = true;
+    swInit();
+    gameState = PLAYING;
+    resetWorld(world, 11, 1);
+    World dice;
+    dice.rng = 99;
+    for (int i = 0; i < count; i++) {
+        Rock r;
+        r.size = 6 + worldRand(dice) % 9;
+        r.x = worldRand(dice) % WINDOW_WIDTH;
+        r.y = worldRand(dice) % WINDOW_HEIGHT;
+        r.speed = r.drift = 0;
+        r.active = true;
+        r.contact = 0;
+        world.rocks.push_back(r);
+    }
+    auto frame = [&]() {
+        Stamp start = std::chrono::steady_clock::now();
+        frameArenaReset();
+        gfxClear(GL_COLOR_BUFFER_BIT);
+        drawScene();
+        gfxFinishFrame();
+        return msBetween(start, std::chrono::steady_clock::now());
+    };
+
+    std::vector<Rock> rocks;
+    rocks.swap(world.rocks);
+    qualityTier = QUALITY_TIER_COUNT - 1;
+    double floorMs = 0;
+    for (int f = 0; f < 30; f++) floorMs += frame();
+    printf("%-6s %7.2f ms with no rocks\n", quality().name, floorMs / 30);
+    rocks.swap(world.rocks);
+
+    for (int tier = 0; tier < QUALITY_TIER_COUNT; tier++) {
+        qualityTier = tier;
+        double ms = 0;
+        long vertices = gfxVertexCount;
+        for (int f = 0; f < 30; f++) ms += frame();
+        printf("%-6s %7.2f ms, %6ld vertices per frame\n", quality().name, ms / 30,
+               (gfxVertexCount - vertices) / 30);
+    }
+
+    qualityTier = 0;
+    const int frames = 600;
+    double total = 0;
+    int overBudget = 0;
+    for (int f = 0; f < frames; f++) {
+        double ms = frame();
+        governorFrame(ms);
+        total += ms;
+        if (ms > FRAME_BUDGET_MS) overBudget++;
+    }
+    printf("governed, %d rocks: settled on %s, %ld steps down, %ld up, %.2f ms average, "
+           "%d of %d frames over %.1f ms\n", count, quality().name, governor.lowered, governor.raised,
+           total / frames, overBudget, frames, FRAME_BUDGET_MS);
+    return 0;
+}
+
+// Restart cost with and without the prebuilder: ./game --restartbench
+// Times building a level on the spot against swapping in one the worker
+// built ahead, for a few level heights.
+int runRestartBench() {
+    const int rounds = 20;
+    const int heights[] = {1, 16, 64};
+    levelPrebuilding = true;
+    selectedDifficulty = 1;
+    for (int screens : heights) {
+        levelScreens = screens;
+        double built = 0, builtWorst = 0, swapped = 0, swappedWorst = 0;
+        for (int i = 0; i < rounds; i++) {
+            Stamp start = std::chrono::steady_clock::now();
+            resetWorld(world, 100 + i, selectedDifficulty, screens);
+            double ms = msBetween(start, std::chrono::steady_clock::now());
+            built += ms;
+            builtWorst = std::max(builtWorst, ms);
+
+            prebuildLevel();
+            while (true) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                std::lock_guard<std::mutex> lock(prebuilder.mutex);
+                if (prebuilder.ready) break;
+            }
+            start = std::chrono::steady_clock::now();
+            bool taken = takePrebuiltLevel(world, selectedDifficulty, screens, false);
+            ms = msBetween(start, std::chrono::steady_clock::now());
+            assert(taken && world.levelScreens == screens);
+            (void)taken;
+            swapped += ms;
+            swappedWorst = std::max(swappedWorst, ms);
+        }
+        printf("%2d screens, %4d platforms: built %.3f ms (worst %.3f), prebuilt swap %.4f ms (worst %.4f)\n",
+               screens, (int)world.platforms.size(), built / rounds, builtWorst,
+               swapped / rounds, swappedWorst);
+    }
+    prebuildStop();
+    return 0;
+}
+
+// Timer cost against how many are waiting: ./game --timerbench
+// Keeps a world's wheel topped up to a few sizes with timers due anywhere in
+// the next 50000 ticks, and times ticking it against counting down the same
+// number of polled timers, the way the game used to.
+int runTimerBench() {
+    const int ticks = 200000;
+    const int sizes[] = {0, 100, 1000, MAX_TIMERS - 8};
+    World bench;
+    resetWorld(bench, 1, 1);
+    std::vector<int> countdowns;
+    countdowns.reserve(MAX_TIMERS);
+    for (int size : sizes) {
+        resetTimers(bench.timers);
+        bench.gameTime = 0;
+        long fired = 0;
+        Stamp start = std::chrono::steady_clock::now();
+        for (int t = 0; t < ticks; t++) {
+            while (bench.timers.pending < size) {
+                scheduleTimer(bench, 1 + worldRand(bench) % 50000, TIMER_BANNER_END);
+                fired++;
+            }
+            bench.gameTime++;
+            runTimers(bench);
+        }
+        double wheelNs = msBetween(start, std::chrono::steady_clock::now()) * 1e6 / ticks;
+        fired -= bench.timers.pending;
+
+        countdowns.assign(size, 0);
+        for (int& c : countdowns) c = 1 + worldRand(bench) % 50000;
+        long polledFired = 0;
+        start = std::chrono::steady_clock::now();
+        for (int t = 0; t < ticks; t++) {
+            for (int& c : countdowns) {
+                if (--c > 0) continue;
+                c = 1 + worldRand(bench) % 50000;
+                polledFired++;
+            }
+        }
+        double polledNs = msBetween(start, std::chrono::steady_clock::now()) * 1e6 / ticks;
+        printf("%4d pending: wheel %6.1f ns/tick (%ld fired), polled %8.1f ns/tick (%ld fired)\n",
+               size, wheelNs, fired, polledNs, polledFired);
+    }
+    return 0;
+}
+
+// Vertices per frame against level height: ./game --viewbench
+// Records frames through the software backend without rasterizing them,
+// with the camera swept from the bottom of each level to the top, with and
+// without culling.
+int runViewBench() {
+    softwareRendering = true;
+    swInit();
+    gameState = PLAYING;
+    const int frames = 200;
+    const int heights[] = {1, 4, 16, 64};
+    for (int screens : heights) {
+        resetWorld(world, 5, 1, screens);
+        double perFrame[2];
+        for (int culled = 0; culled < 2; culled++) {
+            viewCulling = culled;
+            long before = gfxVertexCount;
+            for (int f = 0; f < frames; f++) {
+                world.cameraY = (world.levelHeight - WINDOW_HEIGHT) * f / (frames - 1);
+                world.player.y = world.cameraY + WINDOW_HEIGHT * 0.4f;
+                frameArenaReset();
+                gfxClear(GL_COLOR_BUFFER_BIT);
+                drawScene();
+            }
+            perFrame[culled] = (double)(gfxVertexCount - before) / frames;
+        }
+        printf("%2d screens, %4d platforms: %6.0f vertices per frame culled, %6.0f without\n",
+               screens, (int)world.platforms.size(), perFrame[1], perFrame[0]);
+    }
+    return 0;
+}
+
+// ./game --renderbench [frames]: draws an autopilot game with the software
+// backend twice per frame, directly and through the command buffer. Reports
+// what each submits, the time per frame, and the pixels that differ.
+int runRenderBench(int frames) {
+    softwareRendering = true;
+    swInit();
+    resetWorld(world, 99, 1);
+    gameState = PLAYING;
+    std::vector<uint32_t> direct(sw.framebuffer.size());
+    double ms[2] = {0, 0};
+    long differing = 0, differingFrames = 0;
+    for (int f = 0; f < frames; f++) {
+        stepWorld(world, autopilotDecide(world));
+        if (world.state != PLAYING) resetWorld(world, 99 + f, 1);
+        for (int recorded = 0; recorded < 2; recorded++) {
+            cmd.enabled = recorded;
+            frameArenaReset();
+            srand(f);   // the rocks' jagged edges
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            gfxClear(GL_COLOR_BUFFER_BIT);
+            drawScene();
+            gfxFinishFrame();
+            ms[recorded] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (!recorded) direct = sw.framebuffer;
+        }
+        long d = 0;
+        for (size_t i = 0; i < direct.size(); i++) d += direct[i] != sw.framebuffer[i];
+        differing += d;
+        differingFrames += d > 0;
+    }
+    printf("issued:    %.0f batches, %.0f state calls per frame\n",
+           (double)cmd.batches / cmd.frames, (double)cmd.stateCalls / cmd.frames);
+    printf("submitted: %.0f draws, %.0f state changes per frame (%.0f commands)\n",
+           (double)cmd.submitted / cmd.frames, (double)cmd.stateChanges / cmd.frames,
+           (double)cmd.recorded / cmd.frames);
+    printf("%.2f ms per frame direct, %.2f ms recorded (%.3f ms sort and submit)\n",
+           ms[0] / frames, ms[1] / frames, cmd.submitMs / cmd.frames);
+    printf("%ld of %d frames differ, %.0f pixels each\n", differingFrames, frames,
+           differingFrames ? (double)differing / differingFrames : 0.0);
+    return 0;
+}
+
+// Steady-state allocation check, debug builds only: ./game --alloccheck
+// Records an autopilot game, then replays its inputs on a fresh world from
+// the same seed and requires every tick of the replay to stay off the heap.
+int runAllocationCheck() {
+#ifdef NDEBUG
+    printf("--alloccheck needs a debug build (without -DNDEBUG)\n");
+    return 1;
+#else
+    const unsigned seed = 4242;
+    const long warmup = 2;    // the first decisions size the planner's scratch worlds
+    std::vector<TickInput> inputs;
+    inputs.reserve(1 << 20);
+
+    World w;
+    w.live = false;
+    w.state = PLAYING;
+    resetWorld(w, seed, selectedDifficulty);
+    long decisions = 0, allocatingDecisions = 0;
+    while (w.state == PLAYING && inputs.size() < inputs.capacity()) {
+        long before = allocationCount;
+        long decided = autopilotStats.decisions;
+        TickInput in = autopilotDecide(w);
+        if (autopilotStats.decisions != decided) {
+            decisions++;
+            if (decisions > warmup && allocationCount != before) allocatingDecisions++;
+        }
+        inputs.push_back(in);
+        stepWorld(w, in);
+    }
+
+    World replay;
+    replay.live = false;
+    replay.state = PLAYING;
+    resetWorld(replay, seed, selectedDifficulty);
+    long allocations = 0;
+    for (const TickInput& in : inputs) {
+        long before = allocationCount;
+        stepWorld(replay, in);
+        allocations += allocationCount - before;
+        assert(allocationCount == before);
+    }
+    bool same = replay.state == w.state && replay.gameTime == w.gameTime &&
+                replay.player.score == w.player.score && replay.player.x == w.player.x &&
+                replay.player.y == w.player.y;
+
+    printf("%zu ticks: %ld allocations while ticking, replay %s\n",
+           inputs.size(), allocations, same ? "matches" : "DIVERGED");
+    printf("%ld planner decisions, %ld allocated after the first %ld\n",
+           decisions, allocatingDecisions, warmup);
+    return allocations == 0 && allocatingDecisions == 0 && same ? 0 : 1;
+#endif
+}
+
+// Leaderboard cost with many entries: ./game --leaderboard [entries]
+int runLeaderboardBench(long entries) {
+    const char* base = "leaderboard-bench";
+    unlink("leaderboard-bench.log");
+    unlink("leaderboard-bench.idx");
+    Leaderboard lb;
+    memset(&lb, 0, sizeof(lb));
+    if (!leaderboardOpen(lb, base)) {
+        fprintf(stderr, "cannot create %s files\n", base);
+        return 1;
+    }
+    World w;
+    w.rng = 2024;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (long i = 0; i < entries; i++) {
+        LeaderboardRecord r;
+        memset(&r, 0, sizeof(r));
+        r.coins = worldRand(w) % (COLLECTABLES_COUNT + 1);
+        r.score = r.coins * 10 + worldRand(w) % 2000;
+        r.seed = worldRand(w);
+        r.flags = RESULT_AUTOPILOT;
+        leaderboardAdd(lb, r);
+    }
+    double addNs = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count() / entries;
+    leaderboardClose(lb);
+
+    start = std::chrono::steady_clock::now();
+    leaderboardOpen(lb, base);
+    double openMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+
+    const int queries = 1000000;
+    uint64_t check = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < queries; i++) check += leaderboardRank(lb, worldRand(w) % 2100);
+    double rankNs = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count() / queries;
+
+    LeaderboardRecord top[10];
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < queries / 10; i++) check += leaderboardTop(lb, 10, top);
+    double topNs = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count() / (queries / 10);
+
+    printf("%llu entries: add %.0f ns, reopen %.2f ms, rank %.0f ns, top 10 %.0f ns (best %d) [%llu]\n",
+           (unsigned long long)leaderboardSize(lb), addNs, openMs, rankNs, topNs, top[0].score,
+           (unsigned long long)check);
+    leaderboardClose(lb);
+    unlink("leaderboard-bench.log");
+    unlink("leaderboard-bench.idx");
+    return 0;
+}
+
+// Re-simulates run files: ./game --verify [--threads N] file...
+int runVerifier(int argc, char** argv) {
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<RunFile> batch;
+    std::vector<const char*> names;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = std::max(1, atoi(argv[++i]));
+            continue;
+        }
+        if (strcmp(argv[i], "--hazards") == 0 && i + 1 < argc) {
+            if (!useHazardScript(argv[++i])) return 1;
+            continue;
+        }
+        batch.push_back(RunFile());
+        if (!loadRun(argv[i], batch.back())) batch.back().header.magic = 0;   // reported as malformed
+        names.push_back(argv[i]);
+    }
+    std::vector<RunVerdict> verdicts = verifyBatch(batch, threads);
+    int rejected = 0;
+    for (size_t i = 0; i < batch.size(); i++) {
+        if (verdicts[i] == RUN_OK) continue;
+        printf("%s: %s\n", names[i], runVerdictName(verdicts[i]));
+        rejected++;
+    }
+    return rejected ? 1 : 0;
+}
+
+// Verifier throughput on synthetic runs: ./game --verifybench [runs]
+// Inputs are held for random stretches; every 50th claim is tampered with.
+int runVerifyBench(int count) {
+    std::vector<RunFile> batch(count);
+    World w;
+    for (int i = 0; i < count; i++) {
+        w.live = false;
+        w.state = PLAYING;
+        resetWorld(w, 1000 + i, i % DIFFICULTY_COUNT);
+        runBegin();
+        unsigned r = 7 + i;
+        TickInput in = {false, false, false};
+        for (int hold = 0; w.state == PLAYING; hold--) {
+            if (hold <= 0) {
+                r ^= r << 13;
+                r ^= r >> 17;
+                r ^= r << 5;
+                in = unpackInput((uint8_t)(r & 7));
+                hold = 8 + (r >> 8) % 32;
+            }
+            runRecord(in);
+            stepWorld(w, in);
+        }
+        runFinish(w, batch[i]);
+        if (i % 50 == 49) batch[i].header.score += 10;
+    }
+    int cores = std::max(1u, std::thread::hardware_concurrency());
+    for (int threads = 1; threads <= cores; threads *= 2) verifyBatch(batch, threads);
+    if (cores & (cores - 1)) verifyBatch(batch, cores);
+    return 0;
+}
+
+// Renders autopilot games without a window: ./game --swrender [frames] [every].
+// Reports frame rates for 1..cores raster threads; with every > 0 it also
+// writes every n-th frame of the last pass as frame-NNNNN.ppm.
+int runSoftwareBench(int frames, int every) {
+    softwareRendering = true;
+    swInit();
+    int cores = sw.activeThreads;
+    std::vector<int> passes;
+    for (int threads = 1; threads <= cores; threads *= 2) passes.push_back(threads);
+    if (cores & (cores - 1)) passes.push_back(cores);
+    for (size_t pass = 0; pass < passes.size(); pass++) {
+        int threads = passes[pass];
+        sw.activeThreads = threads;
+        resetWorld(world, 99, 1);
+        gameState = PLAYING;
+        sw.frames = 0;
+        sw.triangleCount = 0;
+        sw.rasterMs = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int f = 0; f < frames; f++) {
+            stepWorld(world, autopilotDecide(world));
+            if (world.state != PLAYING) resetWorld(world, 99 + f, 1);
+            frameArenaReset();
+            gfxClear(GL_COLOR_BUFFER_BIT);
+            drawScene();
+            gfxFinishFrame();
+            if (every > 0 && pass + 1 == passes.size() && f % every == 0) {
+                FILE* out = fopen(frameFormat("frame-%05d.ppm", f), "wb");
+                if (!out) continue;
+                fprintf(out, "P6\n%d %d\n255\n", WINDOW_WIDTH, WINDOW_HEIGHT);
+                for (int y = WINDOW_HEIGHT - 1; y >= 0; y--) {
+                    for (int x = 0; x < WINDOW_WIDTH; x++) {
+                        uint32_t p = sw.framebuffer[y * WINDOW_WIDTH + x];
+                        uint8_t rgb[3] = {(uint8_t)p, (uint8_t)(p >> 8), (uint8_t)(p >> 16)};
+                        fwrite(rgb, 1, 3, out);
+                    }
+                }
+                fclose(out);
             }
         }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%d thread%s: %.0f fps, raster %.2f ms, %.0f triangles per frame\n", threads,
+               threads == 1 ? "" : "s", frames / seconds, sw.rasterMs / frames,
+               (double)sw.triangleCount / frames);
     }
+    return 0;
 }
 
 int main(int argc, char** argv) {
+    gfxInit();
+    if (argc >= 2 && strcmp(argv[1], "--autopilot") == 0) {
+        return runAutopilot(argc >= 3 ? atoi(argv[2]) : 10);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--levelgen") == 0) {
+        return runLevelBench();
+    }
+    if (argc >= 2 && strcmp(argv[1], "--platformbench") == 0) {
+        return runPlatformBench();
+    }
+    if (argc >= 2 && strcmp(argv[1], "--physbench") == 0) {
+        return runPhysicsBench();
+    }
+    if (argc >= 2 && strcmp(argv[1], "--lodbench") == 0) {
+        return runLodBench(argc >= 3 ? atoi(argv[2]) : 600);
+    }
+    if (argc >= 3 && strcmp(argv[1], "--fuzz") == 0 && strstr(argv[2], ".run")) {
+        return runFuzzReplay(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--fuzz") == 0) {
+        return runFuzzer(argc >= 3 ? atof(argv[2]) : 10, argc >= 4 ? (unsigned)atoi(argv[3]) : 1);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--fixedbench") == 0) {
+        return runFixedBench(argc >= 3 ? atoi(argv[2]) : 300);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--restartbench") == 0) {
+        return runRestartBench();
+    }
+    if (argc >= 2 && strcmp(argv[1], "--scriptbench") == 0) {
+        return runScriptBench(argc >= 3 ? argv[2] : NULL);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--timerbench") == 0) {
+        return runTimerBench();
+    }
+    if (argc >= 2 && strcmp(argv[1], "--viewbench") == 0) {
+        return runViewBench();
+    }
+    if (argc >= 2 && strcmp(argv[1], "--renderbench") == 0) {
+        return runRenderBench(argc >= 3 ? atoi(argv[2]) : 300);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--rockbench") == 0) {
+        return runRockBench(argc >= 3 ? atoi(argv[2]) : 5000);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--alloccheck") == 0) {
+        return runAllocationCheck();
+    }
+    if (argc >= 2 && strcmp(argv[1], "--leaderboard") == 0) {
+        return runLeaderboardBench(argc >= 3 ? atol(argv[2]) : 1000000);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--verify") == 0) {
+        return runVerifier(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--verifybench") == 0) {
+        return runVerifyBench(argc >= 3 ? atoi(argv[2]) : 2000);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--swrender") == 0) {
+        return runSoftwareBench(argc >= 3 ? atoi(argv[2]) : 600, argc >= 4 ? atoi(argv[3]) : 0);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--spectate") == 0) {
+        return runSpectator(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--inspector") == 0) {
+        return runInspector(argc >= 3 ? atoi(argv[2]) : 250);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--inspectbench") == 0) {
+        return runInspectBench(argc >= 3 ? atoi(argv[2]) : 20000);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--broadcast") == 0 && !spectatorStart()) {
+        fprintf(stderr, "cannot broadcast on %s\n", SPECTATOR_SOCKET);
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quality") == 0 && i + 1 < argc) {
+            qualityTier = std::min(std::max(atoi(argv[++i]), 0), QUALITY_TIER_COUNT - 1);
+            qualityPinned = true;
+        }
+        if (strcmp(argv[i], "--tall") == 0 && i + 1 < argc) {
+            levelScreens = std::min(std::max(atoi(argv[++i]), 1), MAX_LEVEL_SCREENS);
+        }
+        if (strcmp(argv[i], "--software") == 0) {
+            softwareRendering = true;
+            sw.present = true;
+            swInit();
+        }
+        if (strcmp(argv[i], "--fixed") == 0) {
+            fixedPointPhysics = true;
+        }
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            firstLevelSeed = (unsigned)strtoul(argv[++i], NULL, 10);
+        }
+        if (strcmp(argv[i], "--inspect") == 0 && !inspectorStart()) {
+            fprintf(stderr, "cannot publish state in %s\n", INSPECT_SHM);
+        }
+        if (strcmp(argv[i], "--hazards") == 0 && i + 1 < argc && !useHazardScript(argv[++i])) {
+            return 1;
+        }
+    }
+    if (fixedPointPhysics && levelScreens > FIXED_MAX_SCREENS) {
+        fprintf(stderr, "fixed-point levels are at most %d screens high\n", FIXED_MAX_SCREENS);
+        levelScreens = FIXED_MAX_SCREENS;
+    }
+
+    world.live = true;
+    if (!leaderboardOpen(leaderboard, "leaderboard")) fprintf(stderr, "leaderboard unavailable\n");
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
     glutInitWindowSize(WINDOW_WIDTH, WINDOW_HEIGHT);
     glutInitWindowPosition(100, 100);
     glutCreateWindow("Icy Tower Platformer - Ascend to Victory!");
     
+    telemetryStart();
+#ifndef NDEBUG
+    atexit(printLatencyHistogram);
+    atexit(printAllocationStats);
+#endif
+    levelPrebuilding = true;
+    atexit(prebuildStop);
     init();
     
     glutDisplayFunc(display);
@@ -1277,7 +9488,16 @@ int main(int argc, char** argv) {
     glutKeyboardUpFunc(keyUp);
     glutSpecialFunc(specialKeyDown);
     glutSpecialUpFunc(specialKeyUp);
-    glutTimerFunc(16, update, 0);
+    pacerStart();
+    atexit(printPacerStats);
+    atexit(printGhostStats);
+    atexit(printAtlasStats);
+    atexit(printSoftwareStats);
+    atexit(printViewStats);
+    atexit(printCommandStats);
+    atexit(printGovernorStats);
+    atexit(printRestartStats);
+    glutTimerFunc(pacerDelayMs(), update, 0);
     glutMouseFunc(mouse);
     
     glutMainLoop();